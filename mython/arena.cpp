@@ -0,0 +1,65 @@
+#include "arena.h"
+
+#include <new>
+#include <utility>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+thread_local Arena* current_arena = nullptr;
+
+// Заголовок, который размещается перед каждым объектом и хранит арену, выделившую для него
+// память. Для объектов в куче арена равна nullptr
+struct alignas(max_align_t) ObjectHeader {
+    Arena* arena;
+};
+
+}  // namespace
+
+Arena::Scope::Scope(Arena& arena)
+    : previous_(std::exchange(current_arena, &arena)) {
+}
+
+Arena::Scope::~Scope() {
+    current_arena = previous_;
+}
+
+Arena::Arena()
+    : resource_(INITIAL_BLOCK_SIZE) {
+}
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+    allocated_bytes_ += size;
+    return resource_.allocate(size, alignment);
+}
+
+size_t Arena::GetAllocatedBytes() const {
+    return allocated_bytes_;
+}
+
+Arena* Arena::Current() {
+    return current_arena;
+}
+
+void* Arena::AllocateObject(size_t size) {
+    Arena* arena = current_arena;
+    const size_t total_size = sizeof(ObjectHeader) + size;
+    void* memory = arena ? arena->Allocate(total_size) : ::operator new(total_size);
+    auto* header = new (memory) ObjectHeader{arena};
+    return header + 1;
+}
+
+void Arena::DeallocateObject(void* ptr) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    auto* header = static_cast<ObjectHeader*>(ptr) - 1;
+    if (header->arena == nullptr) {
+        ::operator delete(header);
+    }
+}
+
+}  // namespace runtime
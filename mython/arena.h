@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace runtime {
+
+/*
+ * Арена для объектов, которые создаются вместе и вместе удаляются, например узлов дерева
+ * программы. Память выделяется последовательно из крупных блоков и освобождается только при
+ * удалении арены, поэтому объекты, созданные друг за другом, лежат в памяти рядом.
+ * Арена, назначенная текущей для потока через Arena::Scope, используется для размещения всех
+ * создаваемых в этом потоке наследников runtime::Executable
+ */
+class Arena {
+public:
+    static constexpr std::size_t INITIAL_BLOCK_SIZE = 16 * 1024;
+
+    // Делает арену текущей для потока на время своего существования
+    class Scope {
+    public:
+        explicit Scope(Arena& arena);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Arena* previous_;
+    };
+
+    Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Выделяет size байт с выравниванием alignment. Память освобождается вместе с ареной
+    [[nodiscard]] void* Allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+
+    // Возвращает количество байт, выделенных из арены
+    [[nodiscard]] std::size_t GetAllocatedBytes() const;
+
+    // Возвращает текущую арену потока либо nullptr, если арена не назначена
+    [[nodiscard]] static Arena* Current();
+
+    /*
+     * Выделяет память для объекта размера size в текущей арене потока либо в куче, если
+     * арена не назначена. Память должна освобождаться функцией DeallocateObject, которая
+     * возвращает в кучу только память, выделенную не из арены
+     */
+    [[nodiscard]] static void* AllocateObject(std::size_t size);
+    static void DeallocateObject(void* ptr) noexcept;
+
+private:
+    std::pmr::monotonic_buffer_resource resource_;
+    std::size_t allocated_bytes_ = 0;
+};
+
+}  // namespace runtime
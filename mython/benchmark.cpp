@@ -0,0 +1,267 @@
+#include "benchmark.h"
+
+#include "pool.h"
+#include "runtime.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+
+using namespace std;
+
+namespace bench {
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+const string METHOD_DISPATCH = R"(
+class Shape:
+  def area():
+    return 0
+
+class Square(Shape):
+  def __init__(side):
+    self.side = side
+
+  def area():
+    return self.side * self.side
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.w = w
+    self.h = h
+
+  def area():
+    return self.w * self.h
+
+class Walker:
+  def __init__(a, b):
+    self.a = a
+    self.b = b
+
+  def walk(n):
+    if n < 2:
+      return self.a.area() + self.b.area()
+    return self.walk(n - 1) + self.walk(n - 2)
+
+w = Walker(Square(3), Rect(2, 5))
+print w.walk(18)
+)"s;
+
+const string STRING_BUILDING = R"(
+class Builder:
+  def build(n):
+    if n == 0:
+      return ''
+    return self.build(n - 1) + str(n) + ', '
+
+  def repeat(n):
+    if n < 2:
+      return self.build(200)
+    return self.repeat(n - 1) + self.repeat(n - 2)
+
+b = Builder()
+print b.repeat(8)
+)"s;
+
+const string PRINT_HEAVY = R"(
+class Printer:
+  def out(lo, hi):
+    if hi - lo < 2:
+      print lo, 'value', lo * 3, lo == 0, None
+    else:
+      mid = lo + (hi - lo) / 2
+      self.out(lo, mid)
+      self.out(mid, hi)
+
+p = Printer()
+p.out(0, 5000)
+)"s;
+
+// Цепочка из depth классов: методы value и scaled объявлены только в корне иерархии
+string MakeDeepInheritance(int depth) {
+    string source = R"(
+class Level0:
+  def __init__(v):
+    self.v = v
+
+  def value():
+    return self.v
+
+  def scaled(k):
+    return self.value() * k
+
+  def step():
+    return 0
+)"s;
+    for (int i = 1; i < depth; ++i) {
+        const string level = to_string(i);
+        source += "\nclass Level"s + level + "(Level"s + to_string(i - 1) + "):\n  def step():\n    return "s
+                  + level + "\n"s;
+    }
+    source += R"(
+class Walker:
+  def walk(obj, n):
+    if n < 2:
+      return obj.scaled(2) + obj.step()
+    return self.walk(obj, n - 1) + self.walk(obj, n - 2)
+
+w = Walker()
+)"s;
+    source += "print w.walk(Level"s + to_string(depth - 1) + "(3), 16)\n"s;
+    return source;
+}
+
+// Объекты с field_count полями, которые создаются, изменяются и суммируются
+string MakeFieldHeavy(int field_count) {
+    string init = "  def __init__(seed):\n"s;
+    string bump = "  def bump():\n"s;
+    string total = "  def total():\n    return self.f0"s;
+    for (int i = 0; i < field_count; ++i) {
+        const string field = "self.f"s + to_string(i);
+        init += "    "s + field + " = seed + "s + to_string(i) + "\n"s;
+        bump += "    "s + field + " = "s + field + " + 1\n"s;
+        if (i > 0) {
+            total += " + "s + field;
+        }
+    }
+    return "class Record:\n"s + init + "\n"s + bump + "\n"s + total + R"(
+
+class Walker:
+  def walk(n):
+    if n < 2:
+      r = Record(n)
+      r.bump()
+      return r.total()
+    return self.walk(n - 1) + self.walk(n - 2)
+
+w = Walker()
+print w.walk(15)
+)"s;
+}
+
+// Большая программа из class_count классов и обращений к ним
+string MakeLargeSource(int class_count) {
+    string source;
+    for (int i = 0; i < class_count; ++i) {
+        const string index = to_string(i);
+        source += "class Class"s + index + R"(:
+  def __init__(a, b):
+    self.a = a
+    self.b = b
+
+  def sum():
+    return self.a + self.b * 2 - (self.a / 3)
+
+  def describe():
+    if self.a < self.b and not self.a == 0:
+      return 'less ' + str(self.a)
+    else:
+      return 'other ' + str(self.b)
+
+)"s;
+    }
+    for (int i = 0; i < class_count; ++i) {
+        const string index = to_string(i);
+        source += "obj"s + index + " = Class"s + index + "("s + index + ", "s + to_string(i + 1)
+                  + ")\nprint obj"s + index + ".sum(), obj"s + index + ".describe()\n"s;
+    }
+    return source;
+}
+
+}  // namespace
+
+vector<Workload> GetWorkloads() {
+    return {
+        {"method_dispatch"s, METHOD_DISPATCH},
+        {"deep_inheritance"s, MakeDeepInheritance(16)},
+        {"field_heavy"s, MakeFieldHeavy(16)},
+        {"string_building"s, STRING_BUILDING},
+        {"print_heavy"s, PRINT_HEAVY},
+        {"large_source_parse"s, MakeLargeSource(300), Phase::Compile},
+    };
+}
+
+Result Measure(const Workload& workload, const Options& options) {
+    optional<mython::Program> program;
+    if (workload.phase == Phase::Run) {
+        program = mython::Program::Compile(workload.source, options.compile);
+    }
+    const auto operation = [&] {
+        if (program) {
+            runtime::BufferedContext context;
+            program->Run(context);
+        } else {
+            (void)mython::Program::Compile(workload.source, options.compile);
+        }
+    };
+
+    for (size_t i = 0; i < options.warmup_iterations; ++i) {
+        operation();
+    }
+
+    vector<Duration> latencies;
+    const uint64_t allocations_before = runtime::ObjectPool::GetAllocationCount();
+    const auto start = Clock::now();
+    Duration elapsed{0};
+    while (elapsed < options.min_time || latencies.size() < options.min_iterations) {
+        const auto operation_start = Clock::now();
+        operation();
+        const auto operation_end = Clock::now();
+        latencies.push_back(operation_end - operation_start);
+        elapsed = operation_end - start;
+    }
+    const uint64_t allocations = runtime::ObjectPool::GetAllocationCount() - allocations_before;
+
+    sort(latencies.begin(), latencies.end());
+    Result result;
+    result.name = workload.name;
+    result.iterations = latencies.size();
+    result.throughput = static_cast<double>(latencies.size()) / chrono::duration<double>(elapsed).count();
+    result.p50 = Percentile(latencies, 0.5);
+    result.p90 = Percentile(latencies, 0.9);
+    result.p99 = Percentile(latencies, 0.99);
+    result.allocations_per_operation
+        = static_cast<double>(allocations) / static_cast<double>(latencies.size());
+    return result;
+}
+
+Duration Percentile(const vector<Duration>& sorted, double q) {
+    // Ранговый перцентиль: наименьшее значение, не меньше которого доля q выборки
+    const auto rank = static_cast<size_t>(ceil(q * static_cast<double>(sorted.size())));
+    return sorted[min(max(rank, size_t{1}), sorted.size()) - 1];
+}
+
+void PrintResults(const vector<Result>& results, ostream& os) {
+    const auto to_milliseconds = [](Duration duration) {
+        return chrono::duration<double, milli>(duration).count();
+    };
+    const auto flags = os.flags();
+    os << fixed << setprecision(3);
+
+    os << left << setw(24) << "Workload"sv << right << setw(10) << "Ops"sv << setw(12) << "Ops/s"sv
+       << setw(12) << "p50 ms"sv << setw(12) << "p90 ms"sv << setw(12) << "p99 ms"sv << setw(14)
+       << "Alloc/op"sv << '\n';
+    for (const auto& result : results) {
+        os << left << setw(24) << result.name << right << setw(10) << result.iterations << setw(12)
+           << result.throughput << setw(12) << to_milliseconds(result.p50) << setw(12)
+           << to_milliseconds(result.p90) << setw(12) << to_milliseconds(result.p99) << setw(14)
+           << result.allocations_per_operation << '\n';
+    }
+    os.flags(flags);
+}
+
+void RunBenchmarks(string_view filter, const Options& options, ostream& os) {
+    vector<Result> results;
+    for (const auto& workload : GetWorkloads()) {
+        if (workload.name.find(filter) != string::npos) {
+            results.push_back(Measure(workload, options));
+        }
+    }
+    PrintResults(results, os);
+}
+
+}  // namespace bench
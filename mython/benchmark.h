@@ -0,0 +1,72 @@
+#pragma once
+
+#include "program.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bench {
+
+using Duration = std::chrono::nanoseconds;
+
+// Что измеряется в одной операции нагрузки
+enum class Phase {
+    Run,      // исполнение заранее скомпилированной программы
+    Compile,  // разбор и компиляция исходного текста
+};
+
+// Нагрузка: программа Mython, которая многократно исполняется либо компилируется
+struct Workload {
+    std::string name;
+    std::string source;
+    Phase phase = Phase::Run;
+};
+
+// Параметры измерения
+struct Options {
+    mython::CompileOptions compile;
+    // Операции повторяются, пока не пройдёт min_time и не наберётся min_iterations операций
+    Duration min_time = std::chrono::milliseconds(500);
+    std::size_t min_iterations = 5;
+    // Количество операций, выполняемых до начала измерения
+    std::size_t warmup_iterations = 1;
+};
+
+// Результаты измерения одной нагрузки
+struct Result {
+    std::string name;
+    std::size_t iterations = 0;
+    // Операций в секунду
+    double throughput = 0;
+    Duration p50{0};
+    Duration p90{0};
+    Duration p99{0};
+    // Объекты, выделенные из пула объектов Mython, в среднем на операцию
+    double allocations_per_operation = 0;
+};
+
+/*
+ * Возвращает стандартный набор нагрузок: вызовы виртуальных методов, глубокое наследование,
+ * объекты с большим количеством полей, построение строк, интенсивный вывод и разбор
+ * большой программы
+ */
+[[nodiscard]] std::vector<Workload> GetWorkloads();
+
+// Измеряет нагрузку workload. Вывод программы собирается в памяти и отбрасывается
+[[nodiscard]] Result Measure(const Workload& workload, const Options& options);
+
+// Возвращает перцентиль q (от 0 до 1) упорядоченной по возрастанию непустой выборки
+[[nodiscard]] Duration Percentile(const std::vector<Duration>& sorted, double q);
+
+// Выводит результаты в виде таблицы
+void PrintResults(const std::vector<Result>& results, std::ostream& os);
+
+// Измеряет нагрузки, имя которых содержит filter, и выводит результаты в os
+void RunBenchmarks(std::string_view filter, const Options& options, std::ostream& os);
+
+}  // namespace bench
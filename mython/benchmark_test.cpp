@@ -0,0 +1,69 @@
+#include "benchmark.h"
+#include "test_runner_p.h"
+
+using namespace std;
+
+namespace bench {
+
+namespace {
+
+string Run(const Workload& workload, const mython::CompileOptions& options) {
+    ostringstream output;
+    mython::Program::Compile(workload.source, options).Run(output);
+    return output.str();
+}
+
+void TestWorkloadsAgree() {
+    const auto workloads = GetWorkloads();
+    ASSERT_EQUAL(workloads.size(), 6U);
+    for (const auto& workload : workloads) {
+        // Нагрузки исполняются без ошибок и одинаково всеми способами исполнения
+        const string expected = Run(workload, {mython::Backend::Tree, false});
+        ASSERT(!expected.empty());
+        ASSERT_EQUAL(Run(workload, {mython::Backend::Tree, true}), expected);
+        ASSERT_EQUAL(Run(workload, {mython::Backend::Bytecode, true}), expected);
+    }
+}
+
+void TestPercentile() {
+    using chrono::nanoseconds;
+    vector<Duration> sorted;
+    for (int i = 1; i <= 100; ++i) {
+        sorted.push_back(nanoseconds(i));
+    }
+    ASSERT_EQUAL(Percentile(sorted, 0.5).count(), 50);
+    ASSERT_EQUAL(Percentile(sorted, 0.99).count(), 99);
+    ASSERT_EQUAL(Percentile(sorted, 1.0).count(), 100);
+    ASSERT_EQUAL(Percentile(sorted, 0.0).count(), 1);
+    ASSERT_EQUAL(Percentile({nanoseconds(7)}, 0.9).count(), 7);
+}
+
+void TestMeasure() {
+    Options options;
+    options.min_time = Duration{0};
+    options.min_iterations = 3;
+    options.warmup_iterations = 0;
+
+    const Workload workload{"counter"s, "class A:\n  def f():\n    return 1\na = A()\nprint a.f()\n"s};
+    const Result result = Measure(workload, options);
+    ASSERT_EQUAL(result.name, "counter"s);
+    ASSERT_EQUAL(result.iterations, 3U);
+    ASSERT(result.throughput > 0);
+    ASSERT(result.p50 <= result.p90 && result.p90 <= result.p99);
+    // Каждое исполнение создаёт хотя бы экземпляр класса
+    ASSERT(result.allocations_per_operation >= 1);
+
+    ostringstream report;
+    PrintResults({result}, report);
+    ASSERT(report.str().find("counter"s) != string::npos);
+}
+
+}  // namespace
+
+void RunBenchmarkTests(TestRunner& tr) {
+    RUN_TEST(tr, bench::TestWorkloadsAgree);
+    RUN_TEST(tr, bench::TestPercentile);
+    RUN_TEST(tr, bench::TestMeasure);
+}
+
+}  // namespace bench
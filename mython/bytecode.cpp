@@ -0,0 +1,972 @@
+#include "bytecode.h"
+
+#include "statement.h"
+
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <typeinfo>
+#include <unordered_map>
+
+using namespace std;
+
+namespace bytecode {
+
+using runtime::Closure;
+using runtime::CompareOp;
+using runtime::Context;
+using runtime::ObjectHolder;
+
+namespace {
+
+// Возвращает результат сравнения lhs и rhs оператором Op
+template <CompareOp Op>
+ObjectHolder CompareRegisters(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+    return ObjectHolder::Own(runtime::Bool(runtime::Compare<Op>(lhs, rhs, context)));
+}
+
+string_view OpCodeName(OpCode op) {
+    switch (op) {
+        case OpCode::LoadConst: return "LoadConst"sv;
+        case OpCode::LoadNone: return "LoadNone"sv;
+        case OpCode::Move: return "Move"sv;
+        case OpCode::LoadName: return "LoadName"sv;
+        case OpCode::StoreName: return "StoreName"sv;
+        case OpCode::LoadLocal: return "LoadLocal"sv;
+        case OpCode::StoreLocal: return "StoreLocal"sv;
+        case OpCode::LoadField: return "LoadField"sv;
+        case OpCode::StoreField: return "StoreField"sv;
+        case OpCode::Add: return "Add"sv;
+        case OpCode::Sub: return "Sub"sv;
+        case OpCode::Mult: return "Mult"sv;
+        case OpCode::Div: return "Div"sv;
+        case OpCode::Equal: return "Equal"sv;
+        case OpCode::NotEqual: return "NotEqual"sv;
+        case OpCode::Less: return "Less"sv;
+        case OpCode::Greater: return "Greater"sv;
+        case OpCode::LessOrEqual: return "LessOrEqual"sv;
+        case OpCode::GreaterOrEqual: return "GreaterOrEqual"sv;
+        case OpCode::Not: return "Not"sv;
+        case OpCode::ToBool: return "ToBool"sv;
+        case OpCode::Stringify: return "Stringify"sv;
+        case OpCode::Jump: return "Jump"sv;
+        case OpCode::JumpIfFalse: return "JumpIfFalse"sv;
+        case OpCode::JumpIfTrue: return "JumpIfTrue"sv;
+        case OpCode::Print: return "Print"sv;
+        case OpCode::PrintChar: return "PrintChar"sv;
+        case OpCode::Step: return "Step"sv;
+        case OpCode::Call: return "Call"sv;
+        case OpCode::NewInstance: return "NewInstance"sv;
+        case OpCode::DefineClass: return "DefineClass"sv;
+        case OpCode::Return: return "Return"sv;
+        case OpCode::AddNumbers: return "AddNumbers"sv;
+        case OpCode::SubNumbers: return "SubNumbers"sv;
+        case OpCode::MultNumbers: return "MultNumbers"sv;
+        case OpCode::DivNumbers: return "DivNumbers"sv;
+        case OpCode::AddStrings: return "AddStrings"sv;
+        case OpCode::EqualNumbers: return "EqualNumbers"sv;
+        case OpCode::NotEqualNumbers: return "NotEqualNumbers"sv;
+        case OpCode::LessNumbers: return "LessNumbers"sv;
+        case OpCode::GreaterNumbers: return "GreaterNumbers"sv;
+        case OpCode::LessOrEqualNumbers: return "LessOrEqualNumbers"sv;
+        case OpCode::GreaterOrEqualNumbers: return "GreaterOrEqualNumbers"sv;
+        case OpCode::CallCached: return "CallCached"sv;
+    }
+    return "Unknown"sv;
+}
+
+runtime::ClassInstance& ExpectInstance(const ObjectHolder& object) {
+    if (auto instance = object.TryAs<runtime::ClassInstance>()) {
+        return *instance;
+    }
+    throw std::runtime_error("Error cast to ClassInstance"s);
+}
+
+// Возвращает операцию специализированного кода для op, операнды которой - числа
+optional<OpCode> NumbersOpCode(OpCode op) {
+    switch (op) {
+        case OpCode::Add: return OpCode::AddNumbers;
+        case OpCode::Sub: return OpCode::SubNumbers;
+        case OpCode::Mult: return OpCode::MultNumbers;
+        case OpCode::Div: return OpCode::DivNumbers;
+        case OpCode::Equal: return OpCode::EqualNumbers;
+        case OpCode::NotEqual: return OpCode::NotEqualNumbers;
+        case OpCode::Less: return OpCode::LessNumbers;
+        case OpCode::Greater: return OpCode::GreaterNumbers;
+        case OpCode::LessOrEqual: return OpCode::LessOrEqualNumbers;
+        case OpCode::GreaterOrEqual: return OpCode::GreaterOrEqualNumbers;
+        default: return nullopt;
+    }
+}
+
+// Запоминает в feedback виды операндов бинарной операции
+void RecordOperands(Feedback& feedback, const ObjectHolder& lhs, const ObjectHolder& rhs) {
+    const runtime::ObjectKind kind = lhs.GetKind();
+    uint8_t bit = Feedback::OTHER;
+    if (kind == rhs.GetKind()) {
+        if (kind == runtime::ObjectKind::Number) {
+            bit = Feedback::NUMBERS;
+        } else if (kind == runtime::ObjectKind::String) {
+            bit = Feedback::STRINGS;
+        }
+    }
+    // Сведения почти всегда уже записаны, а чтение обходится дешевле атомарного изменения
+    if ((feedback.kinds.load(memory_order_relaxed) & bit) == 0) {
+        feedback.kinds.fetch_or(bit, memory_order_relaxed);
+    }
+}
+
+// Запоминает в feedback класс получателя вызова метода
+void RecordReceiver(Feedback& feedback, const runtime::Class& cls) {
+    const runtime::Class* seen = feedback.receiver.load(memory_order_relaxed);
+    if (seen == &cls) {
+        return;
+    }
+    if (seen == nullptr
+        && feedback.receiver.compare_exchange_strong(seen, &cls, memory_order_relaxed)) {
+        return;
+    }
+    if (seen != &cls && (feedback.kinds.load(memory_order_relaxed) & Feedback::OTHER) == 0) {
+        feedback.kinds.fetch_or(Feedback::OTHER, memory_order_relaxed);
+    }
+}
+
+// Записывает в dst результат operation над числами lhs и rhs. Возвращает false, если хотя бы
+// один из операндов - не число, хранящееся в самом ObjectHolder
+template <typename Operation>
+bool ApplyToNumbers(ObjectHolder& dst, const ObjectHolder& lhs, const ObjectHolder& rhs,
+                    Operation operation) {
+    const runtime::Number* lhs_number = lhs.GetInlineNumber();
+    const runtime::Number* rhs_number = rhs.GetInlineNumber();
+    if (lhs_number == nullptr || rhs_number == nullptr) {
+        return false;
+    }
+    dst.Assign(operation(lhs_number->GetValue(), rhs_number->GetValue()));
+    return true;
+}
+
+template <CompareOp Op>
+runtime::Bool CompareNumbers(int lhs, int rhs) {
+    return runtime::Bool(runtime::CompareValues<Op>(lhs, rhs));
+}
+
+}  // namespace
+
+// Компилятор программы. Отвечает за классы, общие для всех фрагментов байткода
+class Compiler {
+public:
+    unique_ptr<Function> CompileProgram(const runtime::Executable& program);
+
+    // Возвращает скомпилированную копию класса cls, компилируя её при первом обращении
+    runtime::Class& CompileClass(const runtime::Class& cls);
+
+private:
+    unordered_map<const runtime::Class*, ObjectHolder> classes_;
+};
+
+namespace {
+
+// Компилятор одного фрагмента байткода. Значение каждого узла дерева вычисляется в заданный
+// регистр, временные значения размещаются в регистрах выше по принципу стека
+class ChunkCompiler {
+public:
+    ChunkCompiler(Compiler& compiler, Chunk& chunk)
+        : compiler_(compiler), chunk_(chunk) {
+    }
+
+    // Компилирует тело метода либо программу верхнего уровня
+    void CompileFunction(const runtime::Executable& body) {
+        offset_ = body.GetSourceOffset();
+        const uint16_t result = AllocateRegister();
+        Compile(body, result);
+        Emit({OpCode::Return, 0, result});
+        chunk_.field_caches.resize(chunk_.names.size());
+        chunk_.feedback.resize(chunk_.code.size());
+    }
+
+private:
+    // Место, куда передаёт управление инструкция return
+    struct ReturnTarget {
+        uint16_t result;
+        vector<size_t> jumps;
+    };
+
+    void Compile(const runtime::Executable& node, uint16_t dst) {
+        using namespace ast;
+
+        if (auto p = dynamic_cast<const NumericConst*>(&node)) {
+            EmitConstant(dst, ObjectHolder::Own(runtime::Number(p->GetValue())));
+        } else if (auto p = dynamic_cast<const StringConst*>(&node)) {
+            EmitConstant(dst, ObjectHolder::Own(runtime::String(p->GetValue())));
+        } else if (auto p = dynamic_cast<const BoolConst*>(&node)) {
+            EmitConstant(dst, ObjectHolder::Own(runtime::Bool(p->GetValue())));
+        } else if (dynamic_cast<const None*>(&node)) {
+            Emit({OpCode::LoadNone, 0, dst});
+        } else if (auto p = dynamic_cast<const VariableValue*>(&node)) {
+            CompileVariable(*p, dst);
+        } else if (auto p = dynamic_cast<const Assignment*>(&node)) {
+            Compile(p->GetValue(), dst);
+            if (auto slot = p->GetSlot()) {
+                Emit({OpCode::StoreLocal, 0, dst, SlotIndex(*slot)});
+            } else {
+                Emit({OpCode::StoreName, 0, dst, NameIndex(p->GetVarName())});
+            }
+        } else if (auto p = dynamic_cast<const FieldAssignment*>(&node)) {
+            CompileFieldAssignment(*p, dst);
+        } else if (auto p = dynamic_cast<const Print*>(&node)) {
+            CompilePrint(*p, dst);
+        } else if (auto p = dynamic_cast<const MethodCall*>(&node)) {
+            CompileMethodCall(*p, dst);
+        } else if (auto p = dynamic_cast<const MethodBody*>(&node)) {
+            CompileMethodBody(*p, dst);
+        } else if (auto p = dynamic_cast<const Return*>(&node)) {
+            CompileReturn(*p);
+        } else if (auto p = dynamic_cast<const ClassDefinition*>(&node)) {
+            auto& cls = compiler_.CompileClass(p->GetClass());
+            Emit({OpCode::DefineClass, 0, AddConstant(ObjectHolder::Share(cls))});
+            Emit({OpCode::LoadNone, 0, dst});
+        } else if (auto p = dynamic_cast<const NewInstance*>(&node)) {
+            CompileNewInstance(*p, dst);
+        } else if (auto p = dynamic_cast<const Stringify*>(&node)) {
+            Compile(p->GetArgument(), dst);
+            Emit({OpCode::Stringify, 0, dst, dst});
+        } else if (auto p = dynamic_cast<const Not*>(&node)) {
+            Compile(p->GetArgument(), dst);
+            Emit({OpCode::Not, 0, dst, dst});
+        } else if (auto p = dynamic_cast<const Add*>(&node)) {
+            CompileBinary(OpCode::Add, *p, dst);
+        } else if (auto p = dynamic_cast<const Sub*>(&node)) {
+            CompileBinary(OpCode::Sub, *p, dst);
+        } else if (auto p = dynamic_cast<const Mult*>(&node)) {
+            CompileBinary(OpCode::Mult, *p, dst);
+        } else if (auto p = dynamic_cast<const Div*>(&node)) {
+            CompileBinary(OpCode::Div, *p, dst);
+        } else if (auto p = dynamic_cast<const Or*>(&node)) {
+            CompileLogical(OpCode::JumpIfTrue, *p, dst);
+        } else if (auto p = dynamic_cast<const And*>(&node)) {
+            CompileLogical(OpCode::JumpIfFalse, *p, dst);
+        } else if (auto p = dynamic_cast<const Comparison*>(&node)) {
+            CompileBinary(ComparisonOpCode(*p), *p, dst);
+        } else if (auto p = dynamic_cast<const Program*>(&node)) {
+            Compile(p->GetBody(), dst);
+        } else if (auto p = dynamic_cast<const Compound*>(&node)) {
+            CompileCompound(*p, dst);
+        } else if (auto p = dynamic_cast<const IfElse*>(&node)) {
+            CompileIfElse(*p, dst);
+        } else {
+            throw CompileError("Unsupported statement "s + typeid(node).name());
+        }
+    }
+
+    void CompileVariable(const ast::VariableValue& node, uint16_t dst) {
+        const auto& ids = node.GetDottedIds();
+        if (auto slot = node.GetSlot()) {
+            Emit({OpCode::LoadLocal, 0, dst, SlotIndex(*slot)});
+        } else {
+            Emit({OpCode::LoadName, 0, dst, NameIndex(ids.front())});
+        }
+        for (size_t i = 1; i < ids.size(); ++i) {
+            Emit({OpCode::LoadField, 0, dst, dst, NameIndex(ids[i])});
+        }
+    }
+
+    void CompileFieldAssignment(const ast::FieldAssignment& node, uint16_t dst) {
+        const uint16_t mark = next_register_;
+        const uint16_t object = AllocateRegister();
+        CompileVariable(node.GetObject(), object);
+        Compile(node.GetValue(), dst);
+        Emit({OpCode::StoreField, 0, object, NameIndex(node.GetFieldName()), dst});
+        next_register_ = mark;
+    }
+
+    // Каждый аргумент выводится сразу после вычисления, как и при обходе дерева, поэтому
+    // вывод из методов, вызванных в следующих аргументах, идёт после него
+    void CompilePrint(const ast::Print& node, uint16_t dst) {
+        const uint16_t mark = next_register_;
+        const uint16_t value = AllocateRegister();
+        bool first = true;
+        for (const auto& arg : node.GetArgs()) {
+            if (!first) {
+                Emit({OpCode::PrintChar, 0, ' '});
+            }
+            Compile(*arg, value);
+            Emit({OpCode::Print, 0, value});
+            first = false;
+        }
+        Emit({OpCode::PrintChar, 0, '\n'});
+        Emit({OpCode::LoadNone, 0, dst});
+        next_register_ = mark;
+    }
+
+    void CompileMethodCall(const ast::MethodCall& node, uint16_t dst) {
+        const uint16_t mark = next_register_;
+        const uint16_t object = AllocateRegister();
+        Compile(node.GetObject(), object);
+        const auto& args = node.GetArgs();
+        CompileArguments(args);
+        Emit({OpCode::Call, ArgumentCount(args), dst, object, NameIndex(node.GetMethodName())});
+        next_register_ = mark;
+    }
+
+    void CompileNewInstance(const ast::NewInstance& node, uint16_t dst) {
+        auto& cls = compiler_.CompileClass(node.GetClass());
+        const uint16_t mark = next_register_;
+        const auto& args = node.GetArgs();
+        // Как и при обходе дерева, аргументы вычисляются, только если вызывается __init__.
+        // Иначе количество аргументов не совпадает с количеством параметров __init__, и
+        // инструкция не читает их регистры
+        const runtime::Method* init = node.GetClass().GetInitMethod();
+        if (init && init->formal_params.size() == args.size()) {
+            CompileArguments(args);
+        }
+        Emit({OpCode::NewInstance, ArgumentCount(args), dst, AddConstant(ObjectHolder::Share(cls)),
+              mark});
+        next_register_ = mark;
+    }
+
+    // Значения аргументов размещаются в последовательных регистрах начиная с next_register_
+    void CompileArguments(const vector<unique_ptr<ast::Statement>>& args) {
+        for (const auto& arg : args) {
+            const uint16_t reg = AllocateRegister();
+            Compile(*arg, reg);
+            next_register_ = reg + 1;
+        }
+    }
+
+    void CompileMethodBody(const ast::MethodBody& node, uint16_t dst) {
+        return_targets_.push_back({dst, {}});
+        const uint16_t mark = next_register_;
+        const uint16_t scratch = AllocateRegister();
+        Compile(node.GetBody(), scratch);
+        next_register_ = mark;
+        Emit({OpCode::LoadNone, 0, dst});
+        for (size_t jump : return_targets_.back().jumps) {
+            PatchJump(jump);
+        }
+        return_targets_.pop_back();
+    }
+
+    void CompileReturn(const ast::Return& node) {
+        if (return_targets_.empty()) {
+            // return вне тела метода завершает исполнение фрагмента
+            const uint16_t mark = next_register_;
+            const uint16_t value = AllocateRegister();
+            Compile(node.GetStatement(), value);
+            Emit({OpCode::Return, 0, value});
+            next_register_ = mark;
+            return;
+        }
+        const uint16_t result = return_targets_.back().result;
+        Compile(node.GetStatement(), result);
+        return_targets_.back().jumps.push_back(Emit({OpCode::Jump}));
+    }
+
+    void CompileBinary(OpCode op, const ast::BinaryOperation& node, uint16_t dst) {
+        const uint16_t mark = next_register_;
+        const uint16_t lhs = AllocateRegister();
+        Compile(node.GetLhs(), lhs);
+        const uint16_t rhs = AllocateRegister();
+        Compile(node.GetRhs(), rhs);
+        Emit({op, 0, dst, lhs, rhs});
+        next_register_ = mark;
+    }
+
+    // and и or вычисляют правый аргумент, только если левого не хватает для результата
+    void CompileLogical(OpCode short_circuit, const ast::BinaryOperation& node, uint16_t dst) {
+        const uint16_t mark = next_register_;
+        const uint16_t value = AllocateRegister();
+        Compile(node.GetLhs(), value);
+        Emit({OpCode::ToBool, 0, dst, value});
+        const size_t jump = Emit({short_circuit, 0, dst});
+        Compile(node.GetRhs(), value);
+        Emit({OpCode::ToBool, 0, dst, value});
+        PatchJump(jump);
+        next_register_ = mark;
+    }
+
+    void CompileCompound(const ast::Compound& node, uint16_t dst) {
+        const uint16_t mark = next_register_;
+        const uint16_t scratch = AllocateRegister();
+        for (const auto& statement : node.GetStatements()) {
+            offset_ = statement->GetSourceOffset();
+            Emit({OpCode::Step});
+            Compile(*statement, scratch);
+        }
+        next_register_ = mark;
+        Emit({OpCode::LoadNone, 0, dst});
+    }
+
+    void CompileIfElse(const ast::IfElse& node, uint16_t dst) {
+        const uint16_t mark = next_register_;
+        const uint16_t condition = AllocateRegister();
+        Compile(node.GetCondition(), condition);
+        next_register_ = mark;
+        const size_t to_else = Emit({OpCode::JumpIfFalse, 0, condition});
+        Compile(node.GetIfBody(), dst);
+        const size_t to_end = Emit({OpCode::Jump});
+        PatchJump(to_else);
+        if (const auto* else_body = node.GetElseBody()) {
+            Compile(*else_body, dst);
+        } else {
+            Emit({OpCode::LoadNone, 0, dst});
+        }
+        PatchJump(to_end);
+    }
+
+    static OpCode ComparisonOpCode(const ast::Comparison& node) {
+        switch (node.GetOperator()) {
+            case CompareOp::Equal: return OpCode::Equal;
+            case CompareOp::NotEqual: return OpCode::NotEqual;
+            case CompareOp::Less: return OpCode::Less;
+            case CompareOp::Greater: return OpCode::Greater;
+            case CompareOp::LessOrEqual: return OpCode::LessOrEqual;
+            case CompareOp::GreaterOrEqual: return OpCode::GreaterOrEqual;
+        }
+        throw CompileError("Unsupported comparator"s);
+    }
+
+    static uint8_t ArgumentCount(const vector<unique_ptr<ast::Statement>>& args) {
+        if (args.size() > numeric_limits<uint8_t>::max()) {
+            throw CompileError("Too many arguments"s);
+        }
+        return static_cast<uint8_t>(args.size());
+    }
+
+    size_t Emit(Instruction instruction) {
+        if (chunk_.code.size() >= numeric_limits<uint32_t>::max()) {
+            throw CompileError("Chunk is too large"s);
+        }
+        chunk_.code.push_back(instruction);
+        chunk_.offsets.push_back(offset_);
+        return chunk_.code.size() - 1;
+    }
+
+    // Направляет переход с индексом jump на следующую инструкцию
+    void PatchJump(size_t jump) {
+        auto& instruction = chunk_.code[jump];
+        const auto target = static_cast<uint32_t>(chunk_.code.size());
+        instruction.b = static_cast<uint16_t>(target);
+        instruction.c = static_cast<uint16_t>(target >> 16);
+    }
+
+    void EmitConstant(uint16_t dst, ObjectHolder value) {
+        Emit({OpCode::LoadConst, 0, dst, AddConstant(std::move(value))});
+    }
+
+    uint16_t AddConstant(ObjectHolder value) {
+        if (chunk_.constants.size() >= numeric_limits<uint16_t>::max()) {
+            throw CompileError("Too many constants"s);
+        }
+        chunk_.constants.push_back(std::move(value));
+        return static_cast<uint16_t>(chunk_.constants.size() - 1);
+    }
+
+    uint16_t NameIndex(runtime::Symbol name) {
+        auto [it, inserted] = name_indices_.emplace(name, chunk_.names.size());
+        if (inserted) {
+            if (chunk_.names.size() >= numeric_limits<uint16_t>::max()) {
+                throw CompileError("Too many names"s);
+            }
+            chunk_.names.push_back(name);
+        }
+        return it->second;
+    }
+
+    uint16_t SlotIndex(size_t slot) {
+        if (slot > numeric_limits<uint16_t>::max()) {
+            throw CompileError("Too many local variables"s);
+        }
+        chunk_.uses_frame = true;
+        return static_cast<uint16_t>(slot);
+    }
+
+    uint16_t AllocateRegister() {
+        if (next_register_ == numeric_limits<uint16_t>::max()) {
+            throw CompileError("Too many registers"s);
+        }
+        const uint16_t reg = next_register_++;
+        chunk_.register_count = max(chunk_.register_count, next_register_);
+        return reg;
+    }
+
+    Compiler& compiler_;
+    Chunk& chunk_;
+    // Позиция в исходном тексте инструкции, которая компилируется сейчас
+    uint32_t offset_ = runtime::Executable::NO_SOURCE_OFFSET;
+    uint16_t next_register_ = 0;
+    unordered_map<runtime::Symbol, uint16_t> name_indices_;
+    vector<ReturnTarget> return_targets_;
+};
+
+}  // namespace
+
+unique_ptr<Function> Compiler::CompileProgram(const runtime::Executable& program) {
+    auto function = make_unique<Function>();
+    ChunkCompiler(*this, function->chunk_).CompileFunction(program);
+    for (auto& [source, cls] : classes_) {
+        function->classes_.push_back(std::move(cls));
+    }
+    return function;
+}
+
+runtime::Class& Compiler::CompileClass(const runtime::Class& cls) {
+    if (auto it = classes_.find(&cls); it != classes_.end()) {
+        return static_cast<runtime::Class&>(*it->second);  // NOLINT
+    }
+
+    const runtime::Class* parent = cls.GetParent() ? &CompileClass(*cls.GetParent()) : nullptr;
+
+    // Тела методов компилируются после регистрации класса, чтобы методы могли создавать
+    // экземпляры собственного класса
+    vector<runtime::Method> methods;
+    vector<Function*> bodies;
+    for (const auto& method : cls.GetMethods()) {
+        auto body = make_unique<Function>();
+        bodies.push_back(body.get());
+        methods.push_back(
+            {method.name, method.formal_params, std::move(body), method.frame_size});
+    }
+
+    // Классы хранятся в функции верхнего уровня, а константы байткода ссылаются на них
+    // невладеющими ObjectHolder, иначе методы, создающие экземпляры своего класса, образовали бы
+    // цикл владения
+    auto& compiled = classes_[&cls]
+        = ObjectHolder::Own(runtime::Class(cls.GetName(), std::move(methods), parent));
+    auto& result = static_cast<runtime::Class&>(*compiled);  // NOLINT
+
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        ChunkCompiler(*this, bodies[i]->chunk_).CompileFunction(*cls.GetMethods()[i].body);
+    }
+    return result;
+}
+
+Function::Function(Chunk chunk)
+    : chunk_(std::move(chunk)) {
+    chunk_.feedback.resize(chunk_.code.size());
+}
+
+const Chunk& Function::GetChunk() const {
+    return chunk_;
+}
+
+ObjectHolder Function::Execute(Closure& closure, Context& context) {
+    const SpecializedCode* specialized = specialized_.load(memory_order_acquire);
+    bool profile = false;
+    if (specialized == nullptr
+        && specializations_.load(memory_order_relaxed) < MAX_SPECIALIZATIONS) {
+        // Точность счётчика не важна, поэтому он увеличивается без атомарного чтения-записи
+        const uint32_t calls = calls_.load(memory_order_relaxed) + 1;
+        calls_.store(calls, memory_order_relaxed);
+        if (calls > HOT_THRESHOLD) {
+            specialized = Specialize();
+        }
+        profile = specialized == nullptr;
+    }
+
+    size_t pc = 0;
+    try {
+        if (specialized != nullptr) {
+            return Run<false>(specialized->code.data(), specialized->call_sites.data(), closure,
+                              context, pc);
+        }
+        if (profile) {
+            return Run<true>(chunk_.code.data(), nullptr, closure, context, pc);
+        }
+        return Run<false>(chunk_.code.data(), nullptr, closure, context, pc);
+    } catch (const runtime::LimitExceeded& error) {
+        if (error.GetSourceOffset() != runtime::Executable::NO_SOURCE_OFFSET || pc == 0) {
+            throw;
+        }
+        throw runtime::LimitExceeded(error.what(), error.GetLimit(), chunk_.offsets[pc - 1]);
+    } catch (const runtime::ExecutionError&) {
+        throw;
+    } catch (const std::runtime_error& error) {
+        // Ошибка относится к инструкции, которая исполнялась последней
+        throw runtime::ExecutionError(error.what(), chunk_.offsets[pc - 1]);
+    }
+}
+
+const SpecializedCode* Function::Specialize() {
+    const lock_guard lock(specialize_mutex_);
+    if (const SpecializedCode* specialized = specialized_.load(memory_order_relaxed)) {
+        return specialized;
+    }
+    if (specializations_.load(memory_order_relaxed) >= MAX_SPECIALIZATIONS) {
+        return nullptr;
+    }
+
+    auto specialized = make_unique<SpecializedCode>();
+    specialized->code = chunk_.code;
+    for (size_t i = 0; i < specialized->code.size(); ++i) {
+        Instruction& in = specialized->code[i];
+        const Feedback& feedback = chunk_.feedback[i];
+        const uint8_t kinds = feedback.kinds.load(memory_order_relaxed);
+        if (in.op == OpCode::Call) {
+            const runtime::Class* receiver = feedback.receiver.load(memory_order_relaxed);
+            if (receiver == nullptr || (kinds & Feedback::OTHER) != 0
+                || specialized->call_sites.size() > numeric_limits<uint16_t>::max()) {
+                continue;
+            }
+            const runtime::Method* method = receiver->GetMethod(chunk_.names[in.c]);
+            if (method == nullptr || method->formal_params.size() != in.d) {
+                continue;
+            }
+            specialized->call_sites.push_back({receiver, method, in.c});
+            in.op = OpCode::CallCached;
+            in.c = static_cast<uint16_t>(specialized->call_sites.size() - 1);
+        } else if (kinds == Feedback::NUMBERS) {
+            in.op = NumbersOpCode(in.op).value_or(in.op);
+        } else if (kinds == Feedback::STRINGS && in.op == OpCode::Add) {
+            in.op = OpCode::AddStrings;
+        }
+    }
+
+    const SpecializedCode* result = specialized.get();
+    specialized_codes_.push_back(std::move(specialized));
+    specializations_.fetch_add(1, memory_order_relaxed);
+    specialized_.store(result, memory_order_release);
+    return result;
+}
+
+void Function::Deoptimize() {
+    if (specialized_.load(memory_order_relaxed) == nullptr) {
+        return;
+    }
+    const lock_guard lock(specialize_mutex_);
+    specialized_.store(nullptr, memory_order_relaxed);
+    calls_.store(0, memory_order_relaxed);
+}
+
+template <bool PROFILE>
+ObjectHolder Function::Run(const Instruction* code, const CallSite* call_sites, Closure& closure,
+                           Context& context, size_t& pc) {
+    vector<ObjectHolder> registers(chunk_.register_count);
+    runtime::CallStack::Slot* frame
+        = chunk_.uses_frame ? context.GetCallStack().CurrentFrame() : nullptr;
+    const auto& constants = chunk_.constants;
+    const auto& names = chunk_.names;
+    auto& field_caches = chunk_.field_caches;
+    auto& feedback = chunk_.feedback;
+    // Продолжает исполнение с текущей инструкции по исходному коду, в котором значения
+    // хранятся в тех же регистрах
+    const auto fall_back = [&] {
+        code = chunk_.code.data();
+        --pc;
+    };
+    // Проверка специализированной инструкции не прошла: запоминаем операнды, отменяем
+    // специализацию и переходим к исходному коду
+    const auto deoptimize = [&](const ObjectHolder& lhs, const ObjectHolder& rhs) {
+        RecordOperands(feedback[pc - 1], lhs, rhs);
+        Deoptimize();
+        fall_back();
+    };
+
+    for (;;) {
+        const Instruction& in = code[pc++];
+        switch (in.op) {
+            case OpCode::LoadConst:
+                registers[in.a] = constants[in.b].Borrow();
+                break;
+            case OpCode::LoadNone:
+                registers[in.a] = ObjectHolder::None();
+                break;
+            case OpCode::Move:
+                registers[in.a] = registers[in.b];
+                break;
+            case OpCode::LoadName: {
+                auto it = closure.find(names[in.b]);
+                if (it == closure.end()) {
+                    throw std::runtime_error("Variable not found"s);
+                }
+                registers[in.a] = it->second;
+                break;
+            }
+            case OpCode::StoreName:
+                closure[names[in.b]] = registers[in.a];
+                break;
+            case OpCode::LoadLocal:
+                if (!frame[in.b]) {
+                    throw std::runtime_error("Variable not found"s);
+                }
+                registers[in.a] = *frame[in.b];
+                break;
+            case OpCode::StoreLocal:
+                frame[in.b] = registers[in.a];
+                break;
+            case OpCode::LoadField: {
+                const ObjectHolder* value = field_caches[in.c].Find(
+                    ExpectInstance(registers[in.b]).Fields(), names[in.c]);
+                if (!value) {
+                    throw std::runtime_error("Variable not found"s);
+                }
+                registers[in.a] = *value;
+                break;
+            }
+            case OpCode::StoreField:
+                field_caches[in.b].Store(ExpectInstance(registers[in.a]).Fields(), names[in.b],
+                                         registers[in.c]);
+                break;
+            case OpCode::Add:
+                if constexpr (PROFILE) {
+                    RecordOperands(feedback[pc - 1], registers[in.b], registers[in.c]);
+                }
+                registers[in.a] = runtime::Add(registers[in.b], registers[in.c], context);
+                break;
+            case OpCode::Sub:
+                if constexpr (PROFILE) {
+                    RecordOperands(feedback[pc - 1], registers[in.b], registers[in.c]);
+                }
+                registers[in.a] = runtime::Sub(registers[in.b], registers[in.c]);
+                break;
+            case OpCode::Mult:
+                if constexpr (PROFILE) {
+                    RecordOperands(feedback[pc - 1], registers[in.b], registers[in.c]);
+                }
+                registers[in.a] = runtime::Mult(registers[in.b], registers[in.c]);
+                break;
+            case OpCode::Div:
+                if constexpr (PROFILE) {
+                    RecordOperands(feedback[pc - 1], registers[in.b], registers[in.c]);
+                }
+                registers[in.a] = runtime::Div(registers[in.b], registers[in.c]);
+                break;
+            case OpCode::Equal:
+                if constexpr (PROFILE) {
+                    RecordOperands(feedback[pc - 1], registers[in.b], registers[in.c]);
+                }
+                registers[in.a] = CompareRegisters<CompareOp::Equal>(
+                    registers[in.b], registers[in.c], context);
+                break;
+            case OpCode::NotEqual:
+                if constexpr (PROFILE) {
+                    RecordOperands(feedback[pc - 1], registers[in.b], registers[in.c]);
+                }
+                registers[in.a] = CompareRegisters<CompareOp::NotEqual>(
+                    registers[in.b], registers[in.c], context);
+                break;
+            case OpCode::Less:
+                if constexpr (PROFILE) {
+                    RecordOperands(feedback[pc - 1], registers[in.b], registers[in.c]);
+                }
+                registers[in.a] = CompareRegisters<CompareOp::Less>(
+                    registers[in.b], registers[in.c], context);
+                break;
+            case OpCode::Greater:
+                if constexpr (PROFILE) {
+                    RecordOperands(feedback[pc - 1], registers[in.b], registers[in.c]);
+                }
+                registers[in.a] = CompareRegisters<CompareOp::Greater>(
+                    registers[in.b], registers[in.c], context);
+                break;
+            case OpCode::LessOrEqual:
+                if constexpr (PROFILE) {
+                    RecordOperands(feedback[pc - 1], registers[in.b], registers[in.c]);
+                }
+                registers[in.a] = CompareRegisters<CompareOp::LessOrEqual>(
+                    registers[in.b], registers[in.c], context);
+                break;
+            case OpCode::GreaterOrEqual:
+                if constexpr (PROFILE) {
+                    RecordOperands(feedback[pc - 1], registers[in.b], registers[in.c]);
+                }
+                registers[in.a] = CompareRegisters<CompareOp::GreaterOrEqual>(
+                    registers[in.b], registers[in.c], context);
+                break;
+            case OpCode::Not:
+                registers[in.a] = ObjectHolder::Own(runtime::Bool(!runtime::IsTrue(registers[in.b])));
+                break;
+            case OpCode::ToBool:
+                registers[in.a] = ObjectHolder::Own(runtime::Bool(runtime::IsTrue(registers[in.b])));
+                break;
+            case OpCode::Stringify:
+                registers[in.a] = runtime::Stringify(registers[in.b], context);
+                break;
+            case OpCode::Jump:
+                pc = GetJumpTarget(in);
+                break;
+            case OpCode::JumpIfFalse:
+                if (!runtime::IsTrue(registers[in.a])) {
+                    pc = GetJumpTarget(in);
+                }
+                break;
+            case OpCode::JumpIfTrue:
+                if (runtime::IsTrue(registers[in.a])) {
+                    pc = GetJumpTarget(in);
+                }
+                break;
+            case OpCode::Print: {
+                auto& out = context.GetOutputBuffer();
+                [[maybe_unused]] const size_t start_size = out.GetTotalSize();
+                if (const auto& object = registers[in.a]) {
+                    object->Print(out, context);
+                } else {
+                    out.Append("None"sv);
+                }
+                runtime::UpdateMetrics([&](runtime::Metrics& metrics) {
+                    metrics.bytes_printed += out.GetTotalSize() - start_size;
+                });
+                break;
+            }
+            case OpCode::PrintChar:
+                context.GetOutputBuffer().Append(static_cast<char>(in.a));
+                runtime::UpdateMetrics([](runtime::Metrics& metrics) {
+                    ++metrics.bytes_printed;
+                });
+                break;
+            case OpCode::Call:
+            case OpCode::CallCached: {
+                auto& instance = ExpectInstance(registers[in.b]);
+                const runtime::Method* method = nullptr;
+                if (in.op == OpCode::CallCached) {
+                    const CallSite& site = call_sites[in.c];
+                    const bool hit = &instance.GetClass() == site.receiver;
+                    runtime::UpdateMetrics([hit](runtime::Metrics& metrics) {
+                        ++(hit ? metrics.method_cache_hits : metrics.method_cache_misses);
+                    });
+                    if (!hit) {
+                        RecordReceiver(feedback[pc - 1], instance.GetClass());
+                        Deoptimize();
+                        fall_back();
+                        continue;
+                    }
+                    method = site.method;
+                } else {
+                    runtime::UpdateMetrics([](runtime::Metrics& metrics) {
+                        ++metrics.method_cache_misses;
+                    });
+                    if constexpr (PROFILE) {
+                        RecordReceiver(feedback[pc - 1], instance.GetClass());
+                    }
+                }
+                vector<ObjectHolder> args(registers.begin() + in.b + 1,
+                                          registers.begin() + in.b + 1 + in.d);
+                registers[in.a] = method != nullptr ? instance.CallMethod(*method, args, context)
+                                                    : instance.Call(names[in.c], args, context);
+                break;
+            }
+            case OpCode::NewInstance: {
+                const auto& cls = static_cast<const runtime::Class&>(*constants[in.b]);  // NOLINT
+                auto instance = ObjectHolder::Make<runtime::ClassInstance>(cls);
+                const runtime::Method* init = cls.GetInitMethod();
+                if (init && init->formal_params.size() == in.d) {
+                    vector<ObjectHolder> args(registers.begin() + in.c,
+                                              registers.begin() + in.c + in.d);
+                    static_cast<runtime::ClassInstance&>(*instance)  // NOLINT
+                        .CallMethod(*init, args, context);
+                }
+                registers[in.a] = std::move(instance);
+                break;
+            }
+            case OpCode::Step:
+                context.Step();
+                break;
+            case OpCode::DefineClass: {
+                const auto& cls = static_cast<const runtime::Class&>(*constants[in.a]);  // NOLINT
+                closure[cls.GetName()] = constants[in.a].Borrow();
+                break;
+            }
+            case OpCode::Return:
+                return registers[in.a];
+            case OpCode::AddNumbers:
+                if (!ApplyToNumbers(registers[in.a], registers[in.b], registers[in.c],
+                                    [](int lhs, int rhs) { return runtime::Number(lhs + rhs); })) {
+                    deoptimize(registers[in.b], registers[in.c]);
+                    continue;
+                }
+                break;
+            case OpCode::SubNumbers:
+                if (!ApplyToNumbers(registers[in.a], registers[in.b], registers[in.c],
+                                    [](int lhs, int rhs) { return runtime::Number(lhs - rhs); })) {
+                    deoptimize(registers[in.b], registers[in.c]);
+                    continue;
+                }
+                break;
+            case OpCode::MultNumbers:
+                if (!ApplyToNumbers(registers[in.a], registers[in.b], registers[in.c],
+                                    [](int lhs, int rhs) { return runtime::Number(lhs * rhs); })) {
+                    deoptimize(registers[in.b], registers[in.c]);
+                    continue;
+                }
+                break;
+            case OpCode::DivNumbers: {
+                // О делении на ноль сообщает исходная инструкция, специализация при этом
+                // не отменяется
+                const runtime::Number* divisor = registers[in.c].GetInlineNumber();
+                if (divisor != nullptr && divisor->GetValue() == 0) {
+                    fall_back();
+                    continue;
+                }
+                if (!ApplyToNumbers(registers[in.a], registers[in.b], registers[in.c],
+                                    [](int lhs, int rhs) { return runtime::Number(lhs / rhs); })) {
+                    deoptimize(registers[in.b], registers[in.c]);
+                    continue;
+                }
+                break;
+            }
+            case OpCode::AddStrings:
+                if (registers[in.b].GetKind() != runtime::ObjectKind::String
+                    || registers[in.c].GetKind() != runtime::ObjectKind::String) {
+                    deoptimize(registers[in.b], registers[in.c]);
+                    continue;
+                }
+                registers[in.a] = runtime::String::Concat(registers[in.b], registers[in.c]);
+                break;
+            case OpCode::EqualNumbers:
+                if (!ApplyToNumbers(registers[in.a], registers[in.b], registers[in.c],
+                                    CompareNumbers<CompareOp::Equal>)) {
+                    deoptimize(registers[in.b], registers[in.c]);
+                    continue;
+                }
+                break;
+            case OpCode::NotEqualNumbers:
+                if (!ApplyToNumbers(registers[in.a], registers[in.b], registers[in.c],
+                                    CompareNumbers<CompareOp::NotEqual>)) {
+                    deoptimize(registers[in.b], registers[in.c]);
+                    continue;
+                }
+                break;
+            case OpCode::LessNumbers:
+                if (!ApplyToNumbers(registers[in.a], registers[in.b], registers[in.c],
+                                    CompareNumbers<CompareOp::Less>)) {
+                    deoptimize(registers[in.b], registers[in.c]);
+                    continue;
+                }
+                break;
+            case OpCode::GreaterNumbers:
+                if (!ApplyToNumbers(registers[in.a], registers[in.b], registers[in.c],
+                                    CompareNumbers<CompareOp::Greater>)) {
+                    deoptimize(registers[in.b], registers[in.c]);
+                    continue;
+                }
+                break;
+            case OpCode::LessOrEqualNumbers:
+                if (!ApplyToNumbers(registers[in.a], registers[in.b], registers[in.c],
+                                    CompareNumbers<CompareOp::LessOrEqual>)) {
+                    deoptimize(registers[in.b], registers[in.c]);
+                    continue;
+                }
+                break;
+            case OpCode::GreaterOrEqualNumbers:
+                if (!ApplyToNumbers(registers[in.a], registers[in.b], registers[in.c],
+                                    CompareNumbers<CompareOp::GreaterOrEqual>)) {
+                    deoptimize(registers[in.b], registers[in.c]);
+                    continue;
+                }
+                break;
+        }
+    }
+}
+
+void Disassemble(const Chunk& chunk, std::ostream& os) {
+    for (size_t i = 0; i < chunk.code.size(); ++i) {
+        const auto& in = chunk.code[i];
+        os << i << ' ' << OpCodeName(in.op) << ' ' << in.a << ' ' << in.b << ' ' << in.c << ' '
+           << static_cast<unsigned>(in.d) << '\n';
+    }
+}
+
+unique_ptr<Function> Compile(const runtime::Executable& program) {
+    return Compiler().CompileProgram(program);
+}
+
+}  // namespace bytecode
@@ -0,0 +1,221 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bytecode {
+
+class CompileError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Операция байткода. В комментариях R - регистры, K - таблица констант, N - таблица имён,
+// F - слоты кадра метода в стеке вызовов, T - 32-битный индекс инструкции, младшие разряды
+// которого хранятся в b, а старшие - в c (см. GetJumpTarget)
+enum class OpCode : std::uint8_t {
+    LoadConst,       // R[a] = K[b]
+    LoadNone,        // R[a] = None
+    Move,            // R[a] = R[b]
+    LoadName,        // R[a] = closure[N[b]]
+    StoreName,       // closure[N[b]] = R[a]
+    LoadLocal,       // R[a] = F[b]
+    StoreLocal,      // F[b] = R[a]
+    LoadField,       // R[a] = R[b].N[c]
+    StoreField,      // R[a].N[b] = R[c]
+    Add,             // R[a] = R[b] + R[c]
+    Sub,             // R[a] = R[b] - R[c]
+    Mult,            // R[a] = R[b] * R[c]
+    Div,             // R[a] = R[b] / R[c]
+    Equal,           // R[a] = R[b] == R[c]
+    NotEqual,        // R[a] = R[b] != R[c]
+    Less,            // R[a] = R[b] < R[c]
+    Greater,         // R[a] = R[b] > R[c]
+    LessOrEqual,     // R[a] = R[b] <= R[c]
+    GreaterOrEqual,  // R[a] = R[b] >= R[c]
+    Not,             // R[a] = not R[b]
+    ToBool,          // R[a] = Bool(R[b])
+    Stringify,       // R[a] = str(R[b])
+    Jump,            // pc = T
+    JumpIfFalse,     // if not R[a]: pc = T
+    JumpIfTrue,      // if R[a]: pc = T
+    Print,           // выводит R[a]
+    PrintChar,       // выводит символ с кодом a: разделитель аргументов print либо конец строки
+    Step,            // учитывает шаг исполнения (Context::Step)
+    Call,            // R[a] = R[b].N[c](R[b + 1], ..., R[b + d])
+    NewInstance,     // R[a] = K[b](R[c], ..., R[c + d - 1])
+    DefineClass,     // closure[K[a].name] = K[a]
+    Return,          // return R[a]
+
+    // Операции специализированного кода (см. Function). Каждая проверяет, что операнды такие
+    // же, как при профилировании, а иначе отменяет специализацию и передаёт исполнение
+    // исходной инструкции
+    AddNumbers,             // Add для чисел
+    SubNumbers,             // Sub для чисел
+    MultNumbers,            // Mult для чисел
+    DivNumbers,             // Div для чисел
+    AddStrings,             // Add для строк
+    EqualNumbers,           // Equal для чисел
+    NotEqualNumbers,        // NotEqual для чисел
+    LessNumbers,            // Less для чисел
+    GreaterNumbers,         // Greater для чисел
+    LessOrEqualNumbers,     // LessOrEqual для чисел
+    GreaterOrEqualNumbers,  // GreaterOrEqual для чисел
+    CallCached,             // Call метода, найденного для класса получателя S[c] заранее
+};
+
+// Инструкция фиксированного размера: код операции и до четырёх операндов
+struct Instruction {
+    OpCode op;
+    std::uint8_t d = 0;
+    std::uint16_t a = 0;
+    std::uint16_t b = 0;
+    std::uint16_t c = 0;
+};
+
+// Возвращает индекс инструкции, на которую передаёт управление инструкция перехода
+inline std::uint32_t GetJumpTarget(const Instruction& instruction) {
+    return instruction.b | (static_cast<std::uint32_t>(instruction.c) << 16);
+}
+
+// Операнды, которые наблюдала инструкция при профилировании. Копия пуста, как и у FieldCache
+struct Feedback {
+    // Биты kinds
+    static constexpr std::uint8_t NUMBERS = 1;  // оба операнда - числа
+    static constexpr std::uint8_t STRINGS = 2;  // оба операнда - строки
+    static constexpr std::uint8_t OTHER = 4;    // прочие операнды либо получатели разных классов
+
+    Feedback() = default;
+    Feedback(const Feedback& /*other*/) noexcept {
+    }
+    Feedback& operator=(const Feedback&) = delete;
+
+    std::atomic<std::uint8_t> kinds = 0;
+    // Класс получателя вызова метода
+    std::atomic<const runtime::Class*> receiver = nullptr;
+};
+
+// Скомпилированный фрагмент кода: тело метода либо программа верхнего уровня
+struct Chunk {
+    std::vector<Instruction> code;
+    // Позиции инструкций code в исходном тексте, Executable::NO_SOURCE_OFFSET, если неизвестны
+    std::vector<std::uint32_t> offsets;
+    std::vector<runtime::ObjectHolder> constants;
+    std::vector<runtime::Symbol> names;
+    // Кэши обращений к полям с именами names[i]: общие для всех инструкций фрагмента
+    std::vector<runtime::FieldCache> field_caches;
+    // Сведения об операндах инструкций code[i], собираемые для специализации
+    std::vector<Feedback> feedback;
+    // Количество регистров, необходимых для исполнения фрагмента
+    std::uint16_t register_count = 0;
+    // Фрагмент обращается к переменным через слоты кадра, добавленного вызывающим методом
+    bool uses_frame = false;
+};
+
+// Вызов метода в специализированном коде: метод, найденный для класса получателя
+struct CallSite {
+    const runtime::Class* receiver;
+    const runtime::Method* method;
+    // Номер имени метода в таблице имён фрагмента
+    std::uint16_t name;
+};
+
+// Код фрагмента, специализированный по операндам, которые наблюдались при профилировании.
+// Инструкции расположены на тех же местах, что и в исходном коде
+struct SpecializedCode {
+    std::vector<Instruction> code;
+    // Вызовы методов инструкций CallCached
+    std::vector<CallSite> call_sites;
+};
+
+/*
+ * Функция, исполняющая байткод. Используется и как тело метода, и как программа целиком,
+ * поэтому её можно подставить везде, где ожидается runtime::Executable.
+ *
+ * Первые HOT_THRESHOLD исполнений функция профилирует: инструкции арифметики и сравнения
+ * запоминают виды операндов, а вызовы методов - классы получателей. Затем функция переходит
+ * на специализированный код: операции над одними числами или строками заменяются операциями,
+ * которые вычисляются без общих функций runtime, а вызовы с единственным классом получателя -
+ * вызовами заранее найденного метода. Если проверка специализированной инструкции не
+ * проходит, исполнение продолжается с той же инструкции исходного кода, а функция
+ * возвращается к профилированию
+ * и позже специализируется заново с учётом новых операндов, но не более
+ * MAX_SPECIALIZATIONS раз.
+ * Счётчики и сведения об операндах атомарны, а специализированный код не изменяется после
+ * создания и существует вместе с функцией, поэтому функцию можно исполнять одновременно из
+ * нескольких потоков
+ */
+class Function : public runtime::Executable {
+public:
+    static constexpr std::uint32_t HOT_THRESHOLD = 1000;
+    static constexpr std::uint32_t MAX_SPECIALIZATIONS = 4;
+
+    Function() = default;
+    explicit Function(Chunk chunk);
+
+    // Исполняет байткод в цикле диспетчеризации. Глобальные переменные берутся из closure, а
+    // переменные методов - из closure либо из текущего кадра стека вызовов, если их имена
+    // разрешены в слоты. Возвращает значение, переданное в инструкцию Return
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const Chunk& GetChunk() const;
+
+    // Возвращает код, по которому исполняется функция, если она специализирована, иначе nullptr
+    [[nodiscard]] const SpecializedCode* GetSpecializedCode() const {
+        return specialized_.load(std::memory_order_acquire);
+    }
+
+    // Возвращает количество специализаций функции
+    [[nodiscard]] std::uint32_t GetSpecializationCount() const {
+        return specializations_.load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class Compiler;
+
+    // Цикл диспетчеризации по коду code. В pc хранится индекс следующей инструкции, по
+    // которому Execute определяет позицию ошибки в исходном тексте. При PROFILE инструкции
+    // записывают сведения об операндах
+    template <bool PROFILE>
+    runtime::ObjectHolder Run(const Instruction* code, const CallSite* call_sites,
+                              runtime::Closure& closure, runtime::Context& context,
+                              std::size_t& pc);
+
+    // Создаёт специализированный код по собранным сведениям, если его ещё нет
+    const SpecializedCode* Specialize();
+    // Возвращает функцию к профилированию после того, как не прошла проверка инструкции
+    void Deoptimize();
+
+    Chunk chunk_;
+    std::atomic<const SpecializedCode*> specialized_ = nullptr;
+    // Исполнения с начала профилирования
+    std::atomic<std::uint32_t> calls_ = 0;
+    std::atomic<std::uint32_t> specializations_ = 0;
+    // Все созданные варианты кода: их может исполнять другой поток и после отмены
+    std::vector<std::unique_ptr<SpecializedCode>> specialized_codes_;
+    std::mutex specialize_mutex_;
+    // Классы программы. Заполняется только у функции верхнего уровня, которая ими владеет
+    std::vector<runtime::ObjectHolder> classes_;
+};
+
+// Выводит в os байткод chunk в текстовом виде, по одной инструкции в строке
+void Disassemble(const Chunk& chunk, std::ostream& os);
+
+/*
+ * Компилирует дерево программы, полученное из ParseProgram, в байткод.
+ * Для классов программы создаются собственные объекты runtime::Class, методы которых
+ * тоже исполняются байткодом, поэтому исходное дерево остаётся нетронутым и может
+ * по-прежнему исполняться обходом дерева.
+ * Если в дереве встречается неизвестный узел, выбрасывается исключение CompileError
+ */
+std::unique_ptr<Function> Compile(const runtime::Executable& program);
+
+}  // namespace bytecode
@@ -0,0 +1,431 @@
+#include "bytecode.h"
+#include "lexer.h"
+#include "parse.h"
+#include "statement.h"
+#include "test_runner_p.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace bytecode {
+
+namespace {
+
+unique_ptr<runtime::Executable> ParseFromString(const string& program) {
+    istringstream is(program);
+    parse::Lexer lexer(is);
+    return ParseProgram(lexer);
+}
+
+string RunTree(const runtime::Executable& program) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    const_cast<runtime::Executable&>(program).Execute(closure, context);
+    return context.output.str();
+}
+
+string RunBytecode(const runtime::Executable& program) {
+    auto function = Compile(program);
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    function->Execute(closure, context);
+    return context.output.str();
+}
+
+// Возвращает функцию, которая исполняет метод method_name класса class_name программы program
+const Function& GetMethodFunction(const Function& program, const string& class_name,
+                                  const string& method_name) {
+    const auto& chunk = program.GetChunk();
+    for (const auto& instruction : chunk.code) {
+        if (instruction.op != OpCode::DefineClass) {
+            continue;
+        }
+        const auto* cls = chunk.constants.at(instruction.a).TryAs<runtime::Class>();
+        if (cls->GetName() == class_name) {
+            return static_cast<const Function&>(*cls->GetMethod(method_name)->body);
+        }
+    }
+    throw invalid_argument("Unknown class "s + class_name);
+}
+
+vector<OpCode> GetSpecializedOps(const Function& function) {
+    vector<OpCode> ops;
+    for (const auto& instruction : function.GetSpecializedCode()->code) {
+        ops.push_back(instruction.op);
+    }
+    return ops;
+}
+
+bool Contains(const vector<OpCode>& ops, OpCode op) {
+    return find(ops.begin(), ops.end(), op) != ops.end();
+}
+
+// Исполняет программу обоими способами и проверяет, что результаты совпадают с ожидаемым
+void AssertSameOutput(const string& program, const string& expected) {
+    auto tree = ParseFromString(program);
+    ASSERT_EQUAL(RunBytecode(*tree), expected);
+    ASSERT_EQUAL(RunTree(*tree), expected);
+}
+
+void TestArithmetics() {
+    AssertSameOutput("print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2, -3\n"s,
+                     "15 120 -13 3 15 -3\n"s);
+    AssertSameOutput("x = 'C++ ' + 'black belt'\nprint x, str(42), str(None)\n"s,
+                     "C++ black belt 42 None\n"s);
+}
+
+void TestLogicalOperations() {
+    const string program = R"(
+a = 1
+b = 0
+print a and b, a or b, not a, b or 'x', None or 0 and 1
+print 1 < 2, 2 > 1, 1 == 1, 1 != 1, 'a' <= 'b', 'b' >= 'c'
+)"s;
+    AssertSameOutput(program, "False True False True False\nTrue True True False True False\n"s);
+}
+
+void TestClassesAndMethods() {
+    const string program = R"(
+class Shape:
+  def __str__():
+    return "Shape"
+
+  def area():
+    return 0
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.w = w
+    self.h = h
+
+  def area():
+    return self.w * self.h
+
+  def __str__():
+    return "Rect(" + str(self.w) + 'x' + str(self.h) + ')'
+
+class Holder:
+  def __init__(shape):
+    self.shape = shape
+
+  def describe():
+    if self.shape.area() > 10:
+      return 'big ' + str(self.shape)
+    return 'small ' + str(self.shape)
+
+r = Rect(10, 20)
+s = Shape()
+print r, r.area(), s, s.area()
+h = Holder(r)
+print h.describe(), h.shape.w
+h.shape = Rect(1, 2)
+print h.describe()
+)"s;
+    AssertSameOutput(program, "Rect(10x20) 200 Shape 0\nbig Rect(10x20) 10\nsmall Rect(1x2)\n"s);
+}
+
+void TestRecursion() {
+    const string program = R"(
+class GCD:
+  def __init__():
+    self.call_count = 0
+
+  def calc(a, b):
+    self.call_count = self.call_count + 1
+    if a < b:
+      return self.calc(b, a)
+    if b == 0:
+      return a
+    return self.calc(a - b, b)
+
+x = GCD()
+print x.calc(510510, 18629977)
+print x.calc(22, 17)
+print x.call_count
+)"s;
+    AssertSameOutput(program, "17\n1\n115\n"s);
+}
+
+void TestSpecialMethods() {
+    const string program = R"(
+class Money:
+  def __init__(value):
+    self.value = value
+
+  def __add__(rhs):
+    return self.value + rhs.value
+
+  def __eq__(rhs):
+    return self.value == rhs.value
+
+  def __lt__(rhs):
+    return self.value < rhs.value
+
+  def __str__():
+    return str(self.value) + '$'
+
+a = Money(5)
+b = Money(7)
+print a + b, a == b, a < b, a > b, a <= b, a != b
+)"s;
+    AssertSameOutput(program, "12 False True False True True\n"s);
+}
+
+void TestSideEffectsInPrint() {
+    // Аргументы print выводятся по мере вычисления, поэтому вывод вызванного метода
+    // оказывается между ними
+    const string program = R"(
+class Noisy:
+  def f(n):
+    print 'inner', n
+    return n
+
+o = Noisy()
+print 'x', o.f(1), 'y', o.f(2)
+print
+)"s;
+    AssertSameOutput(program, "x inner 1\n1 y inner 2\n2\n\n"s);
+}
+
+void TestSideEffectsInNewInstance() {
+    // Аргументы конструктора вычисляются, только если вызывается __init__
+    const string program = R"(
+class Noisy:
+  def f(n):
+    print 'inner', n
+    return n
+
+class Plain:
+  def g():
+    return 0
+
+class Pair:
+  def __init__(a, b):
+    self.sum = a + b
+
+o = Noisy()
+p = Plain(o.f(1))
+q = Pair(o.f(2))
+r = Pair(o.f(3), o.f(4))
+print r.sum
+)"s;
+    AssertSameOutput(program, "inner 3\ninner 4\n7\n"s);
+}
+
+void TestRuntimeErrors() {
+    auto expect_error = [](const string& program) {
+        auto tree = ParseFromString(program);
+        ASSERT_THROWS(RunBytecode(*tree), std::runtime_error);
+    };
+    expect_error("print x\n"s);
+    expect_error("print 1 + 'a'\n"s);
+    expect_error("print 1 / 0\n"s);
+    expect_error("x = 1\nx.y = 2\n"s);
+    expect_error("class A:\n  def f():\n    return 1\na = A()\nprint a.g()\n"s);
+}
+
+void TestCompiledCode() {
+    auto tree = ParseFromString("x = 1 + 2\nprint x\n"s);
+    auto function = Compile(*tree);
+
+    vector<OpCode> ops;
+    for (const auto& instruction : function->GetChunk().code) {
+        ops.push_back(instruction.op);
+    }
+    // Каждая инструкция программы начинается с учёта шага исполнения
+    const vector<OpCode> expected = {OpCode::Step,     OpCode::LoadConst, OpCode::LoadConst,
+                                     OpCode::Add,      OpCode::StoreName, OpCode::Step,
+                                     OpCode::LoadName, OpCode::Print,     OpCode::PrintChar,
+                                     OpCode::LoadNone, OpCode::LoadNone,  OpCode::Return};
+    ASSERT(ops == expected);
+    ASSERT_EQUAL(function->GetChunk().names, (vector<runtime::Symbol>{"x"s}));
+
+    ostringstream listing;
+    Disassemble(function->GetChunk(), listing);
+    ASSERT(listing.str().find("StoreName"s) != string::npos);
+}
+
+void TestLocalVariables() {
+    const string program = R"(
+class Sum:
+  def calc(n):
+    result = 0
+    i = n
+    if i > 0:
+      result = i + self.calc(i - 1)
+    return result
+
+s = Sum()
+print s.calc(10)
+)"s;
+    auto tree = ParseFromString(program);
+    AssertSameOutput(program, "55\n"s);
+
+    auto function = Compile(*tree);
+    ASSERT(function->GetChunk().code.front().op == OpCode::Step);
+    const auto& define_class = function->GetChunk().code.at(1);
+    ASSERT(define_class.op == OpCode::DefineClass);
+    const auto* cls = function->GetChunk().constants.at(define_class.a).TryAs<runtime::Class>();
+    const auto& method = *cls->GetMethod("calc"s);
+    ASSERT_EQUAL(method.frame_size, 4U);
+
+    const auto& chunk = static_cast<const Function&>(*method.body).GetChunk();
+    ASSERT(chunk.uses_frame);
+    ASSERT(chunk.names == (vector<runtime::Symbol>{"calc"s}));
+}
+
+void TestUnsupportedStatement() {
+    struct Custom : runtime::Executable {
+        runtime::ObjectHolder Execute(runtime::Closure& /*closure*/,
+                                      runtime::Context& /*context*/) override {
+            return {};
+        }
+    };
+    ASSERT_THROWS(Compile(Custom{}), CompileError);
+}
+
+void TestLargeChunk() {
+    // Переход через тело условия, которое занимает больше 65535 инструкций
+    string program = "x = 0\nif True:\n"s;
+    for (int i = 0; i < 30000; ++i) {
+        program += "  x = x + 1\n"s;
+    }
+    program += "print x\n"s;
+    auto tree = ParseFromString(program);
+    ASSERT(Compile(*tree)->GetChunk().code.size() > numeric_limits<uint16_t>::max());
+    AssertSameOutput(program, "30000\n"s);
+}
+
+void TestSpecialization() {
+    const string program = R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+  def ratio(n, d):
+    return n / d
+
+f = Fib()
+print f.calc(16)
+)"s;
+    auto tree = ParseFromString(program);
+    AssertSameOutput(program, "987\n"s);
+
+    auto function = Compile(*tree);
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    function->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "987\n"s);
+
+    // Метод вызван больше HOT_THRESHOLD раз с числами и одним классом получателя
+    const Function& calc = GetMethodFunction(*function, "Fib"s, "calc"s);
+    ASSERT(calc.GetSpecializedCode() != nullptr);
+    ASSERT_EQUAL(calc.GetSpecializationCount(), 1U);
+    const auto ops = GetSpecializedOps(calc);
+    ASSERT(Contains(ops, OpCode::LessNumbers));
+    ASSERT(Contains(ops, OpCode::SubNumbers));
+    ASSERT(Contains(ops, OpCode::AddNumbers));
+    ASSERT(Contains(ops, OpCode::CallCached));
+    ASSERT(!Contains(ops, OpCode::Call));
+    ASSERT_EQUAL(calc.GetSpecializedCode()->code.size(), calc.GetChunk().code.size());
+
+    // Неисполнявшийся метод не специализируется
+    const Function& ratio = GetMethodFunction(*function, "Fib"s, "ratio"s);
+    ASSERT(ratio.GetSpecializedCode() == nullptr);
+    ASSERT_EQUAL(ratio.GetSpecializationCount(), 0U);
+
+    // Деление на ноль в специализированном коде сообщает об ошибке, как и исходная операция
+    auto divide = ParseFromString(R"(
+class Div:
+  def ratio(n, d):
+    return n / d
+
+  def run(n):
+    if n < 1:
+      return self.ratio(6, 3)
+    return self.run(n - 1) + self.run(n - 1)
+
+x = Div()
+print x.run(11)
+print x.ratio(1, 0)
+)"s);
+    auto divide_function = Compile(*divide);
+    runtime::DummyContext divide_context;
+    runtime::Closure divide_closure;
+    ASSERT_THROWS(divide_function->Execute(divide_closure, divide_context), runtime_error);
+    ASSERT_EQUAL(divide_context.output.str(), "4096\n"s);
+    const Function& divide_ratio = GetMethodFunction(*divide_function, "Div"s, "ratio"s);
+    ASSERT(Contains(GetSpecializedOps(divide_ratio), OpCode::DivNumbers));
+}
+
+void TestDeoptimization() {
+    const string program = R"(
+class Adder:
+  def add(a, b):
+    return a + b
+
+  def count(n):
+    if n < 1:
+      return self.add(1, 0)
+    return self.count(n - 1) + self.count(n - 1)
+
+class Doubler(Adder):
+  def add(a, b):
+    return a + a
+
+a = Adder()
+print a.count(11)
+print a.add('x', 'y')
+print a.count(11)
+d = Doubler()
+print d.count(3)
+)"s;
+    const string expected = "2048\nxy\n2048\n16\n"s;
+    auto tree = ParseFromString(program);
+    AssertSameOutput(program, expected);
+
+    auto function = Compile(*tree);
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    function->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), expected);
+
+    // Сложение строк отменило специализацию по числам, и после повторного профилирования
+    // сложение выполняется общей операцией
+    const Function& add = GetMethodFunction(*function, "Adder"s, "add"s);
+    ASSERT_EQUAL(add.GetSpecializationCount(), 2U);
+    ASSERT(add.GetSpecializedCode() != nullptr);
+    const auto add_ops = GetSpecializedOps(add);
+    ASSERT(Contains(add_ops, OpCode::Add));
+    ASSERT(!Contains(add_ops, OpCode::AddNumbers));
+
+    // Получатель другого класса не прошёл проверку вызова, и вызван метод Doubler
+    const Function& count = GetMethodFunction(*function, "Adder"s, "count"s);
+    ASSERT(count.GetSpecializedCode() == nullptr);
+    ASSERT(count.GetSpecializationCount() <= Function::MAX_SPECIALIZATIONS);
+}
+
+}  // namespace
+
+void RunBytecodeTests(TestRunner& tr) {
+    RUN_TEST(tr, bytecode::TestArithmetics);
+    RUN_TEST(tr, bytecode::TestLogicalOperations);
+    RUN_TEST(tr, bytecode::TestClassesAndMethods);
+    RUN_TEST(tr, bytecode::TestRecursion);
+    RUN_TEST(tr, bytecode::TestSpecialMethods);
+    RUN_TEST(tr, bytecode::TestSideEffectsInPrint);
+    RUN_TEST(tr, bytecode::TestSideEffectsInNewInstance);
+    RUN_TEST(tr, bytecode::TestRuntimeErrors);
+    RUN_TEST(tr, bytecode::TestCompiledCode);
+    RUN_TEST(tr, bytecode::TestLocalVariables);
+    RUN_TEST(tr, bytecode::TestUnsupportedStatement);
+    RUN_TEST(tr, bytecode::TestLargeChunk);
+    RUN_TEST(tr, bytecode::TestSpecialization);
+    RUN_TEST(tr, bytecode::TestDeoptimization);
+}
+
+}  // namespace bytecode
@@ -0,0 +1,198 @@
+#include "collector.h"
+
+#include "runtime.h"
+
+#include <algorithm>
+#include <ostream>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+using Clock = chrono::steady_clock;
+}  // namespace
+
+CycleCollector& CycleCollector::Current() {
+    // Деструктор сборщика тривиален, поэтому экземпляры, удаляемые после завершения потока,
+    // например статические объекты, не обращаются к уничтоженному сборщику
+    thread_local CycleCollector collector;
+    return collector;
+}
+
+CycleCollector::CycleCollector() {
+    young_.prev_ = young_.next_ = &young_;
+    old_.prev_ = old_.next_ = &old_;
+}
+
+CycleCollector::Stats CycleCollector::GetStats() const {
+    return stats_;
+}
+
+void CycleCollector::Track(ClassInstance& object) {
+    if (options_.young_threshold > 0 && ++allocations_ >= options_.young_threshold
+        && !collecting_) {
+        const bool full = options_.full_collection_interval > 0
+                          && ++automatic_collections_ % options_.full_collection_interval == 0;
+        Collect(full);
+    }
+    Node& node = object;
+    node.prev_ = young_.prev_;
+    node.next_ = &young_;
+    young_.prev_->next_ = &node;
+    young_.prev_ = &node;
+    node.old_ = false;
+    ++stats_.heap_objects;
+    ++stats_.young_objects;
+}
+
+void CycleCollector::Untrack(ClassInstance& object) {
+    Node& node = object;
+    node.prev_->next_ = node.next_;
+    node.next_->prev_ = node.prev_;
+    node.prev_ = node.next_ = nullptr;
+    --stats_.heap_objects;
+    if (!node.old_) {
+        --stats_.young_objects;
+    }
+}
+
+size_t CycleCollector::Collect(bool full) {
+    if (collecting_) {
+        return 0;
+    }
+    collecting_ = true;
+    const auto start = Clock::now();
+
+    // При полной сборке молодое поколение сразу присоединяется к старому
+    Node& head = full ? old_ : young_;
+    if (full) {
+        Splice(old_, young_);
+    }
+    vector<ClassInstance*> objects;
+    objects.reserve(full ? stats_.heap_objects : stats_.young_objects);
+    for (Node* node = head.next_; node != &head; node = node->next_) {
+        objects.push_back(static_cast<ClassInstance*>(node));
+    }
+
+    // Экземпляр, которым не владеет ни одна ссылка, размещён не в куче либо ещё создаётся,
+    // поэтому всегда достижим
+    for (ClassInstance* object : objects) {
+        Node& node = *object;
+        node.gc_refs_ = max(object->ref_count_, uint32_t{1});
+        node.reachable_ = false;
+    }
+    const auto owned_child = [full](const ObjectHolder& value) -> ClassInstance* {
+        if (!value.IsOwning() || value.GetKind() != ObjectKind::ClassInstance) {
+            return nullptr;
+        }
+        auto* child = static_cast<ClassInstance*>(value.Get());  // NOLINT
+        return full || !static_cast<const Node&>(*child).old_ ? child : nullptr;
+    };
+    for (ClassInstance* object : objects) {
+        const FieldTable& fields = object->Fields();
+        for (size_t index = 0; index < fields.GetSize(); ++index) {
+            if (ClassInstance* child = owned_child(fields.At(index))) {
+                --static_cast<Node&>(*child).gc_refs_;
+            }
+        }
+    }
+
+    vector<ClassInstance*> pending;
+    for (ClassInstance* object : objects) {
+        Node& node = *object;
+        if (node.gc_refs_ > 0) {
+            node.reachable_ = true;
+            pending.push_back(object);
+        }
+    }
+    // Адреса просматриваемых объектов нужны, только если встретятся невладеющие ссылки
+    unordered_set<const Object*> members;
+    while (!pending.empty()) {
+        const ClassInstance* object = pending.back();
+        pending.pop_back();
+        const FieldTable& fields = object->Fields();
+        for (size_t index = 0; index < fields.GetSize(); ++index) {
+            const ObjectHolder& value = fields.At(index);
+            ClassInstance* child = owned_child(value);
+            if (child == nullptr && value.IsShared()) {
+                if (members.empty()) {
+                    members.insert(objects.begin(), objects.end());
+                }
+                // Невладеющая ссылка может указывать на уже удалённый объект, поэтому
+                // объект по ней не читается, пока не найден среди просматриваемых
+                if (members.count(value.Get()) > 0) {
+                    child = static_cast<ClassInstance*>(value.Get());  // NOLINT
+                }
+            }
+            if (child != nullptr) {
+                Node& node = *child;
+                if (!node.reachable_) {
+                    node.reachable_ = true;
+                    pending.push_back(child);
+                }
+            }
+        }
+    }
+
+    // Пережившие сборку объекты переходят в старое поколение
+    for (ClassInstance* object : objects) {
+        static_cast<Node&>(*object).old_ = true;
+    }
+    if (!full) {
+        Splice(old_, young_);
+    }
+    stats_.young_objects = 0;
+    vector<ObjectRef> garbage;
+    for (ClassInstance* object : objects) {
+        if (!static_cast<Node&>(*object).reachable_) {
+            garbage.emplace_back(object);
+        }
+    }
+    // Очистка полей разрывает циклы, а удаление последних ссылок освобождает объекты.
+    // Мусор может пережить программу, создавшую его классы, поэтому формы не читаются
+    for (const ObjectRef& object : garbage) {
+        static_cast<ClassInstance*>(object.Get())->Fields().ReleaseValues();  // NOLINT
+    }
+    const size_t collected = garbage.size();
+    garbage.clear();
+
+    const Duration pause = Clock::now() - start;
+    ++stats_.collections;
+    stats_.full_collections += full ? 1 : 0;
+    stats_.collected_objects += collected;
+    stats_.total_pause += pause;
+    stats_.max_pause = max(stats_.max_pause, pause);
+    stats_.last_pause = pause;
+    allocations_ = 0;
+    collecting_ = false;
+    return collected;
+}
+
+void CycleCollector::PrintStats(ostream& os) const {
+    const auto to_milliseconds = [](Duration duration) {
+        return chrono::duration<double, milli>(duration).count();
+    };
+    os << "Heap objects: "sv << stats_.heap_objects << " ("sv << stats_.young_objects
+       << " young)\n"sv;
+    os << "Collections: "sv << stats_.collections << " ("sv << stats_.full_collections
+       << " full), collected objects: "sv << stats_.collected_objects << '\n';
+    os << "Pause ms: total "sv << to_milliseconds(stats_.total_pause) << ", max "sv
+       << to_milliseconds(stats_.max_pause) << ", last "sv << to_milliseconds(stats_.last_pause)
+       << '\n';
+}
+
+void CycleCollector::Splice(Node& to, Node& from) {
+    if (from.next_ == &from) {
+        return;
+    }
+    from.next_->prev_ = to.prev_;
+    to.prev_->next_ = from.next_;
+    from.prev_->next_ = &to;
+    to.prev_ = from.prev_;
+    from.prev_ = from.next_ = &from;
+}
+
+}  // namespace runtime
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+namespace runtime {
+
+class ClassInstance;
+
+/*
+ * Сборщик циклического мусора. Объекты Mython удаляются по счётчику ссылок, но экземпляры
+ * классов, ссылающиеся друг на друга через поля, образуют циклы, которые счётчик не
+ * освобождает. Сборщик отслеживает все экземпляры классов потока и находит среди них
+ * недостижимые: у каждого объекта из счётчика ссылок вычитаются ссылки из полей других
+ * отслеживаемых объектов. Объект с оставшимися ссылками достижим извне - из переменных,
+ * кадров методов или кода интерпретатора, - как и всё, что достижимо из него через поля.
+ * Прочие объекты - мусор: сборщик очищает их поля, и циклы удаляются счётчиком ссылок.
+ * Поэтому корни перечислять не нужно, а сборку можно запускать в любой момент исполнения.
+ *
+ * Отслеживаемые объекты делятся на два поколения. Новые экземпляры попадают в молодое
+ * поколение, а пережившие сборку переходят в старое, которое просматривается реже. Ссылки из
+ * старого поколения на молодое при сборке молодого поколения считаются внешними.
+ * Невладеющая ссылка на объект (см. ObjectHolder::Share) не препятствует его удалению
+ * счётчиком ссылок, но сборщик не удаляет мусор, на который она указывает из достижимого
+ * объекта, чтобы не сделать её недействительной.
+ *
+ * Сборщик свой у каждого потока: экземпляр класса должен удаляться потоком, который его создал
+ */
+class CycleCollector {
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    struct Options {
+        // Молодое поколение собирается, когда с прошлой сборки создано столько экземпляров.
+        // При нуле сборка запускается только вызовом Collect
+        std::size_t young_threshold = 1000;
+        // Каждая full_collection_interval-я автоматическая сборка просматривает и старое
+        // поколение
+        std::size_t full_collection_interval = 10;
+    };
+
+    struct Stats {
+        // Количество отслеживаемых экземпляров классов, в том числе в молодом поколении
+        std::size_t heap_objects = 0;
+        std::size_t young_objects = 0;
+        std::uint64_t collections = 0;
+        std::uint64_t full_collections = 0;
+        // Количество удалённых сборщиком объектов
+        std::uint64_t collected_objects = 0;
+        Duration total_pause{0};
+        Duration max_pause{0};
+        Duration last_pause{0};
+    };
+
+    // Узел списка отслеживаемых объектов, встроенный в экземпляр класса
+    class Node {
+    public:
+        Node() = default;
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
+
+    private:
+        friend class CycleCollector;
+
+        Node* prev_ = nullptr;
+        Node* next_ = nullptr;
+        // Ссылки на объект извне просматриваемого поколения
+        std::uint32_t gc_refs_ = 0;
+        bool old_ = false;
+        bool reachable_ = false;
+    };
+
+    // Возвращает сборщик текущего потока
+    [[nodiscard]] static CycleCollector& Current();
+
+    CycleCollector(const CycleCollector&) = delete;
+    CycleCollector& operator=(const CycleCollector&) = delete;
+
+    void SetOptions(const Options& options) {
+        options_ = options;
+    }
+
+    [[nodiscard]] const Options& GetOptions() const {
+        return options_;
+    }
+
+    [[nodiscard]] Stats GetStats() const;
+
+    // Удаляет недостижимые объекты молодого поколения либо, если full, обоих поколений.
+    // Возвращает количество удалённых объектов
+    std::size_t Collect(bool full = true);
+
+    // Выводит статистику в os
+    void PrintStats(std::ostream& os) const;
+
+private:
+    friend class ClassInstance;
+
+    CycleCollector();
+
+    // Вызываются конструктором и деструктором экземпляра класса
+    void Track(ClassInstance& object);
+    void Untrack(ClassInstance& object);
+
+    // Переносит все узлы списка from в конец списка to
+    static void Splice(Node& to, Node& from);
+
+    Options options_;
+    Stats stats_;
+    // Кольцевые списки поколений с фиктивными узлами в начале
+    Node young_;
+    Node old_;
+    // Количество экземпляров, созданных после последней сборки
+    std::size_t allocations_ = 0;
+    std::size_t automatic_collections_ = 0;
+    bool collecting_ = false;
+};
+
+}  // namespace runtime
@@ -0,0 +1,214 @@
+#include "collector.h"
+#include "program.h"
+#include "runtime.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+// Задаёт настройки сборщика текущего потока на время своего существования
+class OptionsScope {
+public:
+    explicit OptionsScope(const CycleCollector::Options& options)
+        : saved_(CycleCollector::Current().GetOptions()) {
+        CycleCollector::Current().SetOptions(options);
+    }
+
+    ~OptionsScope() {
+        CycleCollector::Current().SetOptions(saved_);
+    }
+
+    OptionsScope(const OptionsScope&) = delete;
+    OptionsScope& operator=(const OptionsScope&) = delete;
+
+private:
+    CycleCollector::Options saved_;
+};
+
+// Без автоматической сборки результат каждого вызова Collect известен заранее
+const CycleCollector::Options MANUAL{0, 0};
+
+FieldTable& FieldsOf(const ObjectHolder& object) {
+    return object.TryAs<ClassInstance>()->Fields();
+}
+
+void TestCollectsCycles() {
+    OptionsScope scope(MANUAL);
+    CycleCollector& collector = CycleCollector::Current();
+    collector.Collect();
+    const auto before = collector.GetStats();
+
+    Class cls("Node"s, {}, nullptr);
+    {
+        auto a = ObjectHolder::Make<ClassInstance>(cls);
+        auto b = ObjectHolder::Make<ClassInstance>(cls);
+        FieldsOf(a)["peer"s] = b;
+        FieldsOf(b)["peer"s] = a;
+        ASSERT_EQUAL(collector.GetStats().heap_objects, before.heap_objects + 2);
+        ASSERT_EQUAL(collector.Collect(), 0U);
+    }
+    // Счётчик ссылок не освобождает цикл
+    ASSERT_EQUAL(collector.GetStats().heap_objects, before.heap_objects + 2);
+    ASSERT_EQUAL(collector.Collect(), 2U);
+
+    const auto after = collector.GetStats();
+    ASSERT_EQUAL(after.heap_objects, before.heap_objects);
+    ASSERT_EQUAL(after.collected_objects, before.collected_objects + 2);
+    ASSERT_EQUAL(after.collections, before.collections + 2);
+    ASSERT_EQUAL(after.full_collections, before.full_collections + 2);
+    ASSERT(after.max_pause >= after.last_pause);
+    ASSERT(after.total_pause >= before.total_pause + after.last_pause);
+
+    // Объект, ссылающийся сам на себя, тоже образует цикл
+    auto self = ObjectHolder::Make<ClassInstance>(cls);
+    FieldsOf(self)["me"s] = self;
+    self = ObjectHolder::None();
+    ASSERT_EQUAL(collector.Collect(), 1U);
+}
+
+void TestKeepsReachableObjects() {
+    OptionsScope scope(MANUAL);
+    CycleCollector& collector = CycleCollector::Current();
+    collector.Collect();
+
+    Class cls("Node"s, {}, nullptr);
+    auto root = ObjectHolder::Make<ClassInstance>(cls);
+    {
+        auto a = ObjectHolder::Make<ClassInstance>(cls);
+        auto b = ObjectHolder::Make<ClassInstance>(cls);
+        FieldsOf(root)["child"s] = a;
+        FieldsOf(a)["peer"s] = b;
+        FieldsOf(b)["peer"s] = a;
+        FieldsOf(b)["value"s] = ObjectHolder::Own(String("kept"s));
+    }
+    // Цикл достижим из root
+    ASSERT_EQUAL(collector.Collect(), 0U);
+    const auto* b = FieldsOf(*FieldsOf(root).Find("child"s)).Find("peer"s);
+    ASSERT_EQUAL(FieldsOf(*b).Find("value"s)->TryAs<String>()->GetValue(), "kept"s);
+
+    // Экземпляр вне кучи всегда достижим вместе с объектами, на которые он ссылается
+    ClassInstance local(cls);
+    local.Fields()["child"s] = *FieldsOf(root).Find("child"s);
+    root = ObjectHolder::None();
+    ASSERT_EQUAL(collector.Collect(), 0U);
+
+    local.Fields().Clear();
+    ASSERT_EQUAL(collector.Collect(), 2U);
+}
+
+void TestGenerations() {
+    OptionsScope scope(MANUAL);
+    CycleCollector& collector = CycleCollector::Current();
+    collector.Collect();
+    const size_t heap = collector.GetStats().heap_objects;
+
+    Class cls("Node"s, {}, nullptr);
+    auto old = ObjectHolder::Make<ClassInstance>(cls);
+    ASSERT_EQUAL(collector.GetStats().young_objects, 1U);
+    // Переживший сборку объект переходит в старое поколение
+    ASSERT_EQUAL(collector.Collect(false), 0U);
+    ASSERT_EQUAL(collector.GetStats().young_objects, 0U);
+    ASSERT_EQUAL(collector.GetStats().heap_objects, heap + 1);
+
+    // Цикл между поколениями: ссылка из старого поколения считается внешней для молодого
+    auto young = ObjectHolder::Make<ClassInstance>(cls);
+    FieldsOf(old)["peer"s] = young;
+    FieldsOf(young)["peer"s] = old;
+    old = ObjectHolder::None();
+    young = ObjectHolder::None();
+    ASSERT_EQUAL(collector.Collect(false), 0U);
+    ASSERT_EQUAL(collector.Collect(false), 0U);
+    ASSERT_EQUAL(collector.Collect(true), 2U);
+    ASSERT_EQUAL(collector.GetStats().heap_objects, heap);
+}
+
+void TestSharedReferences() {
+    OptionsScope scope(MANUAL);
+    CycleCollector& collector = CycleCollector::Current();
+    collector.Collect();
+
+    Class cls("Node"s, {}, nullptr);
+    auto owner = ObjectHolder::Make<ClassInstance>(cls);
+    {
+        auto a = ObjectHolder::Make<ClassInstance>(cls);
+        auto b = ObjectHolder::Make<ClassInstance>(cls);
+        FieldsOf(a)["peer"s] = b;
+        FieldsOf(b)["peer"s] = a;
+        // Так поле получает значение self в методе Mython
+        FieldsOf(owner)["peer"s] = ObjectHolder::Share(*a);
+    }
+    // Сборщик не делает недействительной невладеющую ссылку из достижимого объекта
+    ASSERT_EQUAL(collector.Collect(), 0U);
+    ASSERT(FieldsOf(*FieldsOf(owner).Find("peer"s)).Find("peer"s) != nullptr);
+
+    owner = ObjectHolder::None();
+    ASSERT_EQUAL(collector.Collect(), 2U);
+}
+
+void TestAutomaticCollection() {
+    const string program_text = R"(
+class Node:
+  def link(other):
+    self.peer = other
+
+class Maker:
+  def make(n):
+    if n < 2:
+      a = Node()
+      b = Node()
+      a.link(b)
+      b.link(a)
+      return 1
+    return self.make(n - 1) + self.make(n - 2)
+
+m = Maker()
+print m.make(15)
+)"s;
+    constexpr size_t THRESHOLD = 50;
+    OptionsScope scope({THRESHOLD, 2});
+    CycleCollector& collector = CycleCollector::Current();
+
+    for (const auto backend : {mython::Backend::Tree, mython::Backend::Bytecode}) {
+        collector.Collect();
+        const auto before = collector.GetStats();
+
+        DummyContext context;
+        mython::Program::Compile(program_text, {backend}).Run(context);
+        ASSERT_EQUAL(context.output.str(), "987\n"s);
+
+        // Программа создаёт 987 циклов, но куча не растёт сверх бюджета молодого поколения
+        const auto after = collector.GetStats();
+        ASSERT(after.collections > before.collections);
+        ASSERT(after.full_collections > before.full_collections);
+        ASSERT(after.collected_objects > before.collected_objects + 1800);
+        ASSERT(after.heap_objects < before.heap_objects + 4 * THRESHOLD);
+
+        collector.Collect();
+        ASSERT_EQUAL(collector.GetStats().heap_objects, before.heap_objects);
+    }
+}
+
+void TestPrintStats() {
+    ostringstream os;
+    CycleCollector::Current().PrintStats(os);
+    ASSERT(os.str().find("Heap objects: "s) != string::npos);
+    ASSERT(os.str().find("Collections: "s) != string::npos);
+}
+
+}  // namespace
+
+void RunCollectorTests(TestRunner& tr) {
+    RUN_TEST(tr, runtime::TestCollectsCycles);
+    RUN_TEST(tr, runtime::TestKeepsReachableObjects);
+    RUN_TEST(tr, runtime::TestGenerations);
+    RUN_TEST(tr, runtime::TestSharedReferences);
+    RUN_TEST(tr, runtime::TestAutomaticCollection);
+    RUN_TEST(tr, runtime::TestPrintStats);
+}
+
+}  // namespace runtime
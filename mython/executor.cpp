@@ -0,0 +1,114 @@
+#include "executor.h"
+
+using namespace std;
+
+namespace mython {
+
+Executor::Executor(size_t thread_count) {
+    thread_count = max<size_t>(thread_count, 1);
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.push_back(make_unique<Worker>());
+    }
+    threads_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back([this, i] {
+            WorkerLoop(i);
+        });
+    }
+}
+
+Executor::~Executor() {
+    {
+        lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+future<string> Executor::Submit(Program program, runtime::Limits limits) {
+    Job job{std::move(program), limits, {}};
+    auto result = job.result.get_future();
+
+    size_t index = 0;
+    {
+        lock_guard lock(mutex_);
+        index = next_worker_++ % workers_.size();
+    }
+    {
+        Worker& worker = *workers_[index];
+        lock_guard lock(worker.mutex);
+        worker.jobs.push_back(std::move(job));
+    }
+    // Счётчик увеличивается после добавления задания в очередь, поэтому поток, закрепивший
+    // за собой задание, всегда найдёт его в одной из очередей
+    {
+        lock_guard lock(mutex_);
+        ++pending_;
+    }
+    wake_.notify_one();
+    return result;
+}
+
+size_t Executor::GetThreadCount() const {
+    return threads_.size();
+}
+
+optional<Executor::Job> Executor::TryTake(size_t index) {
+    {
+        Worker& own = *workers_[index];
+        lock_guard lock(own.mutex);
+        if (!own.jobs.empty()) {
+            Job job = std::move(own.jobs.front());
+            own.jobs.pop_front();
+            return job;
+        }
+    }
+    for (size_t offset = 1; offset < workers_.size(); ++offset) {
+        Worker& victim = *workers_[(index + offset) % workers_.size()];
+        lock_guard lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            Job job = std::move(victim.jobs.back());
+            victim.jobs.pop_back();
+            return job;
+        }
+    }
+    return nullopt;
+}
+
+void Executor::WorkerLoop(size_t index) {
+    for (;;) {
+        {
+            unique_lock lock(mutex_);
+            wake_.wait(lock, [this] {
+                return pending_ > 0 || stopping_;
+            });
+            if (pending_ == 0) {
+                return;
+            }
+            --pending_;
+        }
+
+        optional<Job> job = TryTake(index);
+        while (!job) {
+            job = TryTake(index);
+        }
+
+        try {
+            // Вывод накапливается в буфере контекста и передаётся в future без копирования
+            runtime::BufferedContext context;
+            context.SetLimits(job->limits);
+            job->program.Run(context);
+            job->result.set_value(context.TakeOutput());
+        } catch (...) {
+            job->result.set_exception(current_exception());
+        }
+        // Циклы из объектов завершённой программы освобождаются до следующего задания
+        runtime::CycleCollector::Current().Collect();
+    }
+}
+
+}  // namespace mython
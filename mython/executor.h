@@ -0,0 +1,74 @@
+#pragma once
+
+#include "program.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mython {
+
+/*
+ * Пул потоков, одновременно исполняющий независимые запуски скомпилированных программ.
+ * У каждого рабочего потока своя очередь заданий: новые задания распределяются по очередям
+ * по кругу, поток берёт задания из начала своей очереди, а освободившись, забирает задания
+ * с конца чужих очередей. Так долгие программы не задерживают короткие, попавшие в ту же
+ * очередь.
+ * Каждое исполнение получает собственные контекст и буфер вывода, а объекты Mython
+ * выделяются из пулов текущего потока, поэтому рабочие потоки не разделяют изменяемого
+ * состояния, кроме самих очередей
+ */
+class Executor {
+public:
+    // Создаёт пул из thread_count рабочих потоков (не меньше одного)
+    explicit Executor(std::size_t thread_count = std::thread::hardware_concurrency());
+    // Дожидается исполнения всех поставленных в очередь заданий и останавливает потоки
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    /*
+     * Ставит в очередь исполнение программы с ограничениями ресурсов limits. Результат
+     * future - вывод программы. Если исполнение завершилось исключением, например
+     * runtime::LimitExceeded, оно передаётся через future
+     */
+    [[nodiscard]] std::future<std::string> Submit(Program program, runtime::Limits limits = {});
+
+    [[nodiscard]] std::size_t GetThreadCount() const;
+
+private:
+    struct Job {
+        Program program;
+        runtime::Limits limits;
+        std::promise<std::string> result;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void WorkerLoop(std::size_t index);
+    // Извлекает задание из очереди потока index либо из очереди другого потока
+    std::optional<Job> TryTake(std::size_t index);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    // Количество заданий в очередях, ещё не закреплённых за рабочими потоками
+    std::size_t pending_ = 0;
+    std::size_t next_worker_ = 0;
+    bool stopping_ = false;
+};
+
+}  // namespace mython
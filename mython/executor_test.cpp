@@ -0,0 +1,103 @@
+#include "executor.h"
+#include "test_runner_p.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace mython {
+
+namespace {
+
+// Программа, время исполнения которой растёт вместе с depth
+string MakeCountdown(int depth, int tag) {
+    return R"(
+class Countdown:
+  def run(n):
+    if n == 0:
+      return 0
+    return 1 + self.run(n - 1)
+
+c = Countdown()
+print )"s + to_string(tag) + ", c.run("s + to_string(depth) + ")\n"s;
+}
+
+void TestResultsMatchSubmissions() {
+    Executor executor(4);
+    ASSERT_EQUAL(executor.GetThreadCount(), 4U);
+
+    // Длинные и короткие программы чередуются, чтобы потокам приходилось забирать чужие задания
+    vector<future<string>> results;
+    for (int i = 0; i < 40; ++i) {
+        const int depth = i % 5 == 0 ? 300 : 1;
+        const auto options = i % 2 == 0 ? CompileOptions{} : CompileOptions{Backend::Bytecode};
+        results.push_back(executor.Submit(Program::Compile(MakeCountdown(depth, i), options)));
+    }
+    for (int i = 0; i < 40; ++i) {
+        const int depth = i % 5 == 0 ? 300 : 1;
+        ASSERT_EQUAL(results[i].get(), to_string(i) + " "s + to_string(depth) + "\n"s);
+    }
+}
+
+void TestSharedProgram() {
+    const auto program = Program::Compile(R"(
+class Box:
+  def __init__(v):
+    self.v = v
+
+b = Box(1)
+b.v = b.v + 1
+print b.v
+)"s);
+    Executor executor(3);
+    vector<future<string>> results;
+    for (int i = 0; i < 30; ++i) {
+        results.push_back(executor.Submit(program));
+    }
+    for (auto& result : results) {
+        ASSERT_EQUAL(result.get(), "2\n"s);
+    }
+}
+
+void TestErrorsArePropagated() {
+    Executor executor(2);
+    auto failed = executor.Submit(Program::Compile("print 1\nprint 1 / 0\n"s));
+    auto succeeded = executor.Submit(Program::Compile("print 2\n"s));
+    ASSERT_THROWS(failed.get(), runtime_error);
+    ASSERT_EQUAL(succeeded.get(), "2\n"s);
+}
+
+void TestLimitsPerJob() {
+    Executor executor(2);
+    runtime::Limits limits;
+    limits.max_steps = 100;
+    auto runaway = executor.Submit(Program::Compile(MakeCountdown(300, 1)), limits);
+    auto unlimited = executor.Submit(Program::Compile(MakeCountdown(300, 2)));
+    ASSERT_THROWS(runaway.get(), runtime::LimitExceeded);
+    ASSERT_EQUAL(unlimited.get(), "2 300\n"s);
+}
+
+void TestDestructorDrainsQueue() {
+    vector<future<string>> results;
+    {
+        Executor executor(1);
+        for (int i = 0; i < 10; ++i) {
+            results.push_back(executor.Submit(Program::Compile(MakeCountdown(50, i))));
+        }
+    }
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQUAL(results[i].get(), to_string(i) + " 50\n"s);
+    }
+}
+
+}  // namespace
+
+void RunExecutorTests(TestRunner& tr) {
+    RUN_TEST(tr, mython::TestResultsMatchSubmissions);
+    RUN_TEST(tr, mython::TestSharedProgram);
+    RUN_TEST(tr, mython::TestErrorsArePropagated);
+    RUN_TEST(tr, mython::TestLimitsPerJob);
+    RUN_TEST(tr, mython::TestDestructorDrainsQueue);
+}
+
+}  // namespace mython
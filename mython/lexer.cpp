@@ -1,8 +1,16 @@
 #include "lexer.h"
 
+#include "metrics.h"
+
 #include <algorithm>
+#include <cctype>
 #include <charconv>
-#include <cassert>
+#include <iterator>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -75,8 +83,50 @@ std::ostream& operator<<(std::ostream& os, const Token& rhs) {
     return os << "Unknown token :("sv;
 }
 
+MappedSource::MappedSource(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file "s + path);
+    }
+    struct stat info {};
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot read file "s + path);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ > 0) {
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data_ == MAP_FAILED) {
+            data_ = nullptr;
+            close(fd);
+            throw std::runtime_error("Cannot map file "s + path);
+        }
+    }
+    close(fd);
+}
+
+MappedSource::~MappedSource() {
+    if (data_) {
+        munmap(data_, size_);
+    }
+}
+
+std::string_view MappedSource::GetText() const {
+    return {static_cast<const char*>(data_), size_};
+}
+
 Lexer::Lexer(std::istream& input)
-    : input_(input) {
+    : input_(&input) {
+    LoadNextToken();
+}
+
+Lexer::Lexer(std::string_view source, std::uint32_t base_offset)
+    : pos_(source.data()),
+      end_(source.data() + source.size()),
+      buffer_begin_(source.data()),
+      buffer_offset_(base_offset),
+      token_offset_(base_offset),
+      source_map_(source, {}, base_offset) {
     LoadNextToken();
 }
 
@@ -89,18 +139,49 @@ Token Lexer::NextToken() {
     return current_token_;
 }
 
+bool Lexer::Fill() {
+    if (pos_ != end_) {
+        return true;
+    }
+    if (!input_) {
+        return false;
+    }
+    const auto line_start = buffer_offset_ + static_cast<uint32_t>(line_.size());
+    if (!std::getline(*input_, line_)) {
+        return false;
+    }
+    buffer_offset_ = line_start;
+    source_map_.AddLine(line_start);
+    // Символ конца строки сохраняется, если он был в потоке
+    if (!input_->eof()) {
+        line_ += '\n';
+    }
+    pos_ = line_.data();
+    end_ = line_.data() + line_.size();
+    buffer_begin_ = pos_;
+    return pos_ != end_ || Fill();
+}
+
+std::optional<char> Lexer::PeekChar() {
+    if (!Fill()) {
+        return std::nullopt;
+    }
+    return *pos_;
+}
+
 void Lexer::PassString() {
-    std::string s;
-    std::getline(input_, s);
+    if (Fill()) {
+        const char* line_end = std::find(pos_, end_, '\n');
+        pos_ = line_end == end_ ? end_ : line_end + 1;
+    }
     begin_ = true;
     indents_ = 0;
 }
 
 void Lexer::PassComment() {
-    char c;
-    while (input_.get(c)) {
-        if (c == '\n') {
-            input_.putback(c);
+    while (Fill()) {
+        pos_ = std::find(pos_, end_, '\n');
+        if (pos_ != end_) {
             break;
         }
     }
@@ -108,80 +189,104 @@ void Lexer::PassComment() {
 
 void Lexer::CountSpaces() {
     size_t spaces_amount = 0;
-    char c;
-    while (input_.get(c)) {
-        if (c == ' ') {
-            ++spaces_amount;
-        } else {
-            input_.putback(c);
-            break;
-        }
+    while (Fill() && *pos_ == ' ') {
+        const char* spaces_end = std::find_if(pos_, end_, [](char c) { return c != ' '; });
+        spaces_amount += spaces_end - pos_;
+        pos_ = spaces_end;
     }
     if (begin_) {
         indents_ = spaces_amount / 2;
     }
 }
 
-int Lexer::ParseNumber(std::istream &input) {
-    std::string number;
-    char c;
-    while(input.get(c)) {
-        if (std::isdigit(c)) {
-            number += c;
-        } else {
-            input.putback(c);
-            break;
-        }
+int Lexer::ParseNumber() {
+    const char* number_end
+        = std::find_if(pos_, end_, [](unsigned char c) { return std::isdigit(c) == 0; });
+    int number = 0;
+    const auto [ptr, error] = std::from_chars(pos_, number_end, number);
+    if (error != std::errc()) {
+        throw LexerError("Number is out of range: "s + std::string(pos_, number_end));
     }
-    return std::stoi(number);
+    pos_ = ptr;
+    return number;
 }
 
-std::string Lexer::ParseName(std::istream &input) {
-    std::string line;
-    char c;
-    while (input.get(c)) {
-        if (std::isalnum(c) || c == '_') {
-            line += c;
-        } else {
-            input.putback(c);
-            break;
-        }
+std::string_view Lexer::ParseName() {
+    const char* name_end = std::find_if(pos_, end_, [](unsigned char c) {
+        return std::isalnum(c) == 0 && c != '_';
+    });
+    std::string_view name(pos_, name_end - pos_);
+    pos_ = name_end;
+    return name;
+}
+
+Token Lexer::NameToken(runtime::Symbol name) {
+    using runtime::PredefinedSymbol;
+
+    // Ключевые слова интернируются первыми, поэтому распознаются по номеру символа
+    switch (static_cast<PredefinedSymbol>(name.GetId())) {
+        case PredefinedSymbol::Class: return token_type::Class{};
+        case PredefinedSymbol::Return: return token_type::Return{};
+        case PredefinedSymbol::If: return token_type::If{};
+        case PredefinedSymbol::Else: return token_type::Else{};
+        case PredefinedSymbol::Def: return token_type::Def{};
+        case PredefinedSymbol::Print: return token_type::Print{};
+        case PredefinedSymbol::And: return token_type::And{};
+        case PredefinedSymbol::Or: return token_type::Or{};
+        case PredefinedSymbol::Not: return token_type::Not{};
+        case PredefinedSymbol::None: return token_type::None{};
+        case PredefinedSymbol::True: return token_type::True{};
+        case PredefinedSymbol::False: return token_type::False{};
+        default: return token_type::Id{name};
     }
-    return line;
 }
 
-std::string Lexer::ParseString(std::istream& input) {
+std::string Lexer::ParseString() {
     std::string line;
-    char start = input.get();
-    char c;
-    while (input.get(c)) {
-        if (c == '\\') {
-            char next;
-            input.get(next);
-            if (next == '\"') {
-                line += '\"';
-            } else if (next == '\'') {
-                line += '\'';
-            } else if (next == 'n') {
-                line += '\n';
-            } else if (next == 't') {
-                line += '\t';
-            }
-        } else {
-            if (c == start) {
-                break;
-            }
-            line += c;
+    const char start = *pos_++;
+    const char specials[] = {start, '\\'};
+    for (;;) {
+        if (!Fill()) {
+            throw LexerError("Unterminated string literal"s);
+        }
+        // Символы между escape-последовательностями копируются одним блоком
+        const char* run_end = std::find_first_of(pos_, end_, std::begin(specials),
+                                                 std::end(specials));
+        line.append(pos_, run_end);
+        pos_ = run_end;
+        if (pos_ == end_) {
+            continue;
+        }
+        if (*pos_++ == start) {
+            return line;
+        }
+        if (!Fill()) {
+            throw LexerError("Unterminated string literal"s);
+        }
+        const char next = *pos_++;
+        if (next == '\"') {
+            line += '\"';
+        } else if (next == '\'') {
+            line += '\'';
+        } else if (next == 'n') {
+            line += '\n';
+        } else if (next == 't') {
+            line += '\t';
         }
     }
-    assert(c == start);
-    return line;
+}
+
+LexerError Lexer::UnexpectedToken() const {
+    std::ostringstream message;
+    message << "Unexpected token "s << current_token_;
+    return LexerError(message.str());
 }
 
 void Lexer::LoadNextToken() {
-    char ch = input_.peek();
+    const std::optional<char> next = PeekChar();
+    token_offset_ = Offset();
 
-    if (ch == std::ios::traits_type::eof()) {
+    if (!next) {
         if (!begin_) {
             PassString();
             current_token_ = token_type::Newline{};
@@ -193,7 +298,11 @@ void Lexer::LoadNextToken() {
                 current_token_ = token_type::Eof{};
             }
         }
-    } else if (ch == '\n') {
+        return;
+    }
+
+    const char ch = *next;
+    if (ch == '\n') {
         if (begin_) {
             PassString();
             LoadNextToken();
@@ -216,28 +325,23 @@ void Lexer::LoadNextToken() {
             current_token_ = token_type::Dedent{};
         }
     } else {
-        if (std::isdigit(ch)) {
-            int number = ParseNumber(input_);
-            current_token_ = token_type::Number{number};
-        } else if (std::isalpha(ch) || ch == '_') {
-            std::string name = ParseName(input_);
-            if (key_words.count(name) != 0) {
-                current_token_ = key_words.at(name);
-            } else {
-                current_token_ = token_type::Id{name};
-            }
+        const auto uch = static_cast<unsigned char>(ch);
+        if (std::isdigit(uch)) {
+            current_token_ = token_type::Number{ParseNumber()};
+        } else if (std::isalpha(uch) || ch == '_') {
+            current_token_ = NameToken(runtime::Symbol(ParseName()));
         } else if (ch == '\"' || ch == '\'') {
-            std::string str = ParseString(input_);
-            current_token_ = token_type::String{str};
+            current_token_ = token_type::String{ParseString()};
         } else {
-            std::string dual;
-            dual += input_.get();
-            dual += input_.peek();
-            if (dual_symbols.count(dual)) {
-                input_.get();
-                current_token_ = dual_symbols.at(dual);
-            } else {
-                current_token_ = token_type::Char{dual[0]};
+            ++pos_;
+            current_token_ = token_type::Char{ch};
+            if (const std::optional<char> second = PeekChar()) {
+                const char dual[] = {ch, *second};
+                if (auto it = dual_symbols.find(std::string_view(dual, 2));
+                    it != dual_symbols.end()) {
+                    ++pos_;
+                    current_token_ = it->second;
+                }
             }
         }
         begin_ = false;
@@ -1,10 +1,15 @@
 #pragma once
 
+#include "source_map.h"
+#include "symbol.h"
+
+#include <cstdint>
 #include <iosfwd>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <map>
 
@@ -15,8 +20,8 @@ struct Number {  // Лексема «число»
     int value;   // число
 };
 
-struct Id {             // Лексема «идентификатор»
-    std::string value;  // Имя идентификатора
+struct Id {                 // Лексема «идентификатор»
+    runtime::Symbol value;  // Имя идентификатора, интернированное при чтении лексемы
 };
 
 struct Char {    // Лексема «символ»
@@ -86,22 +91,7 @@ public:
     using std::runtime_error::runtime_error;
 };
 
-static std::map<std::string, parse::Token> key_words = {
-    {"class",   parse::token_type::Class{}},
-    {"return",  parse::token_type::Return{}},
-    {"if",      parse::token_type::If{}},
-    {"else",    parse::token_type::Else{}},
-    {"def",     parse::token_type::Def{}},
-    {"print",   parse::token_type::Print{}},
-    {"and",     parse::token_type::And{}},
-    {"or",      parse::token_type::Or{}},
-    {"not",     parse::token_type::Not{}},
-    {"None",    parse::token_type::None{}},
-    {"True",    parse::token_type::True{}},
-    {"False",   parse::token_type::False{}}
-};
-
-static std::map<std::string, parse::Token> dual_symbols = {
+static std::map<std::string, parse::Token, std::less<>> dual_symbols = {
     {"==",  parse::token_type::Eq{}},
     {"!=",  parse::token_type::NotEq{}},
     {">=",  parse::token_type::GreaterOrEq{}},
@@ -112,9 +102,32 @@ int ReadNumber(std::istream &input);
 std::string ReadString(std::istream& input);
 std::string ReadName(std::istream &input);
 
+// Файл с исходным текстом программы, отображённый в память только для чтения.
+// Если файл не удаётся открыть или отобразить, конструктор выбрасывает исключение runtime_error
+class MappedSource {
+public:
+    explicit MappedSource(const std::string& path);
+    ~MappedSource();
+
+    MappedSource(const MappedSource&) = delete;
+    MappedSource& operator=(const MappedSource&) = delete;
+
+    // Возвращает содержимое файла. Действительно, пока существует объект MappedSource
+    [[nodiscard]] std::string_view GetText() const;
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
 class Lexer {
 public:
+    // Читает программу из потока построчно
     explicit Lexer(std::istream& input);
+    // Читает программу из непрерывного буфера source, не копируя его.
+    // Буфер должен существовать, пока используется лексер. Смещения лексем отсчитываются
+    // от base_offset, чтобы смещения модулей одной программы не пересекались
+    explicit Lexer(std::string_view source, std::uint32_t base_offset = 0);
 
     // Возвращает ссылку на текущий токен или token_type::Eof, если поток токенов закончился
     [[nodiscard]] const Token& CurrentToken() const;
@@ -122,6 +135,21 @@ public:
     // Возвращает следующий токен, либо token_type::Eof, если поток токенов закончился
     Token NextToken();
 
+    // Возвращает смещение начала текущего токена от начала текста программы
+    [[nodiscard]] std::uint32_t CurrentOffset() const {
+        return token_offset_;
+    }
+
+    // Возвращает таблицу строк прочитанной части программы
+    [[nodiscard]] const SourceMap& GetSourceMap() const {
+        return source_map_;
+    }
+
+    // Задаёт имя текста программы, с которым в сообщениях об ошибках выводятся позиции
+    void SetSourceName(std::string name) {
+        source_map_.SetName(std::move(name));
+    }
+
     // Если текущий токен имеет тип T, метод возвращает ссылку на него.
     // В противном случае метод выбрасывает исключение LexerError
     template <typename T>
@@ -130,7 +158,7 @@ public:
         if (current_token_.Is<T>()) {
             return current_token_.As<T>();
         }
-        throw LexerError("Not implemented"s);
+        throw UnexpectedToken();
     }
 
     // Метод проверяет, что текущий токен имеет тип T, а сам токен содержит значение value.
@@ -141,7 +169,7 @@ public:
         if (current_token_.Is<T>() && current_token_.As<T>().value == value) {
             return;
         }
-        throw LexerError("Not implemented"s);
+        throw UnexpectedToken();
     }
 
     // Если следующий токен имеет тип T, метод возвращает ссылку на него.
@@ -161,19 +189,44 @@ public:
     }
 
 private:
-    std::istream& input_;
+    // Поток, из которого читается программа, либо nullptr, если программа задана буфером
+    std::istream* input_ = nullptr;
+    // Последняя прочитанная из потока строка
+    std::string line_;
+    // Непрочитанная часть текущего буфера: всей программы либо строки line_
+    const char* pos_ = nullptr;
+    const char* end_ = nullptr;
+    // Начало текущего буфера и его смещение от начала текста программы
+    const char* buffer_begin_ = nullptr;
+    std::uint32_t buffer_offset_ = 0;
+    std::uint32_t token_offset_ = 0;
+    SourceMap source_map_;
     Token current_token_;
     bool begin_ = true;
     size_t indents_ = 0;
     size_t indent_pos_ = 0;
 
+    // Возвращает false, если текст программы закончился. При чтении из потока загружает
+    // в буфер следующую строку, когда текущая прочитана полностью
+    bool Fill();
+    // Возвращает очередной символ, не извлекая его, либо std::nullopt в конце программы
+    std::optional<char> PeekChar();
+
+    [[nodiscard]] std::uint32_t Offset() const {
+        return buffer_offset_ + static_cast<std::uint32_t>(pos_ - buffer_begin_);
+    }
+
+    [[nodiscard]] LexerError UnexpectedToken() const;
+
     void LoadNextToken();
     void PassString();
     void PassComment();
     void CountSpaces();
-    int ParseNumber(std::istream &input);
-    std::string ParseName(std::istream &input);
-    std::string ParseString(std::istream& input);
+    int ParseNumber();
+    std::string_view ParseName();
+    // Возвращает лексему ключевого слова либо идентификатора name
+    static Token NameToken(runtime::Symbol name);
+    std::string ParseString();
 };
 
 }  // namespace parse
@@ -1,8 +1,14 @@
 #include "lexer.h"
 #include "test_runner_p.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 #include <string>
+#include <vector>
+
+#include <unistd.h>
 
 using namespace std;
 
@@ -351,6 +357,111 @@ abc#
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
     }
 }
+
+vector<Token> ReadAllTokens(Lexer& lexer) {
+    vector<Token> tokens{lexer.CurrentToken()};
+    while (!tokens.back().Is<token_type::Eof>()) {
+        tokens.push_back(lexer.NextToken());
+    }
+    return tokens;
+}
+
+void TestBufferMode() {
+    const string program = R"(class Point:
+  def __init__(x, y):  # comment
+    self.x = x
+    self.y = y
+
+p = Point(12345, 0)
+if p.x >= 10 and p.y != 1:
+  print 'it''s', "a \"quoted\"\tstring\n", 'multi
+line'
+  print p.x<=p.y, p.x==p.y
++)"s;
+
+    istringstream input(program);
+    Lexer stream_lexer(input);
+    Lexer buffer_lexer(string_view{program});
+
+    const auto expected = ReadAllTokens(stream_lexer);
+    const auto tokens = ReadAllTokens(buffer_lexer);
+    ASSERT_EQUAL(tokens.size(), expected.size());
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        ASSERT_EQUAL(tokens[i], expected[i]);
+    }
+    ASSERT(count(tokens.begin(), tokens.end(), Token(token_type::String{"multi\nline"s})) == 1);
+    ASSERT(count(tokens.begin(), tokens.end(), Token(token_type::GreaterOrEq{})) == 1);
+
+    // Буфер не обязан заканчиваться нулевым символом
+    const string padded = "x = 42!"s;
+    Lexer lexer(string_view{padded}.substr(0, 6));
+    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{42}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+
+    ASSERT_THROWS(Lexer(string_view{"'unterminated"}), LexerError);
+    ASSERT_THROWS(Lexer(string_view{"99999999999"}), LexerError);
+}
+
+void TestMappedSource() {
+    const string path = "/tmp/mython_lexer_test_"s + to_string(getpid()) + ".my"s;
+    {
+        ofstream file(path);
+        file << "print 'hello'\n"sv;
+    }
+    {
+        MappedSource source(path);
+        ASSERT_EQUAL(source.GetText(), "print 'hello'\n"sv);
+        Lexer lexer(source.GetText());
+        ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Print{}));
+        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"hello"s}));
+    }
+    {
+        ofstream file(path);
+    }
+    {
+        MappedSource empty(path);
+        ASSERT(empty.GetText().empty());
+        Lexer lexer(empty.GetText());
+        ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Eof{}));
+    }
+    remove(path.c_str());
+    ASSERT_THROWS(MappedSource{path}, runtime_error);
+}
+void TestSourceOffsets() {
+    const string program = "x = 1\nif x:\n  print 'a\nb',  x\n\ny\n"s;
+
+    // Смещения токенов одинаковы при чтении из потока и из буфера
+    istringstream input(program);
+    Lexer stream_lexer(input);
+    Lexer buffer_lexer(string_view{program});
+    vector<uint32_t> offsets;
+    for (;;) {
+        ASSERT_EQUAL(stream_lexer.CurrentToken(), buffer_lexer.CurrentToken());
+        ASSERT_EQUAL(stream_lexer.CurrentOffset(), buffer_lexer.CurrentOffset());
+        offsets.push_back(buffer_lexer.CurrentOffset());
+        if (buffer_lexer.CurrentToken().Is<token_type::Eof>()) {
+            break;
+        }
+        stream_lexer.NextToken();
+        buffer_lexer.NextToken();
+    }
+    ASSERT_EQUAL(stream_lexer.GetSourceMap().Format(offsets[9]), "3:3"s);
+    ASSERT_EQUAL(buffer_lexer.GetSourceMap().Format(offsets[9]), "3:3"s);
+    // x после многострочной строки
+    ASSERT_EQUAL(buffer_lexer.GetSourceMap().Format(offsets[12]), "4:6"s);
+    ASSERT_EQUAL(stream_lexer.GetSourceMap().Format(offsets[12]), "4:6"s);
+
+    const SourceMap map("ab\ncd\n\ne"sv, "prog.my"s);
+    ASSERT_EQUAL(map.Locate(0).line, 1U);
+    ASSERT_EQUAL(map.Locate(4).line, 2U);
+    ASSERT_EQUAL(map.Locate(4).column, 2U);
+    ASSERT_EQUAL(map.Format(6), "prog.my:3:1"s);
+    ASSERT_EQUAL(map.Format(7), "prog.my:4:1"s);
+    ASSERT_EQUAL(SourceMap("ab"sv).Format(1), "1:2"s);
+}
 }  // namespace
 
 void RunOpenLexerTests(TestRunner& tr) {
@@ -367,6 +478,9 @@ void RunOpenLexerTests(TestRunner& tr) {
     RUN_TEST(tr, parse::TestMythonProgram);
     RUN_TEST(tr, parse::TestAlwaysEmitsNewlineAtTheEndOfNonemptyLine);
     RUN_TEST(tr, parse::TestCommentsAreIgnored);
+    RUN_TEST(tr, parse::TestBufferMode);
+    RUN_TEST(tr, parse::TestMappedSource);
+    RUN_TEST(tr, parse::TestSourceOffsets);
 }
 
 }  // namespace parse
@@ -1,10 +1,22 @@
+#include "benchmark.h"
+#include "collector.h"
 #include "lexer.h"
+#include "metrics.h"
+#include "module_loader.h"
 #include "parse.h"
+#include "profiler.h"
+#include "program.h"
+#include "program_cache.h"
 #include "runtime.h"
+#include "source_map.h"
 #include "statement.h"
 #include "test_runner_p.h"
 
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <string_view>
+#include <vector>
 
 using namespace std;
 
@@ -18,19 +30,80 @@ void RunUnitTests(TestRunner& tr);
 namespace runtime {
 void RunObjectHolderTests(TestRunner& tr);
 void RunObjectsTests(TestRunner& tr);
+void RunProfilerTests(TestRunner& tr);
+void RunCollectorTests(TestRunner& tr);
+void RunMetricsTests(TestRunner& tr);
 }  // namespace runtime
 
+namespace bytecode {
+void RunBytecodeTests(TestRunner& tr);
+}  // namespace bytecode
+
+namespace ast {
+void RunOptimizerTests(TestRunner& tr);
+}  // namespace ast
+
+namespace cache {
+void RunProgramCacheTests(TestRunner& tr);
+}  // namespace cache
+
+namespace mython {
+void RunProgramTests(TestRunner& tr);
+void RunExecutorTests(TestRunner& tr);
+void RunModuleLoaderTests(TestRunner& tr);
+}  // namespace mython
+
+namespace bench {
+void RunBenchmarkTests(TestRunner& tr);
+}  // namespace bench
+
 void TestParseProgram(TestRunner& tr);
 
 namespace {
 
-void RunMythonProgram(istream& input, ostream& output) {
+void RunMythonProgram(parse::Lexer& lexer, ostream& output,
+                      const mython::CompileOptions& options = {}) {
+    mython::Program::Compile(lexer, options).Run(output);
+}
+
+void RunMythonProgram(istream& input, ostream& output,
+                      const mython::CompileOptions& options = {}) {
     parse::Lexer lexer(input);
-    auto program = ParseProgram(lexer);
+    RunMythonProgram(lexer, output, options);
+}
+
+// Разбирает и компилирует программу из файла source_path либо, если файл не задан, из cin
+mython::Program CompileProgram(const char* source_path, bool use_cache,
+                               const mython::CompileOptions& options) {
+    if (!source_path) {
+        parse::Lexer lexer(cin);
+        return mython::Program::Compile(lexer, options);
+    }
+    // Файл отображается в память и разбирается без копирования в поток
+    parse::MappedSource source(source_path);
+    if (use_cache) {
+        auto tree = cache::LoadOrParse(source.GetText(), cache::GetCachePath(source_path));
+        return mython::Program::Compile(
+            std::move(tree), options,
+            make_shared<parse::SourceMap>(source.GetText(), source_path));
+    }
+    parse::Lexer lexer(source.GetText());
+    lexer.SetSourceName(source_path);
+    return mython::Program::Compile(lexer, options);
+}
 
-    runtime::SimpleContext context{output};
-    runtime::Closure closure;
-    program->Execute(closure, context);
+// Исполняет программу из файла source_path либо, если файл не задан, из cin по мере разбора
+void RunIncrementally(const char* source_path, runtime::Context& context,
+                      const mython::CompileOptions& options) {
+    if (!source_path) {
+        parse::Lexer lexer(cin);
+        mython::RunIncrementally(lexer, context, options);
+        return;
+    }
+    parse::MappedSource source(source_path);
+    parse::Lexer lexer(source.GetText());
+    lexer.SetSourceName(source_path);
+    mython::RunIncrementally(lexer, context, options);
 }
 
 void TestSimplePrints() {
@@ -118,6 +191,16 @@ void TestAll() {
     runtime::RunObjectsTests(tr);
     ast::RunUnitTests(tr);
     TestParseProgram(tr);
+    bytecode::RunBytecodeTests(tr);
+    ast::RunOptimizerTests(tr);
+    cache::RunProgramCacheTests(tr);
+    mython::RunProgramTests(tr);
+    mython::RunExecutorTests(tr);
+    mython::RunModuleLoaderTests(tr);
+    runtime::RunProfilerTests(tr);
+    runtime::RunCollectorTests(tr);
+    runtime::RunMetricsTests(tr);
+    bench::RunBenchmarkTests(tr);
 
     RUN_TEST(tr, TestSimplePrints);
     RUN_TEST(tr, TestAssignments);
@@ -127,11 +210,126 @@ void TestAll() {
 
 }  // namespace
 
-int main() {
-    try {
-        TestAll();
+int main(int argc, char* argv[]) {
+    constexpr string_view PROFILE_STACKS = "--profile-stacks="sv;
+    constexpr string_view BENCHMARK = "--benchmark"sv;
+    mython::CompileOptions options;
+    // Загружать разобранную программу из файла кеша .mypc рядом с исходным файлом
+    bool use_cache = false;
+    // Вывести в stderr отчёт профилировщика
+    bool profile = false;
+    // Файл для дерева вызовов в формате collapsed stacks
+    const char* stacks_path = nullptr;
+    // Вывести в stderr статистику сборщика циклического мусора
+    bool gc_stats = false;
+    // Вывести в stderr счётчики исполнения (см. runtime::Metrics)
+    bool metrics = false;
+    // Исполнять инструкции верхнего уровня по мере разбора программы
+    bool stream = false;
+    // Выполнить тесты интерпретатора вместо программы
+    bool self_test = false;
+    // Измерить нагрузки, имена которых содержат заданную подстроку, вместо исполнения программы
+    optional<string_view> benchmark_filter;
+    const char* source_path = nullptr;
+    // Модули программы, если указано несколько файлов
+    vector<string> module_paths;
+    for (int i = 1; i < argc; ++i) {
+        const string_view arg = argv[i];
+        if (arg == "--vm"sv) {
+            options.backend = mython::Backend::Bytecode;
+        } else if (arg == "--no-optimize"sv) {
+            options.optimize = false;
+        } else if (arg == "--cache"sv) {
+            use_cache = true;
+        } else if (arg == "--profile"sv) {
+            profile = true;
+        } else if (arg.substr(0, PROFILE_STACKS.size()) == PROFILE_STACKS
+                   && arg.size() > PROFILE_STACKS.size()) {
+            stacks_path = argv[i] + PROFILE_STACKS.size();
+        } else if (arg == "--gc-stats"sv) {
+            gc_stats = true;
+        } else if (arg == "--metrics"sv) {
+            metrics = true;
+        } else if (arg == "--stream"sv) {
+            stream = true;
+        } else if (arg == "--self-test"sv) {
+            self_test = true;
+        } else if (arg == BENCHMARK) {
+            benchmark_filter = ""sv;
+        } else if (arg.substr(0, BENCHMARK.size() + 1) == "--benchmark="sv) {
+            benchmark_filter = arg.substr(BENCHMARK.size() + 1);
+        } else if (!arg.empty() && arg.front() != '-') {
+            if (!source_path) {
+                source_path = argv[i];
+            }
+            module_paths.emplace_back(arg);
+        } else {
+            cerr << "Usage: "sv << argv[0]
+                 << " [--vm] [--no-optimize] [--cache] [--profile] [--profile-stacks=file]"sv
+                 << " [--gc-stats] [--metrics] [file...]\n"sv
+                 << "       "sv << argv[0]
+                 << " --stream [--no-optimize] [--profile] [--profile-stacks=file] [--gc-stats]"sv
+                 << " [--metrics] [file]\n"sv
+                 << "       "sv << argv[0] << " --self-test\n"sv
+                 << "       "sv << argv[0] << " [--vm] [--no-optimize] --benchmark[=filter]"sv
+                 << endl;
+            return 1;
+        }
+    }
+    if (stream && (use_cache || options.backend != mython::Backend::Tree)) {
+        cerr << "--stream cannot be combined with --vm or --cache"sv << endl;
+        return 1;
+    }
+    if (module_paths.size() > 1 && (stream || use_cache)) {
+        cerr << "--stream and --cache accept a single file"sv << endl;
+        return 1;
+    }
+    if (metrics && !runtime::METRICS_ENABLED) {
+        cerr << "--metrics requires building with -DMYTHON_ENABLE_METRICS"sv << endl;
+        return 1;
+    }
 
-        RunMythonProgram(cin, cout);
+    try {
+        if (self_test) {
+            TestAll();
+            return 0;
+        }
+        if (benchmark_filter) {
+            bench::Options bench_options;
+            bench_options.compile = options;
+            bench::RunBenchmarks(*benchmark_filter, bench_options, cout);
+            return 0;
+        }
+
+        runtime::Profiler profiler;
+        runtime::Metrics run_metrics;
+        {
+            runtime::BufferedContext context(cout);
+            if (profile || stacks_path) {
+                context.SetProfiler(&profiler);
+            }
+            if (stream) {
+                RunIncrementally(source_path, context, options);
+            } else if (module_paths.size() > 1) {
+                mython::LoadModuleFiles(module_paths, options).Run(context);
+            } else {
+                CompileProgram(source_path, use_cache, options).Run(context);
+            }
+            run_metrics = context.GetMetrics();
+        }
+        if (profile) {
+            profiler.PrintReport(cerr);
+        }
+        if (stacks_path) {
+            ofstream stacks(stacks_path);
+            profiler.PrintCollapsedStacks(stacks);
+        }
+        if (gc_stats) {
+            runtime::CycleCollector::Current().PrintStats(cerr);
+        }
+        if (metrics) {
+            run_metrics.Print(cerr);
+        }
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
 		return 1;
@@ -0,0 +1,135 @@
+#include "metrics.h"
+
+#include "runtime.h"
+
+#include <ostream>
+#include <string_view>
+#include <utility>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+using Clock = chrono::steady_clock;
+
+static_assert(static_cast<size_t>(ObjectKind::Other) + 1 == OBJECT_KIND_COUNT);
+
+constexpr array<string_view, OBJECT_KIND_COUNT> KIND_NAMES = {
+    "None"sv, "Number"sv, "String"sv, "Bool"sv, "Class"sv, "ClassInstance"sv, "Other"sv,
+};
+
+struct ThreadMetrics {
+    Metrics counters;
+    Metrics::Phase phase = Metrics::Phase::None;
+    // Начало отрезка времени, ещё не учтённого в счётчике текущего этапа
+    Clock::time_point phase_start;
+};
+
+ThreadMetrics& CurrentThreadMetrics() {
+    thread_local ThreadMetrics metrics;
+    return metrics;
+}
+
+Metrics::Duration* PhaseTime(Metrics& metrics, Metrics::Phase phase) {
+    switch (phase) {
+        case Metrics::Phase::Parse: return &metrics.parse_time;
+        case Metrics::Phase::Link: return &metrics.link_time;
+        case Metrics::Phase::Compile: return &metrics.compile_time;
+        case Metrics::Phase::Execute: return &metrics.execution_time;
+        case Metrics::Phase::None: break;
+    }
+    return nullptr;
+}
+
+// Учитывает время от начала отрезка до now в счётчике текущего этапа
+void ChargePhase(ThreadMetrics& metrics, Clock::time_point now) {
+    if (auto* time = PhaseTime(metrics.counters, metrics.phase)) {
+        *time += chrono::duration_cast<Metrics::Duration>(now - metrics.phase_start);
+    }
+    metrics.phase_start = now;
+}
+
+}  // namespace
+
+Metrics& Metrics::Current() {
+    return CurrentThreadMetrics().counters;
+}
+
+Metrics Metrics::Snapshot() {
+    if constexpr (!METRICS_ENABLED) {
+        return {};
+    }
+    ChargePhase(CurrentThreadMetrics(), Clock::now());
+    return Current();
+}
+
+uint64_t Metrics::GetAllocationCount() const {
+    uint64_t count = 0;
+    for (const uint64_t kind_count : allocations) {
+        count += kind_count;
+    }
+    return count;
+}
+
+uint64_t Metrics::GetAllocationCount(ObjectKind kind) const {
+    return allocations[static_cast<size_t>(kind)];
+}
+
+Metrics& Metrics::operator-=(const Metrics& other) {
+    for (size_t kind = 0; kind < OBJECT_KIND_COUNT; ++kind) {
+        allocations[kind] -= other.allocations[kind];
+    }
+    ref_increments -= other.ref_increments;
+    ref_decrements -= other.ref_decrements;
+    method_calls -= other.method_calls;
+    method_cache_hits -= other.method_cache_hits;
+    method_cache_misses -= other.method_cache_misses;
+    field_cache_hits -= other.field_cache_hits;
+    field_cache_misses -= other.field_cache_misses;
+    bytes_printed -= other.bytes_printed;
+    parse_time -= other.parse_time;
+    link_time -= other.link_time;
+    compile_time -= other.compile_time;
+    execution_time -= other.execution_time;
+    return *this;
+}
+
+void Metrics::Print(ostream& os) const {
+    const auto to_milliseconds = [](Duration duration) {
+        return chrono::duration<double, milli>(duration).count();
+    };
+    const auto hit_rate = [](uint64_t hits, uint64_t misses) {
+        return hits + misses > 0 ? 100.0 * static_cast<double>(hits)
+                                       / static_cast<double>(hits + misses)
+                                 : 0.0;
+    };
+    os << "Allocations: "sv << GetAllocationCount();
+    for (size_t kind = 0; kind < OBJECT_KIND_COUNT; ++kind) {
+        if (allocations[kind] > 0) {
+            os << ", "sv << KIND_NAMES[kind] << ' ' << allocations[kind];
+        }
+    }
+    os << '\n';
+    os << "Reference count operations: "sv << ref_increments << " increments, "sv
+       << ref_decrements << " decrements\n"sv;
+    os << "Method calls: "sv << method_calls << ", peak call depth: "sv << peak_call_depth
+       << '\n';
+    os << "Method cache: "sv << method_cache_hits << " hits, "sv << method_cache_misses
+       << " misses ("sv << hit_rate(method_cache_hits, method_cache_misses) << "% hit rate)\n"sv;
+    os << "Field cache: "sv << field_cache_hits << " hits, "sv << field_cache_misses
+       << " misses ("sv << hit_rate(field_cache_hits, field_cache_misses) << "% hit rate)\n"sv;
+    os << "Bytes printed: "sv << bytes_printed << '\n';
+    os << "Time ms: parsing "sv << to_milliseconds(parse_time) << ", linking "sv
+       << to_milliseconds(link_time) << ", compilation "sv << to_milliseconds(compile_time)
+       << ", execution "sv << to_milliseconds(execution_time) << '\n';
+}
+
+Metrics::Phase Metrics::SwitchPhase(Phase phase) {
+    ThreadMetrics& metrics = CurrentThreadMetrics();
+    ChargePhase(metrics, Clock::now());
+    return std::exchange(metrics.phase, phase);
+}
+
+}  // namespace runtime
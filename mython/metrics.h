@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+namespace runtime {
+
+enum class ObjectKind : std::uint8_t;
+
+// Счётчики собираются, только если интерпретатор собран с макросом MYTHON_ENABLE_METRICS.
+// Иначе обновление счётчиков не попадает в код, а все счётчики остаются равными нулю
+#ifdef MYTHON_ENABLE_METRICS
+inline constexpr bool METRICS_ENABLED = true;
+#else
+inline constexpr bool METRICS_ENABLED = false;
+#endif
+
+// Количество видов ObjectKind
+inline constexpr std::size_t OBJECT_KIND_COUNT = 7;
+
+/*
+ * Счётчики исполнения программ Mython, по которым можно понять, во что упирается программа:
+ * в создание объектов, в диспетчеризацию вызовов или в вывод.
+ * Счётчики свои у каждого потока и не разделяются с другими потоками, поэтому не требуют
+ * синхронизации. Контекст исполнения возвращает их приращение за время своего существования
+ * (см. Context::GetMetrics)
+ */
+struct Metrics {
+    using Duration = std::chrono::nanoseconds;
+
+    // Этапы работы интерпретатора, время которых учитывается отдельно
+    enum class Phase : std::uint8_t {
+        None,
+        // Разбор текста. Парсер запрашивает лексемы по одной, поэтому время лексического
+        // анализа входит во время разбора, а не учитывается отдельно на каждой лексеме
+        Parse,
+        // Связывание модулей программы (LinkModules)
+        Link,
+        // Оптимизация дерева и компиляция в байткод
+        Compile,
+        Execute,
+    };
+
+    // Учитывает время своего существования как время этапа phase. Время вложенного этапа
+    // не входит во время внешнего
+    class PhaseScope {
+    public:
+        explicit PhaseScope(Phase phase) {
+            if constexpr (METRICS_ENABLED) {
+                previous_ = SwitchPhase(phase);
+            }
+        }
+
+        ~PhaseScope() {
+            if constexpr (METRICS_ENABLED) {
+                SwitchPhase(previous_);
+            }
+        }
+
+        PhaseScope(const PhaseScope&) = delete;
+        PhaseScope& operator=(const PhaseScope&) = delete;
+
+    private:
+        Phase previous_ = Phase::None;
+    };
+
+    // Объекты, созданные в куче через ObjectHolder, по видам: индекс - значение ObjectKind
+    std::array<std::uint64_t, OBJECT_KIND_COUNT> allocations{};
+    // Увеличения и уменьшения счётчиков ссылок на объекты в куче
+    std::uint64_t ref_increments = 0;
+    std::uint64_t ref_decrements = 0;
+    std::uint64_t method_calls = 0;
+    // Поиски метода по классу получателя в кэшах вызовов. Вызов, для которого метод не найден
+    // заранее, ищет его по имени и учитывается как промах
+    std::uint64_t method_cache_hits = 0;
+    std::uint64_t method_cache_misses = 0;
+    // Поиски поля по форме объекта в кэшах обращений к полям
+    std::uint64_t field_cache_hits = 0;
+    std::uint64_t field_cache_misses = 0;
+    // Наибольшая глубина вызовов методов. Учитывается контекстом исполнения, а не потоком
+    std::size_t peak_call_depth = 0;
+    // Объём вывода команд print
+    std::uint64_t bytes_printed = 0;
+    Duration parse_time{0};
+    Duration link_time{0};
+    Duration compile_time{0};
+    Duration execution_time{0};
+
+    // Возвращает изменяемые счётчики текущего потока
+    [[nodiscard]] static Metrics& Current();
+    // Возвращает копию счётчиков текущего потока, включающую время ещё не завершённого этапа
+    [[nodiscard]] static Metrics Snapshot();
+
+    [[nodiscard]] std::uint64_t GetAllocationCount() const;
+    [[nodiscard]] std::uint64_t GetAllocationCount(ObjectKind kind) const;
+
+    // Вычитает счётчики other, кроме peak_call_depth
+    Metrics& operator-=(const Metrics& other);
+
+    // Выводит счётчики в os
+    void Print(std::ostream& os) const;
+
+private:
+    // Делает phase текущим этапом потока, учитывая время предыдущего. Возвращает предыдущий
+    static Phase SwitchPhase(Phase phase);
+};
+
+// Вызывает update со счётчиками текущего потока. Без MYTHON_ENABLE_METRICS update не вызывается
+// и не попадает в код
+template <typename Update>
+void UpdateMetrics(Update update) {
+    if constexpr (METRICS_ENABLED) {
+        update(Metrics::Current());
+    }
+}
+
+}  // namespace runtime
@@ -0,0 +1,152 @@
+#include "metrics.h"
+#include "module_loader.h"
+#include "program.h"
+#include "runtime.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+const string PROGRAM = R"(
+class Node:
+  def __init__(value):
+    self.value = value
+
+class Builder:
+  def build(n):
+    if n == 0:
+      return 0
+    node = Node(n)
+    return node.value + self.build(n - 1)
+
+b = Builder()
+print b.build(10)
+print 'done'
+)"s;
+
+void AssertZero(const Metrics& metrics) {
+    ASSERT_EQUAL(metrics.GetAllocationCount(), 0U);
+    ASSERT_EQUAL(metrics.ref_increments, 0U);
+    ASSERT_EQUAL(metrics.ref_decrements, 0U);
+    ASSERT_EQUAL(metrics.method_calls, 0U);
+    ASSERT_EQUAL(metrics.method_cache_hits + metrics.method_cache_misses, 0U);
+    ASSERT_EQUAL(metrics.field_cache_hits + metrics.field_cache_misses, 0U);
+    ASSERT_EQUAL(metrics.peak_call_depth, 0U);
+    ASSERT_EQUAL(metrics.bytes_printed, 0U);
+    ASSERT(metrics.parse_time.count() == 0 && metrics.link_time.count() == 0);
+    ASSERT(metrics.compile_time.count() == 0 && metrics.execution_time.count() == 0);
+}
+
+void TestCounters() {
+    for (const auto backend : {mython::Backend::Tree, mython::Backend::Bytecode}) {
+        DummyContext context;
+        mython::Program::Compile(PROGRAM, {backend}).Run(context);
+        const string output = context.output.str();
+        ASSERT_EQUAL(output, "55\ndone\n"s);
+        const Metrics metrics = context.GetMetrics();
+        if constexpr (!METRICS_ENABLED) {
+            AssertZero(metrics);
+            continue;
+        }
+
+        // Builder.build вызван 11 раз, Node.__init__ - 10 раз, из самого глубокого build
+        ASSERT_EQUAL(metrics.method_calls, 21U);
+        ASSERT_EQUAL(metrics.peak_call_depth, 11U);
+        ASSERT_EQUAL(metrics.GetAllocationCount(ObjectKind::ClassInstance), 11U);
+        ASSERT(metrics.GetAllocationCount() >= 11U);
+        ASSERT(metrics.ref_increments > 0 && metrics.ref_decrements > 0);
+        ASSERT_EQUAL(metrics.bytes_printed, output.size());
+        // Все экземпляры Node имеют одну форму
+        ASSERT(metrics.field_cache_hits > metrics.field_cache_misses);
+        // Вызовы build ищут метод, а __init__ вызывается без поиска
+        ASSERT_EQUAL(metrics.method_cache_hits + metrics.method_cache_misses, 11U);
+        if (backend == mython::Backend::Tree) {
+            ASSERT(metrics.method_cache_hits > metrics.method_cache_misses);
+        }
+        ASSERT(metrics.parse_time.count() > 0);
+        // Программа из одного текста не связывается
+        ASSERT(metrics.link_time.count() == 0);
+        ASSERT(metrics.compile_time.count() > 0);
+        ASSERT(metrics.execution_time.count() > 0);
+
+        ostringstream report;
+        metrics.Print(report);
+        ASSERT(report.str().find("Method calls: 21, peak call depth: 11"s) != string::npos);
+        ASSERT(report.str().find("ClassInstance 11"s) != string::npos);
+    }
+}
+
+void TestModules() {
+    DummyContext context;
+    const string_view text = PROGRAM;
+    mython::LoadModules({{"a.my"s, text.substr(0, text.find("b = "sv))},
+                         {"b.my"s, text.substr(text.find("b = "sv))}},
+                        {}, 1)
+        .Run(context);
+    ASSERT_EQUAL(context.output.str(), "55\ndone\n"s);
+    const Metrics metrics = context.GetMetrics();
+    if constexpr (METRICS_ENABLED) {
+        ASSERT(metrics.parse_time.count() > 0);
+        ASSERT(metrics.link_time.count() > 0);
+        ostringstream report;
+        metrics.Print(report);
+        ASSERT(report.str().find("Time ms: parsing "s) != string::npos);
+    } else {
+        AssertZero(metrics);
+    }
+}
+
+void TestReset() {
+    DummyContext context;
+    const auto program = mython::Program::Compile(PROGRAM);
+    program.Run(context);
+    context.ResetMetrics();
+    AssertZero(context.GetMetrics());
+
+    program.Run(context);
+    const Metrics metrics = context.GetMetrics();
+    if constexpr (METRICS_ENABLED) {
+        // Разбор выполнен до сброса и не учитывается
+        ASSERT_EQUAL(metrics.method_calls, 21U);
+        ASSERT(metrics.parse_time.count() == 0 && metrics.link_time.count() == 0);
+        ASSERT(metrics.execution_time.count() > 0);
+    } else {
+        AssertZero(metrics);
+    }
+}
+
+void TestPerThread() {
+    const auto program = mython::Program::Compile(PROGRAM);
+    DummyContext context;
+    program.Run(context);
+    const uint64_t calls = context.GetMetrics().method_calls;
+
+    // Счётчики другого потока не влияют на счётчики этого
+    uint64_t other_calls = 0;
+    thread other([&] {
+        DummyContext other_context;
+        program.Run(other_context);
+        program.Run(other_context);
+        other_calls = other_context.GetMetrics().method_calls;
+    });
+    other.join();
+    ASSERT_EQUAL(context.GetMetrics().method_calls, calls);
+    ASSERT_EQUAL(other_calls, 2 * calls);
+}
+
+}  // namespace
+
+void RunMetricsTests(TestRunner& tr) {
+    RUN_TEST(tr, runtime::TestCounters);
+    RUN_TEST(tr, runtime::TestModules);
+    RUN_TEST(tr, runtime::TestReset);
+    RUN_TEST(tr, runtime::TestPerThread);
+}
+
+}  // namespace runtime
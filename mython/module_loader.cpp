@@ -0,0 +1,135 @@
+#include "module_loader.h"
+
+#include "lexer.h"
+#include "parse.h"
+#include "source_map.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+using namespace std;
+
+namespace mython {
+
+namespace {
+
+// Результат разбора модуля: модуль и таблица его строк либо ошибка
+struct ParseResult {
+    optional<ParsedModule> module;
+    optional<parse::SourceMap> source_map;
+    exception_ptr error;
+};
+
+// Дожидается завершения потоков при выходе из области видимости, в том числе по исключению
+class ThreadJoiner {
+public:
+    explicit ThreadJoiner(vector<thread>& threads)
+        : threads_(threads) {
+    }
+
+    ~ThreadJoiner() {
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    ThreadJoiner(const ThreadJoiner&) = delete;
+    ThreadJoiner& operator=(const ThreadJoiner&) = delete;
+
+private:
+    vector<thread>& threads_;
+};
+
+}  // namespace
+
+Program LoadModules(const vector<ModuleSource>& sources, const CompileOptions& options,
+                    size_t thread_count) {
+    // Смещения модулей не пересекаются, включая смещение конца текста каждого модуля
+    vector<uint32_t> base_offsets;
+    base_offsets.reserve(sources.size());
+    uint64_t next_offset = 0;
+    for (const auto& source : sources) {
+        if (next_offset + source.text.size() >= UINT32_MAX) {
+            throw runtime_error("Program modules are too large"s);
+        }
+        base_offsets.push_back(static_cast<uint32_t>(next_offset));
+        next_offset += source.text.size() + 1;
+    }
+
+    // Потоки забирают модули по одному, поэтому крупные модули не задерживают остальные
+    vector<ParseResult> results(sources.size());
+    atomic<size_t> next_module = 0;
+    const auto parse_modules = [&] {
+        for (size_t i = next_module++; i < sources.size(); i = next_module++) {
+            try {
+                parse::Lexer lexer(sources[i].text, base_offsets[i]);
+                lexer.SetSourceName(sources[i].name);
+                results[i].module = ParseModule(lexer);
+                results[i].source_map = lexer.GetSourceMap();
+            } catch (...) {
+                results[i].error = current_exception();
+            }
+        }
+    };
+    vector<thread> threads;
+    const size_t worker_count = min(max<size_t>(thread_count, 1), max<size_t>(sources.size(), 1));
+    threads.reserve(worker_count - 1);
+    {
+        const ThreadJoiner joiner(threads);
+        for (size_t i = 1; i < worker_count; ++i) {
+            try {
+                threads.emplace_back(parse_modules);
+            } catch (const system_error&) {
+                // Модули, которые не достались несозданным потокам, разберут уже запущенные
+                break;
+            }
+        }
+        parse_modules();
+    }
+
+    // Модули, предшествующие первому ошибочному, связываются, чтобы ошибка связывания в них
+    // была обнаружена раньше ошибки разбора следующего модуля
+    parse::SourceMap source_map;
+    vector<ParsedModule> modules;
+    exception_ptr error;
+    for (auto& result : results) {
+        if (result.error) {
+            error = result.error;
+            break;
+        }
+        if (modules.empty()) {
+            source_map = std::move(*result.source_map);
+        } else {
+            source_map.Append(*result.source_map);
+        }
+        modules.push_back(std::move(*result.module));
+    }
+    auto tree = LinkModules(std::move(modules), source_map);
+    if (error) {
+        rethrow_exception(error);
+    }
+    return Program::Compile(std::move(tree), options,
+                            make_shared<const parse::SourceMap>(std::move(source_map)));
+}
+
+Program LoadModuleFiles(const vector<string>& paths, const CompileOptions& options,
+                        size_t thread_count) {
+    vector<unique_ptr<parse::MappedSource>> files;
+    vector<ModuleSource> sources;
+    files.reserve(paths.size());
+    sources.reserve(paths.size());
+    for (const auto& path : paths) {
+        const auto& file = files.emplace_back(make_unique<parse::MappedSource>(path));
+        sources.push_back({path, file->GetText()});
+    }
+    return LoadModules(sources, options, thread_count);
+}
+
+}  // namespace mython
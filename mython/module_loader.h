@@ -0,0 +1,39 @@
+#pragma once
+
+#include "program.h"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace mython {
+
+// Исходный текст модуля программы и имя, с которым выводятся позиции в сообщениях об ошибках
+struct ModuleSource {
+    std::string name;
+    std::string_view text;
+};
+
+/*
+ * Загружает программу, состоящую из нескольких модулей. Программа исполняется так, как если бы
+ * тексты модулей были записаны подряд в порядке sources: модулю видны классы предшествующих
+ * модулей (см. LinkModules).
+ * Лексический и синтаксический анализ модулей выполняются одновременно на thread_count потоках,
+ * включая вызывающий, поэтому время загрузки определяется самыми большими модулями, а не
+ * суммарным объёмом текста. Затем однопоточное связывание разрешает ссылки на классы других
+ * модулей, не обходя дерево программы.
+ * Если в программе несколько ошибок, выбрасывается первая из них в порядке модулей, и её
+ * сообщение начинается с имени модуля и позиции в нём
+ */
+[[nodiscard]] Program LoadModules(const std::vector<ModuleSource>& sources,
+                                  const CompileOptions& options = {},
+                                  std::size_t thread_count = std::thread::hardware_concurrency());
+
+// Загружает программу из модулей, записанных в файлах paths. Файлы отображаются в память
+[[nodiscard]] Program LoadModuleFiles(const std::vector<std::string>& paths,
+                                      const CompileOptions& options = {},
+                                      std::size_t thread_count = std::thread::hardware_concurrency());
+
+}  // namespace mython
@@ -0,0 +1,175 @@
+#include "lexer.h"
+#include "module_loader.h"
+#include "parse.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace mython {
+
+namespace {
+
+const CompileOptions BACKENDS[] = {
+    {Backend::Tree, true},
+    {Backend::Tree, false},
+    {Backend::Bytecode, true},
+};
+
+// Модули ссылаются на классы предшествующих модулей: базовый класс Shape объявлен в первом
+// модуле, а Square наследует его через Rect, объявленный вместе с ним
+const string SHAPES = R"(
+class Shape:
+  def __init__(name):
+    self.name = name
+
+  def describe():
+    return self.name + ' ' + str(self.area())
+)"s;
+
+const string RECTS = R"(
+class Rect(Shape):
+  def __init__(w, h):
+    self.name = 'rect'
+    self.w = w
+    self.h = h
+
+  def area():
+    return self.w * self.h
+
+class Square(Rect):
+  def __init__(side):
+    self.name = 'square'
+    self.w = side
+    self.h = side
+)"s;
+
+const string MAIN = R"(
+class Registry:
+  def make(side):
+    return Square(side)
+
+r = Registry()
+rect = Rect(2, 3)
+square = r.make(4)
+shape = Shape('plain')
+print rect.describe()
+print square.describe()
+print shape.name
+)"s;
+
+string Run(const Program& program) {
+    ostringstream output;
+    program.Run(output);
+    return output.str();
+}
+
+// Возвращает сообщение об ошибке загрузки модулей sources
+string LoadError(const vector<ModuleSource>& sources) {
+    try {
+        (void)LoadModules(sources, {}, 4);
+    } catch (const ParseError& error) {
+        return error.what();
+    } catch (const parse::LexerError& error) {
+        return error.what();
+    }
+    return {};
+}
+
+void TestMatchesConcatenation() {
+    const vector<ModuleSource> sources = {
+        {"shapes.my"s, SHAPES},
+        {"rects.my"s, RECTS},
+        {"main.my"s, MAIN},
+    };
+    for (const auto& options : BACKENDS) {
+        const string expected = Run(Program::Compile(SHAPES + RECTS + MAIN, options));
+        ASSERT_EQUAL(expected, "rect 6\nsquare 16\nplain\n"s);
+        for (const size_t threads : {1U, 2U, 8U}) {
+            ASSERT_EQUAL(Run(LoadModules(sources, options, threads)), expected);
+        }
+    }
+    ASSERT_EQUAL(Run(LoadModules({})), ""s);
+}
+
+void TestManyModules() {
+    // Каждый модуль наследует класс предыдущего и добавляет к результату свой номер
+    vector<string> texts;
+    texts.push_back("class C0:\n  def value():\n    return 0\n"s);
+    for (int i = 1; i < 64; ++i) {
+        const string name = "C"s + to_string(i);
+        texts.push_back("class "s + name + "(C"s + to_string(i - 1) + "):\n  def value"s
+                        + to_string(i) + "():\n    return self.value() + "s + to_string(i) + "\n"s);
+    }
+    texts.push_back("c = C63()\nprint c.value63(), c.value1()\n"s);
+    vector<ModuleSource> sources;
+    for (size_t i = 0; i < texts.size(); ++i) {
+        sources.push_back({"m"s + to_string(i) + ".my"s, texts[i]});
+    }
+    for (const auto& options : BACKENDS) {
+        ASSERT_EQUAL(Run(LoadModules(sources, options, 4)), "63 1\n"s);
+    }
+}
+
+void TestLinkErrors() {
+    // Класс следующего модуля не виден, как и класс, объявленный в тексте позже
+    ASSERT_EQUAL(LoadError({{"a.my"s, "x = B()\n"s}, {"b.my"s, "class B:\n  def f():\n    return 1\n"s}}),
+                 "a.my:1:8: Unknown call to B()"s);
+    ASSERT_EQUAL(LoadError({{"a.my"s, "print 1\n"s}, {"b.my"s, "class C(A):\n  def f():\n    return 1\n"s}}),
+                 "b.my:1:11: Base class A not found for class C"s);
+    const string cls = "class A:\n  def f():\n    return 1\n"s;
+    ASSERT_EQUAL(LoadError({{"a.my"s, cls}, {"b.my"s, "print 1\n"s + cls}}),
+                 "b.my:5:1: Class A already exists"s);
+
+    // Ошибка связывания выводится с той же позицией, что и ошибка разбора текста целиком
+    for (const string& text : {"x = 1\ny = B(x, 2)\n"s, "class C(A):\n  def f():\n    return 1\n"s,
+                               cls + cls}) {
+        string expected;
+        try {
+            parse::Lexer lexer(text);
+            lexer.SetSourceName("a.my"s);
+            (void)ParseProgram(lexer);
+        } catch (const ParseError& error) {
+            expected = error.what();
+        }
+        ASSERT(!expected.empty());
+        ASSERT_EQUAL(LoadError({{"a.my"s, text}}), expected);
+    }
+}
+
+void TestErrorOrder() {
+    // Ошибка разбора сообщается с позицией в своём модуле
+    ASSERT_EQUAL(LoadError({{"a.my"s, "print 1\n"s}, {"b.my"s, "x = 1\ny = )\n"s}}).substr(0, 9),
+                 "b.my:2:5:"s);
+    // Ошибка связывания в первом модуле предшествует ошибке разбора во втором
+    ASSERT_EQUAL(LoadError({{"a.my"s, "x = Z()\n"s}, {"b.my"s, "y = )\n"s}}),
+                 "a.my:1:8: Unknown call to Z()"s);
+}
+
+void TestRuntimeErrorLocations() {
+    const string lib = "class A:\n  def f():\n    return 1 / 0\n"s;
+    const string main = "a = A()\nprint 1\nprint a.f()\n"s;
+    const vector<ModuleSource> sources = {{"lib.my"s, lib}, {"main.my"s, main}};
+    for (const auto& options : BACKENDS) {
+        const auto program = LoadModules(sources, options);
+        try {
+            Run(program);
+            ASSERT(false);
+        } catch (const runtime::ExecutionError& error) {
+            ASSERT_EQUAL(error.what(), "lib.my:3:5: Division by zero"s);
+        }
+    }
+}
+
+}  // namespace
+
+void RunModuleLoaderTests(TestRunner& tr) {
+    RUN_TEST(tr, mython::TestMatchesConcatenation);
+    RUN_TEST(tr, mython::TestManyModules);
+    RUN_TEST(tr, mython::TestLinkErrors);
+    RUN_TEST(tr, mython::TestErrorOrder);
+    RUN_TEST(tr, mython::TestRuntimeErrorLocations);
+}
+
+}  // namespace mython
@@ -0,0 +1,189 @@
+#include "optimizer.h"
+
+#include "statement.h"
+
+#include <optional>
+#include <stdexcept>
+
+using namespace std;
+
+namespace ast {
+
+using runtime::ObjectHolder;
+using runtime::ObjectKind;
+
+namespace {
+
+bool IsConstant(const Statement& node) {
+    return dynamic_cast<const NumericConst*>(&node) != nullptr
+           || dynamic_cast<const StringConst*>(&node) != nullptr
+           || dynamic_cast<const BoolConst*>(&node) != nullptr
+           || dynamic_cast<const None*>(&node) != nullptr;
+}
+
+// Создаёт узел-константу со значением value либо возвращает nullptr, если значение нельзя
+// записать константой
+unique_ptr<Statement> MakeConstant(const ObjectHolder& value) {
+    switch (value.GetKind()) {
+        case ObjectKind::Number:
+            return make_unique<NumericConst>(*value.TryAs<runtime::Number>());
+        case ObjectKind::String:
+            return make_unique<StringConst>(*value.TryAs<runtime::String>());
+        case ObjectKind::Bool:
+            return make_unique<BoolConst>(*value.TryAs<runtime::Bool>());
+        case ObjectKind::None:
+            return make_unique<None>();
+        default:
+            return nullptr;
+    }
+}
+
+class Optimizer {
+public:
+    void Optimize(unique_ptr<Statement>& node) {
+        Statement* p = node.get();
+        if (auto compound = dynamic_cast<Compound*>(p)) {
+            OptimizeCompound(*compound);
+        } else if (auto if_else = dynamic_cast<IfElse*>(p)) {
+            OptimizeIfElse(node, *if_else);
+        } else if (auto method_body = dynamic_cast<MethodBody*>(p)) {
+            Optimize(method_body->MutableBody());
+        } else if (auto ret = dynamic_cast<Return*>(p)) {
+            Optimize(ret->MutableStatement());
+        } else if (auto assignment = dynamic_cast<Assignment*>(p)) {
+            Optimize(assignment->MutableValue());
+        } else if (auto field_assignment = dynamic_cast<FieldAssignment*>(p)) {
+            Optimize(field_assignment->MutableValue());
+        } else if (auto print = dynamic_cast<Print*>(p)) {
+            OptimizeAll(print->MutableArgs());
+        } else if (auto call = dynamic_cast<MethodCall*>(p)) {
+            Optimize(call->MutableObject());
+            OptimizeAll(call->MutableArgs());
+        } else if (auto new_instance = dynamic_cast<NewInstance*>(p)) {
+            OptimizeAll(new_instance->MutableArgs());
+        } else if (auto class_definition = dynamic_cast<ClassDefinition*>(p)) {
+            for (runtime::Method& method : class_definition->GetClass().GetMethods()) {
+                Optimize(method.body);
+            }
+        } else if (auto unary = dynamic_cast<UnaryOperation*>(p)) {
+            Optimize(unary->MutableArgument());
+            if (IsConstant(unary->GetArgument())) {
+                Fold(node);
+            }
+        } else if (auto binary = dynamic_cast<BinaryOperation*>(p)) {
+            OptimizeBinary(node, *binary);
+        }
+    }
+
+private:
+    void OptimizeAll(vector<unique_ptr<Statement>>& nodes) {
+        for (auto& node : nodes) {
+            Optimize(node);
+        }
+    }
+
+    void OptimizeBinary(unique_ptr<Statement>& node, BinaryOperation& binary) {
+        Optimize(binary.MutableLhs());
+        Optimize(binary.MutableRhs());
+        if (!IsConstant(binary.GetLhs())) {
+            return;
+        }
+        // and и or не вычисляют правый аргумент, если результат определяется левым
+        const bool is_and = dynamic_cast<And*>(&binary) != nullptr;
+        const bool is_or = dynamic_cast<Or*>(&binary) != nullptr;
+        if (is_and || is_or) {
+            const bool lhs = runtime::IsTrue(Evaluate(binary.GetLhs()).value());
+            if (is_and != lhs) {
+                Replace(node, make_unique<BoolConst>(runtime::Bool(lhs)));
+                return;
+            }
+        }
+        if (IsConstant(binary.GetRhs())) {
+            Fold(node);
+        }
+    }
+
+    void OptimizeIfElse(unique_ptr<Statement>& node, IfElse& if_else) {
+        Optimize(if_else.MutableCondition());
+        Optimize(if_else.MutableIfBody());
+        if (if_else.MutableElseBody()) {
+            Optimize(if_else.MutableElseBody());
+        }
+        if (!IsConstant(if_else.GetCondition())) {
+            return;
+        }
+        if (runtime::IsTrue(Evaluate(if_else.GetCondition()).value())) {
+            node = std::move(if_else.MutableIfBody());
+        } else if (if_else.MutableElseBody()) {
+            node = std::move(if_else.MutableElseBody());
+        } else {
+            Replace(node, make_unique<None>());
+        }
+    }
+
+    // Оптимизирует инструкции и переносит в compound содержимое вложенных составных
+    // инструкций. Константы, значения которых не используются, и инструкции после return
+    // удаляются
+    void OptimizeCompound(Compound& compound) {
+        vector<unique_ptr<Statement>> statements = std::move(compound.MutableStatements());
+        vector<unique_ptr<Statement>>& result = compound.MutableStatements();
+        result.clear();
+        for (auto& statement : statements) {
+            Optimize(statement);
+            if (auto nested = dynamic_cast<Compound*>(statement.get())) {
+                // Вложенная инструкция уже оптимизирована и сама не содержит составных
+                for (auto& nested_statement : nested->MutableStatements()) {
+                    result.push_back(std::move(nested_statement));
+                }
+            } else if (!IsConstant(*statement)) {
+                result.push_back(std::move(statement));
+            }
+            if (!result.empty() && dynamic_cast<const Return*>(result.back().get())) {
+                break;
+            }
+        }
+    }
+
+    // Вычисляет узел, операнды которого уже заменены константами, и заменяет его результатом.
+    // Если вычисление завершается ошибкой, узел остаётся без изменений
+    void Fold(unique_ptr<Statement>& node) {
+        if (auto value = Evaluate(*node)) {
+            if (auto constant = MakeConstant(*value)) {
+                Replace(node, std::move(constant));
+            }
+        }
+    }
+
+    // Заменяет узел вычисленным значением, сохраняя его позицию в исходном тексте
+    static void Replace(unique_ptr<Statement>& node, unique_ptr<Statement> replacement) {
+        replacement->SetSourceOffset(node->GetSourceOffset());
+        node = std::move(replacement);
+    }
+
+    optional<ObjectHolder> Evaluate(const Statement& node) {
+        try {
+            runtime::Closure closure;
+            return const_cast<Statement&>(node).Execute(closure, context_);
+        } catch (const std::runtime_error&) {
+            return nullopt;
+        }
+    }
+
+    runtime::DummyContext context_;
+};
+
+}  // namespace
+
+unique_ptr<runtime::Executable> Optimize(unique_ptr<runtime::Executable> program) {
+    Optimizer optimizer;
+    if (auto root = dynamic_cast<Program*>(program.get())) {
+        // Новые узлы размещаются в арене рядом с остальными узлами программы
+        runtime::Arena::Scope scope(root->GetArena());
+        optimizer.Optimize(root->MutableBody());
+    } else {
+        optimizer.Optimize(program);
+    }
+    return program;
+}
+
+}  // namespace ast
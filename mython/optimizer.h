@@ -0,0 +1,22 @@
+#pragma once
+
+#include <memory>
+
+namespace runtime {
+class Executable;
+}
+
+namespace ast {
+
+/*
+ * Оптимизирует дерево программы, полученное из ParseProgram, и возвращает его.
+ * Вычисляет заранее арифметические операции, конкатенацию строк, сравнения, str() и логические
+ * операции над константами, заменяет if с константным условием выбранной веткой, разворачивает
+ * вложенные составные инструкции и удаляет недостижимые инструкции после return.
+ * Тела методов классов программы оптимизируются так же. Операции, вычисление которых
+ * завершается ошибкой (например, деление на ноль), остаются в дереве, чтобы ошибка возникла
+ * при исполнении программы
+ */
+std::unique_ptr<runtime::Executable> Optimize(std::unique_ptr<runtime::Executable> program);
+
+}  // namespace ast
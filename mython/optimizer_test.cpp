@@ -0,0 +1,146 @@
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "statement.h"
+#include "test_runner_p.h"
+
+using namespace std;
+
+namespace ast {
+
+namespace {
+
+unique_ptr<runtime::Executable> ParseFromString(const string& program, bool optimize) {
+    istringstream is(program);
+    parse::Lexer lexer(is);
+    auto tree = ParseProgram(lexer);
+    return optimize ? Optimize(std::move(tree)) : std::move(tree);
+}
+
+string Run(runtime::Executable& program) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program.Execute(closure, context);
+    return context.output.str();
+}
+
+const vector<unique_ptr<Statement>>& Statements(const runtime::Executable& program) {
+    const auto& body = static_cast<const Program&>(program).GetBody();
+    return static_cast<const Compound&>(body).GetStatements();
+}
+
+// Проверяет, что оптимизированная и исходная программы выводят ожидаемый результат
+void AssertSameOutput(const string& program, const string& expected) {
+    auto original = ParseFromString(program, false);
+    auto optimized = ParseFromString(program, true);
+    ASSERT_EQUAL(Run(*original), expected);
+    ASSERT_EQUAL(Run(*optimized), expected);
+}
+
+void TestConstantFolding() {
+    auto tree = ParseFromString("print 1+2+3+4+5, 36/4/3, -3, 'a' + 'b', str(42), str(None)\n"s,
+                                true);
+    const auto& statements = Statements(*tree);
+    ASSERT_EQUAL(statements.size(), 1U);
+    const auto& args = static_cast<const Print&>(*statements.front()).GetArgs();
+    ASSERT_EQUAL(args.size(), 6U);
+    ASSERT_EQUAL(dynamic_cast<const NumericConst&>(*args[0]).GetValue().GetValue(), 15);
+    ASSERT_EQUAL(dynamic_cast<const NumericConst&>(*args[1]).GetValue().GetValue(), 3);
+    ASSERT_EQUAL(dynamic_cast<const NumericConst&>(*args[2]).GetValue().GetValue(), -3);
+    ASSERT_EQUAL(dynamic_cast<const StringConst&>(*args[3]).GetValue().GetValue(), "ab"s);
+    ASSERT_EQUAL(dynamic_cast<const StringConst&>(*args[4]).GetValue().GetValue(), "42"s);
+    ASSERT_EQUAL(dynamic_cast<const StringConst&>(*args[5]).GetValue().GetValue(), "None"s);
+
+    // Выражения с переменными сворачиваются только в константных частях
+    tree = ParseFromString("x = 2\nprint x * (3 + 4)\n"s, true);
+    const auto& print = static_cast<const Print&>(*Statements(*tree).back());
+    const auto& mult = dynamic_cast<const Mult&>(*print.GetArgs().front());
+    ASSERT(dynamic_cast<const VariableValue*>(&mult.GetLhs()) != nullptr);
+    ASSERT_EQUAL(dynamic_cast<const NumericConst&>(mult.GetRhs()).GetValue().GetValue(), 7);
+    ASSERT_EQUAL(Run(*tree), "14\n"s);
+}
+
+void TestLogicalFolding() {
+    auto tree = ParseFromString("print True and False, 0 or 'x', not None, 1 < 2, False and x\n"s,
+                                true);
+    const auto& args = static_cast<const Print&>(*Statements(*tree).front()).GetArgs();
+    for (const auto& arg : args) {
+        ASSERT(dynamic_cast<const BoolConst*>(arg.get()) != nullptr);
+    }
+    ASSERT_EQUAL(Run(*tree), "False True True True False\n"s);
+
+    // Правый аргумент не вычисляется, если результат определяется левым
+    AssertSameOutput("print True or x, False and x\n"s, "True False\n"s);
+}
+
+void TestConstantConditions() {
+    const string program = R"(
+if 1 < 2:
+  print 'yes'
+else:
+  print 'no'
+if 'a' > 'b':
+  print 'never'
+print 'end'
+)"s;
+    auto tree = ParseFromString(program, true);
+    const auto& statements = Statements(*tree);
+    ASSERT_EQUAL(statements.size(), 2U);
+    ASSERT(dynamic_cast<const Print*>(statements[0].get()) != nullptr);
+    ASSERT(dynamic_cast<const Print*>(statements[1].get()) != nullptr);
+    ASSERT_EQUAL(Run(*tree), "yes\nend\n"s);
+}
+
+void TestMethodBodies() {
+    const string program = R"(
+class Calc:
+  def value():
+    if True:
+      return 2 * 3 + 1
+    print 'unreachable'
+    return 0
+
+c = Calc()
+print c.value()
+)"s;
+    AssertSameOutput(program, "7\n"s);
+
+    auto tree = ParseFromString(program, true);
+    const auto& cls = static_cast<const ClassDefinition&>(*Statements(*tree).front()).GetClass();
+    const auto& body = static_cast<const MethodBody&>(*cls.GetMethod("value"s)->body).GetBody();
+    const auto& statements = static_cast<const Compound&>(body).GetStatements();
+    ASSERT_EQUAL(statements.size(), 1U);
+    const auto& ret = dynamic_cast<const Return&>(*statements.front());
+    ASSERT_EQUAL(dynamic_cast<const NumericConst&>(ret.GetStatement()).GetValue().GetValue(), 7);
+}
+
+void TestErrorsArePreserved() {
+    auto tree = ParseFromString("print 1 / 0, 1 + 'a'\n"s, true);
+    const auto& args = static_cast<const Print&>(*Statements(*tree).front()).GetArgs();
+    ASSERT(dynamic_cast<const Div*>(args[0].get()) != nullptr);
+    ASSERT(dynamic_cast<const Add*>(args[1].get()) != nullptr);
+    ASSERT_THROWS(Run(*tree), std::runtime_error);
+}
+
+void TestSameOutput() {
+    AssertSameOutput("print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2, -3\n"s,
+                     "15 120 -13 3 15 -3\n"s);
+    AssertSameOutput("x = 'C++ ' + 'black belt'\nprint x, str(42), str(None)\n"s,
+                     "C++ black belt 42 None\n"s);
+    AssertSameOutput("print 1 < 2, 2 > 1, 1 == 1, 1 != 1, 'a' <= 'b', 'b' >= 'c'\n"s,
+                     "True True True False True False\n"s);
+    AssertSameOutput("x = 0\nif x:\n  print 1\nelse:\n  if not x:\n    print 2\n"s, "2\n"s);
+}
+
+}  // namespace
+
+void RunOptimizerTests(TestRunner& tr) {
+    RUN_TEST(tr, ast::TestConstantFolding);
+    RUN_TEST(tr, ast::TestLogicalFolding);
+    RUN_TEST(tr, ast::TestConstantConditions);
+    RUN_TEST(tr, ast::TestMethodBodies);
+    RUN_TEST(tr, ast::TestErrorsArePreserved);
+    RUN_TEST(tr, ast::TestSameOutput);
+}
+
+}  // namespace ast
@@ -0,0 +1,62 @@
+#include "output_buffer.h"
+
+#include <charconv>
+#include <limits>
+#include <ostream>
+
+using namespace std;
+
+namespace runtime {
+
+OutputBuffer::OutputBuffer(ostream& sink, size_t flush_threshold)
+    : sink_(&sink), flush_threshold_(flush_threshold) {
+    if (flush_threshold_ > 0) {
+        data_.reserve(flush_threshold_);
+    }
+}
+
+OutputBuffer::~OutputBuffer() {
+    Flush();
+}
+
+void OutputBuffer::Append(int value) {
+    // Знак и все десятичные цифры int
+    char digits[numeric_limits<int>::digits10 + 2];
+    const auto result = to_chars(begin(digits), end(digits), value);
+    data_.append(digits, result.ptr);
+    FlushIfFull();
+}
+
+void OutputBuffer::Flush() {
+    if (sink_ != nullptr && !data_.empty()) {
+        sink_->write(data_.data(), static_cast<streamsize>(data_.size()));
+        released_ += data_.size();
+        data_.clear();
+    }
+}
+
+string OutputBuffer::Take() {
+    released_ += data_.size();
+    string result = std::move(data_);
+    data_.clear();
+    return result;
+}
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type ch) {
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        Append(traits_type::to_char_type(ch));
+    }
+    return traits_type::not_eof(ch);
+}
+
+streamsize OutputBuffer::xsputn(const char* s, streamsize count) {
+    Append(string_view(s, static_cast<size_t>(count)));
+    return count;
+}
+
+int OutputBuffer::sync() {
+    Flush();
+    return 0;
+}
+
+}  // namespace runtime
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+namespace runtime {
+
+/*
+ * Буфер вывода программы Mython. Текст и числа дописываются в конец непрерывного буфера без
+ * обращения к механизмам std::ostream; числа форматируются функцией std::to_chars.
+ * Буфер с приёмником сбрасывает накопленные данные в приёмник одной записью, как только их
+ * объём достигает порога, а также при вызове Flush и при удалении буфера. Буфер без приёмника
+ * накапливает весь вывод, который затем можно забрать без копирования методом Take.
+ * Буфер является и std::streambuf, поэтому запись через std::ostream, связанный с ним,
+ * не нарушает порядок вывода
+ */
+class OutputBuffer : public std::streambuf {
+public:
+    static constexpr std::size_t DEFAULT_FLUSH_THRESHOLD = 64 * 1024;
+
+    // Создаёт буфер, накапливающий весь вывод
+    OutputBuffer() = default;
+    // Создаёт буфер, сбрасывающий вывод в sink. При flush_threshold == 0 данные передаются в
+    // sink после каждой записи
+    explicit OutputBuffer(std::ostream& sink,
+                          std::size_t flush_threshold = DEFAULT_FLUSH_THRESHOLD);
+    ~OutputBuffer() override;
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void Append(std::string_view text) {
+        data_.append(text);
+        FlushIfFull();
+    }
+
+    void Append(char c) {
+        data_.push_back(c);
+        FlushIfFull();
+    }
+
+    // Дописывает десятичную запись числа
+    void Append(int value);
+
+    // Передаёт накопленные данные приёмнику. Без приёмника ничего не делает
+    void Flush();
+
+    // Возвращает данные, ещё не переданные приёмнику
+    [[nodiscard]] std::string_view View() const {
+        return data_;
+    }
+
+    // Забирает накопленные данные, оставляя буфер пустым
+    [[nodiscard]] std::string Take();
+
+    // Возвращает объём всех данных, записанных в буфер, в том числе переданных приёмнику
+    // и забранных методом Take
+    [[nodiscard]] std::size_t GetTotalSize() const {
+        return released_ + data_.size();
+    }
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize count) override;
+    int sync() override;
+
+private:
+    void FlushIfFull() {
+        if (sink_ != nullptr && data_.size() >= flush_threshold_) {
+            Flush();
+        }
+    }
+
+    std::ostream* sink_ = nullptr;
+    std::size_t flush_threshold_ = 0;
+    std::string data_;
+    // Объём данных, уже переданных приёмнику или забранных
+    std::size_t released_ = 0;
+};
+
+}  // namespace runtime
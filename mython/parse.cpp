@@ -1,8 +1,14 @@
 #include "parse.h"
 
 #include "lexer.h"
+#include "metrics.h"
+#include "source_map.h"
 #include "statement.h"
 
+#include <optional>
+#include <unordered_set>
+#include <utility>
+
 using namespace std;
 
 namespace TokenType = parse::token_type;
@@ -17,16 +23,51 @@ bool operator!=(const parse::Token& token, char c) {
     return !(token == c);
 }
 
+// Ссылки модуля, разобранного независимо от остальных, на классы, объявленные в других модулях.
+// Позиции ссылок - те, с которыми ParseProgram сообщила бы об ошибке, если бы класса не
+// оказалось и в других модулях, поэтому ошибки связывания выводятся так же, как ошибки разбора
+struct ModuleLinks {
+    // Класс модуля. Если его базовый класс в модуле не объявлен, base - имя базового класса,
+    // а сам класс создан без родителя
+    struct Declaration {
+        runtime::Class* cls;
+        uint32_t offset;
+        optional<runtime::Symbol> base;
+        uint32_t base_offset = 0;
+    };
+
+    // Создание экземпляра класса, который в модуле не объявлен
+    struct Instance {
+        ast::NewInstance* node;
+        runtime::Symbol name;
+        uint32_t offset;
+    };
+
+    vector<Declaration> classes;
+    vector<Instance> instances;
+};
+
+// Класс, с которым создаются узлы NewInstance до связывания модулей
+const runtime::Class& UnlinkedClass() {
+    static const runtime::Class cls("<unlinked>"s, {}, nullptr);
+    return cls;
+}
+
 class Parser {
 public:
-    explicit Parser(parse::Lexer& lexer)
-        : lexer_(lexer) {
+    // При owning_constants константы вне методов возвращают копии своих значений.
+    // Если задан links, классы, не объявленные в тексте, не считаются ошибкой, а ссылки на них
+    // сохраняются в links для последующего связывания
+    Parser(parse::Lexer& lexer, shared_ptr<runtime::Arena> arena, bool owning_constants = false,
+           ModuleLinks* links = nullptr)
+        : lexer_(lexer), arena_(std::move(arena)), owning_constants_(owning_constants),
+          links_(links) {
     }
 
     // Program -> eps
     //          | Statement \n Program
     unique_ptr<ast::Statement> ParseProgram() {
-        auto result = make_unique<ast::Compound>();
+        auto result = At(lexer_.CurrentOffset(), make_unique<ast::Compound>());
         while (!lexer_.CurrentToken().Is<TokenType::Eof>()) {
             result->AddStatement(ParseStatement());
         }
@@ -34,7 +75,36 @@ public:
         return result;
     }
 
+    // Возвращает очередную инструкцию программы либо nullptr, если текст закончился
+    unique_ptr<ast::Statement> ParseNextStatement() {
+        if (lexer_.CurrentToken().Is<TokenType::Eof>()) {
+            return nullptr;
+        }
+        return ParseStatement();
+    }
+
+    // Возвращает классы, объявленные после предыдущего вызова, в порядке объявления
+    vector<runtime::ObjectHolder> TakeClasses() {
+        return std::exchange(classes_, {});
+    }
+
 private:
+    // Назначает узлу смещение offset в исходном тексте и возвращает узел
+    template <typename Node>
+    static unique_ptr<Node> At(uint32_t offset, unique_ptr<Node> node) {
+        node->SetSourceOffset(offset);
+        return node;
+    }
+
+    // Создаёт константу со значением value
+    template <typename T>
+    unique_ptr<ast::Statement> MakeConstant(T value) const {
+        if (owning_constants_ && method_scopes_.empty()) {
+            return make_unique<ast::OwnedValueStatement<T>>(std::move(value));
+        }
+        return make_unique<ast::ValueStatement<T>>(std::move(value));
+    }
+
     // Suite -> NEWLINE INDENT (Statement)+ DEDENT
     unique_ptr<ast::Statement> ParseSuite()  // NOLINT
     {
@@ -43,7 +113,7 @@ private:
 
         lexer_.NextToken();
 
-        auto result = make_unique<ast::Compound>();
+        auto result = At(lexer_.CurrentOffset(), make_unique<ast::Compound>());
         while (!lexer_.CurrentToken().Is<TokenType::Dedent>()) {
             result->AddStatement(ParseStatement());  // NOLINT
         }
@@ -60,6 +130,7 @@ private:
         vector<runtime::Method> result;
 
         while (lexer_.CurrentToken().Is<TokenType::Def>()) {
+            const uint32_t offset = lexer_.CurrentOffset();
             runtime::Method m;
 
             m.name = lexer_.ExpectNext<TokenType::Id>().value;
@@ -76,7 +147,17 @@ private:
             lexer_.ExpectNext<TokenType::Char>(':');
             lexer_.NextToken();
 
-            m.body = std::make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+            // self занимает слот 0, параметры - слоты 1..N. При повторе имени параметра
+            // переменной соответствует последний из них, как и при заполнении Closure
+            MethodScope& scope = method_scopes_.emplace_back();
+            scope.slots[runtime::PredefinedSymbol::Self] = 0;
+            for (const auto& param : m.formal_params) {
+                scope.slots[param] = scope.frame_size++;
+            }
+
+            m.body = At(offset, std::make_unique<ast::MethodBody>(ParseSuite()));  // NOLINT
+            m.frame_size = method_scopes_.back().frame_size;
+            method_scopes_.pop_back();
 
             result.push_back(std::move(m));
         }
@@ -86,46 +167,85 @@ private:
     // ClassDefinition -> Id ['(' Id ')'] : new_line indent MethodList dedent
     unique_ptr<ast::Statement> ParseClassDefinition()  // NOLINT
     {
-        string class_name = lexer_.Expect<TokenType::Id>().value;
+        string class_name = lexer_.Expect<TokenType::Id>().value.GetName();
 
         lexer_.NextToken();
 
         const runtime::Class* base_class = nullptr;
+        optional<runtime::Symbol> linked_base;
+        uint32_t base_offset = 0;
         if (lexer_.CurrentToken() == '(') {
             auto name = lexer_.ExpectNext<TokenType::Id>().value;
             lexer_.ExpectNext<TokenType::Char>(')');
             lexer_.NextToken();
+            base_offset = lexer_.CurrentOffset();
 
             auto it = declared_classes_.find(name);
-            if (it == declared_classes_.end()) {
-                throw ParseError("Base class "s + name + " not found for class "s + class_name);
+            if (it != declared_classes_.end()) {
+                base_class = static_cast<const runtime::Class*>(it->second.Get());  // NOLINT
+            } else if (links_ != nullptr) {
+                linked_base = name;
+            } else {
+                throw ParseError("Base class "s + name.GetName() + " not found for class "s + class_name);
             }
-            base_class = static_cast<const runtime::Class*>(it->second.Get());  // NOLINT
         }
 
         lexer_.Expect<TokenType::Char>(':');
         lexer_.ExpectNext<TokenType::Newline>();
         lexer_.ExpectNext<TokenType::Indent>();
         lexer_.ExpectNext<TokenType::Def>();
-        vector<runtime::Method> methods = ParseMethods();  // NOLINT
+        vector<runtime::Method> methods;
+        {
+            // Тела методов живут вместе с классом, даже если инструкции программы в арене
+            // не размещаются
+            runtime::Arena::Scope scope(*arena_);
+            methods = ParseMethods();  // NOLINT
+        }
 
         lexer_.Expect<TokenType::Dedent>();
         lexer_.NextToken();
 
         auto [it, inserted] = declared_classes_.insert({
             class_name,
-            runtime::ObjectHolder::Own(runtime::Class(class_name, std::move(methods), base_class)),
+            runtime::ObjectHolder::Own(runtime::Class(class_name, std::move(methods), base_class, arena_)),
         });
 
         if (!inserted) {
             throw ParseError("Class "s + class_name + " already exists"s);
         }
+        classes_.push_back(it->second);
+        if (links_ != nullptr) {
+            links_->classes.push_back({it->second.TryAs<runtime::Class>(), lexer_.CurrentOffset(),
+                                       linked_base, base_offset});
+        }
 
         return make_unique<ast::ClassDefinition>(it->second);
     }
 
-    vector<string> ParseDottedIds() {
-        vector<string> result(1, lexer_.Expect<TokenType::Id>().value);
+    // Возвращает номер слота переменной name в кадре разбираемого метода.
+    // Переменные метода не видны за его пределами, поэтому каждое новое имя получает новый слот.
+    // Вне методов переменные хранятся в Closure, и слот не назначается
+    optional<size_t> ResolveSlot(runtime::Symbol name) {
+        if (method_scopes_.empty()) {
+            return nullopt;
+        }
+        MethodScope& scope = method_scopes_.back();
+        auto [it, inserted] = scope.slots.emplace(name, scope.frame_size);
+        if (inserted) {
+            ++scope.frame_size;
+        }
+        return it->second;
+    }
+
+    ast::VariableValue MakeVariableValue(vector<runtime::Symbol> dotted_ids) {
+        if (auto slot = ResolveSlot(dotted_ids.front())) {
+            return ast::VariableValue(std::move(dotted_ids), *slot);
+        }
+        return ast::VariableValue(std::move(dotted_ids));
+    }
+
+    vector<runtime::Symbol> ParseDottedIds() {
+        vector<runtime::Symbol> result(1, lexer_.Expect<TokenType::Id>().value);
 
         while (lexer_.NextToken() == '.') {
             result.push_back(lexer_.ExpectNext<TokenType::Id>().value);
@@ -138,25 +258,31 @@ private:
     //               | DottedIds '(' ExprList ')'
     unique_ptr<ast::Statement> ParseAssignmentOrCall() {
         lexer_.Expect<TokenType::Id>();
+        const uint32_t offset = lexer_.CurrentOffset();
 
-        vector<string> id_list = ParseDottedIds();
-        string last_name = id_list.back();
+        vector<runtime::Symbol> id_list = ParseDottedIds();
+        runtime::Symbol last_name = id_list.back();
         id_list.pop_back();
 
         if (lexer_.CurrentToken() == '=') {
             lexer_.NextToken();
 
             if (id_list.empty()) {
+                if (auto slot = ResolveSlot(last_name)) {
+                    return make_unique<ast::Assignment>(std::move(last_name), ParseTest(), *slot);
+                }
                 return make_unique<ast::Assignment>(std::move(last_name), ParseTest());
             }
-            return make_unique<ast::FieldAssignment>(ast::VariableValue{std::move(id_list)},
-                                                     std::move(last_name), ParseTest());
+            ast::VariableValue object = MakeVariableValue(std::move(id_list));
+            object.SetSourceOffset(offset);
+            return make_unique<ast::FieldAssignment>(std::move(object), std::move(last_name),
+                                                     ParseTest());
         }
         lexer_.Expect<TokenType::Char>('(');
         lexer_.NextToken();
 
         if (id_list.empty()) {
-            throw ParseError("Mython doesn't support functions, only methods: "s + last_name);
+            throw ParseError("Mython doesn't support functions, only methods: "s + last_name.GetName());
         }
 
         vector<unique_ptr<ast::Statement>> args;
@@ -166,22 +292,24 @@ private:
         lexer_.Expect<TokenType::Char>(')');
         lexer_.NextToken();
 
-        return make_unique<ast::MethodCall>(make_unique<ast::VariableValue>(std::move(id_list)),
-                                            std::move(last_name), std::move(args));
+        return make_unique<ast::MethodCall>(
+            At(offset, make_unique<ast::VariableValue>(MakeVariableValue(std::move(id_list)))),
+            std::move(last_name), std::move(args));
     }
 
     // Expr -> Adder ['+'/'-' Adder]*
     unique_ptr<ast::Statement> ParseExpression()  // NOLINT
     {
         unique_ptr<ast::Statement> result = ParseAdder();
+        const uint32_t offset = result->GetSourceOffset();
         while (lexer_.CurrentToken() == '+' || lexer_.CurrentToken() == '-') {
             char op = lexer_.CurrentToken().As<TokenType::Char>().value;
             lexer_.NextToken();
 
             if (op == '+') {
-                result = make_unique<ast::Add>(std::move(result), ParseAdder());
+                result = At(offset, make_unique<ast::Add>(std::move(result), ParseAdder()));
             } else {
-                result = make_unique<ast::Sub>(std::move(result), ParseAdder());
+                result = At(offset, make_unique<ast::Sub>(std::move(result), ParseAdder()));
             }
         }
         return result;
@@ -191,14 +319,15 @@ private:
     unique_ptr<ast::Statement> ParseAdder()  // NOLINT
     {
         unique_ptr<ast::Statement> result = ParseMult();
+        const uint32_t offset = result->GetSourceOffset();
         while (lexer_.CurrentToken() == '*' || lexer_.CurrentToken() == '/') {
             char op = lexer_.CurrentToken().As<TokenType::Char>().value;
             lexer_.NextToken();
 
             if (op == '*') {
-                result = make_unique<ast::Mult>(std::move(result), ParseMult());
+                result = At(offset, make_unique<ast::Mult>(std::move(result), ParseMult()));
             } else {
-                result = make_unique<ast::Div>(std::move(result), ParseMult());
+                result = At(offset, make_unique<ast::Div>(std::move(result), ParseMult()));
             }
         }
         return result;
@@ -215,6 +344,7 @@ private:
     //       | DottedIds
     unique_ptr<ast::Statement> ParseMult()  // NOLINT
     {
+        const uint32_t offset = lexer_.CurrentOffset();
         if (lexer_.CurrentToken() == '(') {
             lexer_.NextToken();
             auto result = ParseTest();
@@ -224,36 +354,37 @@ private:
         }
         if (lexer_.CurrentToken() == '-') {
             lexer_.NextToken();
-            return make_unique<ast::Mult>(ParseMult(), make_unique<ast::NumericConst>(-1));
+            return At(offset, make_unique<ast::Mult>(ParseMult(), At(offset, MakeConstant(runtime::Number(-1)))));
         }
         if (const auto* num = lexer_.CurrentToken().TryAs<TokenType::Number>()) {
             int result = num->value;
             lexer_.NextToken();
-            return make_unique<ast::NumericConst>(result);
+            return At(offset, MakeConstant(runtime::Number(result)));
         }
         if (const auto* str = lexer_.CurrentToken().TryAs<TokenType::String>()) {
             string result = str->value;
             lexer_.NextToken();
-            return make_unique<ast::StringConst>(std::move(result));
+            return At(offset, MakeConstant(runtime::String(std::move(result))));
         }
         if (lexer_.CurrentToken().Is<TokenType::True>()) {
             lexer_.NextToken();
-            return make_unique<ast::BoolConst>(runtime::Bool(true));
+            return At(offset, MakeConstant(runtime::Bool(true)));
         }
         if (lexer_.CurrentToken().Is<TokenType::False>()) {
             lexer_.NextToken();
-            return make_unique<ast::BoolConst>(runtime::Bool(false));
+            return At(offset, MakeConstant(runtime::Bool(false)));
         }
         if (lexer_.CurrentToken().Is<TokenType::None>()) {
             lexer_.NextToken();
-            return make_unique<ast::None>();
+            return At(offset, make_unique<ast::None>());
         }
 
         return ParseDottedIdsInMultExpr();
     }
 
     std::unique_ptr<ast::Statement> ParseDottedIdsInMultExpr() {
-        vector<string> names = ParseDottedIds();
+        const uint32_t offset = lexer_.CurrentOffset();
+        vector<runtime::Symbol> names = ParseDottedIds();
 
         if (lexer_.CurrentToken() == '(') {
             // various calls
@@ -268,23 +399,28 @@ private:
             names.pop_back();
 
             if (!names.empty()) {
-                return make_unique<ast::MethodCall>(
-                    make_unique<ast::VariableValue>(std::move(names)), std::move(method_name),
-                    std::move(args));
+                return At(offset, make_unique<ast::MethodCall>(
+                    At(offset, make_unique<ast::VariableValue>(MakeVariableValue(std::move(names)))),
+                    std::move(method_name), std::move(args)));
             }
             if (auto it = declared_classes_.find(method_name); it != declared_classes_.end()) {
-                return make_unique<ast::NewInstance>(
-                    static_cast<const runtime::Class&>(*it->second), std::move(args));  // NOLINT
+                return At(offset, make_unique<ast::NewInstance>(
+                    static_cast<const runtime::Class&>(*it->second), std::move(args)));  // NOLINT
             }
             if (method_name == "str"sv) {
                 if (args.size() != 1) {
                     throw ParseError("Function str takes exactly one argument"s);
                 }
-                return make_unique<ast::Stringify>(std::move(args.front()));
+                return At(offset, make_unique<ast::Stringify>(std::move(args.front())));
             }
-            throw ParseError("Unknown call to "s + method_name + "()"s);
+            if (links_ != nullptr) {
+                auto node = At(offset, make_unique<ast::NewInstance>(UnlinkedClass(), std::move(args)));
+                links_->instances.push_back({node.get(), method_name, lexer_.CurrentOffset()});
+                return node;
+            }
+            throw ParseError("Unknown call to "s + method_name.GetName() + "()"s);
         }
-        return make_unique<ast::VariableValue>(std::move(names));
+        return At(offset, make_unique<ast::VariableValue>(MakeVariableValue(std::move(names))));
     }
 
     vector<unique_ptr<ast::Statement>> ParseTestList()  // NOLINT
@@ -330,9 +466,10 @@ private:
     unique_ptr<ast::Statement> ParseTest()  // NOLINT
     {
         auto result = ParseAndTest();
+        const uint32_t offset = result->GetSourceOffset();
         while (lexer_.CurrentToken().Is<TokenType::Or>()) {
             lexer_.NextToken();
-            result = make_unique<ast::Or>(std::move(result), ParseAndTest());
+            result = At(offset, make_unique<ast::Or>(std::move(result), ParseAndTest()));
         }
         return result;
     }
@@ -340,9 +477,10 @@ private:
     unique_ptr<ast::Statement> ParseAndTest()  // NOLINT
     {
         auto result = ParseNotTest();
+        const uint32_t offset = result->GetSourceOffset();
         while (lexer_.CurrentToken().Is<TokenType::And>()) {
             lexer_.NextToken();
-            result = make_unique<ast::And>(std::move(result), ParseNotTest());
+            result = At(offset, make_unique<ast::And>(std::move(result), ParseNotTest()));
         }
         return result;
     }
@@ -350,8 +488,9 @@ private:
     unique_ptr<ast::Statement> ParseNotTest()  // NOLINT
     {
         if (lexer_.CurrentToken().Is<TokenType::Not>()) {
+            const uint32_t offset = lexer_.CurrentOffset();
             lexer_.NextToken();
-            return make_unique<ast::Not>(ParseNotTest());  // NOLINT
+            return At(offset, make_unique<ast::Not>(ParseNotTest()));  // NOLINT
         }
         return ParseComparison();
     }
@@ -360,38 +499,39 @@ private:
     unique_ptr<ast::Statement> ParseComparison()  // NOLINT
     {
         auto result = ParseExpression();
+        const uint32_t offset = result->GetSourceOffset();
 
         const auto tok = lexer_.CurrentToken();
 
         if (tok == '<') {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Less, std::move(result),
-                                                ParseExpression());
+            return At(offset, ast::Comparison::Make(runtime::CompareOp::Less,
+                                                    std::move(result), ParseExpression()));
         }
         if (tok == '>') {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Greater, std::move(result),
-                                                ParseExpression());
+            return At(offset, ast::Comparison::Make(runtime::CompareOp::Greater,
+                                                    std::move(result), ParseExpression()));
         }
         if (tok.Is<TokenType::Eq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Equal, std::move(result),
-                                                ParseExpression());
+            return At(offset, ast::Comparison::Make(runtime::CompareOp::Equal,
+                                                    std::move(result), ParseExpression()));
         }
         if (tok.Is<TokenType::NotEq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::NotEqual, std::move(result),
-                                                ParseExpression());
+            return At(offset, ast::Comparison::Make(runtime::CompareOp::NotEqual,
+                                                    std::move(result), ParseExpression()));
         }
         if (tok.Is<TokenType::LessOrEq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::LessOrEqual, std::move(result),
-                                                ParseExpression());
+            return At(offset, ast::Comparison::Make(runtime::CompareOp::LessOrEqual,
+                                                    std::move(result), ParseExpression()));
         }
         if (tok.Is<TokenType::GreaterOrEq>()) {
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::GreaterOrEqual, std::move(result),
-                                                ParseExpression());
+            return At(offset, ast::Comparison::Make(runtime::CompareOp::GreaterOrEqual,
+                                                    std::move(result), ParseExpression()));
         }
         return result;
     }
@@ -402,15 +542,16 @@ private:
     unique_ptr<ast::Statement> ParseStatement()  // NOLINT
     {
         const auto& tok = lexer_.CurrentToken();
+        const uint32_t offset = lexer_.CurrentOffset();
 
         if (tok.Is<TokenType::Class>()) {
             lexer_.NextToken();
-            return ParseClassDefinition();  // NOLINT
+            return At(offset, ParseClassDefinition());  // NOLINT
         }
         if (tok.Is<TokenType::If>()) {
-            return ParseCondition();
+            return At(offset, ParseCondition());
         }
-        auto result = ParseSimpleStatement();
+        auto result = At(offset, ParseSimpleStatement());
         lexer_.Expect<TokenType::Newline>();
         lexer_.NextToken();
         return result;
@@ -437,12 +578,183 @@ private:
         return ParseAssignmentOrCall();
     }
 
+    // Переменные метода, тело которого сейчас разбирается
+    struct MethodScope {
+        unordered_map<runtime::Symbol, size_t> slots;
+        size_t frame_size = 1;
+    };
+
     parse::Lexer& lexer_;
+    shared_ptr<runtime::Arena> arena_;
     runtime::Closure declared_classes_;
+    // Классы программы в порядке объявления
+    vector<runtime::ObjectHolder> classes_;
+    vector<MethodScope> method_scopes_;
+    bool owning_constants_;
+    ModuleLinks* links_;
 };
 
+// Дополняет сообщение об ошибке разбора позицией текущей лексемы в формате "имя:строка:столбец: "
+string Locate(const parse::Lexer& lexer, const std::exception& error) {
+    return lexer.GetSourceMap().Format(lexer.CurrentOffset()) + ": "s + error.what();
+}
+
 }  // namespace
 
 unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer) {
-    return Parser{lexer}.ParseProgram();
+    // Узлы дерева размещаются в арене в порядке разбора, который близок к порядку исполнения.
+    // Сам узел Program создаётся в куче, так как владеет ареной
+    auto arena = make_shared<runtime::Arena>();
+    unique_ptr<ast::Statement> body;
+    vector<runtime::ObjectHolder> classes;
+    const runtime::Metrics::PhaseScope phase(runtime::Metrics::Phase::Parse);
+    try {
+        runtime::Arena::Scope scope(*arena);
+        Parser parser{lexer, arena};
+        body = parser.ParseProgram();
+        classes = parser.TakeClasses();
+    } catch (const ParseError& error) {
+        throw ParseError(Locate(lexer, error));
+    } catch (const parse::LexerError& error) {
+        throw parse::LexerError(Locate(lexer, error));
+    }
+    return make_unique<ast::Program>(std::move(arena), std::move(body), std::move(classes));
+}
+
+class ParsedModule::Impl {
+public:
+    shared_ptr<runtime::Arena> arena = make_shared<runtime::Arena>();
+    unique_ptr<ast::Statement> body;
+    vector<runtime::ObjectHolder> classes;
+    ModuleLinks links;
+};
+
+ParsedModule::ParsedModule(unique_ptr<Impl> impl)
+    : impl_(std::move(impl)) {
+}
+
+ParsedModule::ParsedModule(ParsedModule&&) noexcept = default;
+ParsedModule& ParsedModule::operator=(ParsedModule&&) noexcept = default;
+ParsedModule::~ParsedModule() = default;
+
+ParsedModule ParseModule(parse::Lexer& lexer) {
+    auto module = make_unique<ParsedModule::Impl>();
+    const runtime::Metrics::PhaseScope phase(runtime::Metrics::Phase::Parse);
+    try {
+        runtime::Arena::Scope scope(*module->arena);
+        Parser parser{lexer, module->arena, false, &module->links};
+        module->body = parser.ParseProgram();
+        module->classes = parser.TakeClasses();
+    } catch (const ParseError& error) {
+        throw ParseError(Locate(lexer, error));
+    } catch (const parse::LexerError& error) {
+        throw parse::LexerError(Locate(lexer, error));
+    }
+    return ParsedModule(std::move(module));
+}
+
+unique_ptr<runtime::Executable> LinkModules(vector<ParsedModule> modules,
+                                            const parse::SourceMap& source_map) {
+    const runtime::Metrics::PhaseScope phase(runtime::Metrics::Phase::Link);
+    const auto fail = [&source_map](uint32_t offset, const string& message) {
+        throw ParseError(source_map.Format(offset) + ": "s + message);
+    };
+
+    // Классы предшествующих модулей, которые видны очередному модулю
+    unordered_map<runtime::Symbol, const runtime::Class*> declared;
+    const auto find_class = [&declared](runtime::Symbol name) -> const runtime::Class* {
+        const auto it = declared.find(name);
+        return it != declared.end() ? it->second : nullptr;
+    };
+
+    auto arena = make_shared<runtime::Arena>();
+    vector<shared_ptr<runtime::Arena>> module_arenas;
+    vector<runtime::ObjectHolder> classes;
+    unique_ptr<ast::Compound> body;
+    {
+        runtime::Arena::Scope scope(*arena);
+        body = make_unique<ast::Compound>();
+    }
+    for (ParsedModule& parsed : modules) {
+        ParsedModule::Impl& module = *parsed.impl_;
+        for (const auto& instance : module.links.instances) {
+            const runtime::Class* cls = find_class(instance.name);
+            if (cls == nullptr) {
+                fail(instance.offset, "Unknown call to "s + instance.name.GetName() + "()"s);
+            }
+            instance.node->SetClass(*cls);
+        }
+
+        // Классы, таблицы методов которых изменились при связывании. Наследники таких классов
+        // внутри модуля перестраиваются вслед за ними
+        unordered_set<const runtime::Class*> relinked;
+        for (const auto& declaration : module.links.classes) {
+            runtime::Class& cls = *declaration.cls;
+            if (find_class(cls.GetName()) != nullptr) {
+                fail(declaration.offset, "Class "s + cls.GetName() + " already exists"s);
+            }
+            if (declaration.base) {
+                const runtime::Class* base = find_class(*declaration.base);
+                if (base == nullptr) {
+                    fail(declaration.base_offset, "Base class "s + declaration.base->GetName()
+                                                      + " not found for class "s + cls.GetName());
+                }
+                cls.SetParent(base);
+                relinked.insert(&cls);
+            } else if (relinked.count(cls.GetParent()) > 0) {
+                cls.SetParent(cls.GetParent());
+                relinked.insert(&cls);
+            }
+        }
+        for (const auto& declaration : module.links.classes) {
+            declared.emplace(declaration.cls->GetName(), declaration.cls);
+        }
+
+        body->AddStatement(std::move(module.body));
+        classes.insert(classes.end(), std::make_move_iterator(module.classes.begin()),
+                       std::make_move_iterator(module.classes.end()));
+        module_arenas.push_back(std::move(module.arena));
+    }
+    return make_unique<ast::Program>(std::move(arena), std::move(body), std::move(classes),
+                                     std::move(module_arenas));
+}
+
+class IncrementalParser::Impl {
+public:
+    explicit Impl(parse::Lexer& lexer)
+        : lexer_(lexer), parser_(lexer, make_shared<runtime::Arena>(), true) {
+    }
+
+    unique_ptr<runtime::Executable> Next() {
+        const runtime::Metrics::PhaseScope phase(runtime::Metrics::Phase::Parse);
+        try {
+            return parser_.ParseNextStatement();
+        } catch (const ParseError& error) {
+            throw ParseError(Locate(lexer_, error));
+        } catch (const parse::LexerError& error) {
+            throw parse::LexerError(Locate(lexer_, error));
+        }
+    }
+
+    vector<runtime::ObjectHolder> TakeNewClasses() {
+        return parser_.TakeClasses();
+    }
+
+private:
+    parse::Lexer& lexer_;
+    Parser parser_;
+};
+
+IncrementalParser::IncrementalParser(parse::Lexer& lexer)
+    : impl_(make_unique<Impl>(lexer)) {
+}
+
+IncrementalParser::~IncrementalParser() = default;
+
+unique_ptr<runtime::Executable> IncrementalParser::Next() {
+    return impl_->Next();
+}
+
+vector<runtime::ObjectHolder> IncrementalParser::TakeNewClasses() {
+    return impl_->TakeNewClasses();
 }
@@ -2,13 +2,16 @@
 
 #include <memory>
 #include <stdexcept>
+#include <vector>
 
 namespace parse {
 class Lexer;
-}
+class SourceMap;
+}  // namespace parse
 
 namespace runtime {
 class Executable;
+class ObjectHolder;
 }
 
 struct ParseError : std::runtime_error {
@@ -16,3 +19,68 @@ struct ParseError : std::runtime_error {
 };
 
 std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
+
+/*
+ * Модуль программы, разобранный независимо от остальных модулей, например в отдельном потоке.
+ * Базовые классы и создаваемые классы, которые в модуле не объявлены, остаются неразрешёнными,
+ * пока модуль не связан с предшествующими ему модулями функцией LinkModules
+ */
+class ParsedModule {
+public:
+    ParsedModule(ParsedModule&&) noexcept;
+    ParsedModule& operator=(ParsedModule&&) noexcept;
+    ~ParsedModule();
+
+private:
+    class Impl;
+    explicit ParsedModule(std::unique_ptr<Impl> impl);
+
+    friend ParsedModule ParseModule(parse::Lexer& lexer);
+    friend std::unique_ptr<runtime::Executable> LinkModules(std::vector<ParsedModule> modules,
+                                                            const parse::SourceMap& source_map);
+
+    std::unique_ptr<Impl> impl_;
+};
+
+// Разбирает модуль программы. Ошибки разбора выбрасываются так же, как из ParseProgram
+ParsedModule ParseModule(parse::Lexer& lexer);
+
+/*
+ * Собирает программу из модулей, перечисленных в порядке следования. Программа исполняется
+ * так же, как текст модулей, записанных подряд: модулю видны классы предшествующих модулей,
+ * а имена классов не должны повторяться. Встроенная функция str вызывается и в модулях,
+ * следующих за модулем, объявившим класс str.
+ * source_map - таблица строк всех модулей, по которой сообщения об ошибках связывания
+ * начинаются с позиции ссылки на класс. Модули должны быть разобраны из лексеров, смещения
+ * которых не пересекаются
+ */
+std::unique_ptr<runtime::Executable> LinkModules(std::vector<ParsedModule> modules,
+                                                 const parse::SourceMap& source_map);
+
+/*
+ * Разбирает программу по одной инструкции верхнего уровня, не дожидаясь конца текста, чтобы
+ * каждую инструкцию можно было исполнить сразу после разбора и затем удалить.
+ * Узлы инструкций размещаются в куче, а константы вне методов при исполнении возвращают
+ * собственные копии значений, поэтому значения, сохранённые программой в переменных и полях,
+ * переживают удаление инструкции. Классы и тела их методов размещаются в арене и существуют,
+ * пока существует IncrementalParser
+ */
+class IncrementalParser {
+public:
+    explicit IncrementalParser(parse::Lexer& lexer);
+    ~IncrementalParser();
+
+    IncrementalParser(const IncrementalParser&) = delete;
+    IncrementalParser& operator=(const IncrementalParser&) = delete;
+
+    // Возвращает очередную инструкцию верхнего уровня либо nullptr, если текст закончился.
+    // Ошибки разбора выбрасываются так же, как из ParseProgram
+    std::unique_ptr<runtime::Executable> Next();
+
+    // Возвращает классы, объявленные после предыдущего вызова, в порядке объявления
+    std::vector<runtime::ObjectHolder> TakeNewClasses();
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
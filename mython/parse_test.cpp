@@ -244,6 +244,111 @@ print r, c, t1, t2
                  "Rect(10x20) Circle(52) Triangle(3, 4, 5) Wrong triangle\n"s);
 }
 
+void TestMethodSlots() {
+    const string program = R"(
+class Counter:
+  def count(a, b, a):
+    total = a + b
+    if total > 10:
+      unused = 0
+    return total + a
+
+  def broken():
+    return missing
+
+c = Counter()
+print c.count(1, 2, 3)
+)"s;
+
+    auto tree = ParseProgramFromString(program);
+    const auto& statements = static_cast<const ast::Compound&>(
+        static_cast<const ast::Program&>(*tree).GetBody()).GetStatements();
+    const auto& cls = static_cast<const ast::ClassDefinition&>(*statements.front()).GetClass();
+
+    // self, три параметра и две локальные переменные
+    ASSERT_EQUAL(cls.GetMethod("count"s)->frame_size, 6U);
+    ASSERT_EQUAL(cls.GetMethod("broken"s)->frame_size, 2U);
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    tree->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "8\n"s);
+    // Локальные переменные метода не попадают в глобальную область видимости
+    ASSERT(closure.count("total"s) == 0);
+
+    closure.clear();
+    auto broken = ParseProgramFromString(
+        "class A:\n  def f():\n    return x\na = A()\nprint a.f()\n"s);
+    ASSERT_THROWS(broken->Execute(closure, context), std::runtime_error);
+}
+
+void TestProgramArena() {
+    runtime::DummyContext context;
+    runtime::ObjectHolder cls;
+    {
+        auto tree = ParseProgramFromString("class Math:\n  def twice(n):\n    return n + n\n"s);
+        const auto* root = dynamic_cast<const ast::Program*>(tree.get());
+        ASSERT(root != nullptr);
+        ASSERT(root->GetArena().GetAllocatedBytes() > 0U);
+        ASSERT(runtime::Arena::Current() == nullptr);
+        ASSERT_EQUAL(root->GetClasses().size(), 1U);
+        cls = root->GetClasses().front();
+    }
+
+    // Класс программы продлевает жизнь арены, в которой лежат тела его методов
+    runtime::ClassInstance math(*cls.TryAs<runtime::Class>());
+    auto result = math.Call("twice"s, {runtime::ObjectHolder::Own(runtime::Number{21})}, context);
+    ASSERT_EQUAL(result.TryAs<runtime::Number>()->GetValue(), 42);
+
+    ASSERT_THROWS(ParseProgramFromString("class A(B):\n  def f():\n    return 1\n"s), ParseError);
+    ASSERT(runtime::Arena::Current() == nullptr);
+}
+
+void TestSourceOffsets() {
+    const string program = "x = 1\nclass A:\n  def f(n):\n    return n * -2\nprint x + 1\n"s;
+    auto tree = ParseProgramFromString(program);
+    const auto& statements = static_cast<const ast::Compound&>(
+        static_cast<const ast::Program&>(*tree).GetBody()).GetStatements();
+    ASSERT_EQUAL(statements.size(), 3U);
+    ASSERT_EQUAL(statements[0]->GetSourceOffset(), 0U);
+    ASSERT_EQUAL(statements[1]->GetSourceOffset(), 6U);
+    ASSERT_EQUAL(statements[2]->GetSourceOffset(), 45U);
+
+    const auto& cls = static_cast<const ast::ClassDefinition&>(*statements[1]).GetClass();
+    ASSERT_EQUAL(cls.GetMethod("f"s)->body->GetSourceOffset(), 17U);
+
+    // Бинарная операция начинается там же, где её левый операнд
+    const auto& print = static_cast<const ast::Print&>(*statements[2]);
+    const auto& sum = static_cast<const ast::Add&>(*print.GetArgs().front());
+    ASSERT_EQUAL(sum.GetSourceOffset(), 51U);
+    ASSERT_EQUAL(sum.GetLhs().GetSourceOffset(), 51U);
+    ASSERT_EQUAL(sum.GetRhs().GetSourceOffset(), 55U);
+}
+
+void TestErrorLocations() {
+    auto parse_error = [](const string& program) -> string {
+        try {
+            ParseProgramFromString(program);
+        } catch (const std::runtime_error& error) {
+            return error.what();
+        }
+        return {};
+    };
+    ASSERT_EQUAL(parse_error("x = 1\nprint )\n"s).substr(0, 5), "2:7: "s);
+    ASSERT_EQUAL(parse_error("print 1\nx = foo(1)\n"s), "2:11: Unknown call to foo()"s);
+    ASSERT_THROWS(ParseProgramFromString("x = 1\nprint )\n"s), LexerError);
+
+    auto tree = ParseProgramFromString("print 1\nif 1:\n  x = 1 / 0\n"s);
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    try {
+        tree->Execute(closure, context);
+        ASSERT(false);
+    } catch (const runtime::ExecutionError& error) {
+        ASSERT_EQUAL(error.GetSourceOffset(), 16U);
+    }
+}
+
 }  // namespace parse
 
 void TestParseProgram(TestRunner& tr) {
@@ -255,4 +360,8 @@ void TestParseProgram(TestRunner& tr) {
     RUN_TEST(tr, parse::TestRecursion2);
     RUN_TEST(tr, parse::TestComplexLogicalExpression);
     RUN_TEST(tr, parse::TestClassicalPolymorphism);
+    RUN_TEST(tr, parse::TestMethodSlots);
+    RUN_TEST(tr, parse::TestProgramArena);
+    RUN_TEST(tr, parse::TestSourceOffsets);
+    RUN_TEST(tr, parse::TestErrorLocations);
 }
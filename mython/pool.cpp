@@ -0,0 +1,116 @@
+#include "pool.h"
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+constexpr size_t CLASS_COUNT = ObjectPool::MAX_SIZE / ObjectPool::GRANULARITY;
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+// Списки свободных блоков потока. Тип тривиально разрушаемый, поэтому блоки можно возвращать
+// в пул и во время удаления статических объектов. Блоки, оставшиеся в списках завершившегося
+// потока, повторно не используются
+thread_local array<FreeBlock*, CLASS_COUNT> free_lists{};
+// Количество блоков, выделенных потоком
+thread_local uint64_t allocation_count = 0;
+// Объём памяти, выделенной потоком и не освобождённой им
+thread_local int64_t heap_bytes = 0;
+
+// Участки памяти всех пулов. Хранятся до завершения процесса
+struct Chunks {
+    mutex lock;
+    vector<void*> chunks;
+};
+
+Chunks& GetChunks() {
+    static auto* chunks = new Chunks;
+    return *chunks;
+}
+
+size_t SizeClass(size_t size) {
+    return (size + ObjectPool::GRANULARITY - 1) / ObjectPool::GRANULARITY - 1;
+}
+
+// Нарезает новый участок памяти на блоки класса size_class
+FreeBlock* AllocateChunk(size_t size_class) {
+    const size_t block_size = (size_class + 1) * ObjectPool::GRANULARITY;
+    void* chunk = ::operator new(ObjectPool::CHUNK_SIZE);
+    {
+        Chunks& chunks = GetChunks();
+        lock_guard guard(chunks.lock);
+        chunks.chunks.push_back(chunk);
+    }
+
+    auto* begin = static_cast<char*>(chunk);
+    const size_t block_count = ObjectPool::CHUNK_SIZE / block_size;
+    FreeBlock* head = nullptr;
+    for (size_t i = block_count; i > 0; --i) {
+        head = new (begin + (i - 1) * block_size) FreeBlock{head};
+    }
+    return head;
+}
+
+}  // namespace
+
+void* ObjectPool::Allocate(size_t size) {
+    ++allocation_count;
+    return AllocateBuffer(size);
+}
+
+void* ObjectPool::AllocateBuffer(size_t size) {
+    heap_bytes += static_cast<int64_t>(size);
+    if (size == 0 || size > MAX_SIZE) {
+        return ::operator new(size);
+    }
+    FreeBlock*& head = free_lists[SizeClass(size)];
+    if (head == nullptr) {
+        head = AllocateChunk(SizeClass(size));
+    }
+    FreeBlock* block = head;
+    head = block->next;
+    return block;
+}
+
+void ObjectPool::Deallocate(void* ptr, size_t size) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    heap_bytes -= static_cast<int64_t>(size);
+    if (size == 0 || size > MAX_SIZE) {
+        ::operator delete(ptr);
+        return;
+    }
+    FreeBlock*& head = free_lists[SizeClass(size)];
+    head = new (ptr) FreeBlock{head};
+}
+
+uint64_t ObjectPool::GetAllocationCount() {
+    return allocation_count;
+}
+
+int64_t ObjectPool::GetHeapBytes() {
+    return heap_bytes;
+}
+
+void ObjectPool::AccountExternal(int64_t bytes) noexcept {
+    heap_bytes += bytes;
+}
+
+size_t ObjectPool::GetChunkCount() {
+    Chunks& chunks = GetChunks();
+    lock_guard guard(chunks.lock);
+    return chunks.chunks.size();
+}
+
+}  // namespace runtime
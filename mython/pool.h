@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace runtime {
+
+/*
+ * Пулы блоков фиксированного размера для небольших объектов Mython.
+ * Размер запроса округляется вверх до класса размеров, кратного GRANULARITY; для каждого класса
+ * поток ведёт собственный список свободных блоков, поэтому выделение и освобождение не требуют
+ * синхронизации. Блоки нарезаются из крупных участков памяти, которые не возвращаются системе
+ * до завершения процесса. Запросы больше MAX_SIZE передаются глобальному operator new
+ */
+class ObjectPool {
+public:
+    static constexpr std::size_t GRANULARITY = 16;
+    static constexpr std::size_t MAX_SIZE = 256;
+    static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+    // Выделяет блок размером не меньше size байт
+    [[nodiscard]] static void* Allocate(std::size_t size);
+    // Выделяет блок так же, как Allocate, но не учитывает его в GetAllocationCount.
+    // Используется для вспомогательной памяти объектов, например массивов их полей
+    [[nodiscard]] static void* AllocateBuffer(std::size_t size);
+    // Возвращает в пул блок, выделенный Allocate(size) либо AllocateBuffer(size) в любом потоке
+    static void Deallocate(void* ptr, std::size_t size) noexcept;
+
+    // Возвращает количество вызовов Allocate, выполненных текущим потоком
+    [[nodiscard]] static std::uint64_t GetAllocationCount();
+
+    // Возвращает объём памяти в байтах, выделенной текущим потоком и ещё не освобождённой им:
+    // блоков пула и памяти, учтённой AccountExternal
+    [[nodiscard]] static std::int64_t GetHeapBytes();
+    // Учитывает в GetHeapBytes память, которую объект выделил не из пула, например содержимое
+    // строки. Отрицательное значение bytes учитывает освобождение памяти
+    static void AccountExternal(std::int64_t bytes) noexcept;
+
+    // Возвращает количество участков памяти, запрошенных всеми пулами у системы
+    [[nodiscard]] static std::size_t GetChunkCount();
+};
+
+// Аллокатор стандартных контейнеров, выделяющий память из ObjectPool без учёта в счётчике выделений
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+
+    PoolAllocator() noexcept = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& /*other*/) noexcept {  // NOLINT(google-explicit-constructor)
+    }
+
+    [[nodiscard]] T* allocate(std::size_t n) {
+        return static_cast<T*>(ObjectPool::AllocateBuffer(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, std::size_t n) noexcept {
+        ObjectPool::Deallocate(ptr, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& /*other*/) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>& /*other*/) const noexcept {
+        return false;
+    }
+};
+
+}  // namespace runtime
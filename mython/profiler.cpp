@@ -0,0 +1,165 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+// Возвращает класс, в котором объявлен метод method: сам cls либо один из его родителей
+const Class& FindDeclaringClass(const Class& cls, const Method& method) {
+    for (const Class* current = &cls; current != nullptr; current = current->GetParent()) {
+        const auto& methods = current->GetMethods();
+        if (!methods.empty() && &method >= &methods.front() && &method <= &methods.back()) {
+            return *current;
+        }
+    }
+    return cls;
+}
+
+double ToMilliseconds(Profiler::Duration duration) {
+    return chrono::duration<double, milli>(duration).count();
+}
+
+}  // namespace
+
+Profiler::Profiler()
+    : nodes_{Node{0, 0}} {
+}
+
+void Profiler::EnterMethod(const Class& cls, const Method& method) {
+    const size_t entry = GetEntry(cls, method);
+    const size_t parent = frames_.empty() ? 0 : frames_.back().node;
+    const size_t node = GetNode(parent, entry);
+    ++entries_[entry].stats.calls;
+    ++entries_[entry].active_calls;
+    frames_.push_back({entry, node, Clock::now(), Duration{0}, ObjectPool::GetAllocationCount()});
+}
+
+void Profiler::ExitMethod() {
+    const Frame frame = frames_.back();
+    frames_.pop_back();
+
+    const auto elapsed = chrono::duration_cast<Duration>(Clock::now() - frame.start);
+    const uint64_t allocations = ObjectPool::GetAllocationCount() - frame.start_allocations;
+
+    Entry& entry = entries_[frame.entry];
+    entry.stats.exclusive_time += elapsed - frame.child_time;
+    entry.stats.exclusive_allocations += allocations - frame.child_allocations;
+    if (--entry.active_calls == 0) {
+        entry.stats.inclusive_time += elapsed;
+        entry.stats.inclusive_allocations += allocations;
+    }
+    nodes_[frame.node].exclusive_time += elapsed - frame.child_time;
+
+    if (!frames_.empty()) {
+        frames_.back().child_time += elapsed;
+        frames_.back().child_allocations += allocations;
+    }
+}
+
+size_t Profiler::GetEntry(const Class& cls, const Method& method) {
+    const auto [it, inserted] = entry_indices_.emplace(&method, entries_.size());
+    if (inserted) {
+        Entry entry;
+        entry.stats.class_name = FindDeclaringClass(cls, method).GetName();
+        entry.stats.method_name = method.name;
+        entries_.push_back(std::move(entry));
+    }
+    return it->second;
+}
+
+size_t Profiler::GetNode(size_t parent, size_t entry) {
+    const uint64_t key = static_cast<uint64_t>(parent) << 32U | entry;
+    const auto [it, inserted] = node_indices_.emplace(key, nodes_.size());
+    if (inserted) {
+        nodes_.push_back({entry, parent});
+    }
+    return it->second;
+}
+
+string Profiler::GetFrameName(size_t entry) const {
+    const auto& stats = entries_[entry].stats;
+    return stats.class_name + "."s + stats.method_name.GetName();
+}
+
+vector<Profiler::MethodStats> Profiler::GetMethodStats() const {
+    vector<MethodStats> result;
+    result.reserve(entries_.size());
+    for (const auto& entry : entries_) {
+        result.push_back(entry.stats);
+    }
+    stable_sort(result.begin(), result.end(), [](const MethodStats& lhs, const MethodStats& rhs) {
+        return lhs.exclusive_time > rhs.exclusive_time;
+    });
+    return result;
+}
+
+vector<Profiler::ClassStats> Profiler::GetClassStats() const {
+    vector<ClassStats> result;
+    unordered_map<string_view, size_t> indices;
+    for (const auto& entry : entries_) {
+        const auto& stats = entry.stats;
+        const auto [it, inserted] = indices.emplace(stats.class_name, result.size());
+        if (inserted) {
+            result.push_back({stats.class_name});
+        }
+        ClassStats& class_stats = result[it->second];
+        class_stats.calls += stats.calls;
+        class_stats.exclusive_time += stats.exclusive_time;
+        class_stats.exclusive_allocations += stats.exclusive_allocations;
+    }
+    stable_sort(result.begin(), result.end(), [](const ClassStats& lhs, const ClassStats& rhs) {
+        return lhs.exclusive_time > rhs.exclusive_time;
+    });
+    return result;
+}
+
+void Profiler::PrintReport(ostream& os) const {
+    const auto flags = os.flags();
+    os << fixed << setprecision(3);
+
+    os << left << setw(32) << "Method"sv << right << setw(10) << "Calls"sv << setw(12)
+       << "Incl ms"sv << setw(12) << "Excl ms"sv << setw(12) << "Incl alloc"sv << setw(12)
+       << "Excl alloc"sv << '\n';
+    for (const auto& stats : GetMethodStats()) {
+        os << left << setw(32) << stats.class_name + "."s + stats.method_name.GetName() << right
+           << setw(10) << stats.calls << setw(12) << ToMilliseconds(stats.inclusive_time)
+           << setw(12) << ToMilliseconds(stats.exclusive_time) << setw(12)
+           << stats.inclusive_allocations << setw(12) << stats.exclusive_allocations << '\n';
+    }
+
+    os << '\n'
+       << left << setw(32) << "Class"sv << right << setw(10) << "Calls"sv << setw(12)
+       << "Excl ms"sv << setw(12) << "Excl alloc"sv << '\n';
+    for (const auto& stats : GetClassStats()) {
+        os << left << setw(32) << stats.class_name << right << setw(10) << stats.calls
+           << setw(12) << ToMilliseconds(stats.exclusive_time) << setw(12)
+           << stats.exclusive_allocations << '\n';
+    }
+    os.flags(flags);
+}
+
+void Profiler::PrintCollapsedStacks(ostream& os) const {
+    vector<size_t> path;
+    for (size_t node = 1; node < nodes_.size(); ++node) {
+        path.clear();
+        for (size_t current = node; current != 0; current = nodes_[current].parent) {
+            path.push_back(nodes_[current].entry);
+        }
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            if (it != path.rbegin()) {
+                os << ';';
+            }
+            os << GetFrameName(*it);
+        }
+        os << ' ' << chrono::duration_cast<chrono::microseconds>(nodes_[node].exclusive_time).count()
+           << '\n';
+    }
+}
+
+}  // namespace runtime
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace runtime {
+
+/*
+ * Профилировщик методов Mython. Подключается к контексту исполнения через
+ * Context::SetProfiler и учитывает каждый вызов метода: количество вызовов, полное время
+ * (вместе с вложенными вызовами) и собственное время, а также количество объектов, выделенных
+ * в куче. Вызовы группируются по методу и по классу, в котором метод объявлен, а дерево
+ * вызовов позволяет построить flame graph.
+ * Полное время рекурсивного метода учитывается только для внешнего вызова, поэтому оно не
+ * превышает времени исполнения программы. Если профилировщик не подключён, вызов метода
+ * обходится одной проверкой указателя
+ */
+class Profiler {
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    struct MethodStats {
+        // Класс, в котором объявлен метод
+        std::string class_name;
+        Symbol method_name;
+        std::uint64_t calls = 0;
+        Duration inclusive_time{0};
+        Duration exclusive_time{0};
+        std::uint64_t inclusive_allocations = 0;
+        std::uint64_t exclusive_allocations = 0;
+    };
+
+    struct ClassStats {
+        std::string class_name;
+        std::uint64_t calls = 0;
+        Duration exclusive_time{0};
+        std::uint64_t exclusive_allocations = 0;
+    };
+
+    // Учитывает вызов метода method у экземпляра класса cls на время своего существования.
+    // При profiler == nullptr ничего не делает
+    class CallScope {
+    public:
+        CallScope(Profiler* profiler, const Class& cls, const Method& method)
+            : profiler_(profiler) {
+            if (profiler_ != nullptr) {
+                profiler_->EnterMethod(cls, method);
+            }
+        }
+
+        ~CallScope() {
+            if (profiler_ != nullptr) {
+                profiler_->ExitMethod();
+            }
+        }
+
+        CallScope(const CallScope&) = delete;
+        CallScope& operator=(const CallScope&) = delete;
+
+    private:
+        Profiler* profiler_;
+    };
+
+    Profiler();
+
+    void EnterMethod(const Class& cls, const Method& method);
+    void ExitMethod();
+
+    // Возвращает статистику методов в порядке убывания собственного времени
+    [[nodiscard]] std::vector<MethodStats> GetMethodStats() const;
+    // Возвращает статистику классов в порядке убывания собственного времени их методов
+    [[nodiscard]] std::vector<ClassStats> GetClassStats() const;
+
+    // Выводит текстовый отчёт: таблицы методов и классов
+    void PrintReport(std::ostream& os) const;
+    /*
+     * Выводит дерево вызовов в формате collapsed stacks, который принимают flamegraph.pl и
+     * совместимые инструменты: по строке на путь вызовов вида "A.f;B.g <вес>", где вес -
+     * собственное время последнего метода пути в микросекундах
+     */
+    void PrintCollapsedStacks(std::ostream& os) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        MethodStats stats;
+        // Количество незавершённых вызовов метода
+        std::size_t active_calls = 0;
+    };
+
+    // Узел дерева вызовов. Узел 0 - корень, соответствующий коду вне методов
+    struct Node {
+        std::size_t entry;
+        std::size_t parent;
+        Duration exclusive_time{0};
+    };
+
+    struct Frame {
+        std::size_t entry;
+        std::size_t node;
+        Clock::time_point start;
+        Duration child_time{0};
+        std::uint64_t start_allocations;
+        std::uint64_t child_allocations = 0;
+    };
+
+    std::size_t GetEntry(const Class& cls, const Method& method);
+    std::size_t GetNode(std::size_t parent, std::size_t entry);
+    [[nodiscard]] std::string GetFrameName(std::size_t entry) const;
+
+    std::unordered_map<const Method*, std::size_t> entry_indices_;
+    std::vector<Entry> entries_;
+    std::vector<Node> nodes_;
+    // Ключ - номер родительского узла в старших 32 битах и номер метода в младших
+    std::unordered_map<std::uint64_t, std::size_t> node_indices_;
+    std::vector<Frame> frames_;
+};
+
+}  // namespace runtime
@@ -0,0 +1,129 @@
+#include "profiler.h"
+#include "program.h"
+#include "test_runner_p.h"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+const string PROGRAM = R"(
+class Node:
+  def __init__(value):
+    self.value = value
+
+class Base:
+  def make(n):
+    return Node(n)
+
+class Builder(Base):
+  def build(n):
+    if n == 0:
+      return 0
+    node = self.make(n)
+    return node.value + self.build(n - 1)
+
+b = Builder()
+print b.build(10)
+)"s;
+
+const Profiler::MethodStats& FindMethod(const vector<Profiler::MethodStats>& stats,
+                                        const string& class_name, const string& method) {
+    const auto it = find_if(stats.begin(), stats.end(), [&](const Profiler::MethodStats& s) {
+        return s.class_name == class_name && s.method_name.GetName() == method;
+    });
+    ASSERT(it != stats.end());
+    return *it;
+}
+
+void TestCallStats() {
+    for (const auto backend : {mython::Backend::Tree, mython::Backend::Bytecode}) {
+        const auto program = mython::Program::Compile(PROGRAM, {backend});
+        Profiler profiler;
+        DummyContext context;
+        context.SetProfiler(&profiler);
+        program.Run(context);
+        ASSERT_EQUAL(context.output.str(), "55\n"s);
+
+        const auto stats = profiler.GetMethodStats();
+        ASSERT_EQUAL(stats.size(), 3U);
+        const auto& build = FindMethod(stats, "Builder"s, "build"s);
+        ASSERT_EQUAL(build.calls, 11U);
+        // Унаследованный метод учитывается в классе, где он объявлен
+        const auto& make = FindMethod(stats, "Base"s, "make"s);
+        ASSERT_EQUAL(make.calls, 10U);
+        const auto& init = FindMethod(stats, "Node"s, "__init__"s);
+        ASSERT_EQUAL(init.calls, 10U);
+
+        // Экземпляры Node создаются внутри make, а не в самом build
+        ASSERT_EQUAL(make.inclusive_allocations, make.exclusive_allocations);
+        ASSERT(make.exclusive_allocations >= 10U);
+        ASSERT(build.inclusive_allocations >= make.inclusive_allocations);
+        ASSERT(build.inclusive_time >= build.exclusive_time);
+        ASSERT(build.inclusive_time >= make.inclusive_time);
+
+        const auto classes = profiler.GetClassStats();
+        ASSERT_EQUAL(classes.size(), 3U);
+        uint64_t calls = 0;
+        for (const auto& cls : classes) {
+            calls += cls.calls;
+        }
+        ASSERT_EQUAL(calls, 31U);
+
+        ostringstream report;
+        profiler.PrintReport(report);
+        ASSERT(report.str().find("Builder.build"s) != string::npos);
+        ASSERT(report.str().find("Base"s) != string::npos);
+    }
+}
+
+void TestCollapsedStacks() {
+    const auto program = mython::Program::Compile(PROGRAM);
+    Profiler profiler;
+    DummyContext context;
+    context.SetProfiler(&profiler);
+    program.Run(context);
+
+    ostringstream os;
+    profiler.PrintCollapsedStacks(os);
+    istringstream lines(os.str());
+    vector<string> paths;
+    for (string line; getline(lines, line);) {
+        const auto space = line.rfind(' ');
+        ASSERT(space != string::npos);
+        ASSERT(line.find_first_not_of("0123456789"s, space + 1) == string::npos);
+        paths.push_back(line.substr(0, space));
+    }
+    ASSERT(find(paths.begin(), paths.end(), "Builder.build"s) != paths.end());
+    ASSERT(find(paths.begin(), paths.end(), "Builder.build;Base.make;Node.__init__"s)
+           != paths.end());
+    ASSERT(find(paths.begin(), paths.end(),
+                "Builder.build;Builder.build;Builder.build;Base.make;Node.__init__"s)
+           != paths.end());
+}
+
+void TestDisabledByDefault() {
+    const auto program = mython::Program::Compile(PROGRAM);
+    Profiler profiler;
+    DummyContext context;
+    ASSERT(context.GetProfiler() == nullptr);
+    program.Run(context);
+    ASSERT(profiler.GetMethodStats().empty());
+    ostringstream os;
+    profiler.PrintCollapsedStacks(os);
+    ASSERT(os.str().empty());
+}
+
+}  // namespace
+
+void RunProfilerTests(TestRunner& tr) {
+    RUN_TEST(tr, runtime::TestCallStats);
+    RUN_TEST(tr, runtime::TestCollapsedStacks);
+    RUN_TEST(tr, runtime::TestDisabledByDefault);
+}
+
+}  // namespace runtime
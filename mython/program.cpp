@@ -0,0 +1,121 @@
+#include "program.h"
+
+#include "bytecode.h"
+#include "lexer.h"
+#include "metrics.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "source_map.h"
+#include "statement.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace mython {
+
+namespace {
+
+// Выбрасывает error заново, дополнив сообщение позицией ошибки в исходном тексте
+[[noreturn]] void ThrowWithLocation(const runtime::ExecutionError& error,
+                                    const parse::SourceMap* source_map) {
+    const uint32_t offset = error.GetSourceOffset();
+    if (!source_map || offset == runtime::Executable::NO_SOURCE_OFFSET) {
+        throw;
+    }
+    const string message = source_map->Format(offset) + ": "s + error.what();
+    if (const auto* limit = dynamic_cast<const runtime::LimitExceeded*>(&error)) {
+        throw runtime::LimitExceeded(message, limit->GetLimit(), offset);
+    }
+    throw runtime::ExecutionError(message, offset);
+}
+
+}  // namespace
+
+Program::Program(shared_ptr<runtime::Executable> code,
+                 shared_ptr<const parse::SourceMap> source_map)
+    : code_(std::move(code)), source_map_(std::move(source_map)) {
+}
+
+Program Program::Compile(parse::Lexer& lexer, const CompileOptions& options) {
+    auto tree = ParseProgram(lexer);
+    // После разбора лексер прочитал весь текст, поэтому его таблица строк полна
+    return Compile(std::move(tree), options, make_shared<parse::SourceMap>(lexer.GetSourceMap()));
+}
+
+Program Program::Compile(string_view source, const CompileOptions& options) {
+    parse::Lexer lexer(source);
+    return Compile(lexer, options);
+}
+
+Program Program::Compile(unique_ptr<runtime::Executable> tree, const CompileOptions& options,
+                         shared_ptr<const parse::SourceMap> source_map) {
+    const runtime::Metrics::PhaseScope phase(runtime::Metrics::Phase::Compile);
+    if (options.optimize) {
+        tree = ast::Optimize(std::move(tree));
+    }
+    if (options.backend == Backend::Bytecode) {
+        // Программа, которая не укладывается в ограничения байткода, исполняется обходом дерева:
+        // компиляция не изменяет дерево
+        try {
+            tree = bytecode::Compile(*tree);
+        } catch (const bytecode::CompileError&) {
+        }
+    }
+    return Program(std::move(tree), std::move(source_map));
+}
+
+runtime::Closure Program::Run(runtime::Context& context) const {
+    runtime::Closure closure;
+    const runtime::Metrics::PhaseScope phase(runtime::Metrics::Phase::Execute);
+    // Дерево и байткод не изменяются при исполнении: состояние исполнения хранится в closure
+    // и context, а общие кэши узлов безопасны для одновременного использования
+    try {
+        code_->Execute(closure, context);
+    } catch (const runtime::ExecutionError& error) {
+        ThrowWithLocation(error, source_map_.get());
+    }
+    return closure;
+}
+
+void Program::Run(ostream& output) const {
+    runtime::BufferedContext context{output};
+    Run(context);
+}
+
+void RunIncrementally(parse::Lexer& lexer, runtime::Context& context,
+                      const CompileOptions& options) {
+    if (options.backend != Backend::Tree) {
+        throw invalid_argument("Incremental execution supports only the tree backend"s);
+    }
+    IncrementalParser parser(lexer);
+    runtime::Closure closure;
+    // Инструкция исполняется внутри составной, которая считает шаги исполнения и привязывает
+    // ошибки к инструкциям, как и тело программы
+    ast::Compound block;
+    while (auto statement = parser.Next()) {
+        if (options.optimize) {
+            const runtime::Metrics::PhaseScope phase(runtime::Metrics::Phase::Compile);
+            for (auto& cls : parser.TakeNewClasses()) {
+                for (auto& method : cls.TryAs<runtime::Class>()->GetMethods()) {
+                    method.body = ast::Optimize(std::move(method.body));
+                }
+            }
+        }
+        block.AddStatement(std::move(statement));
+        try {
+            const runtime::Metrics::PhaseScope phase(runtime::Metrics::Phase::Execute);
+            block.Execute(closure, context);
+        } catch (const runtime::ExecutionError& error) {
+            // Таблица строк лексера уже содержит строки исполняемой инструкции
+            ThrowWithLocation(error, &lexer.GetSourceMap());
+        }
+        block.MutableStatements().clear();
+        context.GetOutputBuffer().Flush();
+        if (context.HasReturnSignal()) {
+            break;
+        }
+    }
+}
+
+}  // namespace mython
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <iosfwd>
+#include <memory>
+#include <string_view>
+
+namespace parse {
+class Lexer;
+class SourceMap;
+}  // namespace parse
+
+namespace mython {
+
+// Способ исполнения программы
+enum class Backend {
+    Tree,      // обход синтаксического дерева
+    Bytecode,  // компиляция в байткод и исполнение виртуальной машиной, а для программ, которые
+               // нельзя скомпилировать в байткод, - обход дерева
+};
+
+// Параметры компиляции программы
+struct CompileOptions {
+    Backend backend = Backend::Tree;
+    // Оптимизировать дерево программы перед исполнением
+    bool optimize = true;
+};
+
+/*
+ * Скомпилированная программа Mython. После компиляции программа не изменяется, поэтому её
+ * можно исполнять многократно, в том числе одновременно из нескольких потоков. Каждое
+ * исполнение получает новое глобальное Closure, а экземпляры классов и остальные объекты,
+ * созданные при исполнении, не разделяются между исполнениями.
+ * Копии Program ссылаются на одну и ту же скомпилированную программу
+ */
+class Program {
+public:
+    // Разбирает и компилирует программу. Ошибки разбора передаются вызывающему коду, а их
+    // сообщения начинаются с позиции ошибки в исходном тексте
+    [[nodiscard]] static Program Compile(parse::Lexer& lexer, const CompileOptions& options = {});
+    [[nodiscard]] static Program Compile(std::string_view source,
+                                         const CompileOptions& options = {});
+    // Компилирует дерево программы, полученное из ParseProgram либо из кеша программ.
+    // Таблица строк source_map нужна, чтобы сообщать позиции ошибок исполнения
+    [[nodiscard]] static Program Compile(
+        std::unique_ptr<runtime::Executable> tree, const CompileOptions& options = {},
+        std::shared_ptr<const parse::SourceMap> source_map = nullptr);
+
+    /*
+     * Исполняет программу в контексте context и возвращает её глобальные переменные.
+     * Контекст не должен одновременно использоваться другими исполнениями. Классы программы
+     * в возвращённом Closure действительны, пока существует программа.
+     * Ошибки исполнения выбрасываются как runtime::ExecutionError, и если известна таблица
+     * строк программы, их сообщения начинаются с позиции ошибки
+     */
+    runtime::Closure Run(runtime::Context& context) const;
+    // Исполняет программу, направляя вывод в output. Вывод буферизуется и передаётся в output
+    // крупными блоками, а остаток - по завершении исполнения, в том числе при ошибке
+    void Run(std::ostream& output) const;
+
+private:
+    Program(std::shared_ptr<runtime::Executable> code,
+            std::shared_ptr<const parse::SourceMap> source_map);
+
+    std::shared_ptr<runtime::Executable> code_;
+    std::shared_ptr<const parse::SourceMap> source_map_;
+};
+
+/*
+ * Исполняет программу по мере её разбора: каждая инструкция верхнего уровня исполняется сразу
+ * после того, как разобрана, и затем удаляется, поэтому вывод появляется до конца разбора, а
+ * в памяти хранятся только классы программы. После каждой инструкции накопленный вывод
+ * передаётся в поток контекста. Ошибка разбора прекращает исполнение, но вывод уже исполненных
+ * инструкций сохраняется. Сообщения об ошибках начинаются с позиции ошибки, как и в Program.
+ * Поддерживается только обход дерева: для Backend::Bytecode выбрасывается invalid_argument.
+ * При options.optimize оптимизируются тела методов, а инструкции верхнего уровня, которые
+ * исполняются не более одного раза, исполняются без оптимизации
+ */
+void RunIncrementally(parse::Lexer& lexer, runtime::Context& context,
+                      const CompileOptions& options = {});
+
+}  // namespace mython
@@ -0,0 +1,622 @@
+#include "program_cache.h"
+
+#include "lexer.h"
+#include "parse.h"
+#include "statement.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <system_error>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+
+namespace cache {
+
+using runtime::ObjectHolder;
+using runtime::Symbol;
+
+namespace {
+
+constexpr uint32_t MAGIC = 0x4350594DU;  // "MYPC"
+constexpr uint32_t NO_SLOT = UINT32_MAX;
+constexpr uint32_t NO_PARENT = UINT32_MAX;
+// Наименьший размер в образе узла, отличного от Null: тег и позиция в исходном тексте
+constexpr size_t MIN_NODE_SIZE = sizeof(uint8_t) + sizeof(uint32_t);
+// Наименьший размер в образе метода: имя, количество параметров, размер кадра и тело
+constexpr size_t MIN_METHOD_SIZE = 3 * sizeof(uint32_t) + MIN_NODE_SIZE;
+// Наименьший размер в образе класса: длина имени, базовый класс и количество методов
+constexpr size_t MIN_CLASS_SIZE = 3 * sizeof(uint32_t);
+
+enum class NodeTag : uint8_t {
+    Null,
+    NumericConst,
+    StringConst,
+    BoolConst,
+    None,
+    VariableValue,
+    Assignment,
+    FieldAssignment,
+    Print,
+    MethodCall,
+    MethodBody,
+    Return,
+    ClassDefinition,
+    NewInstance,
+    Stringify,
+    Add,
+    Sub,
+    Mult,
+    Div,
+    Or,
+    And,
+    Not,
+    Comparison,
+    Compound,
+    IfElse,
+};
+
+/*
+ * Записывает дерево программы. Символы записываются при первом упоминании, а далее - номером
+ * в таблице символов образа. Классы записываются в начале образа в порядке объявления, а узлы
+ * ссылаются на них по номеру
+ */
+class Writer {
+public:
+    explicit Writer(ostream& out)
+        : out_(out) {
+    }
+
+    void WriteProgram(const ast::Program& program, uint64_t source_hash) {
+        WriteU32(MAGIC);
+        WriteU32(FORMAT_VERSION);
+        WriteU64(source_hash);
+
+        const auto& classes = program.GetClasses();
+        WriteU32(static_cast<uint32_t>(classes.size()));
+        for (const ObjectHolder& holder : classes) {
+            WriteClass(*holder.TryAs<runtime::Class>());
+        }
+        WriteNode(&program.GetBody());
+    }
+
+private:
+    void WriteClass(const runtime::Class& cls) {
+        WriteString(cls.GetName());
+        WriteU32(cls.GetParent() ? ClassIndex(*cls.GetParent()) : NO_PARENT);
+        WriteU32(static_cast<uint32_t>(cls.GetMethods().size()));
+        for (const runtime::Method& method : cls.GetMethods()) {
+            WriteSymbol(method.name);
+            WriteSymbols(method.formal_params);
+            WriteU32(static_cast<uint32_t>(method.frame_size));
+            WriteNode(method.body.get());
+        }
+        const auto index = static_cast<uint32_t>(class_indices_.size());
+        class_indices_[&cls] = index;
+    }
+
+    void WriteNode(const runtime::Executable* node) {
+        using namespace ast;
+
+        if (node == nullptr) {
+            WriteTag(NodeTag::Null);
+        } else if (auto p = dynamic_cast<const NumericConst*>(node)) {
+            WriteTag(NodeTag::NumericConst);
+            WriteU32(static_cast<uint32_t>(p->GetValue().GetValue()));
+        } else if (auto p = dynamic_cast<const StringConst*>(node)) {
+            WriteTag(NodeTag::StringConst);
+            WriteString(p->GetValue().GetValue());
+        } else if (auto p = dynamic_cast<const BoolConst*>(node)) {
+            WriteTag(NodeTag::BoolConst);
+            WriteU8(p->GetValue().GetValue() ? 1 : 0);
+        } else if (dynamic_cast<const None*>(node)) {
+            WriteTag(NodeTag::None);
+        } else if (auto p = dynamic_cast<const VariableValue*>(node)) {
+            WriteTag(NodeTag::VariableValue);
+            WriteVariable(*p);
+        } else if (auto p = dynamic_cast<const Assignment*>(node)) {
+            WriteTag(NodeTag::Assignment);
+            WriteSymbol(p->GetVarName());
+            WriteSlot(p->GetSlot());
+            WriteNode(&p->GetValue());
+        } else if (auto p = dynamic_cast<const FieldAssignment*>(node)) {
+            WriteTag(NodeTag::FieldAssignment);
+            WriteVariable(p->GetObject());
+            WriteSymbol(p->GetFieldName());
+            WriteNode(&p->GetValue());
+        } else if (auto p = dynamic_cast<const Print*>(node)) {
+            WriteTag(NodeTag::Print);
+            WriteNodes(p->GetArgs());
+        } else if (auto p = dynamic_cast<const MethodCall*>(node)) {
+            WriteTag(NodeTag::MethodCall);
+            WriteNode(&p->GetObject());
+            WriteSymbol(p->GetMethodName());
+            WriteNodes(p->GetArgs());
+        } else if (auto p = dynamic_cast<const MethodBody*>(node)) {
+            WriteTag(NodeTag::MethodBody);
+            WriteNode(&p->GetBody());
+        } else if (auto p = dynamic_cast<const Return*>(node)) {
+            WriteTag(NodeTag::Return);
+            WriteNode(&p->GetStatement());
+        } else if (auto p = dynamic_cast<const ClassDefinition*>(node)) {
+            WriteTag(NodeTag::ClassDefinition);
+            WriteU32(ClassIndex(p->GetClass()));
+        } else if (auto p = dynamic_cast<const NewInstance*>(node)) {
+            WriteTag(NodeTag::NewInstance);
+            WriteU32(ClassIndex(p->GetClass()));
+            WriteNodes(p->GetArgs());
+        } else if (auto p = dynamic_cast<const Stringify*>(node)) {
+            WriteUnary(NodeTag::Stringify, *p);
+        } else if (auto p = dynamic_cast<const Not*>(node)) {
+            WriteUnary(NodeTag::Not, *p);
+        } else if (auto p = dynamic_cast<const Add*>(node)) {
+            WriteBinary(NodeTag::Add, *p);
+        } else if (auto p = dynamic_cast<const Sub*>(node)) {
+            WriteBinary(NodeTag::Sub, *p);
+        } else if (auto p = dynamic_cast<const Mult*>(node)) {
+            WriteBinary(NodeTag::Mult, *p);
+        } else if (auto p = dynamic_cast<const Div*>(node)) {
+            WriteBinary(NodeTag::Div, *p);
+        } else if (auto p = dynamic_cast<const Or*>(node)) {
+            WriteBinary(NodeTag::Or, *p);
+        } else if (auto p = dynamic_cast<const And*>(node)) {
+            WriteBinary(NodeTag::And, *p);
+        } else if (auto p = dynamic_cast<const Comparison*>(node)) {
+            WriteTag(NodeTag::Comparison);
+            WriteU8(static_cast<uint8_t>(p->GetOperator()));
+            WriteNode(&p->GetLhs());
+            WriteNode(&p->GetRhs());
+        } else if (auto p = dynamic_cast<const Compound*>(node)) {
+            WriteTag(NodeTag::Compound);
+            WriteNodes(p->GetStatements());
+        } else if (auto p = dynamic_cast<const IfElse*>(node)) {
+            WriteTag(NodeTag::IfElse);
+            WriteNode(&p->GetCondition());
+            WriteNode(&p->GetIfBody());
+            WriteNode(p->GetElseBody());
+        } else {
+            throw CacheError("Unsupported statement "s + typeid(*node).name());
+        }
+        // Позиция узла в исходном тексте записывается после его содержимого
+        if (node != nullptr) {
+            WriteU32(node->GetSourceOffset());
+        }
+    }
+
+    void WriteNodes(const vector<unique_ptr<ast::Statement>>& nodes) {
+        WriteU32(static_cast<uint32_t>(nodes.size()));
+        for (const auto& node : nodes) {
+            WriteNode(node.get());
+        }
+    }
+
+    void WriteUnary(NodeTag tag, const ast::UnaryOperation& node) {
+        WriteTag(tag);
+        WriteNode(&node.GetArgument());
+    }
+
+    void WriteBinary(NodeTag tag, const ast::BinaryOperation& node) {
+        WriteTag(tag);
+        WriteNode(&node.GetLhs());
+        WriteNode(&node.GetRhs());
+    }
+
+    void WriteVariable(const ast::VariableValue& node) {
+        WriteSymbols(node.GetDottedIds());
+        WriteSlot(node.GetSlot());
+    }
+
+    void WriteSlot(optional<size_t> slot) {
+        WriteU32(slot ? static_cast<uint32_t>(*slot) : NO_SLOT);
+    }
+
+    void WriteSymbols(const vector<Symbol>& symbols) {
+        WriteU32(static_cast<uint32_t>(symbols.size()));
+        for (Symbol symbol : symbols) {
+            WriteSymbol(symbol);
+        }
+    }
+
+    // Новый символ записывается номером, равным размеру таблицы, за которым следует его имя
+    void WriteSymbol(Symbol symbol) {
+        auto [it, inserted] = symbol_indices_.emplace(symbol, symbol_indices_.size());
+        WriteU32(static_cast<uint32_t>(it->second));
+        if (inserted) {
+            WriteString(symbol.GetName());
+        }
+    }
+
+    uint32_t ClassIndex(const runtime::Class& cls) const {
+        auto it = class_indices_.find(&cls);
+        if (it == class_indices_.end()) {
+            throw CacheError("Class "s + cls.GetName() + " is not declared in the program"s);
+        }
+        return it->second;
+    }
+
+    void WriteTag(NodeTag tag) {
+        WriteU8(static_cast<uint8_t>(tag));
+    }
+
+    void WriteU8(uint8_t value) {
+        out_.put(static_cast<char>(value));
+    }
+
+    void WriteU32(uint32_t value) {
+        out_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void WriteU64(uint64_t value) {
+        out_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void WriteString(string_view value) {
+        WriteU32(static_cast<uint32_t>(value.size()));
+        out_.write(value.data(), static_cast<streamsize>(value.size()));
+    }
+
+    ostream& out_;
+    unordered_map<Symbol, size_t> symbol_indices_;
+    unordered_map<const runtime::Class*, uint32_t> class_indices_;
+};
+
+// Восстанавливает дерево программы из образа, записанного Writer
+class Reader {
+public:
+    explicit Reader(string_view image)
+        : image_(image) {
+    }
+
+    // Возвращает false, если заголовок образа не соответствует source_hash или версии формата
+    bool ReadHeader(uint64_t source_hash) {
+        if (image_.size() < 2 * sizeof(uint32_t) + sizeof(uint64_t)) {
+            return false;
+        }
+        return ReadU32() == MAGIC && ReadU32() == FORMAT_VERSION && ReadU64() == source_hash;
+    }
+
+    unique_ptr<runtime::Executable> ReadProgram() {
+        auto arena = make_shared<runtime::Arena>();
+        unique_ptr<ast::Statement> body;
+        {
+            runtime::Arena::Scope scope(*arena);
+            const uint32_t class_count = ReadCount(MIN_CLASS_SIZE);
+            for (uint32_t i = 0; i < class_count; ++i) {
+                ReadClass(arena);
+            }
+            body = ReadNode();
+        }
+        if (pos_ != image_.size()) {
+            throw CacheError("Unexpected data at the end of the program cache"s);
+        }
+        return make_unique<ast::Program>(std::move(arena), std::move(body), std::move(classes_));
+    }
+
+private:
+    void ReadClass(const shared_ptr<runtime::Arena>& arena) {
+        string name = ReadString();
+        const uint32_t parent_index = ReadU32();
+        const runtime::Class* parent =
+            parent_index == NO_PARENT ? nullptr : &GetClass(parent_index);
+
+        vector<runtime::Method> methods(ReadCount(MIN_METHOD_SIZE));
+        for (runtime::Method& method : methods) {
+            method.name = ReadSymbol();
+            method.formal_params = ReadSymbols();
+            method.frame_size = ReadU32();
+            // Кадр вмещает self и параметры, а каждой локальной переменной соответствует хотя бы
+            // одно присваивание в теле метода
+            const size_t min_frame_size = method.formal_params.size() + 1;
+            if (method.frame_size < min_frame_size
+                || method.frame_size - min_frame_size > image_.size() - pos_) {
+                throw CacheError("Invalid frame size in the program cache"s);
+            }
+            frame_size_ = method.frame_size;
+            method.body = ReadRequiredNode();
+            frame_size_ = 0;
+        }
+        classes_.push_back(
+            ObjectHolder::Own(runtime::Class(std::move(name), std::move(methods), parent, arena)));
+    }
+
+    unique_ptr<ast::Statement> ReadNode() {
+        auto node = ReadNodeContent(static_cast<NodeTag>(ReadU8()));
+        if (node) {
+            node->SetSourceOffset(ReadU32());
+        }
+        return node;
+    }
+
+    unique_ptr<ast::Statement> ReadNodeContent(NodeTag tag) {
+        using namespace ast;
+
+        switch (tag) {
+            case NodeTag::Null:
+                return nullptr;
+            case NodeTag::NumericConst:
+                return make_unique<NumericConst>(static_cast<int>(ReadU32()));
+            case NodeTag::StringConst:
+                return make_unique<StringConst>(ReadString());
+            case NodeTag::BoolConst:
+                return make_unique<BoolConst>(runtime::Bool(ReadU8() != 0));
+            case NodeTag::None:
+                return make_unique<None>();
+            case NodeTag::VariableValue:
+                return make_unique<VariableValue>(ReadVariable());
+            case NodeTag::Assignment: {
+                Symbol name = ReadSymbol();
+                const uint32_t slot = ReadSlot();
+                auto value = ReadRequiredNode();
+                if (slot == NO_SLOT) {
+                    return make_unique<Assignment>(name, std::move(value));
+                }
+                return make_unique<Assignment>(name, std::move(value), slot);
+            }
+            case NodeTag::FieldAssignment: {
+                VariableValue object = ReadVariable();
+                Symbol field = ReadSymbol();
+                return make_unique<FieldAssignment>(std::move(object), field, ReadRequiredNode());
+            }
+            case NodeTag::Print:
+                return make_unique<Print>(ReadNodes());
+            case NodeTag::MethodCall: {
+                auto object = ReadRequiredNode();
+                Symbol method = ReadSymbol();
+                return make_unique<MethodCall>(std::move(object), method, ReadNodes());
+            }
+            case NodeTag::MethodBody:
+                return make_unique<MethodBody>(ReadRequiredNode());
+            case NodeTag::Return:
+                return make_unique<Return>(ReadRequiredNode());
+            case NodeTag::ClassDefinition:
+                return make_unique<ClassDefinition>(classes_.at(CheckClassIndex(ReadU32())));
+            case NodeTag::NewInstance: {
+                const runtime::Class& cls = GetClass(ReadU32());
+                return make_unique<NewInstance>(cls, ReadNodes());
+            }
+            case NodeTag::Stringify:
+                return make_unique<Stringify>(ReadRequiredNode());
+            case NodeTag::Not:
+                return make_unique<Not>(ReadRequiredNode());
+            case NodeTag::Add:
+                return ReadBinary<Add>();
+            case NodeTag::Sub:
+                return ReadBinary<Sub>();
+            case NodeTag::Mult:
+                return ReadBinary<Mult>();
+            case NodeTag::Div:
+                return ReadBinary<Div>();
+            case NodeTag::Or:
+                return ReadBinary<Or>();
+            case NodeTag::And:
+                return ReadBinary<And>();
+            case NodeTag::Comparison: {
+                const uint8_t comparator = ReadU8();
+                if (comparator > static_cast<uint8_t>(runtime::CompareOp::GreaterOrEqual)) {
+                    throw CacheError("Invalid comparator in the program cache"s);
+                }
+                auto lhs = ReadRequiredNode();
+                return Comparison::Make(static_cast<runtime::CompareOp>(comparator),
+                                        std::move(lhs), ReadRequiredNode());
+            }
+            case NodeTag::Compound: {
+                auto compound = make_unique<Compound>();
+                for (auto& statement : ReadNodes()) {
+                    compound->AddStatement(std::move(statement));
+                }
+                return compound;
+            }
+            case NodeTag::IfElse: {
+                auto condition = ReadRequiredNode();
+                auto if_body = ReadRequiredNode();
+                return make_unique<IfElse>(std::move(condition), std::move(if_body), ReadNode());
+            }
+        }
+        throw CacheError("Invalid node in the program cache"s);
+    }
+
+    unique_ptr<ast::Statement> ReadRequiredNode() {
+        auto node = ReadNode();
+        if (!node) {
+            throw CacheError("Missing node in the program cache"s);
+        }
+        return node;
+    }
+
+    vector<unique_ptr<ast::Statement>> ReadNodes() {
+        vector<unique_ptr<ast::Statement>> nodes(ReadCount(MIN_NODE_SIZE));
+        for (auto& node : nodes) {
+            node = ReadRequiredNode();
+        }
+        return nodes;
+    }
+
+    template <typename Node>
+    unique_ptr<ast::Statement> ReadBinary() {
+        auto lhs = ReadRequiredNode();
+        return make_unique<Node>(std::move(lhs), ReadRequiredNode());
+    }
+
+    ast::VariableValue ReadVariable() {
+        vector<Symbol> ids = ReadSymbols();
+        if (ids.empty()) {
+            throw CacheError("Empty variable name in the program cache"s);
+        }
+        const uint32_t slot = ReadSlot();
+        if (slot == NO_SLOT) {
+            return ast::VariableValue(std::move(ids));
+        }
+        return ast::VariableValue(std::move(ids), slot);
+    }
+
+    vector<Symbol> ReadSymbols() {
+        vector<Symbol> symbols(ReadCount(sizeof(uint32_t)));
+        for (Symbol& symbol : symbols) {
+            symbol = ReadSymbol();
+        }
+        return symbols;
+    }
+
+    // Слот должен принадлежать кадру метода, тело которого читается
+    uint32_t ReadSlot() {
+        const uint32_t slot = ReadU32();
+        if (slot != NO_SLOT && slot >= frame_size_) {
+            throw CacheError("Invalid slot in the program cache"s);
+        }
+        return slot;
+    }
+
+    Symbol ReadSymbol() {
+        const uint32_t index = ReadU32();
+        if (index == symbols_.size()) {
+            symbols_.emplace_back(ReadString());
+        } else if (index > symbols_.size()) {
+            throw CacheError("Invalid symbol in the program cache"s);
+        }
+        return symbols_[index];
+    }
+
+    uint32_t CheckClassIndex(uint32_t index) const {
+        if (index >= classes_.size()) {
+            throw CacheError("Invalid class in the program cache"s);
+        }
+        return index;
+    }
+
+    const runtime::Class& GetClass(uint32_t index) const {
+        return *classes_[CheckClassIndex(index)].TryAs<runtime::Class>();
+    }
+
+    void Need(size_t size) const {
+        if (image_.size() - pos_ < size) {
+            throw CacheError("Truncated program cache"s);
+        }
+    }
+
+    uint8_t ReadU8() {
+        Need(1);
+        return static_cast<uint8_t>(image_[pos_++]);
+    }
+
+    template <typename T>
+    T ReadScalar() {
+        Need(sizeof(T));
+        T value;
+        memcpy(&value, image_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return value;
+    }
+
+    uint32_t ReadU32() {
+        return ReadScalar<uint32_t>();
+    }
+
+    uint64_t ReadU64() {
+        return ReadScalar<uint64_t>();
+    }
+
+    // Читает количество элементов, каждый из которых занимает в образе не меньше min_size
+    // байт. Количество, для которого в образе не хватает данных, считается повреждением,
+    // чтобы не выделять память под элементы, которых в образе нет
+    uint32_t ReadCount(size_t min_size) {
+        const uint32_t count = ReadU32();
+        if (count > (image_.size() - pos_) / min_size) {
+            throw CacheError("Invalid element count in the program cache"s);
+        }
+        return count;
+    }
+
+    string ReadString() {
+        const uint32_t size = ReadU32();
+        Need(size);
+        string value(image_.substr(pos_, size));
+        pos_ += size;
+        return value;
+    }
+
+    string_view image_;
+    size_t pos_ = 0;
+    vector<Symbol> symbols_;
+    vector<ObjectHolder> classes_;
+    // Размер кадра метода, тело которого читается, либо 0 вне методов
+    size_t frame_size_ = 0;
+};
+
+}  // namespace
+
+uint64_t HashSource(string_view source) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char c : source) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+string GetCachePath(const string& source_path) {
+    return filesystem::path(source_path).replace_extension(".mypc"s).string();
+}
+
+void Save(const runtime::Executable& program, uint64_t source_hash, ostream& out) {
+    const auto* root = dynamic_cast<const ast::Program*>(&program);
+    if (root == nullptr) {
+        throw CacheError("Only programs returned by ParseProgram can be cached"s);
+    }
+    Writer(out).WriteProgram(*root, source_hash);
+}
+
+unique_ptr<runtime::Executable> Load(string_view image, uint64_t source_hash) {
+    Reader reader(image);
+    if (!reader.ReadHeader(source_hash)) {
+        return nullptr;
+    }
+    return reader.ReadProgram();
+}
+
+unique_ptr<runtime::Executable> LoadOrParse(string_view source, const string& cache_path) {
+    const uint64_t source_hash = HashSource(source);
+    if (filesystem::exists(cache_path)) {
+        try {
+            parse::MappedSource image(cache_path);
+            if (auto program = Load(image.GetText(), source_hash)) {
+                return program;
+            }
+        } catch (const CacheError&) {
+            // Повреждённый кеш перезаписывается
+        }
+    }
+
+    parse::Lexer lexer(source);
+    auto program = ParseProgram(lexer);
+
+    // Файл записывается под временным именем и переименовывается, чтобы параллельно
+    // запущенные процессы не прочитали его частично. Если записать кеш не удалось, программа
+    // всё равно исполняется, а кеш будет создан при следующем запуске
+    const string temp_path = cache_path + ".tmp"s + to_string(getpid());
+    bool written = false;
+    {
+        ofstream out(temp_path, ios::binary | ios::trunc);
+        if (out) {
+            Save(*program, source_hash, out);
+            written = static_cast<bool>(out.flush());
+        }
+    }
+    error_code error;
+    if (written) {
+        filesystem::rename(temp_path, cache_path, error);
+    }
+    if (!written || error) {
+        filesystem::remove(temp_path, error);
+    }
+    return program;
+}
+
+}  // namespace cache
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace runtime {
+class Executable;
+}
+
+/*
+ * Кеш разобранных программ (файлы .mypc). В файле сохраняется дерево программы, полученное из
+ * ParseProgram, вместе с таблицей её классов, поэтому при повторном запуске лексический и
+ * синтаксический анализ не выполняются. Файл содержит хеш исходного текста и отбрасывается,
+ * если исходный текст изменился
+ */
+namespace cache {
+
+class CacheError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Версия формата. Увеличивается при любом изменении формата или набора узлов дерева
+inline constexpr std::uint32_t FORMAT_VERSION = 2;
+
+// Возвращает хеш исходного текста программы
+[[nodiscard]] std::uint64_t HashSource(std::string_view source);
+
+// Возвращает путь к файлу кеша для программы source_path: расширение заменяется на .mypc
+[[nodiscard]] std::string GetCachePath(const std::string& source_path);
+
+// Записывает в out дерево программы, полученное из ParseProgram. Для других деревьев
+// выбрасывается исключение CacheError
+void Save(const runtime::Executable& program, std::uint64_t source_hash, std::ostream& out);
+
+// Восстанавливает программу из образа image, записанного функцией Save. Возвращает nullptr,
+// если образ создан для другого исходного текста либо другой версией формата. Если образ
+// повреждён, выбрасывается исключение CacheError
+[[nodiscard]] std::unique_ptr<runtime::Executable> Load(std::string_view image,
+                                                        std::uint64_t source_hash);
+
+// Загружает программу с текстом source из файла кеша cache_path. Если файла нет или он не
+// соответствует тексту, разбирает программу и перезаписывает файл кеша
+[[nodiscard]] std::unique_ptr<runtime::Executable> LoadOrParse(std::string_view source,
+                                                               const std::string& cache_path);
+
+}  // namespace cache
@@ -0,0 +1,190 @@
+#include "lexer.h"
+#include "parse.h"
+#include "program_cache.h"
+#include "statement.h"
+#include "test_runner_p.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+namespace cache {
+
+namespace {
+
+const string PROGRAM = R"(
+class Shape:
+  def __str__():
+    return "Shape"
+
+  def area():
+    return 0
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.w = w
+    self.h = h
+
+  def area():
+    return self.w * self.h
+
+  def __str__():
+    return "Rect(" + str(self.w) + 'x' + str(self.h) + ')'
+
+class Holder:
+  def __init__(shape):
+    self.shape = shape
+
+  def describe():
+    if self.shape.area() > 10 and not False:
+      return 'big ' + str(self.shape)
+    else:
+      x = -1
+    return 'small ' + str(self.shape)
+
+r = Rect(10, 20)
+s = Shape()
+print r, r.area(), s, s.area(), None, 'a' <= 'b', 1 != 2 or 3 == 4
+h = Holder(r)
+print h.describe(), h.shape.w
+h.shape = Rect(1, 2)
+print h.describe()
+)"s;
+
+const string OUTPUT = "Rect(10x20) 200 Shape 0 None True True\nbig Rect(10x20) 10\nsmall Rect(1x2)\n"s;
+
+// Вызов print с десятью аргументами: количество аргументов встречается в образе один раз
+const string PRINT_TEN = "print 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a', 'a'\n"s;
+
+unique_ptr<runtime::Executable> ParseFromString(const string& program) {
+    parse::Lexer lexer(program);
+    return ParseProgram(lexer);
+}
+
+string Run(runtime::Executable& program) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    program.Execute(closure, context);
+    return context.output.str();
+}
+
+string SaveToString(const runtime::Executable& program, uint64_t source_hash) {
+    ostringstream out;
+    Save(program, source_hash, out);
+    return out.str();
+}
+
+// Заменяет в образе единственное вхождение 32-битного значения from значением to
+string PatchU32(string image, uint32_t from, uint32_t to) {
+    const string pattern(reinterpret_cast<const char*>(&from), sizeof(from));
+    const size_t pos = image.find(pattern);
+    ASSERT(pos != string::npos && image.find(pattern, pos + 1) == string::npos);
+    memcpy(image.data() + pos, &to, sizeof(to));
+    return image;
+}
+
+void TestRoundTrip() {
+    const uint64_t hash = HashSource(PROGRAM);
+    const string image = SaveToString(*ParseFromString(PROGRAM), hash);
+
+    auto program = Load(image, hash);
+    ASSERT(program != nullptr);
+    ASSERT_EQUAL(Run(*program), OUTPUT);
+
+    const auto& loaded = dynamic_cast<const ast::Program&>(*program);
+    ASSERT_EQUAL(loaded.GetClasses().size(), 3U);
+    const auto* rect = loaded.GetClasses()[1].TryAs<runtime::Class>();
+    ASSERT_EQUAL(rect->GetName(), "Rect"s);
+    ASSERT(rect->GetParent() == loaded.GetClasses()[0].TryAs<runtime::Class>());
+    ASSERT_EQUAL(rect->GetMethod("__init__"s)->frame_size, 3U);
+
+    // Позиции узлов в исходном тексте сохраняются в образе
+    const auto& statements = dynamic_cast<const ast::Compound&>(loaded.GetBody()).GetStatements();
+    ASSERT_EQUAL(statements.back()->GetSourceOffset(), static_cast<uint32_t>(PROGRAM.rfind("print"s)));
+    ASSERT_EQUAL(rect->GetMethod("area"s)->body->GetSourceOffset(),
+                 static_cast<uint32_t>(PROGRAM.find("def area():\n    return self"s)));
+
+    // Повторная запись загруженной программы даёт тот же образ
+    ASSERT_EQUAL(SaveToString(*program, hash), image);
+}
+
+void TestInvalidImages() {
+    const uint64_t hash = HashSource(PROGRAM);
+    const string image = SaveToString(*ParseFromString(PROGRAM), hash);
+
+    ASSERT(Load(image, HashSource("print 1\n"s)) == nullptr);
+    ASSERT(Load(""sv, hash) == nullptr);
+    ASSERT(Load("not a program cache"sv, hash) == nullptr);
+    ASSERT_THROWS(static_cast<void>(Load(string_view(image).substr(0, image.size() / 2), hash)),
+                  CacheError);
+    ASSERT_THROWS(static_cast<void>(Load(image + "x"s, hash)), CacheError);
+
+    // Количество элементов, для которых в образе нет данных, не приводит к выделению памяти
+    const uint64_t print_hash = HashSource(PRINT_TEN);
+    const string print_image = SaveToString(*ParseFromString(PRINT_TEN), print_hash);
+    for (const uint32_t count : {11U, 0xFFFFU, 0x7FFFFFFFU, UINT32_MAX}) {
+        ASSERT_THROWS(static_cast<void>(Load(PatchU32(print_image, 10, count), print_hash)),
+                      CacheError);
+    }
+
+    // Кадр метода вмещает self и параметры
+    const string method = "class A:\n  def f(a, b, c, d, e, f, g):\n    return a\n"s;
+    const uint64_t method_hash = HashSource(method);
+    const string method_image = SaveToString(*ParseFromString(method), method_hash);
+    ASSERT(Load(method_image, method_hash) != nullptr);
+    for (const uint32_t frame_size : {0U, 7U, 0x7FFFFFFFU}) {
+        ASSERT_THROWS(static_cast<void>(Load(PatchU32(method_image, 8, frame_size), method_hash)),
+                      CacheError);
+    }
+
+    ASSERT_THROWS(SaveToString(ast::Compound{}, hash), CacheError);
+}
+
+void TestLoadOrParse() {
+    const auto dir = filesystem::temp_directory_path() / "mython_cache_test"s;
+    filesystem::create_directories(dir);
+    const string source_path = (dir / "program.my"s).string();
+    const string cache_path = GetCachePath(source_path);
+    ASSERT_EQUAL(cache_path, (dir / "program.mypc"s).string());
+    filesystem::remove(cache_path);
+
+    auto program = LoadOrParse(PROGRAM, cache_path);
+    ASSERT(filesystem::exists(cache_path));
+    ASSERT_EQUAL(Run(*program), OUTPUT);
+
+    // Образ в файле используется, только пока совпадает исходный текст
+    program = LoadOrParse(PROGRAM, cache_path);
+    ASSERT_EQUAL(Run(*program), OUTPUT);
+    program = LoadOrParse("print 'changed'\n"s, cache_path);
+    ASSERT_EQUAL(Run(*program), "changed\n"s);
+
+    {
+        ofstream(cache_path, ios::binary | ios::trunc) << "garbage"s;
+    }
+    program = LoadOrParse("print 'rewritten'\n"s, cache_path);
+    ASSERT_EQUAL(Run(*program), "rewritten\n"s);
+    parse::MappedSource image(cache_path);
+    ASSERT(Load(image.GetText(), HashSource("print 'rewritten'\n"s)) != nullptr);
+
+    // Образ с повреждённым количеством элементов тоже заменяется
+    {
+        const string image = SaveToString(*ParseFromString(PRINT_TEN), HashSource(PRINT_TEN));
+        ofstream(cache_path, ios::binary | ios::trunc) << PatchU32(image, 10, 0x7FFFFFFFU);
+    }
+    program = LoadOrParse(PRINT_TEN, cache_path);
+    ASSERT_EQUAL(Run(*program), "a a a a a a a a a a\n"s);
+
+    filesystem::remove_all(dir);
+}
+
+}  // namespace
+
+void RunProgramCacheTests(TestRunner& tr) {
+    RUN_TEST(tr, cache::TestRoundTrip);
+    RUN_TEST(tr, cache::TestInvalidImages);
+    RUN_TEST(tr, cache::TestLoadOrParse);
+}
+
+}  // namespace cache
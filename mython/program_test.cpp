@@ -0,0 +1,454 @@
+#include "bytecode.h"
+#include "lexer.h"
+#include "parse.h"
+#include "program.h"
+#include "test_runner_p.h"
+
+#include <chrono>
+#include <optional>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace mython {
+
+namespace {
+
+const CompileOptions BACKENDS[] = {
+    {Backend::Tree, true},
+    {Backend::Tree, false},
+    {Backend::Bytecode, true},
+};
+
+string Run(const Program& program) {
+    ostringstream output;
+    program.Run(output);
+    return output.str();
+}
+
+void TestRepeatedRuns() {
+    const string source = R"(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def inc():
+    self.value = self.value + 1
+    return self.value
+
+c = Counter()
+c.inc()
+print c.inc(), c.value
+)"s;
+    for (const auto& options : BACKENDS) {
+        const auto program = Program::Compile(source, options);
+        // Каждое исполнение начинается с пустых глобальных переменных и новых экземпляров
+        for (int i = 0; i < 3; ++i) {
+            ASSERT_EQUAL(Run(program), "2 2\n"s);
+        }
+
+        runtime::DummyContext context;
+        const runtime::Closure globals = program.Run(context);
+        ASSERT_EQUAL(context.output.str(), "2 2\n"s);
+        ASSERT(globals.at("c"s).TryAs<runtime::ClassInstance>() != nullptr);
+        ASSERT(globals.at("Counter"s).TryAs<runtime::Class>() != nullptr);
+    }
+}
+
+void TestFreshInstances() {
+    const string source = R"(
+class Box:
+  def __init__(v):
+    self.v = v
+
+class Factory:
+  def make(v):
+    return Box(v)
+
+f = Factory()
+a = f.make(1)
+b = f.make(2)
+print a.v, b.v
+)"s;
+    for (const auto& options : BACKENDS) {
+        ASSERT_EQUAL(Run(Program::Compile(source, options)), "1 2\n"s);
+    }
+}
+
+void TestEscapingSelf() {
+    // self, возвращённый из метода или сохранённый в поле другого объекта, владеет экземпляром
+    // наравне с переменными, поэтому переживает исчезновение остальных ссылок
+    const string source = R"(
+class Node:
+  def __init__(v):
+    self.v = v
+
+  def me():
+    return self
+
+  def link(o):
+    o.back = self
+
+class Maker:
+  def make():
+    a = Node(7)
+    return a.me()
+
+y = Node(5)
+z = y.me()
+y = 0
+print z.v
+m = Maker()
+k = m.make()
+print k.v
+h = Node(1)
+n = Node(9)
+n.link(h)
+n = 0
+print h.back.v
+)"s;
+    for (const auto& options : BACKENDS) {
+        ASSERT_EQUAL(Run(Program::Compile(source, options)), "5\n7\n9\n"s);
+    }
+}
+
+void TestConcurrentRuns() {
+    const string source = R"(
+class Shape:
+  def area():
+    return 0
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.w = w
+    self.h = h
+
+  def area():
+    return self.w * self.h
+
+  def __str__():
+    return 'Rect ' + str(self.area())
+
+class Sum:
+  def calc(shape, n):
+    if n == 0:
+      return 0
+    return shape.area() + self.calc(shape, n - 1)
+
+s = Sum()
+r = Rect(2, 3)
+print r, s.calc(r, 20), s.calc(Shape(), 5)
+)"s;
+    const string expected = "Rect 6 120 0\n"s;
+    for (const auto& options : BACKENDS) {
+        const auto program = Program::Compile(source, options);
+        vector<string> results(4);
+        vector<thread> workers;
+        for (auto& result : results) {
+            workers.emplace_back([&program, &result] {
+                for (int i = 0; i < 50; ++i) {
+                    result += Run(program);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        string all_runs;
+        for (int i = 0; i < 50; ++i) {
+            all_runs += expected;
+        }
+        for (const auto& result : results) {
+            ASSERT_EQUAL(result, all_runs);
+        }
+    }
+}
+
+void TestErrorLocations() {
+    auto run_error = [](const string& source, const CompileOptions& options,
+                        const string& name = {}) -> string {
+        parse::Lexer lexer(source);
+        lexer.SetSourceName(name);
+        const auto program = Program::Compile(lexer, options);
+        try {
+            Run(program);
+        } catch (const runtime::ExecutionError& error) {
+            return error.what();
+        }
+        return {};
+    };
+    const string method_error = "class A:\n  def f():\n    return 1 / 0\na = A()\nprint a.f()\n"s;
+    for (const auto& options : BACKENDS) {
+        ASSERT_EQUAL(run_error("print 1\nx = 1 / 0\n"s, options), "2:1: Division by zero"s);
+        ASSERT_EQUAL(run_error(method_error, options, "prog.my"s), "prog.my:3:5: Division by zero"s);
+    }
+}
+
+// Программа выполняет около 2^depth вызовов методов с глубиной вложенности depth
+string MakeFibonacci(int depth) {
+    return R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+f = Fib()
+print f.calc()"s + to_string(depth) + ")\n"s;
+}
+
+// Возвращает ограничение, исчерпанное при исполнении program, либо nullopt
+optional<runtime::Limit> RunWithLimits(const Program& program, const runtime::Limits& limits) {
+    runtime::DummyContext context;
+    context.SetLimits(limits);
+    try {
+        program.Run(context);
+    } catch (const runtime::LimitExceeded& error) {
+        // Исчерпанное ограничение не снимается, пока не будут заданы новые
+        ASSERT_THROWS(context.Step(), runtime::LimitExceeded);
+        return error.GetLimit();
+    }
+    return nullopt;
+}
+
+void TestLimits() {
+    const string nested = R"(
+class Node:
+  def __init__(left, right):
+    self.left = left
+    self.right = right
+
+class Builder:
+  def build(n):
+    if n == 0:
+      return None
+    return Node(self.build(n - 1), self.build(n - 1))
+
+b = Builder()
+tree = b.build(13)
+)"s;
+    for (const auto& options : BACKENDS) {
+        const auto fibonacci = Program::Compile(MakeFibonacci(25), options);
+        runtime::Limits steps;
+        steps.max_steps = 1000;
+        ASSERT(RunWithLimits(fibonacci, steps) == runtime::Limit::Steps);
+        runtime::Limits time;
+        time.max_time = chrono::milliseconds(1);
+        ASSERT(RunWithLimits(fibonacci, time) == runtime::Limit::Time);
+
+        // Глубина вызовов ограничена и без явно заданных ограничений
+        const auto countdown = [&](int depth) {
+            return Program::Compile(
+                "class C:\n  def down(n):\n    if n == 0:\n      return 0\n"s
+                    + "    return self.down(n - 1)\nc = C()\nprint c.down("s + to_string(depth) + ")\n"s,
+                options);
+        };
+        ASSERT(RunWithLimits(countdown(runtime::Limits::DEFAULT_MAX_CALL_DEPTH - 2), {}) == nullopt);
+        ASSERT(RunWithLimits(countdown(runtime::Limits::DEFAULT_MAX_CALL_DEPTH), {})
+               == runtime::Limit::CallDepth);
+        runtime::Limits depth;
+        depth.max_call_depth = 10;
+        ASSERT(RunWithLimits(countdown(9), depth) == nullopt);
+        ASSERT(RunWithLimits(countdown(10), depth) == runtime::Limit::CallDepth);
+
+        runtime::Limits heap;
+        heap.max_heap_bytes = 64 * 1024;
+        ASSERT(RunWithLimits(Program::Compile(nested, options), heap) == runtime::Limit::HeapBytes);
+        heap.max_heap_bytes = 64 * 1024 * 1024;
+        ASSERT(RunWithLimits(Program::Compile(nested, options), heap) == nullopt);
+
+        // Строка, удвоенная 31 раз, занимает мало памяти, пока не собрана в непрерывную, а её
+        // сборка за один шаг запросила бы 2 ГБ. Ограничение срабатывает до выделения памяти
+        string doubling = "s = 'ab'\n"s;
+        for (int i = 0; i < 30; ++i) {
+            doubling += "s = s + s\n"s;
+        }
+        runtime::Limits small_heap;
+        small_heap.max_heap_bytes = 10 * 1024 * 1024;
+        for (const string& use : {"print s\n"s, "x = s == s\n"s}) {
+            ASSERT(RunWithLimits(Program::Compile(doubling + use, options), small_heap)
+                   == runtime::Limit::HeapBytes);
+        }
+    }
+
+    // Ошибка указывает на инструкцию, при исполнении которой исчерпано ограничение
+    const string source = MakeFibonacci(10);
+    parse::Lexer lexer(source);
+    lexer.SetSourceName("fib.my"s);
+    const auto program = Program::Compile(lexer);
+    runtime::DummyContext context;
+    runtime::Limits steps;
+    steps.max_steps = 20;
+    context.SetLimits(steps);
+    try {
+        program.Run(context);
+        ASSERT(false);
+    } catch (const runtime::LimitExceeded& error) {
+        ASSERT_EQUAL(error.what(), "fib.my:6:5: Step limit exceeded"s);
+    }
+    ASSERT_EQUAL(context.GetStepCount(), 21U);
+}
+
+void TestStepCountsAgree() {
+    // Оба способа исполнения считают одни и те же шаги
+    vector<uint64_t> counts;
+    for (const auto& options : BACKENDS) {
+        runtime::DummyContext context;
+        context.SetLimits({});
+        Program::Compile(MakeFibonacci(10), options).Run(context);
+        ASSERT_EQUAL(context.output.str(), "55\n"s);
+        counts.push_back(context.GetStepCount());
+    }
+    ASSERT(counts.front() > 0);
+    ASSERT_EQUAL(counts.front(), counts.back());
+}
+
+void TestBytecodeFallback() {
+    // Константы программы не умещаются в таблицу констант байткода
+    string source;
+    for (int i = 0; i < 70000; ++i) {
+        source += "x = "s + to_string(i) + "\n"s;
+    }
+    source += "print x\n"s;
+    parse::Lexer lexer(source);
+    ASSERT_THROWS(static_cast<void>(bytecode::Compile(*ParseProgram(lexer))), bytecode::CompileError);
+    for (const auto& options : BACKENDS) {
+        ASSERT_EQUAL(Run(Program::Compile(source, options)), "69999\n"s);
+    }
+}
+
+// Запоминает, сколько символов программы прочитано из input к моменту первого вывода
+class FirstOutputProbe : public streambuf {
+public:
+    explicit FirstOutputProbe(istream& input)
+        : input_(input) {
+    }
+
+    [[nodiscard]] optional<streamoff> GetReadBeforeOutput() const {
+        return read_;
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        Record();
+        return ch;
+    }
+
+    streamsize xsputn(const char* /*s*/, streamsize count) override {
+        Record();
+        return count;
+    }
+
+private:
+    void Record() {
+        if (!read_) {
+            read_ = input_.tellg();
+        }
+    }
+
+    istream& input_;
+    optional<streamoff> read_;
+};
+
+void TestRunIncrementally() {
+    // Значения констант верхнего уровня сохраняются в переменных и полях после удаления
+    // инструкций, в которых записаны
+    const string source = R"(
+class Named:
+  def __init__(name):
+    self.name = name
+
+  def __str__():
+    return 'Named ' + self.name
+
+class Greeter(Named):
+  def greet(other):
+    return self.name + ' greets ' + other
+
+g = Greeter('Ann')
+g.title = 'Dr'
+n = 42
+flag = True
+if n > 40:
+  class Late:
+    def value():
+      return 'late'
+print g, g.title, n, flag
+print g.greet('Bob'), str(n + 1) + '!'
+l = Late()
+print l.value()
+)"s;
+    for (const bool optimize : {true, false}) {
+        const CompileOptions options{Backend::Tree, optimize};
+        const string expected = Run(Program::Compile(source, options));
+        parse::Lexer lexer(source);
+        runtime::DummyContext context;
+        RunIncrementally(lexer, context, options);
+        ASSERT_EQUAL(context.output.str(), expected);
+    }
+
+    // Первая инструкция исполняется, когда остальная программа ещё не прочитана
+    string generated = "print 'first'\n"s;
+    for (int i = 0; i < 1000; ++i) {
+        generated += "x = "s + to_string(i) + "\n"s;
+    }
+    generated += "print x\n"s;
+    istringstream input(generated);
+    FirstOutputProbe probe(input);
+    ostream probe_stream(&probe);
+    {
+        runtime::BufferedContext context(probe_stream);
+        parse::Lexer lexer(input);
+        RunIncrementally(lexer, context);
+    }
+    ASSERT(probe.GetReadBeforeOutput().has_value());
+    ASSERT(*probe.GetReadBeforeOutput() < static_cast<streamoff>(generated.size() / 10));
+
+    // Ошибка разбора обнаруживается после исполнения предшествующих инструкций
+    {
+        const string broken = "print 'ready'\nprint )\n"s;
+        parse::Lexer lexer(broken);
+        runtime::DummyContext context;
+        try {
+            RunIncrementally(lexer, context);
+            ASSERT(false);
+        } catch (const parse::LexerError& error) {
+            ASSERT_EQUAL(string(error.what()).substr(0, 5), "2:7: "s);
+        }
+        ASSERT_EQUAL(context.output.str(), "ready\n"s);
+    }
+    {
+        const string failing = "print 1\nx = 1 / 0\nprint 2\n"s;
+        parse::Lexer lexer(failing);
+        lexer.SetSourceName("stream.my"s);
+        runtime::DummyContext context;
+        try {
+            RunIncrementally(lexer, context);
+            ASSERT(false);
+        } catch (const runtime::ExecutionError& error) {
+            ASSERT_EQUAL(error.what(), "stream.my:2:1: Division by zero"s);
+        }
+        ASSERT_EQUAL(context.output.str(), "1\n"s);
+    }
+
+    parse::Lexer lexer("print 1\n"sv);
+    runtime::DummyContext context;
+    ASSERT_THROWS(RunIncrementally(lexer, context, {Backend::Bytecode, true}), invalid_argument);
+}
+
+}  // namespace
+
+void RunProgramTests(TestRunner& tr) {
+    RUN_TEST(tr, mython::TestRepeatedRuns);
+    RUN_TEST(tr, mython::TestFreshInstances);
+    RUN_TEST(tr, mython::TestEscapingSelf);
+    RUN_TEST(tr, mython::TestConcurrentRuns);
+    RUN_TEST(tr, mython::TestErrorLocations);
+    RUN_TEST(tr, mython::TestLimits);
+    RUN_TEST(tr, mython::TestStepCountsAgree);
+    RUN_TEST(tr, mython::TestBytecodeFallback);
+    RUN_TEST(tr, mython::TestRunIncrementally);
+}
+
+}  // namespace mython
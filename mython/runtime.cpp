@@ -1,6 +1,10 @@
 #include "runtime.h"
 
+#include "profiler.h"
+
 #include <cassert>
+#include <charconv>
+#include <limits>
 #include <optional>
 #include <sstream>
 #include <algorithm>
@@ -9,23 +13,91 @@ using namespace std;
 
 namespace runtime {
 
-ObjectHolder::ObjectHolder(std::shared_ptr<Object> data)
+namespace {
+const Symbol ADD_METHOD = PredefinedSymbol::Add;
+const Symbol EQ_METHOD = PredefinedSymbol::Eq;
+const Symbol LT_METHOD = PredefinedSymbol::Lt;
+const Symbol STR_METHOD = PredefinedSymbol::Str;
+const Symbol SELF = PredefinedSymbol::Self;
+
+// Объединяет виды аргументов бинарной операции в одно значение для switch
+constexpr unsigned KindPair(ObjectKind lhs, ObjectKind rhs) {
+    return static_cast<unsigned>(lhs) << 8U | static_cast<unsigned>(rhs);
+}
+
+constexpr unsigned NUMBERS = KindPair(ObjectKind::Number, ObjectKind::Number);
+constexpr unsigned STRINGS = KindPair(ObjectKind::String, ObjectKind::String);
+constexpr unsigned BOOLS = KindPair(ObjectKind::Bool, ObjectKind::Bool);
+constexpr unsigned NONES = KindPair(ObjectKind::None, ObjectKind::None);
+
+uint32_t NextClassId() {
+    static atomic<uint32_t> next_id = 1;
+    return next_id.fetch_add(1, memory_order_relaxed);
+}
+
+uint32_t NextShapeId() {
+    static atomic<uint32_t> next_id = 1;
+    return next_id.fetch_add(1, memory_order_relaxed);
+}
+
+// Части конкатенации всегда являются строками
+String* AsString(const ObjectRef& ref) {
+    return static_cast<String*>(ref.Get());  // NOLINT
+}
+
+// Возвращает метод __str__ без параметров либо nullptr, если у класса его нет
+const Method* FindStrMethod(const Class& cls) {
+    const Method* method = cls.GetMethod(STR_METHOD);
+    return method && method->formal_params.empty() ? method : nullptr;
+}
+
+// Строки, которые возвращает str() для None и логических значений. Объекты неизменяемы и
+// существуют до завершения программы, поэтому результаты ссылаются на них, не владея ими
+String& StaticString(PredefinedSymbol symbol) {
+    static String none_string("None"s);
+    static String true_string("True"s);
+    static String false_string("False"s);
+    switch (symbol) {
+        case PredefinedSymbol::True: return true_string;
+        case PredefinedSymbol::False: return false_string;
+        default: return none_string;
+    }
+}
+
+// Аргументы, вид которых уже проверен, приводятся без dynamic_cast
+template <typename T>
+const auto& ValueOf(const ObjectHolder& object) {
+    return static_cast<const T&>(*object).GetValue();  // NOLINT
+}
+}  // namespace
+
+ObjectHolder::ObjectHolder(Data data)
     : data_(std::move(data)) {
 }
 
 void ObjectHolder::AssertIsValid() const {
-    assert(data_ != nullptr);
+    assert(Get() != nullptr);
 }
 
 ObjectHolder ObjectHolder::Share(Object& object) {
-    // Возвращаем невладеющий shared_ptr (его deleter ничего не делает)
-    return ObjectHolder(std::shared_ptr<Object>(&object, [](auto* /*p*/) { /* do nothing */ }));
+    return ObjectHolder(Data(&object));
+}
+
+ObjectHolder ObjectHolder::Retain(Object& object) {
+    return object.ref_count_ > 0 ? ObjectHolder(Data(ObjectRef(&object))) : Share(object);
 }
 
 ObjectHolder ObjectHolder::None() {
     return ObjectHolder();
 }
 
+ObjectHolder ObjectHolder::Borrow() const {
+    if (const auto* object = std::get_if<ObjectRef>(&data_)) {
+        return object->Get() ? Share(*object->Get()) : None();
+    }
+    return *this;
+}
+
 Object& ObjectHolder::operator*() const {
     AssertIsValid();
     return *Get();
@@ -37,35 +109,89 @@ Object* ObjectHolder::operator->() const {
 }
 
 Object* ObjectHolder::Get() const {
-    return data_.get();
+    if (auto* object = std::get_if<ObjectRef>(&data_)) {
+        return object->Get();
+    }
+    if (auto* object = std::get_if<Object*>(&data_)) {
+        return *object;
+    }
+    if (auto* number = std::get_if<Number>(&data_)) {
+        return number;
+    }
+    return std::get_if<Bool>(&data_);
 }
 
 ObjectHolder::operator bool() const {
     return Get() != nullptr;
 }
 
-bool IsTrue(const ObjectHolder& object) {
-    if (Number* object_ = object.TryAs<Number>()) {
-        return object_->GetValue() != 0;
+CallStack::Frame::Frame(CallStack& stack, size_t size)
+    : stack_(stack), slots_(stack.PushFrame(size)) {
+}
+
+CallStack::Frame::~Frame() {
+    stack_.PopFrame();
+}
+
+CallStack::Slot* CallStack::PushFrame(size_t size) {
+    while (current_block_ < blocks_.size()
+           && blocks_[current_block_].capacity - blocks_[current_block_].used < size) {
+        ++current_block_;
     }
-    if (Bool* object_ = object.TryAs<Bool>()) {
-        return object_->GetValue() == true;
+    if (current_block_ == blocks_.size()) {
+        const size_t capacity = std::max(BLOCK_SIZE, size);
+        blocks_.push_back({std::make_unique<Slot[]>(capacity), capacity, 0});
     }
-    if (String* object_ = object.TryAs<String>()) {
-        return !(object_->GetValue().empty());
+    Block& block = blocks_[current_block_];
+    Slot* slots = block.slots.get() + block.used;
+    block.used += size;
+    frames_.push_back({slots, size, current_block_});
+    return slots;
+}
+
+void CallStack::PopFrame() {
+    const FrameRecord frame = frames_.back();
+    frames_.pop_back();
+    std::fill(frame.slots, frame.slots + frame.size, std::nullopt);
+    blocks_[frame.block].used -= frame.size;
+    current_block_ = frame.block;
+}
+
+bool IsTrue(const ObjectHolder& object) {
+    switch (object.GetKind()) {
+        case ObjectKind::Number:
+            return ValueOf<Number>(object) != 0;
+        case ObjectKind::Bool:
+            return ValueOf<Bool>(object);
+        case ObjectKind::String:
+            return !ValueOf<String>(object).empty();
+        default:
+            return false;
     }
-    return false;
 }
 
 void ClassInstance::Print(std::ostream& os, Context& context) {
-    if (HasMethod("__str__"s, 0)) {
-        Call("__str__"s, {}, context)->Print(os, context);
+    if (const Method* str_method = FindStrMethod(cls_)) {
+        CallMethod(*str_method, {}, context)->Print(os, context);
     } else {
         os << this;
     }
 }
 
-bool ClassInstance::HasMethod(const std::string& method, size_t argument_count) const {
+void ClassInstance::Print(OutputBuffer& out, Context& context) {
+    if (const Method* str_method = FindStrMethod(cls_)) {
+        CallMethod(*str_method, {}, context)->Print(out, context);
+    } else {
+        // Адрес выводится так же, как его выводит std::ostream
+        char digits[2 * sizeof(uintptr_t)];
+        const auto result = to_chars(begin(digits), end(digits),
+                                     reinterpret_cast<uintptr_t>(this), 16);  // NOLINT
+        out.Append("0x"sv);
+        out.Append(string_view(digits, result.ptr - digits));
+    }
+}
+
+bool ClassInstance::HasMethod(Symbol method, size_t argument_count) const {
     const Method* method_ = cls_.GetMethod(method);
     if (method_ && (method_->formal_params.size() == argument_count)) {
         return true;
@@ -73,55 +199,290 @@ bool ClassInstance::HasMethod(const std::string& method, size_t argument_count)
     return false;
 }
 
-Closure& ClassInstance::Fields() {
-    return closure_;
+FieldTable& ClassInstance::Fields() {
+    return fields_;
+}
+
+const FieldTable& ClassInstance::Fields() const {
+    return fields_;
 }
 
-const Closure& ClassInstance::Fields() const {
-    return closure_;
+Shape::Shape()
+    : id_(NextShapeId()) {
+}
+
+Shape::Shape(const Shape& parent, Symbol name)
+    : parent_(&parent), id_(NextShapeId()), names_(parent.names_) {
+    names_.push_back(name);
+    if (names_.size() > LINEAR_SEARCH_SIZE) {
+        indices_.reserve(names_.size());
+        for (size_t i = 0; i < names_.size(); ++i) {
+            indices_.emplace(names_[i], static_cast<uint32_t>(i));
+        }
+    }
+}
+
+uint32_t Shape::FindField(Symbol name) const {
+    if (names_.size() > LINEAR_SEARCH_SIZE) {
+        auto it = indices_.find(name);
+        return it != indices_.end() ? it->second : NO_FIELD;
+    }
+    for (size_t i = 0; i < names_.size(); ++i) {
+        if (names_[i] == name) {
+            return static_cast<uint32_t>(i);
+        }
+    }
+    return NO_FIELD;
+}
+
+const Shape& Shape::AddField(Symbol name) const {
+    assert(FindField(name) == NO_FIELD);
+    // Объекты одного класса обычно создаются одинаково, и у формы единственный переход
+    if (const Shape* first = first_transition_.load(memory_order_acquire);
+        first != nullptr && first->names_.back() == name) {
+        return *first;
+    }
+    lock_guard guard(transitions_mutex_);
+    for (const auto& transition : transitions_) {
+        if (transition->names_.back() == name) {
+            return *transition;
+        }
+    }
+    transitions_.push_back(unique_ptr<Shape>(new Shape(*this, name)));
+    if (transitions_.size() == 1) {
+        first_transition_.store(transitions_.front().get(), memory_order_release);
+    }
+    return *transitions_.back();
+}
+
+void Shape::UpdateCapacityHint(size_t field_count) const {
+    size_t hint = capacity_hint_.load(memory_order_relaxed);
+    while (hint < field_count
+           && !capacity_hint_.compare_exchange_weak(hint, field_count, memory_order_relaxed)) {
+    }
+}
+
+FieldTable::FieldTable(const Shape& root)
+    : shape_(&root) {
+    values_.reserve(root.GetCapacityHint());
+}
+
+ObjectHolder* FieldTable::Find(Symbol name) {
+    const uint32_t index = shape_->FindField(name);
+    return index != Shape::NO_FIELD ? &values_[index] : nullptr;
+}
+
+const ObjectHolder* FieldTable::Find(Symbol name) const {
+    const uint32_t index = shape_->FindField(name);
+    return index != Shape::NO_FIELD ? &values_[index] : nullptr;
+}
+
+ObjectHolder& FieldTable::operator[](Symbol name) {
+    if (ObjectHolder* value = Find(name)) {
+        return *value;
+    }
+    return Append(shape_->AddField(name), ObjectHolder::None());
+}
+
+ObjectHolder& FieldTable::Append(const Shape& shape, ObjectHolder value) {
+    assert(shape.GetParent() == shape_);
+    if (values_.size() == values_.capacity()) {
+        // Массив растёт редко: следующие объекты сразу получат память под все поля
+        const Shape* root = &shape;
+        while (root->GetParent() != nullptr) {
+            root = root->GetParent();
+        }
+        root->UpdateCapacityHint(values_.size() + 1);
+    }
+    shape_ = &shape;
+    return values_.emplace_back(std::move(value));
+}
+
+void FieldTable::ReleaseValues() {
+    values_.clear();
+}
+
+void FieldTable::Clear() {
+    values_.clear();
+    while (shape_->GetParent() != nullptr) {
+        shape_ = shape_->GetParent();
+    }
+}
+
+uint32_t FieldCache::FindIndex(const Shape& shape, Symbol name) {
+    const uint64_t shape_bits = static_cast<uint64_t>(shape.GetId()) << 32U;
+    for (const auto& entry : entries_) {
+        const uint64_t value = entry.load(memory_order_relaxed);
+        if ((value & ~uint64_t{UINT32_MAX}) == shape_bits) {
+            UpdateMetrics([](Metrics& metrics) {
+                ++metrics.field_cache_hits;
+            });
+            return static_cast<uint32_t>(value);
+        }
+    }
+    UpdateMetrics([](Metrics& metrics) {
+        ++metrics.field_cache_misses;
+    });
+    const uint32_t index = shape.FindField(name);
+    const uint32_t slot = next_.fetch_add(1, memory_order_relaxed) % SIZE;
+    entries_[slot].store(shape_bits | index, memory_order_relaxed);
+    return index;
+}
+
+const ObjectHolder* FieldCache::Find(const FieldTable& fields, Symbol name) {
+    const uint32_t index = FindIndex(fields.GetShape(), name);
+    return index != Shape::NO_FIELD ? &fields.At(index) : nullptr;
+}
+
+ObjectHolder& FieldCache::Store(FieldTable& fields, Symbol name, ObjectHolder value) {
+    const Shape& shape = fields.GetShape();
+    if (const uint32_t index = FindIndex(shape, name); index != Shape::NO_FIELD) {
+        return fields.At(index) = std::move(value);
+    }
+    return fields.Append(shape.AddField(name), std::move(value));
+}
+
+const Class& ClassInstance::GetClass() const {
+    return cls_;
 }
 
 ClassInstance::ClassInstance(const Class& cls)
-    : cls_(cls) {
+    : Object(ObjectKind::ClassInstance), cls_(cls), fields_(cls.GetRootShape()) {
+    CycleCollector::Current().Track(*this);
 }
 
-ObjectHolder ClassInstance::Call(const std::string& method,
+ClassInstance::ClassInstance(const ClassInstance& other)
+    : Object(other), cls_(other.cls_), fields_(other.fields_) {
+    CycleCollector::Current().Track(*this);
+}
+
+ClassInstance::ClassInstance(ClassInstance&& other)
+    : Object(other), cls_(other.cls_), fields_(std::move(other.fields_)) {
+    CycleCollector::Current().Track(*this);
+}
+
+ClassInstance::~ClassInstance() {
+    CycleCollector::Current().Untrack(*this);
+}
+
+ObjectHolder ClassInstance::Call(Symbol method,
                                  const std::vector<ObjectHolder>& actual_args,
                                  Context& context) {
 
-    if (!HasMethod(method, actual_args.size())) {
-        throw std::runtime_error("Error calling method "s + method);
+    const Method* method_ = cls_.GetMethod(method);
+    if (!method_ || method_->formal_params.size() != actual_args.size()) {
+        throw std::runtime_error("Error calling method "s + method.GetName());
     }
+    return CallMethod(*method_, actual_args, context);
+}
 
-    const Method* method_ = cls_.GetMethod(method);
-    
+ObjectHolder ClassInstance::CallMethod(const Method& method,
+                                       const std::vector<ObjectHolder>& actual_args,
+                                       Context& context) {
+    const Context::CallScope call(context);
+    const Profiler::CallScope profile(context.GetProfiler(), cls_, method);
     Closure closure;
-    
-    closure["self"s] = ObjectHolder::Share(*this);
+
+    if (method.frame_size > 0) {
+        // Метод мог быть загружен из кэша программы, поэтому размер кадра проверяется и в
+        // сборке без отладки
+        if (actual_args.size() >= method.frame_size) {
+            throw std::runtime_error("Invalid frame size of method "s + method.name.GetName());
+        }
+        // Имена уже разрешены в слоты: self и параметры кладутся в кадр, а Closure остаётся пустым
+        CallStack::Frame frame(context.GetCallStack(), method.frame_size);
+        CallStack::Slot* slots = frame.Slots();
+        // self может пережить вызов, если метод вернёт его или сохранит в поле другого объекта
+        slots[0] = ObjectHolder::Retain(*this);
+        for (size_t index = 0; index < actual_args.size(); ++index) {
+            assert(index + 1 < method.frame_size);
+            slots[index + 1] = actual_args[index];
+        }
+        return method.body->Execute(closure, context);
+    }
+
+    closure[SELF] = ObjectHolder::Retain(*this);
 
     size_t index = 0;
-    for (auto &param : method_->formal_params) {
+    for (auto &param : method.formal_params) {
         closure[param] = actual_args.at(index++);
     }
 
-    return method_->body->Execute(closure, context);
+    return method.body->Execute(closure, context);
 }
 
-Class::Class(std::string name, std::vector<Method> methods, const Class* parent)
-    : name_(std::move(name)), methods_(std::move(methods)), parent_(parent) {
+Class::Class(std::string name, std::vector<Method> methods, const Class* parent,
+             std::shared_ptr<Arena> arena)
+    : Object(ObjectKind::Class), arena_(std::move(arena)), name_(std::move(name)),
+      methods_(std::move(methods)), parent_(parent), id_(NextClassId()),
+      root_shape_(make_unique<Shape>()) {
+    BuildMethodTable();
 }
 
-const Method* Class::GetMethod(const std::string& name) const {
-    
-    auto it = std::find_if(methods_.begin(), methods_.end(), 
-        [&name](const Method &method) { return method.name == name; });
+void Class::SetParent(const Class* parent) {
+    parent_ = parent;
+    BuildMethodTable();
+}
 
-    if (it != methods_.end()) {
-        return &(*it);
-    } else if (parent_) {
-        return parent_->GetMethod(name);
+void Class::BuildMethodTable() {
+    method_table_.clear();
+    method_indices_.clear();
+    if (parent_) {
+        method_table_ = parent_->method_table_;
+        method_indices_ = parent_->method_indices_;
+    }
+    // Собственные методы заменяют унаследованные. Если имя повторяется внутри класса,
+    // используется первый из методов с этим именем
+    for (auto it = methods_.rbegin(); it != methods_.rend(); ++it) {
+        auto [index, inserted] = method_indices_.emplace(it->name, method_table_.size());
+        if (inserted) {
+            method_table_.push_back(&*it);
+        } else {
+            method_table_[index->second] = &*it;
+        }
     }
-    return nullptr;
+    init_method_ = GetMethod(PredefinedSymbol::Init);
+}
+
+const Method* Class::GetMethod(Symbol name) const {
+    return GetMethodAt(FindMethod(name));
+}
+
+uint32_t Class::FindMethod(Symbol name) const {
+    auto it = method_indices_.find(name);
+    return it != method_indices_.end() ? it->second : NO_METHOD;
+}
+
+const Method* MethodCache::Lookup(const Class& cls, Symbol name) {
+    const uint64_t class_bits = static_cast<uint64_t>(cls.GetId()) << 32U;
+    for (const auto& entry : entries_) {
+        const uint64_t value = entry.load(memory_order_relaxed);
+        if ((value & ~uint64_t{UINT32_MAX}) == class_bits) {
+            UpdateMetrics([](Metrics& metrics) {
+                ++metrics.method_cache_hits;
+            });
+            return cls.GetMethodAt(static_cast<uint32_t>(value));
+        }
+    }
+    UpdateMetrics([](Metrics& metrics) {
+        ++metrics.method_cache_misses;
+    });
+    const uint32_t index = cls.FindMethod(name);
+    const uint32_t slot = next_.fetch_add(1, memory_order_relaxed) % SIZE;
+    entries_[slot].store(class_bits | index, memory_order_relaxed);
+    return cls.GetMethodAt(index);
+}
+
+const std::vector<Method>& Class::GetMethods() const {
+    return methods_;
+}
+
+std::vector<Method>& Class::GetMethods() {
+    return methods_;
+}
+
+const Class* Class::GetParent() const {
+    return parent_;
 }
 
 // [[nodiscard]] inline const std::string& Class::GetName() const {
@@ -129,45 +490,253 @@ const Method* Class::GetMethod(const std::string& name) const {
     return name_;
 }
 
+// Содержимое строки учитывается в ObjectPool::GetHeapBytes, пока строка хранит его в value_
+String::String(std::string value)
+    : Object(ObjectKind::String), value_(std::move(value)), size_(value_.size()) {
+    Context::ChargeHeap(size_);
+}
+
+String::String(const String& other)
+    : Object(other), size_(other.size_) {
+    const std::string& value = other.GetValue();
+    // Память копии учитывается до копирования, чтобы не выделять её сверх ограничения
+    Context::ChargeHeap(size_);
+    value_ = value;
+}
+
+String::String(String&& other) noexcept
+    : Object(other), value_(std::exchange(other.value_, {})), parts_(std::move(other.parts_)),
+      size_(other.size_) {
+}
+
+String::String(Parts parts, size_t size)
+    : Object(ObjectKind::String), parts_(std::move(parts)), size_(size) {
+}
+
+String::~String() {
+    ObjectPool::AccountExternal(-static_cast<int64_t>(value_.size()));
+    ReleaseParts(parts_);
+}
+
+ObjectHolder String::Concat(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+    const auto& lhs_string = static_cast<const String&>(*lhs);  // NOLINT
+    const auto& rhs_string = static_cast<const String&>(*rhs);  // NOLINT
+    const size_t size = lhs_string.size_ + rhs_string.size_;
+    if (size < MIN_CONCATENATION_SIZE) {
+        return ObjectHolder::Own(String(lhs_string.GetValue() + rhs_string.GetValue()));
+    }
+    // Строки, которыми владеет не исполнение программы (например, её константы), копируются:
+    // на них нельзя ссылаться владеющей ссылкой
+    auto part = [](const ObjectHolder& holder, const String& string) {
+        return holder.IsOwning() ? ObjectRef(holder.Get()) : ObjectRef(new String(string));
+    };
+    return ObjectHolder::Own(
+        String(Parts{part(lhs, lhs_string), part(rhs, rhs_string)}, size));
+}
+
+void String::Print(std::ostream& os, [[maybe_unused]] Context& context) {
+    os << GetValue();
+}
+
+void String::Print(OutputBuffer& out, [[maybe_unused]] Context& context) {
+    out.Append(GetValue());
+}
+
+const std::string& String::GetValue() const {
+    if (parts_) {
+        // Память учитывается до сборки строки: строка, склеенная из одних и тех же частей,
+        // может быть во много раз больше памяти, которую занимают части
+        Context::ChargeHeap(size_);
+        // Части обходятся слева направо без рекурсии: цепочка может быть очень длинной
+        value_.reserve(size_);
+        vector<const String*> pending{AsString(parts_->rhs), AsString(parts_->lhs)};
+        while (!pending.empty()) {
+            const String* part = pending.back();
+            pending.pop_back();
+            if (part->parts_) {
+                pending.push_back(AsString(part->parts_->rhs));
+                pending.push_back(AsString(part->parts_->lhs));
+            } else {
+                value_ += part->value_;
+            }
+        }
+        ReleaseParts(parts_);
+    }
+    return value_;
+}
+
+void String::ReleaseParts(optional<Parts>& parts) {
+    if (!parts) {
+        return;
+    }
+    vector<ObjectRef> pending;
+    pending.push_back(std::move(parts->lhs));
+    pending.push_back(std::move(parts->rhs));
+    parts.reset();
+    while (!pending.empty()) {
+        ObjectRef part = std::move(pending.back());
+        pending.pop_back();
+        // Части удаляемой части забираются до её удаления, поэтому деструкторы не вложены
+        // Ссылки в частях перемещённой строки пусты
+        auto* string = AsString(part);
+        if (string != nullptr && part.IsUnique() && string->parts_) {
+            pending.push_back(std::move(string->parts_->lhs));
+            pending.push_back(std::move(string->parts_->rhs));
+            string->parts_.reset();
+        }
+    }
+}
+
 void Class::Print(ostream& os, [[maybe_unused]] Context& context) {
     os << "Class "s << name_;
 }
 
+void Class::Print(OutputBuffer& out, [[maybe_unused]] Context& context) {
+    out.Append("Class "sv);
+    out.Append(name_);
+}
+
 void Bool::Print(std::ostream& os, [[maybe_unused]] Context& context) {
     os << (GetValue() ? "True"sv : "False"sv);
 }
 
-// Функция Equal возвращает true, если её аргументы содержат одинаковые числа, строки или логические значения,
-// и false — если разные. Если первый аргумент — экземпляр пользовательского класса с методом __eq__,
-// функция возвращает результат вызова lhs.__eq__(rhs), приведённый к типу Bool.
-// Если оба аргумента имеют значение None, функция возвращает true.
-// В остальных случаях выбрасывается исключение runtime_error.
-bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+void Bool::Print(OutputBuffer& out, [[maybe_unused]] Context& context) {
+    out.Append(GetValue() ? "True"sv : "False"sv);
+}
+
+void Object::Print(OutputBuffer& out, Context& context) {
+    ostringstream os;
+    Print(os, context);
+    out.Append(os.str());
+}
+
+OutputBuffer& Context::GetOutputBuffer() {
+    if (!output_buffer_) {
+        output_buffer_ = make_unique<OutputBuffer>(GetOutputStream(), 0);
+    }
+    return *output_buffer_;
+}
+
+Metrics Context::GetMetrics() const {
+    Metrics metrics = Metrics::Snapshot();
+    metrics -= metrics_base_;
+    metrics.peak_call_depth = peak_call_depth_;
+    return metrics;
+}
+
+void Context::ResetMetrics() {
+    metrics_base_ = Metrics::Snapshot();
+    peak_call_depth_ = call_depth_;
+}
+
+namespace {
+
+// Контекст с ограничением памяти, исполняемый текущим потоком
+thread_local Context* heap_limited_context = nullptr;
+
+}  // namespace
 
-    Number* number_l = lhs.TryAs<Number>();
-    Number* number_r = rhs.TryAs<Number>();
-    if (number_l && number_r) {
-        return number_l->GetValue() == number_r->GetValue();
+Context::~Context() {
+    if (heap_limited_context == this) {
+        heap_limited_context = nullptr;
     }
+}
 
-    String* string_l = lhs.TryAs<String>();
-    String* string_r = rhs.TryAs<String>();
-    if (string_l && string_r) {
-        return string_l->GetValue() == string_r->GetValue();
+void Context::ChargeHeap(size_t bytes) {
+    ObjectPool::AccountExternal(static_cast<int64_t>(bytes));
+    Context* context = heap_limited_context;
+    if (context != nullptr
+        && ObjectPool::GetHeapBytes() - context->heap_base_
+               > static_cast<int64_t>(context->limits_.max_heap_bytes)) {
+        ObjectPool::AccountExternal(-static_cast<int64_t>(bytes));
+        context->Abort(Limit::HeapBytes);
     }
+}
 
-    Bool* bool_l = lhs.TryAs<Bool>();
-    Bool* bool_r = rhs.TryAs<Bool>();
-    if (bool_l && bool_r) {
-        return bool_l->GetValue() == bool_r->GetValue();
+void Context::SetLimits(const Limits& limits) {
+    limits_ = limits;
+    steps_ = 0;
+    max_call_depth_ = limits.max_call_depth > 0 ? limits.max_call_depth : SIZE_MAX;
+    deadline_ = Clock::now() + limits.max_time;
+    heap_base_ = ObjectPool::GetHeapBytes();
+    exceeded_.reset();
+    if (limits.max_heap_bytes > 0) {
+        heap_limited_context = this;
+    } else if (heap_limited_context == this) {
+        heap_limited_context = nullptr;
     }
+    ScheduleCheck();
+}
 
-    if (ClassInstance* instance = lhs.TryAs<ClassInstance>()) {
-        return IsTrue(instance->Call("__eq__"s, {rhs}, context));
+void Context::Abort(Limit limit) {
+    exceeded_ = limit;
+    // Следующий шаг снова обращается к CheckLimits
+    next_check_ = 0;
+    switch (limit) {
+        case Limit::Steps: throw LimitExceeded("Step limit exceeded"s, limit);
+        case Limit::Time: throw LimitExceeded("Time limit exceeded"s, limit);
+        case Limit::CallDepth: throw LimitExceeded("Call depth limit exceeded"s, limit);
+        case Limit::HeapBytes: throw LimitExceeded("Heap limit exceeded"s, limit);
     }
+    throw LimitExceeded("Limit exceeded"s, limit);
+}
 
-    if (!lhs && !rhs) {
-        return true;
+void Context::CheckLimits() {
+    if (exceeded_) {
+        Abort(*exceeded_);
+    }
+    if (limits_.max_steps > 0 && steps_ > limits_.max_steps) {
+        Abort(Limit::Steps);
+    }
+    if (limits_.max_time.count() > 0 && Clock::now() >= deadline_) {
+        Abort(Limit::Time);
+    }
+    if (limits_.max_heap_bytes > 0
+        && ObjectPool::GetHeapBytes() - heap_base_ > static_cast<int64_t>(limits_.max_heap_bytes)) {
+        Abort(Limit::HeapBytes);
+    }
+    ScheduleCheck();
+}
+
+void Context::ScheduleCheck() {
+    // Исчерпание шагов обнаруживается на первом шаге сверх ограничения
+    next_check_ = limits_.max_steps > 0 ? limits_.max_steps + 1 : UINT64_MAX;
+    if (limits_.max_time.count() > 0 || limits_.max_heap_bytes > 0) {
+        next_check_ = std::min(next_check_, steps_ + CHECK_INTERVAL);
+    }
+}
+
+BufferedContext::BufferedContext()
+    : stream_(&buffer_) {
+}
+
+BufferedContext::BufferedContext(ostream& output, size_t flush_threshold)
+    : buffer_(output, flush_threshold), stream_(&buffer_) {
+}
+
+// Функция Equal возвращает true, если её аргументы содержат одинаковые числа, строки или логические значения,
+// и false — если разные. Если первый аргумент — экземпляр пользовательского класса с методом __eq__,
+// функция возвращает результат вызова lhs.__eq__(rhs), приведённый к типу Bool.
+// Если оба аргумента имеют значение None, функция возвращает true.
+// В остальных случаях выбрасывается исключение runtime_error.
+bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+    const ObjectKind lhs_kind = lhs.GetKind();
+    switch (KindPair(lhs_kind, rhs.GetKind())) {
+        case NUMBERS:
+            return ValueOf<Number>(lhs) == ValueOf<Number>(rhs);
+        case STRINGS:
+            return ValueOf<String>(lhs) == ValueOf<String>(rhs);
+        case BOOLS:
+            return ValueOf<Bool>(lhs) == ValueOf<Bool>(rhs);
+        case NONES:
+            return true;
+        default:
+            break;
+    }
+
+    if (lhs_kind == ObjectKind::ClassInstance) {
+        auto& instance = static_cast<ClassInstance&>(*lhs);  // NOLINT
+        return IsTrue(instance.Call(EQ_METHOD, {rhs}, context));
     }
     throw std::runtime_error("Cannot compare objects for equality"s);
 }
@@ -177,29 +746,22 @@ bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
 // функция возвращает результат вызова lhs.__lt__(rhs), приведённый к типу Bool.
 // В остальных случаях выбрасывается исключение runtime_error.
 bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-
-    Number* number_l = lhs.TryAs<Number>();
-    Number* number_r = rhs.TryAs<Number>();
-    if (number_l && number_r) {
-        return number_l->GetValue() < number_r->GetValue();
-    }
-
-    String* string_l = lhs.TryAs<String>();
-    String* string_r = rhs.TryAs<String>();
-    if (string_l && string_r) {
-        return string_l->GetValue() < string_r->GetValue();
+    const ObjectKind lhs_kind = lhs.GetKind();
+    switch (KindPair(lhs_kind, rhs.GetKind())) {
+        case NUMBERS:
+            return ValueOf<Number>(lhs) < ValueOf<Number>(rhs);
+        case STRINGS:
+            return ValueOf<String>(lhs) < ValueOf<String>(rhs);
+        case BOOLS:
+            return ValueOf<Bool>(lhs) < ValueOf<Bool>(rhs);
+        default:
+            break;
     }
 
-    Bool* bool_l = lhs.TryAs<Bool>();
-    Bool* bool_r = rhs.TryAs<Bool>();
-    if (bool_l && bool_r) {
-        return bool_l->GetValue() < bool_r->GetValue();
+    if (lhs_kind == ObjectKind::ClassInstance) {
+        auto& instance = static_cast<ClassInstance&>(*lhs);  // NOLINT
+        return IsTrue(instance.Call(LT_METHOD, {rhs}, context));
     }
-
-    if (ClassInstance* instance = lhs.TryAs<ClassInstance>()) {
-        return IsTrue(instance->Call("__lt__"s, {rhs}, context));
-    }
-
     throw std::runtime_error("Cannot compare objects for less"s);
 }
 
@@ -219,4 +781,85 @@ bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& c
     return !Less(lhs, rhs, context);
 }
 
+ObjectHolder Add(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+    const ObjectKind lhs_kind = lhs.GetKind();
+    switch (KindPair(lhs_kind, rhs.GetKind())) {
+        case NUMBERS:
+            return ObjectHolder::Own(Number(ValueOf<Number>(lhs) + ValueOf<Number>(rhs)));
+        case STRINGS:
+            return String::Concat(lhs, rhs);
+        default:
+            break;
+    }
+
+    if (lhs_kind == ObjectKind::ClassInstance) {
+        auto& instance = static_cast<ClassInstance&>(*lhs);  // NOLINT
+        return instance.Call(ADD_METHOD, {rhs}, context);
+    }
+    throw std::runtime_error("Error addition"s);
+}
+
+ObjectHolder Sub(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+    if (KindPair(lhs.GetKind(), rhs.GetKind()) == NUMBERS) {
+        return ObjectHolder::Own(Number(ValueOf<Number>(lhs) - ValueOf<Number>(rhs)));
+    }
+
+    throw std::runtime_error("Error subtration"s);
+}
+
+ObjectHolder Mult(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+    if (KindPair(lhs.GetKind(), rhs.GetKind()) == NUMBERS) {
+        return ObjectHolder::Own(Number(ValueOf<Number>(lhs) * ValueOf<Number>(rhs)));
+    }
+
+    throw std::runtime_error("Error multiplication"s);
+}
+
+ObjectHolder Div(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+    if (KindPair(lhs.GetKind(), rhs.GetKind()) == NUMBERS) {
+        if (ValueOf<Number>(rhs) == 0) {
+            throw std::runtime_error("Division by zero"s);
+        }
+        return ObjectHolder::Own(Number(ValueOf<Number>(lhs) / ValueOf<Number>(rhs)));
+    }
+
+    throw std::runtime_error("Error division"s);
+}
+
+ObjectHolder Stringify(const ObjectHolder& object, Context& context) {
+    switch (object.GetKind()) {
+        case ObjectKind::None:
+            return ObjectHolder::Share(StaticString(PredefinedSymbol::None));
+        case ObjectKind::String:
+            // Строки неизменяемы, поэтому результат разделяет объект аргумента. Строку, на
+            // которую аргумент ссылается не владея ею, например константу программы,
+            // приходится копировать: результат может пережить её владельца
+            if (object.IsOwning()) {
+                return object;
+            }
+            return ObjectHolder::Own(String(ValueOf<String>(object)));
+        case ObjectKind::Number: {
+            char digits[numeric_limits<int>::digits10 + 2];
+            const auto result = to_chars(begin(digits), end(digits), ValueOf<Number>(object));
+            return ObjectHolder::Own(String(string(digits, result.ptr)));
+        }
+        case ObjectKind::Bool:
+            return ObjectHolder::Share(StaticString(ValueOf<Bool>(object)
+                                                        ? PredefinedSymbol::True
+                                                        : PredefinedSymbol::False));
+        case ObjectKind::ClassInstance: {
+            auto& instance = static_cast<ClassInstance&>(*object);  // NOLINT
+            if (const Method* str_method = FindStrMethod(instance.GetClass())) {
+                return Stringify(instance.CallMethod(*str_method, {}, context), context);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    OutputBuffer out;
+    object->Print(out, context);
+    return ObjectHolder::Own(String(out.Take()));
+}
+
 }  // namespace runtime
@@ -1,21 +1,44 @@
 #pragma once
 
+#include "arena.h"
+#include "collector.h"
+#include "metrics.h"
+#include "output_buffer.h"
+#include "pool.h"
+#include "symbol.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
 namespace runtime {
 
-// Контекст исполнения инструкций Mython
-class Context {
-public:
-    // Возвращает поток вывода для команд print
-    virtual std::ostream& GetOutputStream() = 0;
+class Context;
+class Profiler;
 
-protected:
-    ~Context() = default;
+// Вид объекта Mython. Позволяет определить тип объекта без обращения к RTTI
+enum class ObjectKind : std::uint8_t {
+    None,
+    Number,
+    String,
+    Bool,
+    Class,
+    ClassInstance,
+    // Прочие наследники Object, тип которых определяется через dynamic_cast
+    Other,
 };
 
 // Базовый класс для всех объектов языка Mython
@@ -24,6 +47,214 @@ public:
     virtual ~Object() = default;
     // выводит в os своё представление в виде строки
     virtual void Print(std::ostream& os, Context& context) = 0;
+    // Дописывает своё строковое представление в буфер вывода. По умолчанию выводит
+    // представление через std::ostream и копирует результат в буфер
+    virtual void Print(OutputBuffer& out, Context& context);
+
+    [[nodiscard]] ObjectKind GetKind() const {
+        return kind_;
+    }
+
+    // Объекты, создаваемые в куче, размещаются в пулах блоков фиксированного размера
+    static void* operator new(std::size_t size) {
+        return ObjectPool::Allocate(size);
+    }
+
+    static void operator delete(void* ptr, std::size_t size) noexcept {
+        ObjectPool::Deallocate(ptr, size);
+    }
+
+protected:
+    Object() = default;
+    explicit Object(ObjectKind kind)
+        : kind_(kind) {
+    }
+
+    // Копия объекта не наследует владеющие ссылки на оригинал
+    Object(const Object& other)
+        : kind_(other.kind_) {
+    }
+
+    Object& operator=(const Object& /*other*/) {
+        return *this;
+    }
+
+private:
+    friend class ObjectRef;
+    friend class ObjectHolder;
+    friend class CycleCollector;
+
+    ObjectKind kind_ = ObjectKind::Other;
+    // Количество владеющих ссылок на объект. Счётчик не атомарный: объекты программы
+    // используются только потоком, который её исполняет
+    mutable std::uint32_t ref_count_ = 0;
+};
+
+// Владеющая ссылка на объект в куче. Объект удаляется, когда исчезает последняя ссылка
+class ObjectRef {
+public:
+    explicit ObjectRef(Object* object) noexcept
+        : object_(object) {
+        ++object_->ref_count_;
+        UpdateMetrics([](Metrics& metrics) {
+            ++metrics.ref_increments;
+        });
+    }
+
+    ObjectRef(const ObjectRef& other) noexcept
+        : ObjectRef(other.object_) {
+    }
+
+    ObjectRef(ObjectRef&& other) noexcept
+        : object_(std::exchange(other.object_, nullptr)) {
+    }
+
+    ObjectRef& operator=(ObjectRef other) noexcept {
+        std::swap(object_, other.object_);
+        return *this;
+    }
+
+    ~ObjectRef() {
+        if (object_ == nullptr) {
+            return;
+        }
+        UpdateMetrics([](Metrics& metrics) {
+            ++metrics.ref_decrements;
+        });
+        if (--object_->ref_count_ == 0) {
+            delete object_;
+        }
+    }
+
+    // Возвращает nullptr для ссылки, из которой объект был перемещён
+    [[nodiscard]] Object* Get() const noexcept {
+        return object_;
+    }
+
+    // Возвращает true, если других владеющих ссылок на объект нет
+    [[nodiscard]] bool IsUnique() const noexcept {
+        return object_->ref_count_ == 1;
+    }
+
+private:
+    Object* object_;
+};
+
+template <typename T>
+class ValueObject;
+class String;
+class Bool;
+class ObjectHolder;
+class Class;
+class ClassInstance;
+
+// Вид объектов типа T. Для типов, у которых нет собственного вида, равен ObjectKind::Other
+template <typename T>
+inline constexpr ObjectKind OBJECT_KIND = ObjectKind::Other;
+template <>
+inline constexpr ObjectKind OBJECT_KIND<ValueObject<int>> = ObjectKind::Number;
+template <>
+inline constexpr ObjectKind OBJECT_KIND<String> = ObjectKind::String;
+template <>
+inline constexpr ObjectKind OBJECT_KIND<Bool> = ObjectKind::Bool;
+template <>
+inline constexpr ObjectKind OBJECT_KIND<Class> = ObjectKind::Class;
+template <>
+inline constexpr ObjectKind OBJECT_KIND<ClassInstance> = ObjectKind::ClassInstance;
+
+// Объект-значение, хранящий значение типа T
+template <typename T>
+class ValueObject : public Object {
+public:
+    ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : Object(OBJECT_KIND<ValueObject<T>>), value_(v) {
+    }
+
+    void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
+        os << value_;
+    }
+
+    void Print(OutputBuffer& out, [[maybe_unused]] Context& context) override {
+        out.Append(value_);
+    }
+
+    [[nodiscard]] const T& GetValue() const {
+        return value_;
+    }
+
+protected:
+    ValueObject(T v, ObjectKind kind)
+        : Object(kind), value_(v) {
+    }
+
+private:
+    T value_;
+};
+
+/*
+ * Строковое значение. Конкатенация длинных строк не копирует их содержимое: результат хранит
+ * ссылки на части и собирается в непрерывную строку при первом обращении к значению, например
+ * при выводе или сравнении. Поэтому построение строки многократным s = s + piece занимает
+ * линейное время и память. Значение строки после создания не изменяется
+ */
+class String : public Object {
+public:
+    // Результат конкатенации короче этого размера сразу копируется в непрерывную строку
+    static constexpr std::size_t MIN_CONCATENATION_SIZE = 64;
+
+    String(std::string value);  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+    // Копия всегда хранится в непрерывном виде и не разделяет части с оригиналом
+    String(const String& other);
+    String(String&& other) noexcept;
+    String& operator=(const String&) = delete;
+    ~String() override;
+
+    // Возвращает строку lhs + rhs. lhs и rhs должны содержать строки
+    [[nodiscard]] static ObjectHolder Concat(const ObjectHolder& lhs, const ObjectHolder& rhs);
+
+    void Print(std::ostream& os, Context& context) override;
+    void Print(OutputBuffer& out, Context& context) override;
+
+    // Возвращает значение строки, при необходимости собирая его из частей
+    [[nodiscard]] const std::string& GetValue() const;
+
+    [[nodiscard]] std::size_t GetSize() const {
+        return size_;
+    }
+
+    // Возвращает true, если строка ещё не собрана из частей конкатенации
+    [[nodiscard]] bool IsConcatenation() const {
+        return parts_.has_value();
+    }
+
+private:
+    struct Parts {
+        ObjectRef lhs;
+        ObjectRef rhs;
+    };
+
+    String(Parts parts, std::size_t size);
+
+    // Освобождает части, не углубляясь рекурсивно в длинные цепочки конкатенаций
+    static void ReleaseParts(std::optional<Parts>& parts);
+
+    mutable std::string value_;
+    mutable std::optional<Parts> parts_;
+    std::size_t size_;
+};
+
+// Числовое значение
+using Number = ValueObject<int>;
+
+// Логическое значение
+class Bool : public ValueObject<bool> {
+public:
+    Bool(bool v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
+        : ValueObject<bool>(v, ObjectKind::Bool) {
+    }
+
+    void Print(std::ostream& os, Context& context) override;
+    void Print(OutputBuffer& out, Context& context) override;
 };
 
 // Специальный класс-обёртка, предназначенный для хранения объекта в Mython-программе
@@ -34,64 +265,349 @@ public:
 
     // Возвращает ObjectHolder, владеющий объектом типа T
     // Тип T - конкретный класс-наследник Object.
-    // object копируется или перемещается в кучу
+    // Значения Number и Bool хранятся непосредственно внутри ObjectHolder, остальные объекты
+    // копируются или перемещаются в кучу, а ObjectHolder и его копии владеют ими совместно
     template <typename T>
     [[nodiscard]] static ObjectHolder Own(T&& object) {
-        return ObjectHolder(std::make_shared<T>(std::forward<T>(object)));
+        using Type = std::decay_t<T>;
+        if constexpr (std::is_same_v<Type, Number> || std::is_same_v<Type, Bool>) {
+            return ObjectHolder(Data(std::in_place_type<Type>, std::forward<T>(object)));
+        } else {
+            CountAllocation<Type>();
+            return ObjectHolder(Data(ObjectRef(new Type(std::forward<T>(object)))));
+        }
     }
 
-    // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки)
+    // Создаёт в куче объект типа T из аргументов args и возвращает ObjectHolder, владеющий им.
+    // В отличие от Own, объект сразу создаётся на своём месте и не перемещается
+    template <typename T, typename... Args>
+    [[nodiscard]] static ObjectHolder Make(Args&&... args) {
+        CountAllocation<T>();
+        return ObjectHolder(Data(ObjectRef(new T(std::forward<Args>(args)...))));
+    }
+
+    // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки). Память не выделяется
     [[nodiscard]] static ObjectHolder Share(Object& object);
+    // Создаёт ещё одну владеющую ссылку на объект, которым уже владеют другие ObjectHolder,
+    // например на self вызываемого метода. Память не выделяется. На объект без владеющих
+    // ссылок, например размещённый на стеке, создаётся невладеющая ссылка, как в Share
+    [[nodiscard]] static ObjectHolder Retain(Object& object);
     // Создаёт пустой ObjectHolder, соответствующий значению None
     [[nodiscard]] static ObjectHolder None();
 
+    // Возвращает невладеющую копию: значения Number и Bool копируются, а на объект в куче
+    // создаётся невладеющая ссылка. В отличие от обычного копирования, не изменяет счётчик
+    // ссылок, поэтому применяется к объектам, общим для нескольких потоков, например к
+    // константам и классам программы
+    [[nodiscard]] ObjectHolder Borrow() const;
+
+    // Возвращает true, если ObjectHolder владеет объектом в куче
+    [[nodiscard]] bool IsOwning() const {
+        return std::holds_alternative<ObjectRef>(data_);
+    }
+
+    // Возвращает true, если ObjectHolder содержит невладеющую ссылку на объект (см. Share)
+    [[nodiscard]] bool IsShared() const {
+        return std::holds_alternative<Object*>(data_);
+    }
+
     // Возвращает ссылку на Object внутри ObjectHolder.
     // ObjectHolder должен быть непустым
     Object& operator*() const;
 
     Object* operator->() const;
 
+    // Для значений Number и Bool возвращается указатель на объект внутри самого ObjectHolder,
+    // который действителен, пока существует этот ObjectHolder
     [[nodiscard]] Object* Get() const;
 
     // Возвращает указатель на объект типа T либо nullptr, если внутри ObjectHolder не хранится
     // объект данного типа
     template <typename T>
     [[nodiscard]] T* TryAs() const {
-        return dynamic_cast<T*>(this->Get());
+        if constexpr (OBJECT_KIND<T> != ObjectKind::Other) {
+            return GetKind() == OBJECT_KIND<T> ? static_cast<T*>(this->Get()) : nullptr;
+        } else {
+            return dynamic_cast<T*>(this->Get());
+        }
+    }
+
+    // Возвращает число, хранящееся непосредственно внутри ObjectHolder, либо nullptr.
+    // В отличие от TryAs, не учитывает числа в куче и по невладеющим ссылкам
+    [[nodiscard]] const Number* GetInlineNumber() const {
+        return std::get_if<Number>(&data_);
+    }
+
+    // Сохраняет value внутри ObjectHolder вместо прежнего значения. Значение того же типа
+    // перезаписывается на месте, без уничтожения и временного ObjectHolder
+    void Assign(Number value) {
+        data_ = value;
+    }
+
+    void Assign(Bool value) {
+        data_ = value;
+    }
+
+    // Возвращает вид хранимого объекта либо ObjectKind::None для пустого ObjectHolder
+    [[nodiscard]] ObjectKind GetKind() const {
+        if (const auto* object = std::get_if<ObjectRef>(&data_)) {
+            return object->Get() ? object->Get()->GetKind() : ObjectKind::None;
+        }
+        if (const auto* object = std::get_if<Object*>(&data_)) {
+            return (*object)->GetKind();
+        }
+        if (std::holds_alternative<Number>(data_)) {
+            return ObjectKind::Number;
+        }
+        return std::holds_alternative<Bool>(data_) ? ObjectKind::Bool : ObjectKind::None;
     }
 
     // Возвращает true, если ObjectHolder не пуст
     explicit operator bool() const;
 
 private:
-    explicit ObjectHolder(std::shared_ptr<Object> data);
+    // Пустое значение (None), владеющая ссылка на объект в куче, невладеющий указатель либо
+    // значение, хранящееся без выделения памяти. Константность ObjectHolder не
+    // распространяется на хранимый объект, как и в случае указателя, поэтому поле объявлено
+    // mutable
+    using Data = std::variant<std::monostate, ObjectRef, Object*, Number, Bool>;
+
+    explicit ObjectHolder(Data data);
     void AssertIsValid() const;
 
-    std::shared_ptr<Object> data_;
+    // Учитывает в счётчиках потока объект типа T, созданный в куче
+    template <typename T>
+    static void CountAllocation() {
+        UpdateMetrics([](Metrics& metrics) {
+            ++metrics.allocations[static_cast<std::size_t>(OBJECT_KIND<T>)];
+        });
+    }
+
+    mutable Data data_;
 };
 
-// Объект-значение, хранящий значение типа T
-template <typename T>
-class ValueObject : public Object {
+/*
+ * Стек кадров методов. Кадр - непрерывный массив слотов, в которых хранятся self, параметры и
+ * локальные переменные метода; номера слотов назначаются при разборе программы.
+ * Пустой слот соответствует переменной, которой ещё не присваивалось значение.
+ * Стек состоит из блоков, которые не перемещаются в памяти, поэтому указатель на кадр остаётся
+ * действительным, пока кадр не удалён, даже если поверх него добавляются новые кадры
+ */
+class CallStack {
 public:
-    ValueObject(T v)  // NOLINT(google-explicit-constructor,hicpp-explicit-conversions)
-        : value_(v) {
+    using Slot = std::optional<ObjectHolder>;
+
+    // Добавляет кадр из size пустых слотов на время своего существования
+    class Frame {
+    public:
+        Frame(CallStack& stack, size_t size);
+        ~Frame();
+
+        Frame(const Frame&) = delete;
+        Frame& operator=(const Frame&) = delete;
+
+        [[nodiscard]] Slot* Slots() const {
+            return slots_;
+        }
+
+    private:
+        CallStack& stack_;
+        Slot* slots_;
+    };
+
+    // Возвращает слоты текущего кадра
+    [[nodiscard]] Slot* CurrentFrame() const {
+        return frames_.back().slots;
     }
 
-    void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
-        os << value_;
+    // Возвращает количество кадров в стеке
+    [[nodiscard]] size_t Depth() const {
+        return frames_.size();
     }
 
-    [[nodiscard]] const T& GetValue() const {
-        return value_;
+private:
+    static constexpr size_t BLOCK_SIZE = 4096;
+
+    struct Block {
+        std::unique_ptr<Slot[]> slots;
+        size_t capacity = 0;
+        size_t used = 0;
+    };
+
+    struct FrameRecord {
+        Slot* slots;
+        size_t size;
+        size_t block;
+    };
+
+    Slot* PushFrame(size_t size);
+    void PopFrame();
+
+    std::vector<Block> blocks_;
+    std::vector<FrameRecord> frames_;
+    size_t current_block_ = 0;
+};
+
+// Ресурс исполнения, расход которого ограничивают Limits
+enum class Limit : std::uint8_t {
+    Steps,
+    Time,
+    CallDepth,
+    HeapBytes,
+};
+
+// Ограничения ресурсов одного исполнения программы. Нулевое значение снимает ограничение
+struct Limits {
+    // Глубина вызовов по умолчанию, при которой рекурсия заведомо не переполняет стек потока
+    static constexpr std::size_t DEFAULT_MAX_CALL_DEPTH = 1000;
+
+    // Количество шагов: исполненных инструкций составных инструкций и вызовов методов
+    std::uint64_t max_steps = 0;
+    std::chrono::nanoseconds max_time{0};
+    // Количество вложенных вызовов методов
+    std::size_t max_call_depth = DEFAULT_MAX_CALL_DEPTH;
+    // Прирост ObjectPool::GetHeapBytes потока, исполняющего программу
+    std::size_t max_heap_bytes = 0;
+};
+
+// Контекст исполнения инструкций Mython
+class Context {
+public:
+    // Учитывает вызов метода в глубине вызовов на время своего существования
+    class CallScope {
+    public:
+        explicit CallScope(Context& context)
+            : context_(context) {
+            context.Step();
+            if (context.call_depth_ == context.max_call_depth_) {
+                context.Abort(Limit::CallDepth);
+            }
+            ++context.call_depth_;
+            UpdateMetrics([&context](Metrics& metrics) {
+                ++metrics.method_calls;
+                context.peak_call_depth_ = std::max(context.peak_call_depth_, context.call_depth_);
+            });
+        }
+
+        ~CallScope() {
+            --context_.call_depth_;
+        }
+
+        CallScope(const CallScope&) = delete;
+        CallScope& operator=(const CallScope&) = delete;
+
+    private:
+        Context& context_;
+    };
+
+    // Возвращает поток вывода для команд print
+    virtual std::ostream& GetOutputStream() = 0;
+
+    // Возвращает буфер, в который команды print выводят значения. По умолчанию буфер
+    // передаёт каждую запись в GetOutputStream() и ничего не накапливает
+    virtual OutputBuffer& GetOutputBuffer();
+
+    // Возвращает стек кадров методов, исполняемых в этом контексте
+    [[nodiscard]] CallStack& GetCallStack() {
+        return call_stack_;
+    }
+
+    // Сообщает, что выполнена инструкция return. Пока сигнал не снят телом метода, составные
+    // инструкции и ветвления прекращают выполнение и передают наверх результат return
+    void SetReturnSignal() {
+        return_signal_ = true;
     }
 
+    [[nodiscard]] bool HasReturnSignal() const {
+        return return_signal_;
+    }
+
+    // Снимает сигнал return и возвращает true, если он был установлен
+    bool TakeReturnSignal() {
+        return std::exchange(return_signal_, false);
+    }
+
+    // Подключает профилировщик вызовов методов. nullptr отключает профилирование
+    void SetProfiler(Profiler* profiler) {
+        profiler_ = profiler;
+    }
+
+    [[nodiscard]] Profiler* GetProfiler() const {
+        return profiler_;
+    }
+
+    // Задаёт ограничения ресурсов. Шаги, время и память отсчитываются от этого вызова.
+    // Контекст с ограничением памяти назначается текущим для потока, вызвавшего SetLimits,
+    // и исполняться должен в этом потоке
+    void SetLimits(const Limits& limits);
+
+    /*
+     * Учитывает в ObjectPool::GetHeapBytes bytes байт, которые объект собирается выделить не
+     * из пула, например для содержимого строки. Если так превышается ограничение памяти
+     * контекста, текущего для потока, память не учитывается, а выбрасывается LimitExceeded.
+     * Поэтому одна операция, выделяющая много памяти, останавливается до выделения, а не на
+     * следующей проверке ограничений
+     */
+    static void ChargeHeap(std::size_t bytes);
+
+    [[nodiscard]] const Limits& GetLimits() const {
+        return limits_;
+    }
+
+    // Возвращает количество шагов, выполненных после последнего вызова SetLimits
+    [[nodiscard]] std::uint64_t GetStepCount() const {
+        return steps_;
+    }
+
+    // Возвращает счётчики исполнения, накопленные текущим потоком с создания контекста либо с
+    // последнего вызова ResetMetrics, и наибольшую глубину вызовов в этом контексте. Без
+    // MYTHON_ENABLE_METRICS все счётчики равны нулю
+    [[nodiscard]] Metrics GetMetrics() const;
+    void ResetMetrics();
+
+    // Учитывает шаг исполнения. Если ограничение исчерпано, выбрасывает исключение
+    // LimitExceeded, и каждый следующий шаг тоже завершается этим исключением
+    void Step() {
+        if (++steps_ >= next_check_) {
+            CheckLimits();
+        }
+    }
+
+protected:
+    ~Context();
+
 private:
-    T value_;
+    using Clock = std::chrono::steady_clock;
+
+    // Время и память объектов из пулов проверяются раз в столько шагов
+    static constexpr std::uint64_t CHECK_INTERVAL = 1024;
+
+    // Запоминает исчерпание ограничения limit и выбрасывает LimitExceeded
+    [[noreturn]] void Abort(Limit limit);
+    void CheckLimits();
+    // Назначает шаг следующей проверки ограничений
+    void ScheduleCheck();
+
+    CallStack call_stack_;
+    bool return_signal_ = false;
+    std::unique_ptr<OutputBuffer> output_buffer_;
+    Profiler* profiler_ = nullptr;
+    Limits limits_;
+    std::uint64_t steps_ = 0;
+    std::uint64_t next_check_ = UINT64_MAX;
+    std::size_t call_depth_ = 0;
+    // Глубина вызовов, при которой вызов метода завершается исключением
+    std::size_t max_call_depth_ = Limits::DEFAULT_MAX_CALL_DEPTH;
+    Clock::time_point deadline_;
+    std::int64_t heap_base_ = 0;
+    std::optional<Limit> exceeded_;
+    // Значения счётчиков потока, от которых отсчитывает GetMetrics
+    Metrics metrics_base_ = Metrics::Snapshot();
+    std::size_t peak_call_depth_ = 0;
 };
 
 // Таблица символов, связывающая имя объекта с его значением
-using Closure = std::unordered_map<std::string, ObjectHolder>;
+using Closure = std::unordered_map<Symbol, ObjectHolder>;
 
 // Проверяет, содержится ли в object значение, приводимое к True
 // Для отличных от нуля чисел, True и непустых строк возвращается true. В остальных случаях - false.
@@ -100,67 +616,289 @@ bool IsTrue(const ObjectHolder& object);
 // Интерфейс для выполнения действий над объектами Mython
 class Executable {
 public:
+    // Смещение узла, положение которого в исходном тексте неизвестно
+    static constexpr std::uint32_t NO_SOURCE_OFFSET = UINT32_MAX;
+
     virtual ~Executable() = default;
+
+    // Узлы, созданные при назначенной текущей арене, размещаются в ней (см. Arena::Scope)
+    static void* operator new(std::size_t size) {
+        return Arena::AllocateObject(size);
+    }
+
+    static void operator delete(void* ptr) noexcept {
+        Arena::DeallocateObject(ptr);
+    }
+
     // Выполняет действие над объектами внутри closure, используя context
     // Возвращает результирующее значение либо None
     virtual ObjectHolder Execute(Closure& closure, Context& context) = 0;
+
+    // Возвращает смещение начала узла от начала исходного текста программы
+    [[nodiscard]] std::uint32_t GetSourceOffset() const {
+        return source_offset_;
+    }
+
+    void SetSourceOffset(std::uint32_t offset) {
+        source_offset_ = offset;
+    }
+
+private:
+    std::uint32_t source_offset_ = NO_SOURCE_OFFSET;
 };
 
-// Строковое значение
-using String = ValueObject<std::string>;
-// Числовое значение
-using Number = ValueObject<int>;
+// Ошибка исполнения программы, привязанная к инструкции, при исполнении которой она возникла
+class ExecutionError : public std::runtime_error {
+public:
+    ExecutionError(const std::string& message, std::uint32_t source_offset)
+        : std::runtime_error(message), source_offset_(source_offset) {
+    }
 
-// Логическое значение
-class Bool : public ValueObject<bool> {
+    // Возвращает смещение инструкции в исходном тексте либо Executable::NO_SOURCE_OFFSET
+    [[nodiscard]] std::uint32_t GetSourceOffset() const {
+        return source_offset_;
+    }
+
+private:
+    std::uint32_t source_offset_;
+};
+
+// Ошибка исполнения, вызванная исчерпанием ограничения ресурсов (см. Context::SetLimits)
+class LimitExceeded : public ExecutionError {
 public:
-    using ValueObject<bool>::ValueObject;
+    explicit LimitExceeded(const std::string& message, Limit limit,
+                           std::uint32_t source_offset = Executable::NO_SOURCE_OFFSET)
+        : ExecutionError(message, source_offset), limit_(limit) {
+    }
 
-    void Print(std::ostream& os, Context& context) override;
+    [[nodiscard]] Limit GetLimit() const {
+        return limit_;
+    }
+
+private:
+    Limit limit_;
 };
 
 // Метод класса
 struct Method {
     // Имя метода
-    std::string name;
+    Symbol name;
     // Имена формальных параметров метода
-    std::vector<std::string> formal_params;
+    std::vector<Symbol> formal_params;
     // Тело метода
     std::unique_ptr<Executable> body;
+    // Количество слотов в кадре метода. Если имена переменных метода разрешены в номера слотов,
+    // self передаётся в слоте 0, а параметры - в слотах 1..N. При значении 0 метод получает
+    // self и параметры через Closure
+    size_t frame_size = 0;
+};
+
+/*
+ * Форма объекта: упорядоченный набор имён полей. Экземпляры, поля которых добавлялись в одном
+ * и том же порядке, разделяют одну форму, а значения полей хранят в плотном массиве по номерам
+ * полей в форме. Формы образуют дерево переходов с корнем в пустой форме класса: добавление
+ * поля переводит объект в дочернюю форму, которая создаётся при первом таком добавлении и
+ * затем переиспользуется. Форма живёт, пока живёт корень дерева.
+ * Форма не изменяется после создания, кроме таблицы переходов под мьютексом, поэтому формы
+ * классов можно разделять между потоками. Первый переход формы читается без блокировки
+ */
+class Shape {
+public:
+    // Номер, возвращаемый FindField для отсутствующего поля
+    static constexpr std::uint32_t NO_FIELD = UINT32_MAX;
+
+    // Создаёт пустую форму - корень дерева переходов
+    Shape();
+    Shape(const Shape&) = delete;
+    Shape& operator=(const Shape&) = delete;
+
+    // Возвращает номер поля name либо NO_FIELD
+    [[nodiscard]] std::uint32_t FindField(Symbol name) const;
+
+    // Возвращает форму с полем name, добавленным после полей этой формы.
+    // Поле name не должно входить в форму
+    [[nodiscard]] const Shape& AddField(Symbol name) const;
+
+    // Возвращает форму, из которой эта получена добавлением последнего поля, либо nullptr
+    [[nodiscard]] const Shape* GetParent() const {
+        return parent_;
+    }
+
+    // Возвращает имена полей в порядке их номеров
+    [[nodiscard]] const std::vector<Symbol>& GetFieldNames() const {
+        return names_;
+    }
+
+    // Возвращает номер формы, уникальный среди всех созданных форм и не равный нулю
+    [[nodiscard]] std::uint32_t GetId() const {
+        return id_;
+    }
+
+    // Возвращает наибольшее количество полей, которое было у объектов с этим корнем формы.
+    // Используется, чтобы сразу выделять новым объектам память под все поля
+    [[nodiscard]] std::size_t GetCapacityHint() const {
+        return capacity_hint_.load(std::memory_order_relaxed);
+    }
+
+    // Увеличивает подсказку о количестве полей до field_count. Вызывается у корня
+    void UpdateCapacityHint(std::size_t field_count) const;
+
+private:
+    // До этого количества полей имя ищется просмотром names_, а для больших форм - по indices_
+    static constexpr std::size_t LINEAR_SEARCH_SIZE = 8;
+
+    Shape(const Shape& parent, Symbol name);
+
+    const Shape* parent_ = nullptr;
+    std::uint32_t id_;
+    std::vector<Symbol> names_;
+    std::unordered_map<Symbol, std::uint32_t> indices_;
+    mutable std::atomic<std::size_t> capacity_hint_ = 0;
+    mutable std::mutex transitions_mutex_;
+    mutable std::vector<std::unique_ptr<Shape>> transitions_;
+    // Первый из transitions_. Читается без блокировки
+    mutable std::atomic<const Shape*> first_transition_ = nullptr;
+};
+
+// Поля экземпляра класса: текущая форма и значения полей в порядке их номеров в форме
+class FieldTable {
+public:
+    explicit FieldTable(const Shape& root);
+
+    // Возвращает указатель на значение поля name либо nullptr, если поля нет
+    [[nodiscard]] ObjectHolder* Find(Symbol name);
+    [[nodiscard]] const ObjectHolder* Find(Symbol name) const;
+
+    // Возвращает значение поля name. Отсутствующее поле добавляется со значением None
+    ObjectHolder& operator[](Symbol name);
+
+    // Возвращает значение поля с номером index в текущей форме
+    [[nodiscard]] ObjectHolder& At(std::uint32_t index) {
+        return values_[index];
+    }
+
+    [[nodiscard]] const ObjectHolder& At(std::uint32_t index) const {
+        return values_[index];
+    }
+
+    // Добавляет поле со значением value, переводя объект в форму shape. Форма shape должна быть
+    // получена из текущей вызовом AddField
+    ObjectHolder& Append(const Shape& shape, ObjectHolder value);
+
+    [[nodiscard]] const Shape& GetShape() const {
+        return *shape_;
+    }
+
+    [[nodiscard]] std::size_t GetSize() const {
+        return values_.size();
+    }
+
+    // Удаляет все поля, возвращая объект в пустую форму
+    void Clear();
+
+    // Удаляет значения полей, не обращаясь к форме. Используется сборщиком для объектов,
+    // класс которых может быть уже удалён. После вызова таблицу можно только уничтожить
+    void ReleaseValues();
+
+private:
+    const Shape* shape_;
+    // Массивы полей небольших объектов выделяются из пулов, как и сами объекты
+    std::vector<ObjectHolder, PoolAllocator<ObjectHolder>> values_;
 };
 
 // Класс
 class Class : public Object {
 public:
     // Создаёт класс с именем name и набором методов methods, унаследованный от класса parent
-    // Если parent равен nullptr, то создаётся базовый класс
-    explicit Class(std::string name, std::vector<Method> methods, const Class* parent);
+    // Если parent равен nullptr, то создаётся базовый класс.
+    // Если тела методов размещены в арене, arena продлевает её жизнь до удаления класса
+    explicit Class(std::string name, std::vector<Method> methods, const Class* parent,
+                   std::shared_ptr<Arena> arena = nullptr);
+
+    // Номер, возвращаемый FindMethod для отсутствующего метода
+    static constexpr std::uint32_t NO_METHOD = UINT32_MAX;
 
     // Возвращает указатель на метод name или nullptr, если метод с таким именем отсутствует
-    [[nodiscard]] const Method* GetMethod(const std::string& name) const;
+    [[nodiscard]] const Method* GetMethod(Symbol name) const;
+
+    // Возвращает номер метода name в таблице методов класса либо NO_METHOD
+    [[nodiscard]] std::uint32_t FindMethod(Symbol name) const;
+
+    // Возвращает метод __init__ класса либо его родителя или nullptr, если метода нет
+    [[nodiscard]] const Method* GetInitMethod() const {
+        return init_method_;
+    }
+
+    // Возвращает метод с номером index, полученным из FindMethod, либо nullptr для NO_METHOD
+    [[nodiscard]] const Method* GetMethodAt(std::uint32_t index) const {
+        return index == NO_METHOD ? nullptr : method_table_[index];
+    }
+
+    // Возвращает номер класса, уникальный среди всех созданных классов и не равный нулю
+    [[nodiscard]] std::uint32_t GetId() const {
+        return id_;
+    }
 
     // Возвращает имя класса
     [[nodiscard]] const std::string& GetName() const;
 
+    // Возвращает методы, объявленные в самом классе (без унаследованных)
+    [[nodiscard]] const std::vector<Method>& GetMethods() const;
+    // Позволяет заменить тела методов, например при оптимизации. Состав методов менять нельзя
+    [[nodiscard]] std::vector<Method>& GetMethods();
+
+    // Возвращает родительский класс либо nullptr для базового класса
+    [[nodiscard]] const Class* GetParent() const;
+    // Заменяет родительский класс и перестраивает таблицу методов. Нужен при связывании
+    // модулей, разобранных независимо, пока класс не исполнялся. Наследников класса после
+    // этого следует перестроить вызовом SetParent с прежним родителем
+    void SetParent(const Class* parent);
+
+    // Возвращает пустую форму, с которой начинаются экземпляры класса
+    [[nodiscard]] const Shape& GetRootShape() const {
+        return *root_shape_;
+    }
+
     // Выводит в os строку "Class <имя класса>", например "Class cat"
     void Print(std::ostream& os, Context& context) override;
+    void Print(OutputBuffer& out, Context& context) override;
 
 private:
+    // Строит таблицу методов из таблицы родителя и собственных методов
+    void BuildMethodTable();
+
+    // Объявлена первой, чтобы удаляться после методов
+    std::shared_ptr<Arena> arena_;
     std::string name_;
     std::vector<Method> methods_;
     const Class* parent_;
+    std::uint32_t id_;
+    // Все методы класса, включая унаследованные. Строится один раз при создании класса,
+    // поэтому поиск метода не обходит цепочку родителей. Элементы methods_ не перемещаются
+    // в памяти и при перемещении самого класса. Унаследованные методы имеют те же номера,
+    // что и в родительском классе
+    std::vector<const Method*> method_table_;
+    std::unordered_map<Symbol, std::uint32_t> method_indices_;
+    const Method* init_method_ = nullptr;
+    std::unique_ptr<Shape> root_shape_;
 };
 
-// Экземпляр класса
-class ClassInstance : public Object {
+// Экземпляр класса. Экземпляры, созданные в куче, удаляются по счётчику ссылок, а циклы из
+// них - сборщиком CycleCollector потока, который их создал
+class ClassInstance : public Object, private CycleCollector::Node {
 public:
     explicit ClassInstance(const Class& cls);
+    ClassInstance(const ClassInstance& other);
+    ClassInstance(ClassInstance&& other);
+    ClassInstance& operator=(const ClassInstance&) = delete;
+    ~ClassInstance() override;
 
     /*
      * Если у объекта есть метод __str__, выводит в os результат, возвращённый этим методом.
      * В противном случае в os выводится адрес объекта.
      */
     void Print(std::ostream& os, Context& context) override;
+    void Print(OutputBuffer& out, Context& context) override;
 
     /*
      * Вызывает у объекта метод method, передавая ему actual_args параметров.
@@ -168,20 +906,81 @@ public:
      * Если ни сам класс, ни его родители не содержат метод method, метод выбрасывает исключение
      * runtime_error
      */
-    ObjectHolder Call(const std::string& method, const std::vector<ObjectHolder>& actual_args,
+    ObjectHolder Call(Symbol method, const std::vector<ObjectHolder>& actual_args,
                       Context& context);
 
+    // Вызывает у объекта уже найденный метод method класса объекта либо его родителя.
+    // Количество actual_args должно совпадать с количеством параметров метода
+    ObjectHolder CallMethod(const Method& method, const std::vector<ObjectHolder>& actual_args,
+                            Context& context);
+
     // Возвращает true, если объект имеет метод method, принимающий argument_count параметров
-    [[nodiscard]] bool HasMethod(const std::string& method, size_t argument_count) const;
+    [[nodiscard]] bool HasMethod(Symbol method, size_t argument_count) const;
+
+    // Возвращает поля объекта
+    [[nodiscard]] FieldTable& Fields();
+    [[nodiscard]] const FieldTable& Fields() const;
 
-    // Возвращает ссылку на Closure, содержащий поля объекта
-    [[nodiscard]] Closure& Fields();
-    // Возвращает константную ссылку на Closure, содержащую поля объекта
-    [[nodiscard]] const Closure& Fields() const;
+    // Возвращает класс, экземпляром которого является объект
+    [[nodiscard]] const Class& GetClass() const;
 
 private:
+    friend class CycleCollector;
+
     const Class& cls_;
-    Closure closure_;
+    FieldTable fields_;
+};
+
+/*
+ * Кэш поиска метода для одного места вызова. Запоминает найденные методы для нескольких
+ * последних классов получателя, поэтому повторный вызов в том же месте не обращается к
+ * таблице методов класса. Классы не изменяются после создания, так что кэш не устаревает.
+ * Запись кэша - одно атомарное слово из номера класса и номера метода, поэтому одно дерево
+ * программы можно исполнять одновременно из нескольких потоков
+ */
+class MethodCache {
+public:
+    // Возвращает метод name класса cls либо nullptr, если такого метода нет
+    const Method* Lookup(const Class& cls, Symbol name);
+
+private:
+    static constexpr size_t SIZE = 4;
+
+    // Старшие 32 бита - номер класса (0 для пустой записи), младшие - номер метода в классе
+    std::array<std::atomic<std::uint64_t>, SIZE> entries_{};
+    // Запись, которая будет вытеснена следующей
+    std::atomic<std::uint32_t> next_ = 0;
+};
+
+/*
+ * Кэш обращения к полю в одном месте программы: имя поля в этом месте всегда одно и то же.
+ * Запоминает номера поля для нескольких последних форм объектов, поэтому чтение и запись
+ * существующего поля сводятся к обращению к массиву по номеру.
+ * Записи кэша - атомарные слова из номеров формы и поля, поэтому одно дерево программы можно
+ * исполнять одновременно из нескольких потоков, а удаление форм не делает кэш
+ * недействительным. Копия кэша пуста, что позволяет перемещать узлы, которые его содержат
+ */
+class FieldCache {
+public:
+    FieldCache() = default;
+    FieldCache(const FieldCache& /*other*/) noexcept {
+    }
+    FieldCache& operator=(const FieldCache&) = delete;
+
+    // Возвращает значение поля name объекта fields либо nullptr, если такого поля нет
+    [[nodiscard]] const ObjectHolder* Find(const FieldTable& fields, Symbol name);
+
+    // Присваивает полю name объекта fields значение value, при необходимости добавляя поле
+    ObjectHolder& Store(FieldTable& fields, Symbol name, ObjectHolder value);
+
+private:
+    static constexpr size_t SIZE = 4;
+
+    std::uint32_t FindIndex(const Shape& shape, Symbol name);
+
+    // Старшие 32 бита - номер формы (0 для пустой записи), младшие - номер поля либо NO_FIELD
+    std::array<std::atomic<std::uint64_t>, SIZE> entries_{};
+    std::atomic<std::uint32_t> next_ = 0;
 };
 
 /*
@@ -212,6 +1011,92 @@ bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& cont
 // Возвращает значение, противоположное Less(lhs, rhs, context)
 bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 
+// Оператор сравнения. Номера значений записываются в кэш скомпилированных программ
+enum class CompareOp : std::uint8_t {
+    Equal,
+    NotEqual,
+    Less,
+    Greater,
+    LessOrEqual,
+    GreaterOrEqual,
+};
+
+template <CompareOp Op, typename T>
+constexpr bool CompareValues(const T& lhs, const T& rhs) {
+    if constexpr (Op == CompareOp::Equal) {
+        return lhs == rhs;
+    } else if constexpr (Op == CompareOp::NotEqual) {
+        return lhs != rhs;
+    } else if constexpr (Op == CompareOp::Less) {
+        return lhs < rhs;
+    } else if constexpr (Op == CompareOp::Greater) {
+        return lhs > rhs;
+    } else if constexpr (Op == CompareOp::LessOrEqual) {
+        return lhs <= rhs;
+    } else {
+        return lhs >= rhs;
+    }
+}
+
+/*
+ * Возвращает результат сравнения lhs и rhs оператором Op, совпадающий с результатом функций
+ * Equal, NotEqual, Less, Greater, LessOrEqual и GreaterOrEqual. Числа, строки и значения Bool
+ * сравниваются без вызова этих функций одной операцией, а прочие значения, в том числе объекты
+ * с методами __eq__ и __lt__, передаются им
+ */
+template <CompareOp Op>
+bool Compare(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+    const ObjectKind kind = lhs.GetKind();
+    if (kind == rhs.GetKind()) {
+        switch (kind) {
+            case ObjectKind::Number:
+                return CompareValues<Op>(static_cast<const Number&>(*lhs.Get()).GetValue(),
+                                         static_cast<const Number&>(*rhs.Get()).GetValue());
+            case ObjectKind::String:
+                return CompareValues<Op>(static_cast<const String&>(*lhs.Get()).GetValue(),
+                                         static_cast<const String&>(*rhs.Get()).GetValue());
+            case ObjectKind::Bool:
+                return CompareValues<Op>(static_cast<const Bool&>(*lhs.Get()).GetValue(),
+                                         static_cast<const Bool&>(*rhs.Get()).GetValue());
+            default:
+                break;
+        }
+    }
+    if constexpr (Op == CompareOp::Equal) {
+        return Equal(lhs, rhs, context);
+    } else if constexpr (Op == CompareOp::NotEqual) {
+        return NotEqual(lhs, rhs, context);
+    } else if constexpr (Op == CompareOp::Less) {
+        return Less(lhs, rhs, context);
+    } else if constexpr (Op == CompareOp::Greater) {
+        return Greater(lhs, rhs, context);
+    } else if constexpr (Op == CompareOp::LessOrEqual) {
+        return LessOrEqual(lhs, rhs, context);
+    } else {
+        return GreaterOrEqual(lhs, rhs, context);
+    }
+}
+
+/*
+ * Возвращает результат операции lhs + rhs. Поддерживается сложение чисел и конкатенация строк.
+ * Если lhs - объект с методом __add__, возвращает результат вызова lhs.__add__(rhs).
+ * В остальных случаях функция выбрасывает исключение runtime_error.
+ *
+ * Арифметические функции общие для всех способов исполнения программы (обход дерева и байткод)
+ */
+ObjectHolder Add(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+// Возвращает разность чисел lhs и rhs. Для остальных типов выбрасывает исключение runtime_error
+ObjectHolder Sub(const ObjectHolder& lhs, const ObjectHolder& rhs);
+// Возвращает произведение чисел lhs и rhs. Для остальных типов выбрасывает исключение runtime_error
+ObjectHolder Mult(const ObjectHolder& lhs, const ObjectHolder& rhs);
+// Возвращает частное чисел lhs и rhs. Для остальных типов, а также при rhs, равном 0,
+// выбрасывает исключение runtime_error
+ObjectHolder Div(const ObjectHolder& lhs, const ObjectHolder& rhs);
+
+// Возвращает строковое представление object (результат операции str).
+// Для None возвращается строка "None"
+ObjectHolder Stringify(const ObjectHolder& object, Context& context);
+
 // Контекст-заглушка, применяется в тестах.
 // В этом контексте весь вывод перенаправляется в строковый поток вывода output
 struct DummyContext : Context {
@@ -237,4 +1122,34 @@ private:
     std::ostream& output_;
 };
 
+/*
+ * Контекст с буферизованным выводом. Команды print дописывают значения в буфер, который
+ * сбрасывается в поток output крупными блоками и при удалении контекста. Контекст без потока
+ * накапливает весь вывод программы, который можно забрать методом TakeOutput
+ */
+class BufferedContext : public Context {
+public:
+    BufferedContext();
+    explicit BufferedContext(std::ostream& output,
+                             std::size_t flush_threshold = OutputBuffer::DEFAULT_FLUSH_THRESHOLD);
+
+    // Поток, связанный с буфером: запись в него не нарушает порядок вывода команд print
+    std::ostream& GetOutputStream() override {
+        return stream_;
+    }
+
+    OutputBuffer& GetOutputBuffer() override {
+        return buffer_;
+    }
+
+    // Забирает накопленный вывод без копирования
+    [[nodiscard]] std::string TakeOutput() {
+        return buffer_.Take();
+    }
+
+private:
+    OutputBuffer buffer_;
+    std::ostream stream_;
+};
+
 }  // namespace runtime
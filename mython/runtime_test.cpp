@@ -2,6 +2,9 @@
 #include "test_runner_p.h"
 
 #include <functional>
+#include <limits>
+#include <thread>
+#include <vector>
 
 using namespace std;
 
@@ -19,7 +22,7 @@ public:
     }
 
     Logger(const Logger& rhs)
-        : id_(rhs.id_)  //
+        : Object(rhs), id_(rhs.id_)  //
     {
         ++instance_count;
     }
@@ -180,6 +183,60 @@ void TestMethodInvocation() {
     ASSERT_THROWS(child_inst.Call("test"s, {ObjectHolder::None()}, context), runtime_error);
 }
 
+void TestSymbols() {
+    const Symbol a = "some_symbol_name"s;
+    const Symbol b = "some_symbol_name"sv;
+    const Symbol c = "other_symbol_name";
+    ASSERT(a == b);
+    ASSERT(a != c);
+    ASSERT_EQUAL(a.GetId(), b.GetId());
+    ASSERT(&a.GetName() == &b.GetName());
+    ASSERT_EQUAL(a.GetName(), "some_symbol_name"s);
+    ASSERT(c < a);
+    ASSERT_EQUAL(std::hash<Symbol>{}(a), std::hash<Symbol>{}(b));
+
+    // Предопределённые символы имеют фиксированные номера
+    ASSERT(Symbol("self"s) == Symbol(PredefinedSymbol::Self));
+    ASSERT_EQUAL(Symbol("class"s).GetId(), static_cast<uint32_t>(PredefinedSymbol::Class));
+    ASSERT(Symbol() == Symbol(""s));
+    ASSERT(a.GetId() >= static_cast<uint32_t>(PredefinedSymbol::Count));
+
+    ostringstream out;
+    out << a;
+    ASSERT_EQUAL(out.str(), "some_symbol_name"s);
+}
+
+void TestConcurrentSymbols() {
+    // Потоки одновременно добавляют в таблицу новые символы и обращаются к предопределённым
+    constexpr int THREAD_COUNT = 4;
+    constexpr int SYMBOL_COUNT = 20000;
+    vector<vector<Symbol>> symbols(THREAD_COUNT);
+    vector<char> predefined_ok(THREAD_COUNT);
+    vector<thread> threads;
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+        threads.emplace_back([&, t] {
+            bool ok = true;
+            for (int i = 0; i < SYMBOL_COUNT; ++i) {
+                symbols[t].push_back("concurrent_"s + to_string(t) + "_"s + to_string(i));
+                ok = ok && Symbol(PredefinedSymbol::Self).GetName() == "self"s
+                     && Symbol(PredefinedSymbol::Init).GetName() == "__init__"s;
+            }
+            predefined_ok[t] = ok ? 1 : 0;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (int t = 0; t < THREAD_COUNT; ++t) {
+        ASSERT(predefined_ok[t]);
+        for (int i = 0; i < SYMBOL_COUNT; ++i) {
+            const string name = "concurrent_"s + to_string(t) + "_"s + to_string(i);
+            ASSERT(symbols[t][i] == Symbol(name));
+            ASSERT_EQUAL(symbols[t][i].GetName(), name);
+        }
+    }
+}
+
 void TestNonowning() {
     ASSERT_EQUAL(Logger::instance_count, 0);
     Logger logger(784);
@@ -242,12 +299,124 @@ void TestMove() {
     }
 }
 
+void TestSharedOwnership() {
+    ASSERT_EQUAL(Logger::instance_count, 0);
+    {
+        auto one = ObjectHolder::Own(Logger(5));
+        ObjectHolder two = one;
+        ASSERT(two.Get() == one.Get());
+        {
+            ObjectHolder three;
+            three = two;
+            one = ObjectHolder::None();
+            ASSERT_EQUAL(Logger::instance_count, 1);
+        }
+        ASSERT_EQUAL(Logger::instance_count, 1);
+
+        // Копия объекта не наследует ссылки на оригинал и удаляется отдельно
+        auto copy = ObjectHolder::Own(*two.TryAs<Logger>());
+        ASSERT_EQUAL(Logger::instance_count, 2);
+        two = copy;
+        ASSERT_EQUAL(Logger::instance_count, 1);
+        ASSERT(two.Get() == copy.Get());
+    }
+    ASSERT_EQUAL(Logger::instance_count, 0);
+}
+
+void TestObjectPool() {
+    void* first = ObjectPool::Allocate(40);
+    ASSERT_EQUAL(reinterpret_cast<uintptr_t>(first) % ObjectPool::GRANULARITY, 0U);
+    ObjectPool::Deallocate(first, 40);
+    // Освобождённый блок повторно используется для объекта того же класса размеров
+    void* second = ObjectPool::Allocate(48);
+    ASSERT(second == first);
+
+    const size_t chunks = ObjectPool::GetChunkCount();
+    vector<void*> blocks;
+    for (size_t i = 0; i < ObjectPool::CHUNK_SIZE / 256 + 1; ++i) {
+        blocks.push_back(ObjectPool::Allocate(256));
+    }
+    ASSERT(ObjectPool::GetChunkCount() > chunks);
+    for (void* block : blocks) {
+        ObjectPool::Deallocate(block, 256);
+    }
+    ObjectPool::Deallocate(second, 48);
+
+    void* large = ObjectPool::Allocate(ObjectPool::MAX_SIZE + 1);
+    ObjectPool::Deallocate(large, ObjectPool::MAX_SIZE + 1);
+}
+
 void TestNullptr() {
     ObjectHolder oh;
     ASSERT(!oh);
     ASSERT(!oh.Get());
 }
 
+void TestImmediateValues() {
+    auto is_inside = [](const ObjectHolder& holder) {
+        const auto* begin = reinterpret_cast<const char*>(&holder);  // NOLINT
+        const auto* object = reinterpret_cast<const char*>(holder.Get());  // NOLINT
+        return object >= begin && object < begin + sizeof(holder);
+    };
+
+    // Числа и логические значения хранятся внутри ObjectHolder без выделения памяти
+    auto number = ObjectHolder::Own(Number{42});
+    ASSERT(is_inside(number));
+    ASSERT_EQUAL(number.TryAs<Number>()->GetValue(), 42);
+    ASSERT(number.TryAs<Bool>() == nullptr);
+    ASSERT(number.TryAs<String>() == nullptr);
+
+    auto copy = number;
+    ASSERT(is_inside(copy));
+    ASSERT_EQUAL(copy.TryAs<Number>()->GetValue(), 42);
+
+    const Bool value{true};
+    auto flag = ObjectHolder::Own(value);
+    ASSERT(is_inside(flag));
+    ASSERT(flag.TryAs<Bool>()->GetValue());
+    ASSERT(flag.TryAs<Number>() == nullptr);
+
+    DummyContext context;
+    number->Print(context.output, context);
+    context.output << ' ';
+    flag->Print(context.output, context);
+    ASSERT_EQUAL(context.output.str(), "42 True"sv);
+
+    // Строки и остальные объекты по-прежнему размещаются в куче
+    auto str = ObjectHolder::Own(String{"hello"s});
+    ASSERT(!is_inside(str));
+    ASSERT_EQUAL(str.TryAs<String>()->GetValue(), "hello"s);
+
+    // Невладеющая ссылка на число указывает на исходный объект
+    Number external{7};
+    auto shared = ObjectHolder::Share(external);
+    ASSERT(shared.Get() == &external);
+}
+
+void TestObjectKind() {
+    ASSERT(ObjectHolder().GetKind() == ObjectKind::None);
+    ASSERT(ObjectHolder::Own(Number{1}).GetKind() == ObjectKind::Number);
+    ASSERT(ObjectHolder::Own(String{"1"s}).GetKind() == ObjectKind::String);
+    ASSERT(ObjectHolder::Own(Bool{true}).GetKind() == ObjectKind::Bool);
+
+    Class cls{"Test"s, {}, nullptr};
+    ASSERT(ObjectHolder::Share(cls).GetKind() == ObjectKind::Class);
+    ASSERT(ObjectHolder::Share(cls).TryAs<Class>() == &cls);
+    ASSERT(ObjectHolder::Share(cls).TryAs<ClassInstance>() == nullptr);
+
+    auto instance = ObjectHolder::Own(ClassInstance{cls});
+    ASSERT(instance.GetKind() == ObjectKind::ClassInstance);
+    ASSERT(instance.TryAs<ClassInstance>() == instance.Get());
+    ASSERT(instance.TryAs<Class>() == nullptr);
+
+    // Для объектов без собственного вида TryAs продолжает работать через dynamic_cast
+    Logger logger;
+    auto other = ObjectHolder::Share(logger);
+    ASSERT(other.GetKind() == ObjectKind::Other);
+    ASSERT(other.TryAs<Logger>() == &logger);
+    ASSERT(other.TryAs<Number>() == nullptr);
+}
+
 void TestIsTrue() {
     {
         ASSERT(!IsTrue(ObjectHolder::Own(Bool{false})));
@@ -504,6 +673,40 @@ void TestClass() {
     ASSERT_EQUAL(out.str(), "Class Test"s);
 }
 
+void TestMethodTable() {
+    auto make_method = [](string name, int result) {
+        auto body = [result](Closure& /*closure*/, Context& /*ctx*/) {
+            return ObjectHolder::Own(Number{result});
+        };
+        return Method{std::move(name), {}, make_unique<TestMethodBody>(body)};
+    };
+
+    vector<Method> base_methods;
+    base_methods.push_back(make_method("f"s, 1));
+    base_methods.push_back(make_method("g"s, 2));
+    auto base = ObjectHolder::Own(Class{"Base"s, move(base_methods), nullptr});
+
+    vector<Method> middle_methods;
+    middle_methods.push_back(make_method("g"s, 3));
+    middle_methods.push_back(make_method("g"s, 4));
+    const Class middle{"Middle"s, move(middle_methods), base.TryAs<Class>()};
+
+    // Таблица методов сохраняется при перемещении класса
+    vector<Method> derived_methods;
+    derived_methods.push_back(make_method("h"s, 5));
+    Class moved{"Derived"s, move(derived_methods), &middle};
+    const Class derived = std::move(moved);
+
+    DummyContext ctx;
+    ClassInstance instance{derived};
+    ASSERT_EQUAL(instance.Call("f"s, {}, ctx).TryAs<Number>()->GetValue(), 1);
+    ASSERT_EQUAL(instance.Call("g"s, {}, ctx).TryAs<Number>()->GetValue(), 3);
+    ASSERT_EQUAL(instance.Call("h"s, {}, ctx).TryAs<Number>()->GetValue(), 5);
+    ASSERT_EQUAL(derived.GetMethod("f"s), base.TryAs<Class>()->GetMethod("f"s));
+    ASSERT(derived.GetMethod("missing"s) == nullptr);
+    ASSERT_THROWS(instance.Call("f"s, {ObjectHolder::None()}, ctx), runtime_error);
+}
+
 void TestClassInstance() {
     vector<Method> methods;
 
@@ -529,6 +732,317 @@ void TestClassInstance() {
     ASSERT_THROWS(instance.Call("missing_method"s, {}, ctx), runtime_error);
 }
 
+void TestCallStack() {
+    DummyContext ctx;
+    CallStack& stack = ctx.GetCallStack();
+    ASSERT_EQUAL(stack.Depth(), 0U);
+    {
+        CallStack::Frame outer(stack, 2);
+        outer.Slots()[0] = ObjectHolder::Own(Number{1});
+        {
+            // Большой кадр не помещается в текущий блок, но кадр outer остаётся на месте
+            CallStack::Frame inner(stack, 10000);
+            ASSERT_EQUAL(stack.Depth(), 2U);
+            ASSERT_EQUAL(stack.CurrentFrame(), inner.Slots());
+            ASSERT(!inner.Slots()[9999]);
+        }
+        ASSERT_EQUAL(stack.CurrentFrame(), outer.Slots());
+        ASSERT_EQUAL(outer.Slots()[0]->TryAs<Number>()->GetValue(), 1);
+        ASSERT(!outer.Slots()[1]);
+    }
+    ASSERT_EQUAL(stack.Depth(), 0U);
+
+    // Слоты освобождённого кадра очищаются
+    CallStack::Frame frame(stack, 2);
+    ASSERT(!frame.Slots()[0]);
+}
+
+void TestMethodWithFrame() {
+    vector<Method> methods;
+
+    auto body = [](Closure& closure, Context& ctx) {
+        ASSERT(closure.empty());
+        const CallStack::Slot* slots = ctx.GetCallStack().CurrentFrame();
+        ASSERT(slots[0]->TryAs<ClassInstance>() != nullptr);
+        ASSERT(!slots[3]);
+        return ObjectHolder::Own(Number{slots[1]->TryAs<Number>()->GetValue()
+                                        - slots[2]->TryAs<Number>()->GetValue()});
+    };
+    methods.push_back({"sub"s, {"a"s, "b"s}, make_unique<TestMethodBody>(body), 4});
+
+    Class cls{"Test"s, move(methods), nullptr};
+    ClassInstance instance{cls};
+
+    DummyContext ctx;
+    auto result = instance.Call(
+        "sub"s, {ObjectHolder::Own(Number{5}), ObjectHolder::Own(Number{3})}, ctx);
+    ASSERT_EQUAL(result.TryAs<Number>()->GetValue(), 2);
+    ASSERT_EQUAL(ctx.GetCallStack().Depth(), 0U);
+
+    // Кадр, в который не помещаются self и параметры, не заполняется
+    vector<Method> broken;
+    broken.push_back({"sub"s, {"a"s, "b"s}, make_unique<TestMethodBody>(body), 2});
+    Class broken_cls{"Broken"s, move(broken), nullptr};
+    ClassInstance broken_instance{broken_cls};
+    ASSERT_THROWS(broken_instance.Call(
+                      "sub"s, {ObjectHolder::Own(Number{5}), ObjectHolder::Own(Number{3})}, ctx),
+                  std::runtime_error);
+    ASSERT_EQUAL(ctx.GetCallStack().Depth(), 0U);
+}
+
+void TestArena() {
+    struct Node : Executable {
+        explicit Node(int v)
+            : value(v) {
+        }
+        ObjectHolder Execute(Closure& /*closure*/, Context& /*context*/) override {
+            return ObjectHolder::Own(Number{value});
+        }
+        int value;
+    };
+
+    ASSERT(Arena::Current() == nullptr);
+    auto on_heap = make_unique<Node>(1);
+
+    Arena arena;
+    ASSERT_EQUAL(arena.GetAllocatedBytes(), 0U);
+    unique_ptr<Node> first;
+    unique_ptr<Node> second;
+    {
+        Arena::Scope scope(arena);
+        ASSERT(Arena::Current() == &arena);
+        first = make_unique<Node>(2);
+        {
+            Arena nested;
+            Arena::Scope nested_scope(nested);
+            ASSERT(Arena::Current() == &nested);
+        }
+        ASSERT(Arena::Current() == &arena);
+        second = make_unique<Node>(3);
+    }
+    ASSERT(Arena::Current() == nullptr);
+    ASSERT(arena.GetAllocatedBytes() >= 2 * sizeof(Node));
+
+    // Узлы, созданные подряд, лежат в арене рядом
+    const auto distance = reinterpret_cast<const char*>(second.get())
+                          - reinterpret_cast<const char*>(first.get());
+    ASSERT(distance > 0 && distance <= 64);
+
+    DummyContext ctx;
+    Closure closure;
+    ASSERT_EQUAL(second->Execute(closure, ctx).TryAs<Number>()->GetValue(), 3);
+    // Удаление узла арены вызывает деструктор, но не освобождает память
+    first.reset();
+    second.reset();
+    on_heap.reset();
+
+    void* memory = arena.Allocate(100, 64);
+    ASSERT_EQUAL(reinterpret_cast<uintptr_t>(memory) % 64, 0U);
+}
+
+void TestOutputBuffer() {
+    OutputBuffer collected;
+    DummyContext ctx;
+    collected.Append("n="sv);
+    collected.Append(0);
+    collected.Append(' ');
+    collected.Append(numeric_limits<int>::min());
+    collected.Append(' ');
+    Number(42).Print(collected, ctx);
+    collected.Append(' ');
+    Bool(true).Print(collected, ctx);
+    collected.Append(' ');
+    // Наследник, который умеет выводить себя только в std::ostream
+    Logger logger(7);
+    static_cast<Object&>(logger).Print(collected, ctx);
+    ASSERT_EQUAL(collected.View(), "n=0 -2147483648 42 True 7"sv);
+    ASSERT_EQUAL(collected.Take(), "n=0 -2147483648 42 True 7"s);
+    ASSERT(collected.View().empty());
+
+    // Данные передаются приёмнику, только когда их объём достигает порога
+    ostringstream sink;
+    {
+        OutputBuffer buffer(sink, 8);
+        buffer.Append("1234567"sv);
+        ASSERT(sink.str().empty());
+        buffer.Append('8');
+        ASSERT_EQUAL(sink.str(), "12345678"s);
+        buffer.Append("9"sv);
+        ASSERT_EQUAL(buffer.View(), "9"sv);
+    }
+    ASSERT_EQUAL(sink.str(), "123456789"s);
+
+    // Адрес экземпляра без __str__ выводится так же, как через std::ostream
+    Class cls{"Empty"s, {}, nullptr};
+    ClassInstance instance{cls};
+    ostringstream expected;
+    instance.Print(expected, ctx);
+    instance.Print(collected, ctx);
+    ASSERT_EQUAL(collected.Take(), expected.str());
+}
+
+void TestBufferedContext() {
+    ostringstream sink;
+    {
+        BufferedContext ctx(sink);
+        ctx.GetOutputBuffer().Append("print "sv);
+        ctx.GetOutputStream() << "stream "s << 1;
+        ctx.GetOutputBuffer().Append(' ');
+        ASSERT(sink.str().empty());
+    }
+    ASSERT_EQUAL(sink.str(), "print stream 1 "s);
+
+    BufferedContext collecting;
+    collecting.GetOutputStream() << 'a';
+    collecting.GetOutputBuffer().Append("bc"sv);
+    ASSERT_EQUAL(collecting.TakeOutput(), "abc"s);
+
+    // Буфер контекста по умолчанию ничего не задерживает
+    DummyContext ctx;
+    ctx.GetOutputBuffer().Append("x"sv);
+    ASSERT_EQUAL(ctx.output.str(), "x"s);
+}
+
+void TestStringify() {
+    DummyContext ctx;
+    auto as_string = [&ctx](const ObjectHolder& object) {
+        return Stringify(object, ctx).TryAs<String>()->GetValue();
+    };
+    ASSERT_EQUAL(as_string(ObjectHolder::Own(Number(-1234))), "-1234"s);
+    ASSERT_EQUAL(as_string(ObjectHolder::Own(Bool(true))), "True"s);
+    ASSERT_EQUAL(as_string(ObjectHolder::Own(Bool(false))), "False"s);
+    ASSERT_EQUAL(as_string(ObjectHolder::None()), "None"s);
+
+    // Строка, которой владеет аргумент, не копируется
+    const auto text = ObjectHolder::Own(String("text"s));
+    ASSERT_EQUAL(Stringify(text, ctx).Get(), text.Get());
+    const auto borrowed = Stringify(text.Borrow(), ctx);
+    ASSERT(borrowed.IsOwning() && borrowed.Get() != text.Get());
+
+    vector<Method> methods;
+    methods.push_back({"__str__", {}, make_unique<TestMethodBody>([](Closure&, Context&) {
+                           return ObjectHolder::Own(Number(7));
+                       })});
+    Class cls{"Seven"s, move(methods), nullptr};
+    ASSERT_EQUAL(as_string(ObjectHolder::Own(ClassInstance(cls))), "7"s);
+    ASSERT_EQUAL(as_string(ObjectHolder::Share(cls)), "Class Seven"s);
+    ASSERT(ctx.output.str().empty());
+}
+
+void TestStringConcatenation() {
+    DummyContext ctx;
+    const auto piece = ObjectHolder::Own(String("0123456789"s));
+
+    // Короткие конкатенации сразу собираются в непрерывную строку
+    auto short_string = String::Concat(piece, piece);
+    ASSERT(!short_string.TryAs<String>()->IsConcatenation());
+
+    const int piece_count = 10'000;
+    auto text = ObjectHolder::Own(String(string(String::MIN_CONCATENATION_SIZE, 'x')));
+    const auto prefix = text;
+    for (int i = 0; i < piece_count; ++i) {
+        text = String::Concat(text, piece);
+    }
+    const auto& rope = *text.TryAs<String>();
+    ASSERT(rope.IsConcatenation());
+    ASSERT_EQUAL(rope.GetSize(), String::MIN_CONCATENATION_SIZE + 10U * piece_count);
+
+    string expected(String::MIN_CONCATENATION_SIZE, 'x');
+    for (int i = 0; i < piece_count; ++i) {
+        expected += "0123456789"sv;
+    }
+    ASSERT(Equal(text, ObjectHolder::Own(String(expected)), ctx));
+    ASSERT(!rope.IsConcatenation());
+    ASSERT(Less(prefix, text, ctx));
+
+    // Константы программы, на которые ссылаются без владения, копируются в части
+    String constant("c"s);
+    const auto mixed = String::Concat(text, ObjectHolder::Share(constant));
+    ASSERT_EQUAL(mixed.TryAs<String>()->GetValue(), expected + "c"s);
+
+    // Удаление длинной несобранной цепочки не переполняет стек
+    auto chain = piece;
+    for (int i = 0; i < 200'000; ++i) {
+        chain = String::Concat(chain, piece);
+    }
+    chain = ObjectHolder::None();
+    ASSERT_EQUAL(piece.TryAs<String>()->GetValue(), "0123456789"s);
+}
+
+void TestShapes() {
+    Class cls("Point"s, {}, nullptr);
+    const Shape& root = cls.GetRootShape();
+    ASSERT(root.GetParent() == nullptr);
+    ASSERT(root.GetFieldNames().empty());
+
+    // Объекты, поля которых добавлены в одном порядке, разделяют форму
+    ClassInstance a(cls);
+    ClassInstance b(cls);
+    for (ClassInstance* instance : {&a, &b}) {
+        instance->Fields()["x"s] = ObjectHolder::Own(Number{1});
+        instance->Fields()["y"s] = ObjectHolder::Own(Number{2});
+    }
+    ASSERT(&a.Fields().GetShape() == &b.Fields().GetShape());
+    ASSERT_EQUAL(a.Fields().GetShape().GetFieldNames(), (vector<Symbol>{"x"s, "y"s}));
+    ASSERT_EQUAL(a.Fields().GetShape().FindField("y"s), 1U);
+    ASSERT_EQUAL(a.Fields().GetShape().FindField("z"s), Shape::NO_FIELD);
+    ASSERT(a.Fields().GetShape().GetParent()->GetParent() == &root);
+    // Новые объекты сразу получают память под все поля
+    ASSERT_EQUAL(root.GetCapacityHint(), 2U);
+
+    // Другой порядок полей даёт другую форму
+    ClassInstance c(cls);
+    c.Fields()["y"s] = ObjectHolder::Own(Number{3});
+    c.Fields()["x"s] = ObjectHolder::Own(Number{4});
+    ASSERT(&c.Fields().GetShape() != &a.Fields().GetShape());
+    ASSERT_EQUAL(c.Fields().Find("x"s)->TryAs<Number>()->GetValue(), 4);
+
+    // Изменение существующего поля не меняет форму
+    const Shape* shape = &a.Fields().GetShape();
+    a.Fields()["x"s] = ObjectHolder::Own(Number{5});
+    ASSERT(&a.Fields().GetShape() == shape);
+    ASSERT_EQUAL(a.Fields().GetSize(), 2U);
+
+    a.Fields().Clear();
+    ASSERT(&a.Fields().GetShape() == &root);
+    ASSERT(a.Fields().Find("x"s) == nullptr);
+
+    // Большие формы ищут поля по таблице
+    ClassInstance wide(cls);
+    for (int i = 0; i < 20; ++i) {
+        wide.Fields()["f"s + to_string(i)] = ObjectHolder::Own(Number{i});
+    }
+    for (int i = 0; i < 20; ++i) {
+        ASSERT_EQUAL(wide.Fields().GetShape().FindField("f"s + to_string(i)), static_cast<uint32_t>(i));
+    }
+}
+
+void TestFieldCache() {
+    Class cls("Point"s, {}, nullptr);
+    ClassInstance a(cls);
+    ClassInstance b(cls);
+    a.Fields()["x"s] = ObjectHolder::Own(Number{1});
+    b.Fields()["y"s] = ObjectHolder::Own(Number{2});
+    b.Fields()["x"s] = ObjectHolder::Own(Number{3});
+
+    // Один кэш обслуживает объекты разных форм
+    FieldCache cache;
+    for (int round = 0; round < 3; ++round) {
+        ASSERT_EQUAL(cache.Find(a.Fields(), "x"s)->TryAs<Number>()->GetValue(), 1);
+        ASSERT_EQUAL(cache.Find(b.Fields(), "x"s)->TryAs<Number>()->GetValue(), 3);
+    }
+    FieldCache missing;
+    ASSERT(missing.Find(a.Fields(), "y"s) == nullptr);
+
+    FieldCache store;
+    ClassInstance c(cls);
+    store.Store(c.Fields(), "x"s, ObjectHolder::Own(Number{7}));
+    ASSERT(&c.Fields().GetShape() == &a.Fields().GetShape());
+    store.Store(c.Fields(), "x"s, ObjectHolder::Own(Number{8}));
+    ASSERT_EQUAL(c.Fields().GetSize(), 1U);
+    ASSERT_EQUAL(c.Fields().Find("x"s)->TryAs<Number>()->GetValue(), 8);
+}
+
 }  // namespace
 
 void RunObjectsTests(TestRunner& tr) {
@@ -540,13 +1054,29 @@ void RunObjectsTests(TestRunner& tr) {
     RUN_TEST(tr, runtime::TestComparison);
     RUN_TEST(tr, runtime::TestClass);
     RUN_TEST(tr, runtime::TestClassInstance);
+    RUN_TEST(tr, runtime::TestMethodTable);
+    RUN_TEST(tr, runtime::TestCallStack);
+    RUN_TEST(tr, runtime::TestMethodWithFrame);
+    RUN_TEST(tr, runtime::TestArena);
+    RUN_TEST(tr, runtime::TestOutputBuffer);
+    RUN_TEST(tr, runtime::TestBufferedContext);
+    RUN_TEST(tr, runtime::TestStringify);
+    RUN_TEST(tr, runtime::TestStringConcatenation);
+    RUN_TEST(tr, runtime::TestShapes);
+    RUN_TEST(tr, runtime::TestFieldCache);
 }
 
 void RunObjectHolderTests(TestRunner& tr) {
+    RUN_TEST(tr, runtime::TestSymbols);
+    RUN_TEST(tr, runtime::TestConcurrentSymbols);
     RUN_TEST(tr, runtime::TestNonowning);
     RUN_TEST(tr, runtime::TestOwning);
     RUN_TEST(tr, runtime::TestMove);
+    RUN_TEST(tr, runtime::TestSharedOwnership);
+    RUN_TEST(tr, runtime::TestObjectPool);
     RUN_TEST(tr, runtime::TestNullptr);
+    RUN_TEST(tr, runtime::TestImmediateValues);
+    RUN_TEST(tr, runtime::TestObjectKind);
 }
 
 }  // namespace runtime
@@ -0,0 +1,71 @@
+#include "source_map.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace parse {
+
+SourceMap::SourceMap(string name)
+    : modules_{{std::move(name), 0}}, line_starts_{0} {
+}
+
+SourceMap::SourceMap(string_view text, string name, uint32_t base_offset)
+    : modules_{{std::move(name), 0}}, line_starts_{base_offset} {
+    for (size_t pos = text.find('\n'); pos != string_view::npos; pos = text.find('\n', pos + 1)) {
+        line_starts_.push_back(base_offset + static_cast<uint32_t>(pos + 1));
+    }
+}
+
+void SourceMap::AddLine(uint32_t offset) {
+    if (offset > line_starts_.back()) {
+        line_starts_.push_back(offset);
+    }
+}
+
+void SourceMap::Append(const SourceMap& module) {
+    for (const Module& part : module.modules_) {
+        modules_.push_back({part.name, line_starts_.size() + part.first_line});
+    }
+    line_starts_.insert(line_starts_.end(), module.line_starts_.begin(),
+                        module.line_starts_.end());
+}
+
+size_t SourceMap::FindLine(uint32_t offset) const {
+    // Последняя строка, начинающаяся не позже offset
+    const auto it = upper_bound(line_starts_.begin(), line_starts_.end(), offset) - 1;
+    return static_cast<size_t>(it - line_starts_.begin());
+}
+
+const SourceMap::Module& SourceMap::FindModule(size_t line) const {
+    // Последний модуль, начинающийся не позже строки line
+    const auto it = upper_bound(modules_.begin(), modules_.end(), line,
+                                [](size_t value, const Module& module) {
+                                    return value < module.first_line;
+                                });
+    return *(it - 1);
+}
+
+SourceLocation SourceMap::Locate(uint32_t offset) const {
+    const size_t line = FindLine(offset);
+    return {static_cast<uint32_t>(line - FindModule(line).first_line + 1),
+            offset - line_starts_[line] + 1};
+}
+
+string SourceMap::Format(uint32_t offset) const {
+    const SourceLocation location = Locate(offset);
+    const string& name = FindModule(FindLine(offset)).name;
+    string result = name.empty() ? string() : name + ":"s;
+    result += to_string(location.line) + ":"s + to_string(location.column);
+    return result;
+}
+
+const string& SourceMap::GetName() const {
+    return modules_.front().name;
+}
+
+void SourceMap::SetName(string name) {
+    modules_.front().name = std::move(name);
+}
+
+}  // namespace parse
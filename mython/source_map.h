@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace parse {
+
+// Позиция в исходном тексте программы: номера строки и столбца, начиная с единицы
+struct SourceLocation {
+    std::uint32_t line;
+    std::uint32_t column;
+};
+
+/*
+ * Таблица начал строк исходного текста. Позволяет по смещению от начала текста, которое
+ * хранится в узлах дерева программы, найти строку и столбец.
+ * Программа, собранная из нескольких модулей, описывается одной таблицей: смещения каждого
+ * модуля начинаются с собственного начального смещения, а позиции выводятся с именем модуля
+ */
+class SourceMap {
+public:
+    // Создаёт таблицу для текста, из которого пока не прочитано ни одной строки
+    explicit SourceMap(std::string name = {});
+    // Создаёт таблицу всех строк текста text, смещения которого начинаются с base_offset
+    explicit SourceMap(std::string_view text, std::string name = {},
+                       std::uint32_t base_offset = 0);
+
+    // Добавляет строку, начинающуюся со смещения offset. Строки добавляются по порядку
+    void AddLine(std::uint32_t offset);
+    // Добавляет строки модуля module. Смещения модуля должны следовать за смещениями
+    // уже добавленных строк
+    void Append(const SourceMap& module);
+
+    // Возвращает позицию символа со смещением offset
+    [[nodiscard]] SourceLocation Locate(std::uint32_t offset) const;
+    // Возвращает позицию в виде "<имя>:<строка>:<столбец>" либо "<строка>:<столбец>" для
+    // текста без имени
+    [[nodiscard]] std::string Format(std::uint32_t offset) const;
+
+    // Возвращает и задаёт имя первого модуля текста
+    [[nodiscard]] const std::string& GetName() const;
+    void SetName(std::string name);
+
+private:
+    // Модуль текста: его имя и номер его первой строки в line_starts_
+    struct Module {
+        std::string name;
+        std::size_t first_line;
+    };
+
+    // Возвращает номер в line_starts_ строки, содержащей символ со смещением offset
+    [[nodiscard]] std::size_t FindLine(std::uint32_t offset) const;
+    // Возвращает модуль, которому принадлежит строка с номером line в line_starts_
+    [[nodiscard]] const Module& FindModule(std::size_t line) const;
+
+    std::vector<Module> modules_;
+    std::vector<std::uint32_t> line_starts_;
+};
+
+}  // namespace parse
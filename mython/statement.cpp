@@ -11,61 +11,126 @@ using runtime::Closure;
 using runtime::Context;
 using runtime::ObjectHolder;
 
-namespace {
-const string ADD_METHOD = "__add__"s;
-const string INIT_METHOD = "__init__"s;
-}  // namespace
-
-VariableValue::VariableValue(const std::string& var_name)
+VariableValue::VariableValue(runtime::Symbol var_name)
     : dotted_ids_({var_name}) {
 }
 
-VariableValue::VariableValue(std::vector<std::string> dotted_ids)
-    : dotted_ids_(std::move(dotted_ids)) {
+VariableValue::VariableValue(std::vector<runtime::Symbol> dotted_ids)
+    : dotted_ids_(std::move(dotted_ids)),
+      field_caches_(dotted_ids_.empty() ? 0 : dotted_ids_.size() - 1) {
+}
+
+VariableValue::VariableValue(const std::vector<std::string>& dotted_ids)
+    : VariableValue(std::vector<runtime::Symbol>(dotted_ids.begin(), dotted_ids.end())) {
+}
+
+VariableValue::VariableValue(std::vector<runtime::Symbol> dotted_ids, size_t slot)
+    : VariableValue(std::move(dotted_ids)) {
+    slot_ = slot;
 }
 
 ObjectHolder VariableValue::Execute(Closure& closure, Context& context) {
-    if (closure.count(dotted_ids_[0])) {
-        auto variable = closure.at(dotted_ids_[0]);
-        if (dotted_ids_.size() > 1) {
-            if (auto object = variable.TryAs<runtime::ClassInstance>()) {
-                std::vector<std::string> new_dotted_ids_;
-                new_dotted_ids_.insert(new_dotted_ids_.begin(), dotted_ids_.begin() + 1, dotted_ids_.end());
-                return VariableValue(std::move(new_dotted_ids_)).Execute(object->Fields(), context);
-            } else {
-                throw std::runtime_error("Error cast to ClassInstance"s);
-            }
-        }
-        return variable;
-    } else {
+    const ObjectHolder* variable = nullptr;
+    if (slot_) {
+        const auto& slot = context.GetCallStack().CurrentFrame()[*slot_];
+        variable = slot ? &*slot : nullptr;
+    } else if (auto it = closure.find(dotted_ids_.front()); it != closure.end()) {
+        variable = &it->second;
+    }
+    if (!variable) {
         throw std::runtime_error("Variable not found"s);
     }
+
+    // Поля вложенных объектов ищутся по цепочке без копирования идентификаторов
+    for (size_t i = 1; i < dotted_ids_.size(); ++i) {
+        auto object = variable->TryAs<runtime::ClassInstance>();
+        if (!object) {
+            throw std::runtime_error("Error cast to ClassInstance"s);
+        }
+        variable = field_caches_[i - 1].Find(object->Fields(), dotted_ids_[i]);
+        if (!variable) {
+            throw std::runtime_error("Variable not found"s);
+        }
+    }
+    return *variable;
+}
+
+const std::vector<runtime::Symbol>& VariableValue::GetDottedIds() const {
+    return dotted_ids_;
 }
 
-Assignment::Assignment(std::string var, std::unique_ptr<Statement> rv)
+std::optional<size_t> VariableValue::GetSlot() const {
+    return slot_;
+}
+
+Assignment::Assignment(runtime::Symbol var, std::unique_ptr<Statement> rv)
     : var_(std::move(var)), rv_(std::move(rv)) {
 }
 
+Assignment::Assignment(runtime::Symbol var, std::unique_ptr<Statement> rv, size_t slot)
+    : var_(std::move(var)), rv_(std::move(rv)), slot_(slot) {
+}
+
 ObjectHolder Assignment::Execute(Closure& closure, Context& context) {
+    if (slot_) {
+        auto value = rv_->Execute(closure, context);
+        // Кадр читается после вычисления значения: вызовы методов в rv добавляют свои кадры
+        return *(context.GetCallStack().CurrentFrame()[*slot_] = std::move(value));
+    }
     closure[var_] = rv_->Execute(closure, context);
     return closure.at(var_);
 }
 
-FieldAssignment::FieldAssignment(VariableValue object, std::string field_name,
+runtime::Symbol Assignment::GetVarName() const {
+    return var_;
+}
+
+const Statement& Assignment::GetValue() const {
+    return *rv_;
+}
+
+unique_ptr<Statement>& Assignment::MutableValue() {
+    return rv_;
+}
+
+std::optional<size_t> Assignment::GetSlot() const {
+    return slot_;
+}
+
+FieldAssignment::FieldAssignment(VariableValue object, runtime::Symbol field_name,
                                  std::unique_ptr<Statement> rv)
     : object_(std::move(object)), field_name_(std::move(field_name)), rv_(std::move(rv)) {
 }
 
 ObjectHolder FieldAssignment::Execute(Closure& closure, Context& context) {
-    auto object = object_.Execute(closure, context).TryAs<runtime::ClassInstance>();
+    // Указатель, полученный из TryAs, действителен, пока существует holder
+    auto holder = object_.Execute(closure, context);
+    auto object = holder.TryAs<runtime::ClassInstance>();
     if (object) {
-        return object->Fields()[field_name_] = rv_->Execute(closure, context);
+        auto value = rv_->Execute(closure, context);
+        return field_cache_.Store(object->Fields(), field_name_, std::move(value));
     } else {
         throw runtime_error("Error cast to ClassInstance"s);
     }
 }
 
-unique_ptr<Print> Print::Variable(const std::string& name) {
+const VariableValue& FieldAssignment::GetObject() const {
+    return object_;
+}
+
+runtime::Symbol FieldAssignment::GetFieldName() const {
+    return field_name_;
+}
+
+const Statement& FieldAssignment::GetValue() const {
+    return *rv_;
+}
+
+unique_ptr<Statement>& FieldAssignment::MutableValue() {
+    return rv_;
+}
+
+unique_ptr<Print> Print::Variable(runtime::Symbol name) {
     return std::make_unique<Print>(std::make_unique<VariableValue>(name));
 }
 
@@ -79,31 +144,48 @@ Print::Print(vector<unique_ptr<Statement>> args)
 
 ObjectHolder Print::Execute(Closure& closure, Context& context) {
     bool isFirst = true;
-    auto& out = context.GetOutputStream();
+    auto& out = context.GetOutputBuffer();
+    // Вывод методов, вызванных при вычислении аргументов, учитывается их собственными print
+    [[maybe_unused]] size_t printed = 1;
 
     for (auto& arg : args_) {
         if (!isFirst) {
-            out << " "s;
+            out.Append(' ');
+            ++printed;
         }
         auto object = arg->Execute(closure, context);
+        [[maybe_unused]] const size_t start_size = out.GetTotalSize();
         if (object) {
             object->Print(out, context);
         } else {
-            out << "None"s;
+            out.Append("None"sv);
         }
+        printed += out.GetTotalSize() - start_size;
         isFirst = false;
     }
-    out << "\n"s;
+    out.Append('\n');
+    runtime::UpdateMetrics([printed](runtime::Metrics& metrics) {
+        metrics.bytes_printed += printed;
+    });
     return {};
 }
 
-MethodCall::MethodCall(std::unique_ptr<Statement> object, std::string method,
+const std::vector<std::unique_ptr<Statement>>& Print::GetArgs() const {
+    return args_;
+}
+
+std::vector<std::unique_ptr<Statement>>& Print::MutableArgs() {
+    return args_;
+}
+
+MethodCall::MethodCall(std::unique_ptr<Statement> object, runtime::Symbol method,
                        std::vector<std::unique_ptr<Statement>> args)
     : object_(std::move(object)), method_(std::move(method)), args_(std::move(args)) {
 }
 
 ObjectHolder MethodCall::Execute(Closure& closure, Context& context) {
-    auto object = object_->Execute(closure, context).TryAs<runtime::ClassInstance>();
+    auto holder = object_->Execute(closure, context);
+    auto object = holder.TryAs<runtime::ClassInstance>();
     if (object) {
         std::vector<runtime::ObjectHolder> actual_args;
         actual_args.reserve(args_.size());
@@ -112,26 +194,60 @@ ObjectHolder MethodCall::Execute(Closure& closure, Context& context) {
             actual_args.push_back(arg->Execute(closure, context));
         }
 
-        return object->Call(method_, actual_args, context);
+        const runtime::Method* method = method_cache_.Lookup(object->GetClass(), method_);
+        if (!method || method->formal_params.size() != actual_args.size()) {
+            throw std::runtime_error("Error calling method "s + method_.GetName());
+        }
+        return object->CallMethod(*method, actual_args, context);
     } else {
         throw runtime_error("Error cast to ClassInstance"s);
     }
 }
 
+const Statement& MethodCall::GetObject() const {
+    return *object_;
+}
+
+runtime::Symbol MethodCall::GetMethodName() const {
+    return method_;
+}
+
+const std::vector<std::unique_ptr<Statement>>& MethodCall::GetArgs() const {
+    return args_;
+}
+
+unique_ptr<Statement>& MethodCall::MutableObject() {
+    return object_;
+}
+
+std::vector<std::unique_ptr<Statement>>& MethodCall::MutableArgs() {
+    return args_;
+}
+
 MethodBody::MethodBody(std::unique_ptr<Statement>&& body)
     : body_(std::move(body)) {
 }
 
 ObjectHolder MethodBody::Execute(Closure& closure, Context& context) {
-    try {
-        return body_->Execute(closure, context);
-    } catch (ObjectHolder result) {
+    ObjectHolder result = body_->Execute(closure, context);
+    if (context.TakeReturnSignal()) {
         return result;
     }
+    return ObjectHolder::None();
+}
+
+const Statement& MethodBody::GetBody() const {
+    return *body_;
+}
+
+unique_ptr<Statement>& MethodBody::MutableBody() {
+    return body_;
 }
 
 ObjectHolder Return::Execute(Closure& closure, Context& context) {
-    throw statement_->Execute(closure, context);
+    ObjectHolder result = statement_->Execute(closure, context);
+    context.SetReturnSignal();
+    return result;
 }
 
 ClassDefinition::ClassDefinition(ObjectHolder cls)
@@ -140,20 +256,32 @@ ClassDefinition::ClassDefinition(ObjectHolder cls)
 
 ObjectHolder ClassDefinition::Execute(Closure& closure, [[maybe_unused]] Context& context) {
     runtime::Class* cls = cls_.TryAs<runtime::Class>();
-    closure[cls->GetName()] = cls_;
+    // Класс принадлежит программе и переживает её исполнение
+    closure[cls->GetName()] = cls_.Borrow();
     return ObjectHolder::None();
 }
 
+const runtime::Class& ClassDefinition::GetClass() const {
+    return static_cast<const runtime::Class&>(*cls_);  // NOLINT
+}
+
+runtime::Class& ClassDefinition::GetClass() {
+    return static_cast<runtime::Class&>(*cls_);  // NOLINT
+}
+
 NewInstance::NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args)
-    : class_instance_(class_), args_(std::move(args)) {
+    : cls_(&class_), args_(std::move(args)) {
 }
 
 NewInstance::NewInstance(const runtime::Class& class_)
-    : class_instance_(class_) {
+    : cls_(&class_) {
 }
 
 ObjectHolder NewInstance::Execute(Closure& closure, Context& context) {
-    if (class_instance_.HasMethod(INIT_METHOD, args_.size())) {
+    // Поля нового объекта сразу получают память по форме, которую достигали прежние экземпляры
+    auto instance = ObjectHolder::Make<runtime::ClassInstance>(*cls_);
+    const runtime::Method* init = cls_->GetInitMethod();
+    if (init && init->formal_params.size() == args_.size()) {
         std::vector<runtime::ObjectHolder> actual_args;
         actual_args.reserve(args_.size());
 
@@ -161,77 +289,53 @@ ObjectHolder NewInstance::Execute(Closure& closure, Context& context) {
             actual_args.push_back(arg->Execute(closure, context));
         }
 
-        class_instance_.Call(INIT_METHOD, actual_args, context);
+        static_cast<runtime::ClassInstance&>(*instance).CallMethod(*init, actual_args, context);  // NOLINT
     }
-    return runtime::ObjectHolder::Share(class_instance_);
+    return instance;
 }
 
-ObjectHolder Stringify::Execute(Closure& closure, Context& context) {
-    auto object = argument_->Execute(closure, context);
-    if (object) {
-        std::ostringstream os;
-        object->Print(os, context);
-        return ObjectHolder::Own(runtime::String(os.str()));
-    } else {
-        return ObjectHolder::Own(runtime::String("None"s));
-    }
+const runtime::Class& NewInstance::GetClass() const {
+    return *cls_;
 }
 
-ObjectHolder Add::Execute(Closure& closure, Context& context) {
-    auto lhs_object = lhs_->Execute(closure, context);
-    auto rhs_object = rhs_->Execute(closure, context);
+const std::vector<std::unique_ptr<Statement>>& NewInstance::GetArgs() const {
+    return args_;
+}
 
-    auto lhs_number = lhs_object.TryAs<runtime::Number>();
-    auto rhs_number = rhs_object.TryAs<runtime::Number>();
-    if (lhs_number && rhs_number) {
-        return ObjectHolder::Own(runtime::Number(lhs_number->GetValue() + rhs_number->GetValue()));
-    }
+std::vector<std::unique_ptr<Statement>>& NewInstance::MutableArgs() {
+    return args_;
+}
 
-    auto lhs_string = lhs_object.TryAs<runtime::String>();
-    auto rhs_string = rhs_object.TryAs<runtime::String>();
-    if (lhs_string && rhs_string) {
-        return ObjectHolder::Own(runtime::String(lhs_string->GetValue() + rhs_string->GetValue()));
-    }
+void NewInstance::SetClass(const runtime::Class& cls) {
+    cls_ = &cls;
+}
 
-    auto lhs_class_instance = lhs_object.TryAs<runtime::ClassInstance>();
-    if (lhs_class_instance) {
-        return lhs_class_instance->Call(ADD_METHOD, {rhs_object}, context);
-    }
+ObjectHolder Stringify::Execute(Closure& closure, Context& context) {
+    return runtime::Stringify(argument_->Execute(closure, context), context);
+}
 
-    throw runtime_error("Error addition"s);
+ObjectHolder Add::Execute(Closure& closure, Context& context) {
+    auto lhs_object = lhs_->Execute(closure, context);
+    auto rhs_object = rhs_->Execute(closure, context);
+    return runtime::Add(lhs_object, rhs_object, context);
 }
 
 ObjectHolder Sub::Execute(Closure& closure, Context& context) {
-    auto lhs_number = lhs_->Execute(closure, context).TryAs<runtime::Number>();
-    auto rhs_number = rhs_->Execute(closure, context).TryAs<runtime::Number>();
-    if (lhs_number && rhs_number) {
-        return ObjectHolder::Own(runtime::Number(lhs_number->GetValue() - rhs_number->GetValue()));
-    }
-
-    throw runtime_error("Error subtration"s);
+    auto lhs_object = lhs_->Execute(closure, context);
+    auto rhs_object = rhs_->Execute(closure, context);
+    return runtime::Sub(lhs_object, rhs_object);
 }
 
 ObjectHolder Mult::Execute(Closure& closure, Context& context) {
-    auto lhs_number = lhs_->Execute(closure, context).TryAs<runtime::Number>();
-    auto rhs_number = rhs_->Execute(closure, context).TryAs<runtime::Number>();
-    if (lhs_number && rhs_number) {
-        return ObjectHolder::Own(runtime::Number(lhs_number->GetValue() * rhs_number->GetValue()));
-    }
-
-    throw runtime_error("Error multiplication"s);
+    auto lhs_object = lhs_->Execute(closure, context);
+    auto rhs_object = rhs_->Execute(closure, context);
+    return runtime::Mult(lhs_object, rhs_object);
 }
 
 ObjectHolder Div::Execute(Closure& closure, Context& context) {
-    auto lhs_number = lhs_->Execute(closure, context).TryAs<runtime::Number>();
-    auto rhs_number = rhs_->Execute(closure, context).TryAs<runtime::Number>();
-    if (lhs_number && rhs_number) {
-        if (rhs_number->GetValue() == 0) {
-            throw runtime_error("Division by zero"s);
-        }
-        return ObjectHolder::Own(runtime::Number(lhs_number->GetValue() / rhs_number->GetValue()));
-    }
-
-    throw runtime_error("Error division"s);
+    auto lhs_object = lhs_->Execute(closure, context);
+    auto rhs_object = rhs_->Execute(closure, context);
+    return runtime::Div(lhs_object, rhs_object);
 }
 
 ObjectHolder Or::Execute(Closure& closure, Context& context) {
@@ -259,21 +363,72 @@ ObjectHolder Not::Execute(Closure& closure, Context& context) {
     return ObjectHolder::Own(runtime::Bool(bool_object));
 }
 
-Comparison::Comparison(Comparator cmp, unique_ptr<Statement> lhs, unique_ptr<Statement> rhs)
-    : BinaryOperation(std::move(lhs), std::move(rhs)) {
-    cmp_ = std::move(cmp);
+Comparison::Comparison(runtime::CompareOp op, unique_ptr<Statement> lhs,
+                       unique_ptr<Statement> rhs)
+    : BinaryOperation(std::move(lhs), std::move(rhs)), op_(op) {
 }
 
-ObjectHolder Comparison::Execute(Closure& closure, Context& context) {
-    auto object_lhs = lhs_->Execute(closure, context);
-    auto object_rhs = rhs_->Execute(closure, context);
-    runtime::Bool result = cmp_(object_lhs, object_rhs, context);
-    return runtime::ObjectHolder::Own(std::move(result));
+namespace {
+
+// Вычисляет значения выражений lhs и rhs и возвращает результат их сравнения оператором Op
+template <runtime::CompareOp Op>
+class TypedComparison final : public Comparison {
+public:
+    TypedComparison(unique_ptr<Statement> lhs, unique_ptr<Statement> rhs)
+        : Comparison(Op, std::move(lhs), std::move(rhs)) {
+    }
+
+    ObjectHolder Execute(Closure& closure, Context& context) override {
+        const auto object_lhs = lhs_->Execute(closure, context);
+        const auto object_rhs = rhs_->Execute(closure, context);
+        return ObjectHolder::Own(
+            runtime::Bool(runtime::Compare<Op>(object_lhs, object_rhs, context)));
+    }
+};
+
+}  // namespace
+
+unique_ptr<Comparison> Comparison::Make(runtime::CompareOp op, unique_ptr<Statement> lhs,
+                                        unique_ptr<Statement> rhs) {
+    using runtime::CompareOp;
+    switch (op) {
+        case CompareOp::Equal:
+            return make_unique<TypedComparison<CompareOp::Equal>>(std::move(lhs), std::move(rhs));
+        case CompareOp::NotEqual:
+            return make_unique<TypedComparison<CompareOp::NotEqual>>(std::move(lhs), std::move(rhs));
+        case CompareOp::Less:
+            return make_unique<TypedComparison<CompareOp::Less>>(std::move(lhs), std::move(rhs));
+        case CompareOp::Greater:
+            return make_unique<TypedComparison<CompareOp::Greater>>(std::move(lhs), std::move(rhs));
+        case CompareOp::LessOrEqual:
+            return make_unique<TypedComparison<CompareOp::LessOrEqual>>(std::move(lhs),
+                                                                        std::move(rhs));
+        case CompareOp::GreaterOrEqual:
+            return make_unique<TypedComparison<CompareOp::GreaterOrEqual>>(std::move(lhs),
+                                                                           std::move(rhs));
+    }
+    throw std::runtime_error("Unknown comparison operator"s);
 }
 
 ObjectHolder Compound::Execute(Closure& closure, Context& context) {
     for (const auto& arg : args_) {
-        arg->Execute(closure, context);
+        try {
+            context.Step();
+            ObjectHolder result = arg->Execute(closure, context);
+            if (context.HasReturnSignal()) {
+                return result;
+            }
+        } catch (const runtime::LimitExceeded& error) {
+            if (error.GetSourceOffset() != runtime::Executable::NO_SOURCE_OFFSET) {
+                throw;
+            }
+            throw runtime::LimitExceeded(error.what(), error.GetLimit(), arg->GetSourceOffset());
+        } catch (const runtime::ExecutionError&) {
+            throw;
+        } catch (const std::runtime_error& error) {
+            // Ошибка привязывается к самой вложенной инструкции, при исполнении которой возникла
+            throw runtime::ExecutionError(error.what(), arg->GetSourceOffset());
+        }
     }
     return ObjectHolder::None();
 }
@@ -292,4 +447,59 @@ ObjectHolder IfElse::Execute(Closure& closure, Context& context) {
     return runtime::ObjectHolder::None();
 }
 
+const Statement& IfElse::GetCondition() const {
+    return *condition_;
+}
+
+const Statement& IfElse::GetIfBody() const {
+    return *if_body_;
+}
+
+const Statement* IfElse::GetElseBody() const {
+    return else_body_.get();
+}
+
+unique_ptr<Statement>& IfElse::MutableCondition() {
+    return condition_;
+}
+
+unique_ptr<Statement>& IfElse::MutableIfBody() {
+    return if_body_;
+}
+
+unique_ptr<Statement>& IfElse::MutableElseBody() {
+    return else_body_;
+}
+
+Program::Program(std::shared_ptr<runtime::Arena> arena, std::unique_ptr<Statement> body,
+                 std::vector<runtime::ObjectHolder> classes,
+                 std::vector<std::shared_ptr<runtime::Arena>> module_arenas)
+    : arena_(std::move(arena)), module_arenas_(std::move(module_arenas)),
+      classes_(std::move(classes)), body_(std::move(body)) {
+}
+
+ObjectHolder Program::Execute(Closure& closure, Context& context) {
+    return body_->Execute(closure, context);
+}
+
+const Statement& Program::GetBody() const {
+    return *body_;
+}
+
+const runtime::Arena& Program::GetArena() const {
+    return *arena_;
+}
+
+const std::vector<runtime::ObjectHolder>& Program::GetClasses() const {
+    return classes_;
+}
+
+unique_ptr<Statement>& Program::MutableBody() {
+    return body_;
+}
+
+runtime::Arena& Program::GetArena() {
+    return *arena_;
+}
+
 }  // namespace ast
@@ -2,7 +2,7 @@
 
 #include "runtime.h"
 
-#include <functional>
+#include <memory>
 
 namespace ast {
 
@@ -22,6 +22,10 @@ public:
         return runtime::ObjectHolder::Share(value_);
     }
 
+    [[nodiscard]] const T& GetValue() const {
+        return value_;
+    }
+
 private:
     T value_;
 };
@@ -30,6 +34,19 @@ using NumericConst = ValueStatement<runtime::Number>;
 using StringConst = ValueStatement<runtime::String>;
 using BoolConst = ValueStatement<runtime::Bool>;
 
+// Константа, которая при исполнении возвращает собственную копию значения, а не ссылку на
+// хранящееся в узле. Узел такой константы можно удалить, пока программа использует значение
+template <typename T>
+class OwnedValueStatement final : public ValueStatement<T> {
+public:
+    using ValueStatement<T>::ValueStatement;
+
+    runtime::ObjectHolder Execute(runtime::Closure& /*closure*/,
+                                  runtime::Context& /*context*/) override {
+        return runtime::ObjectHolder::Own(T(this->GetValue()));
+    }
+};
+
 /*
 Вычисляет значение переменной либо цепочки вызовов полей объектов id1.id2.id3.
 Например, выражение circle.center.x - цепочка вызовов полей объектов в инструкции:
@@ -37,35 +54,63 @@ x = circle.center.x
 */
 class VariableValue : public Statement {
 public:
-    explicit VariableValue(const std::string& var_name);
-    explicit VariableValue(std::vector<std::string> dotted_ids);
+    explicit VariableValue(runtime::Symbol var_name);
+    explicit VariableValue(std::vector<runtime::Symbol> dotted_ids);
+    explicit VariableValue(const std::vector<std::string>& dotted_ids);
+    // Первый идентификатор читается из слота slot текущего кадра стека вызовов, а не из closure
+    VariableValue(std::vector<runtime::Symbol> dotted_ids, size_t slot);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const std::vector<runtime::Symbol>& GetDottedIds() const;
+    // Возвращает номер слота первого идентификатора, если имя разрешено при разборе программы
+    [[nodiscard]] std::optional<size_t> GetSlot() const;
 private:
-    std::vector<std::string> dotted_ids_;
+    std::vector<runtime::Symbol> dotted_ids_;
+    std::optional<size_t> slot_;
+    // Кэши обращений к полям: по одному на каждый идентификатор после первого
+    std::vector<runtime::FieldCache> field_caches_;
 };
 
 // Присваивает переменной, имя которой задано в параметре var, значение выражения rv
 class Assignment : public Statement {
 public:
-    Assignment(std::string var, std::unique_ptr<Statement> rv);
+    Assignment(runtime::Symbol var, std::unique_ptr<Statement> rv);
+    // Значение записывается в слот slot текущего кадра стека вызовов, а не в closure
+    Assignment(runtime::Symbol var, std::unique_ptr<Statement> rv, size_t slot);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] runtime::Symbol GetVarName() const;
+    [[nodiscard]] const Statement& GetValue() const;
+    [[nodiscard]] std::optional<size_t> GetSlot() const;
+
+    // Позволяет заменить выражение, например при оптимизации дерева
+    [[nodiscard]] std::unique_ptr<Statement>& MutableValue();
 private:
-    std::string var_;
+    runtime::Symbol var_;
     std::unique_ptr<Statement> rv_;
+    std::optional<size_t> slot_;
 };
 
 // Присваивает полю object.field_name значение выражения rv
 class FieldAssignment : public Statement {
 public:
-    FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv);
+    FieldAssignment(VariableValue object, runtime::Symbol field_name,
+                    std::unique_ptr<Statement> rv);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const VariableValue& GetObject() const;
+    [[nodiscard]] runtime::Symbol GetFieldName() const;
+    [[nodiscard]] const Statement& GetValue() const;
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableValue();
 private:
     VariableValue object_;
-    std::string field_name_;
+    runtime::Symbol field_name_;
     std::unique_ptr<Statement> rv_;
+    runtime::FieldCache field_cache_;
 };
 
 // Значение None
@@ -86,11 +131,15 @@ public:
     explicit Print(std::vector<std::unique_ptr<Statement>> args);
 
     // Инициализирует команду print для вывода значения переменной name
-    static std::unique_ptr<Print> Variable(const std::string& name);
+    static std::unique_ptr<Print> Variable(runtime::Symbol name);
 
     // Во время выполнения команды print вывод должен осуществляться в поток, возвращаемый из
     // context.GetOutputStream()
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetArgs() const;
+
+    [[nodiscard]] std::vector<std::unique_ptr<Statement>>& MutableArgs();
 private:
     std::vector<std::unique_ptr<Statement>> args_;
 };
@@ -98,14 +147,22 @@ private:
 // Вызывает метод object.method со списком параметров args
 class MethodCall : public Statement {
 public:
-    MethodCall(std::unique_ptr<Statement> object, std::string method,
+    MethodCall(std::unique_ptr<Statement> object, runtime::Symbol method,
                std::vector<std::unique_ptr<Statement>> args);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const Statement& GetObject() const;
+    [[nodiscard]] runtime::Symbol GetMethodName() const;
+    [[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetArgs() const;
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableObject();
+    [[nodiscard]] std::vector<std::unique_ptr<Statement>>& MutableArgs();
 private:
     std::unique_ptr<Statement> object_;
-    std::string method_;
+    runtime::Symbol method_;
     std::vector<std::unique_ptr<Statement>> args_;
+    runtime::MethodCache method_cache_;
 };
 
 // Тело метода. Как правило, содержит составную инструкцию
@@ -117,6 +174,10 @@ public:
     // Если внутри body была выполнена инструкция return, возвращает результат return
     // В противном случае возвращает None
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const Statement& GetBody() const;
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableBody();
 private:
     std::unique_ptr<Statement> body_;
 };
@@ -130,7 +191,16 @@ public:
 
     // Останавливает выполнение текущего метода. После выполнения инструкции return метод,
     // внутри которого она была исполнена, должен вернуть результат вычисления выражения statement.
+    // Возвращает этот результат и устанавливает в context сигнал return вместо исключения
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const Statement& GetStatement() const {
+        return *statement_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableStatement() {
+        return statement_;
+    }
 private:
     std::unique_ptr<Statement> statement_;
 };
@@ -144,6 +214,9 @@ public:
     // Создаёт внутри closure новый объект, совпадающий с именем класса и значением, переданным в
     // конструктор
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const runtime::Class& GetClass() const;
+    [[nodiscard]] runtime::Class& GetClass();
 private:
     runtime::ObjectHolder cls_;
 };
@@ -165,10 +238,19 @@ class NewInstance : public Statement {
 public:
     explicit NewInstance(const runtime::Class& class_);
     NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args);
-    // Возвращает объект, содержащий значение типа ClassInstance
+    // Создаёт новый экземпляр при каждом вычислении и возвращает владеющий им объект
+    // типа ClassInstance
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const runtime::Class& GetClass() const;
+    [[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetArgs() const;
+
+    [[nodiscard]] std::vector<std::unique_ptr<Statement>>& MutableArgs();
+    // Заменяет создаваемый класс. Нужен при связывании модулей, разобранных независимо,
+    // когда класс объявлен в другом модуле
+    void SetClass(const runtime::Class& cls);
 private:
-    runtime::ClassInstance class_instance_;
+    const runtime::Class* cls_;
     std::vector<std::unique_ptr<Statement>> args_;
 };
 
@@ -178,6 +260,14 @@ public:
     explicit UnaryOperation(std::unique_ptr<Statement> argument)
         : argument_(std::move(argument)) {
     }
+
+    [[nodiscard]] const Statement& GetArgument() const {
+        return *argument_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableArgument() {
+        return argument_;
+    }
 protected:
     std::unique_ptr<Statement> argument_;
 };
@@ -195,6 +285,22 @@ public:
     BinaryOperation(std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs)
         : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {
     }
+
+    [[nodiscard]] const Statement& GetLhs() const {
+        return *lhs_;
+    }
+
+    [[nodiscard]] const Statement& GetRhs() const {
+        return *rhs_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableLhs() {
+        return lhs_;
+    }
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableRhs() {
+        return rhs_;
+    }
 protected:
     std::unique_ptr<Statement> lhs_;
     std::unique_ptr<Statement> rhs_;
@@ -272,20 +378,25 @@ public:
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 };
 
-// Операция сравнения
+// Операция сравнения. Для каждого оператора создаётся свой наследник, сравнивающий значения
+// без косвенного вызова
 class Comparison : public BinaryOperation {
 public:
-    // Comparator задаёт функцию, выполняющую сравнение значений аргументов
-    using Comparator = std::function<bool(const runtime::ObjectHolder&,
-                                          const runtime::ObjectHolder&, runtime::Context&)>;
+    // Возвращает операцию сравнения значений выражений lhs и rhs оператором op
+    [[nodiscard]] static std::unique_ptr<Comparison> Make(runtime::CompareOp op,
+                                                          std::unique_ptr<Statement> lhs,
+                                                          std::unique_ptr<Statement> rhs);
 
-    Comparison(Comparator cmp, std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs);
+    [[nodiscard]] runtime::CompareOp GetOperator() const {
+        return op_;
+    }
+
+protected:
+    Comparison(runtime::CompareOp op, std::unique_ptr<Statement> lhs,
+               std::unique_ptr<Statement> rhs);
 
-    // Вычисляет значение выражений lhs и rhs и возвращает результат работы comparator,
-    // приведённый к типу runtime::Bool
-    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
 private:
-    Comparator cmp_;
+    runtime::CompareOp op_;
 };
 
 // Составная инструкция (например: тело метода, содержимое ветки if, либо else)
@@ -302,8 +413,17 @@ public:
         args_.push_back(std::move(stmt));
     }
 
-    // Последовательно выполняет добавленные инструкции. Возвращает None
+    // Последовательно выполняет добавленные инструкции. Возвращает None либо, если была
+    // выполнена инструкция return, прекращает выполнение и возвращает её результат
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const std::vector<std::unique_ptr<Statement>>& GetStatements() const {
+        return args_;
+    }
+
+    [[nodiscard]] std::vector<std::unique_ptr<Statement>>& MutableStatements() {
+        return args_;
+    }
 private:
     std::vector<std::unique_ptr<Statement>> args_;
 
@@ -324,10 +444,48 @@ public:
            std::unique_ptr<Statement> else_body);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const Statement& GetCondition() const;
+    [[nodiscard]] const Statement& GetIfBody() const;
+    // Возвращает nullptr, если ветка else отсутствует
+    [[nodiscard]] const Statement* GetElseBody() const;
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableCondition();
+    [[nodiscard]] std::unique_ptr<Statement>& MutableIfBody();
+    // Указатель пуст, если ветка else отсутствует
+    [[nodiscard]] std::unique_ptr<Statement>& MutableElseBody();
 private:
     std::unique_ptr<Statement> condition_;
     std::unique_ptr<Statement> if_body_;
     std::unique_ptr<Statement> else_body_;
 };
 
+// Программа, узлы которой размещены в арене. Владеет ареной и классами программы и удаляет
+// их вместе с деревом
+class Program : public Statement {
+public:
+    // classes - все классы программы в порядке объявления. Если программа собрана из модулей,
+    // разобранных независимо, module_arenas - арены модулей, в которых размещены узлы body
+    Program(std::shared_ptr<runtime::Arena> arena, std::unique_ptr<Statement> body,
+            std::vector<runtime::ObjectHolder> classes = {},
+            std::vector<std::shared_ptr<runtime::Arena>> module_arenas = {});
+
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const Statement& GetBody() const;
+    [[nodiscard]] const runtime::Arena& GetArena() const;
+    // Классы перечислены в порядке объявления, поэтому родитель класса всегда предшествует ему
+    [[nodiscard]] const std::vector<runtime::ObjectHolder>& GetClasses() const;
+
+    [[nodiscard]] std::unique_ptr<Statement>& MutableBody();
+    // Узлы, добавляемые в дерево после разбора, следует создавать в этой арене
+    [[nodiscard]] runtime::Arena& GetArena();
+private:
+    // Объявлены первыми, чтобы удаляться после узлов дерева
+    std::shared_ptr<runtime::Arena> arena_;
+    std::vector<std::shared_ptr<runtime::Arena>> module_arenas_;
+    std::vector<runtime::ObjectHolder> classes_;
+    std::unique_ptr<Statement> body_;
+};
+
 }  // namespace ast
@@ -1,6 +1,9 @@
 #include "statement.h"
 #include "test_runner_p.h"
 
+#include <functional>
+#include <optional>
+
 using namespace std;
 
 namespace ast {
@@ -123,8 +126,8 @@ void TestFieldAssignment() {
         ASSERT(o);
         ASSERT_OBJECT_VALUE_EQUAL(o, 57);
     }
-    ASSERT(object.Fields().find("x"s) != object.Fields().end());
-    ASSERT_OBJECT_VALUE_EQUAL(object.Fields().at("x"s), 57);
+    ASSERT(object.Fields().Find("x"s) != nullptr);
+    ASSERT_OBJECT_VALUE_EQUAL(*object.Fields().Find("x"s), 57);
 
     assign_y.Execute(closure, context);
     FieldAssignment assign_yz(
@@ -136,10 +139,10 @@ void TestFieldAssignment() {
         ASSERT_OBJECT_VALUE_EQUAL(o, "Hello, world! Hooray! Yes-yes!!!"s);
     }
 
-    ASSERT(object.Fields().find("y"s) != object.Fields().end());
-    const auto* subobject = object.Fields().at("y"s).TryAs<runtime::ClassInstance>();
-    ASSERT(subobject != nullptr && subobject->Fields().find("z"s) != subobject->Fields().end());
-    ASSERT_OBJECT_VALUE_EQUAL(subobject->Fields().at("z"s), "Hello, world! Hooray! Yes-yes!!!"s);
+    ASSERT(object.Fields().Find("y"s) != nullptr);
+    const auto* subobject = object.Fields().Find("y"s)->TryAs<runtime::ClassInstance>();
+    ASSERT(subobject != nullptr && subobject->Fields().Find("z"s) != nullptr);
+    ASSERT_OBJECT_VALUE_EQUAL(*subobject->Fields().Find("z"s), "Hello, world! Hooray! Yes-yes!!!"s);
 
     ASSERT(context.output.str().empty());
 }
@@ -453,6 +456,204 @@ void TestNot() {
     test_not(false);
 }
 
+void TestComparison() {
+    using runtime::CompareOp;
+    using Reference = bool (*)(const ObjectHolder&, const ObjectHolder&, runtime::Context&);
+    const pair<CompareOp, Reference> operators[] = {
+        {CompareOp::Equal, runtime::Equal},
+        {CompareOp::NotEqual, runtime::NotEqual},
+        {CompareOp::Less, runtime::Less},
+        {CompareOp::Greater, runtime::Greater},
+        {CompareOp::LessOrEqual, runtime::LessOrEqual},
+        {CompareOp::GreaterOrEqual, runtime::GreaterOrEqual},
+    };
+
+    // Экземпляр класса меньше любого значения и не равен ему
+    vector<runtime::Method> methods;
+    methods.push_back({"__eq__"s, {"rhs"s}, make_unique<BoolConst>(false)});
+    methods.push_back({"__lt__"s, {"rhs"s}, make_unique<BoolConst>(true)});
+    runtime::Class cls("Least"s, std::move(methods), nullptr);
+
+    using Factory = function<unique_ptr<Statement>()>;
+    const auto number = [](int value) -> Factory {
+        return [value] {
+            return make_unique<NumericConst>(value);
+        };
+    };
+    const auto str = [](const string& value) -> Factory {
+        return [value] {
+            return make_unique<StringConst>(value);
+        };
+    };
+    const auto boolean = [](bool value) -> Factory {
+        return [value] {
+            return make_unique<BoolConst>(value);
+        };
+    };
+    const Factory none = [] {
+        return make_unique<None>();
+    };
+    const Factory instance = [&cls] {
+        return make_unique<NewInstance>(cls);
+    };
+    const pair<Factory, Factory> operands[] = {
+        {number(2), number(3)},
+        {number(3), number(3)},
+        {number(-1), number(-5)},
+        {str("abc"s), str("abd"s)},
+        {str("abc"s), str("abc"s)},
+        {str("b"s), str(""s)},
+        {boolean(false), boolean(true)},
+        {boolean(true), boolean(true)},
+        {none, none},
+        {instance, number(1)},
+        {number(1), str("1"s)},
+        {none, number(0)},
+        {boolean(false), number(0)},
+        {number(1), instance},
+    };
+
+    for (const auto& [op, reference] : operators) {
+        for (const auto& [lhs, rhs] : operands) {
+            auto comparison = Comparison::Make(op, lhs(), rhs());
+            ASSERT(comparison->GetOperator() == op);
+
+            // Узел сравнивает значения так же, как функции сравнения из runtime
+            Closure closure;
+            runtime::DummyContext context;
+            optional<bool> expected;
+            try {
+                expected = reference(lhs()->Execute(closure, context),
+                                     rhs()->Execute(closure, context), context);
+            } catch (const runtime_error&) {
+            }
+            if (expected) {
+                const auto result = comparison->Execute(closure, context);
+                ASSERT(result.TryAs<runtime::Bool>() != nullptr);
+                ASSERT_EQUAL(result.TryAs<runtime::Bool>()->GetValue(), *expected);
+            } else {
+                ASSERT_THROWS(comparison->Execute(closure, context), runtime_error);
+            }
+        }
+    }
+
+    // Сравнение экземпляра класса выражается через __lt__ и __eq__
+    Closure closure;
+    runtime::DummyContext context;
+    ASSERT(!runtime::IsTrue(Comparison::Make(CompareOp::Greater, instance(), number(1)())
+                                ->Execute(closure, context)));
+    ASSERT(runtime::IsTrue(Comparison::Make(CompareOp::LessOrEqual, instance(), number(1)())
+                               ->Execute(closure, context)));
+}
+
+void TestPolymorphicMethodCall() {
+    runtime::DummyContext context;
+
+    // Больше классов, чем записей в кэше метода, чтобы проверить вытеснение
+    vector<unique_ptr<runtime::Class>> classes;
+    for (int i = 0; i < 6; ++i) {
+        vector<runtime::Method> methods;
+        methods.push_back({"id"s,
+                           {"x"s},
+                           make_unique<Add>(make_unique<NumericConst>(i * 10),
+                                            make_unique<VariableValue>("x"s))});
+        classes.push_back(
+            make_unique<runtime::Class>("C"s + to_string(i), move(methods), nullptr));
+    }
+    runtime::Class no_id("NoId"s, {}, nullptr);
+
+    vector<unique_ptr<Statement>> args;
+    args.push_back(make_unique<NumericConst>(1));
+    MethodCall call(make_unique<VariableValue>(vector{"holder"s, "object"s}), "id"s, move(args));
+
+    Closure closure;
+    auto holder = ObjectHolder::Own(runtime::ClassInstance{*classes.front()});
+    closure["holder"s] = holder;
+    auto& fields = holder.TryAs<runtime::ClassInstance>()->Fields();
+    for (int round = 0; round < 3; ++round) {
+        for (size_t i = 0; i < classes.size(); ++i) {
+            fields["object"s] = ObjectHolder::Own(runtime::ClassInstance{*classes[i]});
+            ASSERT_EQUAL(call.Execute(closure, context).TryAs<runtime::Number>()->GetValue(),
+                         static_cast<int>(i) * 10 + 1);
+        }
+    }
+
+    fields["object"s] = ObjectHolder::Own(runtime::ClassInstance{no_id});
+    ASSERT_THROWS(call.Execute(closure, context), runtime_error);
+    fields["object"s] = ObjectHolder::Own(runtime::Number{1});
+    ASSERT_THROWS(call.Execute(closure, context), runtime_error);
+    fields.Clear();
+    ASSERT_THROWS(call.Execute(closure, context), runtime_error);
+}
+
+void TestReturnSignal() {
+    runtime::DummyContext context;
+    Closure closure;
+
+    // Return не выбрасывает исключение, а возвращает значение и устанавливает сигнал
+    Return ret(make_unique<NumericConst>(5));
+    ASSERT_EQUAL(ret.Execute(closure, context).TryAs<runtime::Number>()->GetValue(), 5);
+    ASSERT(context.TakeReturnSignal());
+    ASSERT(!context.HasReturnSignal());
+
+    auto body = make_unique<Compound>();
+    body->AddStatement(make_unique<Print>(make_unique<NumericConst>(1)));
+    body->AddStatement(make_unique<IfElse>(
+        make_unique<BoolConst>(runtime::Bool(true)),
+        make_unique<Compound>(make_unique<Return>(make_unique<StringConst>("done"s)),
+                              make_unique<Print>(make_unique<NumericConst>(2))),
+        nullptr));
+    body->AddStatement(make_unique<Print>(make_unique<NumericConst>(3)));
+    MethodBody method_body(std::move(body));
+
+    auto result = method_body.Execute(closure, context);
+    ASSERT_EQUAL(result.TryAs<runtime::String>()->GetValue(), "done"s);
+    ASSERT_EQUAL(context.output.str(), "1\n"s);
+    // Сигнал снимается телом метода и не влияет на вызывающий код
+    ASSERT(!context.HasReturnSignal());
+
+    MethodBody no_return(make_unique<Compound>(make_unique<NumericConst>(1)));
+    ASSERT(!no_return.Execute(closure, context));
+    ASSERT(!context.HasReturnSignal());
+}
+
+void TestNewInstance() {
+    runtime::DummyContext context;
+    Closure closure;
+
+    vector<runtime::Method> methods;
+    methods.push_back(
+        {"__init__"s,
+         {"x"s},
+         make_unique<Compound>(make_unique<FieldAssignment>(VariableValue{"self"s}, "x"s,
+                                                            make_unique<VariableValue>("x"s)),
+                               make_unique<Print>(make_unique<StringConst>("init"s)))});
+    runtime::Class base("Base"s, std::move(methods), nullptr);
+    runtime::Class derived("Derived"s, {}, &base);
+    ASSERT(derived.GetInitMethod() == base.GetMethod("__init__"s));
+    ASSERT(!runtime::Class("Empty"s, {}, nullptr).GetInitMethod());
+
+    // Каждое исполнение создаёт новый объект и вызывает унаследованный __init__
+    vector<unique_ptr<Statement>> args;
+    args.push_back(make_unique<NumericConst>(7));
+    NewInstance create(derived, std::move(args));
+    const ObjectHolder first = create.Execute(closure, context);
+    const ObjectHolder second = create.Execute(closure, context);
+    ASSERT(first.Get() != second.Get());
+    ASSERT_OBJECT_VALUE_EQUAL(*first.TryAs<runtime::ClassInstance>()->Fields().Find("x"s), 7);
+    ASSERT_OBJECT_VALUE_EQUAL(*second.TryAs<runtime::ClassInstance>()->Fields().Find("x"s), 7);
+    ASSERT_EQUAL(context.output.str(), "init\ninit\n"s);
+
+    // При несовпадении количества аргументов __init__ не вызывается, а аргументы не вычисляются
+    args.clear();
+    args.push_back(make_unique<Print>(make_unique<StringConst>("arg"s)));
+    args.push_back(make_unique<NumericConst>(1));
+    const ObjectHolder plain = NewInstance(derived, std::move(args)).Execute(closure, context);
+    ASSERT(plain.TryAs<runtime::ClassInstance>());
+    ASSERT(!plain.TryAs<runtime::ClassInstance>()->Fields().Find("x"s));
+    ASSERT_EQUAL(context.output.str(), "init\ninit\n"s);
+}
+
 }  // namespace
 
 void RunUnitTests(TestRunner& tr) {
@@ -476,6 +677,10 @@ void RunUnitTests(TestRunner& tr) {
     RUN_TEST(tr, ast::TestOr);
     RUN_TEST(tr, ast::TestAnd);
     RUN_TEST(tr, ast::TestNot);
+    RUN_TEST(tr, ast::TestComparison);
+    RUN_TEST(tr, ast::TestPolymorphicMethodCall);
+    RUN_TEST(tr, ast::TestReturnSignal);
+    RUN_TEST(tr, ast::TestNewInstance);
 }
 
 }  // namespace ast
@@ -0,0 +1,89 @@
+#include "symbol.h"
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+using namespace std;
+
+namespace runtime {
+
+namespace {
+
+// Имена предопределённых символов в порядке PredefinedSymbol
+const string_view PREDEFINED_NAMES[] = {
+    ""sv, "class"sv, "return"sv, "if"sv, "else"sv, "def"sv, "print"sv, "and"sv, "or"sv, "not"sv,
+    "None"sv, "True"sv, "False"sv, "self"sv, "__init__"sv, "__str__"sv, "__eq__"sv, "__lt__"sv,
+    "__add__"sv,
+};
+
+static_assert(size(PREDEFINED_NAMES) == static_cast<size_t>(PredefinedSymbol::Count));
+
+class SymbolTable {
+public:
+    SymbolTable() {
+        for (size_t i = 0; i < predefined_.size(); ++i) {
+            predefined_[i] = Intern(PREDEFINED_NAMES[i]);
+        }
+    }
+
+    const Symbol::Entry* Intern(string_view name) {
+        lock_guard guard(mutex_);
+        if (auto it = index_.find(name); it != index_.end()) {
+            return it->second;
+        }
+        // Записи хранятся в deque, поэтому ссылки на них и на их имена не меняются
+        const auto& entry = entries_.emplace_back(
+            Symbol::Entry{string(name), static_cast<uint32_t>(entries_.size())});
+        index_.emplace(entry.name, &entry);
+        return &entry;
+    }
+
+    const Symbol::Entry* Predefined(PredefinedSymbol symbol) const {
+        // Массив заполняется в конструкторе и больше не изменяется, поэтому читается без
+        // блокировки. Сам entries_ читать без неё нельзя: Intern в другом потоке может
+        // перестроить внутренние массивы deque
+        return predefined_[static_cast<size_t>(symbol)];
+    }
+
+private:
+    mutex mutex_;
+    deque<Symbol::Entry> entries_;
+    unordered_map<string_view, const Symbol::Entry*> index_;
+    array<const Symbol::Entry*, static_cast<size_t>(PredefinedSymbol::Count)> predefined_{};
+};
+
+SymbolTable& GetSymbolTable() {
+    static SymbolTable table;
+    return table;
+}
+
+}  // namespace
+
+Symbol::Symbol()
+    : Symbol(PredefinedSymbol::Empty) {
+}
+
+Symbol::Symbol(PredefinedSymbol symbol)
+    : entry_(GetSymbolTable().Predefined(symbol)) {
+}
+
+Symbol::Symbol(string_view name)
+    : entry_(GetSymbolTable().Intern(name)) {
+}
+
+Symbol::Symbol(const string& name)
+    : Symbol(string_view(name)) {
+}
+
+Symbol::Symbol(const char* name)
+    : Symbol(string_view(name)) {
+}
+
+ostream& operator<<(ostream& os, Symbol symbol) {
+    return os << symbol.GetName();
+}
+
+}  // namespace runtime
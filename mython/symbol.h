@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+namespace runtime {
+
+// Символы, которые создаются при запуске и номера которых известны заранее.
+// Ключевые слова идут первыми, чтобы лексер мог распознавать их по номеру символа
+enum class PredefinedSymbol : std::uint32_t {
+    Empty,
+    Class,
+    Return,
+    If,
+    Else,
+    Def,
+    Print,
+    And,
+    Or,
+    Not,
+    None,
+    True,
+    False,
+    Self,
+    Init,
+    Str,
+    Eq,
+    Lt,
+    Add,
+    Count,
+};
+
+/*
+ * Интернированный идентификатор. Все символы с одинаковым именем ссылаются на одну запись
+ * общей таблицы символов, поэтому сравнение и хеширование символов не обращаются к строке.
+ * Символ неявно создаётся из строки, что позволяет передавать строки туда, где ожидается Symbol.
+ * Таблица символов общая для всех потоков и никогда не очищается
+ */
+class Symbol {
+public:
+    // Создаёт символ с пустым именем
+    Symbol();
+    Symbol(PredefinedSymbol symbol);  // NOLINT(google-explicit-constructor)
+    Symbol(std::string_view name);    // NOLINT(google-explicit-constructor)
+    Symbol(const std::string& name);  // NOLINT(google-explicit-constructor)
+    Symbol(const char* name);         // NOLINT(google-explicit-constructor)
+
+    // Возвращает номер символа. Номера назначаются подряд начиная с нуля
+    [[nodiscard]] std::uint32_t GetId() const {
+        return entry_->id;
+    }
+
+    // Возвращает имя символа. Ссылка действительна до конца работы программы
+    [[nodiscard]] const std::string& GetName() const {
+        return entry_->name;
+    }
+
+    friend bool operator==(Symbol lhs, Symbol rhs) {
+        return lhs.entry_ == rhs.entry_;
+    }
+
+    friend bool operator!=(Symbol lhs, Symbol rhs) {
+        return !(lhs == rhs);
+    }
+
+    // Упорядочивает символы по имени
+    friend bool operator<(Symbol lhs, Symbol rhs) {
+        return lhs.GetName() < rhs.GetName();
+    }
+
+    struct Entry {
+        std::string name;
+        std::uint32_t id;
+    };
+
+private:
+    const Entry* entry_;
+};
+
+std::ostream& operator<<(std::ostream& os, Symbol symbol);
+
+}  // namespace runtime
+
+namespace std {
+
+template <>
+struct hash<runtime::Symbol> {
+    size_t operator()(runtime::Symbol symbol) const noexcept {
+        return symbol.GetId();
+    }
+};
+
+}  // namespace std